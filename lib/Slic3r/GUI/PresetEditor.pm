@@ -1257,6 +1257,10 @@ sub options {
         host_type print_host octoprint_apikey
         use_firmware_retraction pressure_advance vibration_limit
         use_volumetric_e
+        machine_max_feedrate_x machine_max_feedrate_y machine_max_feedrate_z machine_max_feedrate_e
+        machine_max_acceleration_x machine_max_acceleration_y machine_max_acceleration_z machine_max_acceleration_e
+        machine_max_acceleration_extruding machine_max_acceleration_retracting
+        machine_max_jerk_x machine_max_jerk_y machine_max_jerk_z machine_max_jerk_e machine_junction_deviation
         start_gcode end_gcode before_layer_gcode layer_gcode toolchange_gcode between_objects_gcode
         nozzle_diameter extruder_offset min_layer_height max_layer_height
         retract_length retract_lift retract_speed retract_restart_extra retract_before_travel retract_layer_change wipe
@@ -1421,6 +1425,24 @@ sub build {
             $optgroup->append_single_option_line('fan_percentage');
         }
     }
+    {
+        my $page = $self->add_options_page('Machine limits', 'time.png');
+        {
+            my $optgroup = $page->new_optgroup('Maximum feedrates');
+            $optgroup->append_single_option_line("machine_max_feedrate_$_") for qw(x y z e);
+        }
+        {
+            my $optgroup = $page->new_optgroup('Maximum accelerations');
+            $optgroup->append_single_option_line("machine_max_acceleration_$_") for qw(x y z e);
+            $optgroup->append_single_option_line('machine_max_acceleration_extruding');
+            $optgroup->append_single_option_line('machine_max_acceleration_retracting');
+        }
+        {
+            my $optgroup = $page->new_optgroup('Jerk limits');
+            $optgroup->append_single_option_line("machine_max_jerk_$_") for qw(x y z e);
+            $optgroup->append_single_option_line('machine_junction_deviation');
+        }
+    }
     {
         my $page = $self->add_options_page('Custom G-code', 'script.png');
         {
@@ -222,6 +222,10 @@ public:
             "host_type"s, "print_host"s, "octoprint_apikey"s,
             "use_firmware_retraction"s, "pressure_advance"s, "vibration_limit"s,
             "use_volumetric_e"s,
+            "machine_max_feedrate_x"s, "machine_max_feedrate_y"s, "machine_max_feedrate_z"s, "machine_max_feedrate_e"s,
+            "machine_max_acceleration_x"s, "machine_max_acceleration_y"s, "machine_max_acceleration_z"s, "machine_max_acceleration_e"s,
+            "machine_max_acceleration_extruding"s, "machine_max_acceleration_retracting"s,
+            "machine_max_jerk_x"s, "machine_max_jerk_y"s, "machine_max_jerk_z"s, "machine_max_jerk_e"s, "machine_junction_deviation"s,
             "start_gcode"s, "end_gcode"s, "before_layer_gcode"s, "layer_gcode"s, "toolchange_gcode"s, "between_objects_gcode"s,
             "nozzle_diameter"s, "extruder_offset"s, "min_layer_height"s, "max_layer_height"s,
             "retract_length"s, "retract_lift"s, "retract_speed"s, "retract_restart_extra"s, "retract_before_travel"s, "retract_layer_change"s, "wipe"s,
@@ -1,5 +1,6 @@
 #include "Plater/Plate3D.hpp"
 #include "misc_ui.hpp"
+#include <limits>
 
 namespace Slic3r { namespace GUI {
 
@@ -89,7 +90,7 @@ void Plate3D::update(){
                 instance->transform_mesh(&copy);
                 GLVertexArray model;
                 model.load_mesh(copy);
-                volumes.push_back(Volume{ wxColor(200,200,200), Pointf3(0,0,0), model, copy.bounding_box()});
+                volumes.push_back(Volume{ wxColor(200,200,200), Pointf3(0,0,0), model, copy.bounding_box(), copy});
             }
         }
     }
@@ -124,23 +125,25 @@ void Plate3D::before_render(){
         return;
     }
 
-    // Color each volume a different color, render and test which color is beneath the mouse.
-    
-    //glDisable(GL_MULTISAMPLE) if ($self->{can_multisample});
-    glDisable(GL_LIGHTING);
-    uint i = 1;
-    for(Volume &volume : volumes){
-        volume.color = wxColor((i>>16)&0xFF,(i>>8)&0xFF,i&0xFF);
+    // Cast the mouse ray through the volumes and keep the nearest hit. The
+    // meshes answer through their AABB trees, so this stays cheap on every move.
+    const Linef3 ray = mouse_ray(pos);
+    double nearest = std::numeric_limits<double>::infinity();
+    uint index = 0, i = 1;
+    for(const Volume &volume : volumes){
+        // volumes are drawn translated by their origin, so move the ray the other way
+        Linef3 local = ray;
+        local.a.translate(volume.origin.negative());
+        local.b.translate(volume.origin.negative());
+        Pointf3 hit;
+        if (volume.mesh.intersect_ray(local, &hit) && local.a.distance_to(hit) < nearest) {
+            nearest = local.a.distance_to(hit);
+            index = i;
+        }
         i++;
     }
-    draw_volumes();
-    glFlush();
-    glFinish();
-    GLubyte color[4] = {0,0,0,0};
-    glReadPixels(pos.x, GetSize().GetHeight()-  pos.y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, color);
 
     // Handle the hovered volume
-    uint index = (color[0]<<16) + (color[1]<<8) + color[2];
     hover = false;
     ///*$self->_hover_volume_idx(undef);
     //$_->hover(0) for @{$self->volumes};
@@ -165,10 +168,6 @@ void Plate3D::before_render(){
         
         //$self->on_hover->($volume_idx) if $self->on_hover;
     }
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glFlush();
-    glFinish();
-    glEnable(GL_LIGHTING);
     color_volumes();
     mouse = false;
 }
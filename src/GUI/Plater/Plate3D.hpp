@@ -27,8 +27,8 @@ public:
     
     void selection_changed(){Refresh();}
  protected:
-    // Render each volume as a different color and check what color is beneath
-    // the mouse to determine the hovered volume
+    // Cast a ray from the mouse through the volumes to determine the
+    // hovered volume
     void before_render();
 
     // Mouse events are needed to handle selecting and moving objects
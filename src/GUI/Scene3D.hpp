@@ -19,6 +19,7 @@ struct Volume {
     Pointf3 origin;
     GLVertexArray model;
     BoundingBoxf3 bb;
+    TriangleMesh mesh; ///< kept for picking, relative to origin
 };
 
 class Scene3D : public wxGLCanvas {
@@ -0,0 +1,79 @@
+#include <catch.hpp>
+
+#include "BridgeDetector.hpp"
+#include "Geometry.hpp"
+
+using namespace Slic3r;
+
+namespace {
+
+ExPolygon rectangle(double x1, double y1, double x2, double y2) {
+    ExPolygon e;
+    e.contour = Polygon({ Point::new_scale(x1, y1), Point::new_scale(x2, y1),
+                          Point::new_scale(x2, y2), Point::new_scale(x1, y2) });
+    return e;
+}
+
+}
+
+SCENARIO("BridgeDetector: bridging angle detection") {
+    GIVEN("A 10x10 mm bridge anchored on its left and right sides") {
+        const ExPolygon bridge = rectangle(0, 0, 10, 10);
+        ExPolygonCollection lower_slices;
+        lower_slices.expolygons.push_back(rectangle(-5, -2, 1, 12));
+        lower_slices.expolygons.push_back(rectangle(9, -2, 15, 12));
+        const coord_t width = scale_(0.5);
+
+        WHEN("The angle is detected with one thread and with several") {
+            BridgeDetector serial(bridge, lower_slices, width, 1);
+            BridgeDetector parallel(bridge, lower_slices, width, 4);
+            const bool serial_found = serial.detect_angle();
+            const bool parallel_found = parallel.detect_angle();
+            THEN("The bridge spans the gap between the anchors") {
+                REQUIRE(serial_found);
+                REQUIRE(Slic3r::Geometry::directions_parallel(serial.angle, 0, PI/180.0));
+            }
+            THEN("Both find the same angle") {
+                REQUIRE(parallel_found);
+                REQUIRE(parallel.angle == serial.angle);
+            }
+        }
+        WHEN("Identical bridges share a cache") {
+            BridgeAngleCache cache;
+            BridgeDetector first(bridge, lower_slices, width, 4);
+            first.cache = &cache;
+            REQUIRE(first.detect_angle());
+            BridgeDetector second(bridge, lower_slices, width, 4);
+            second.cache = &cache;
+            second.resolution = PI/2.0;
+            THEN("A different resolution is a different entry") {
+                REQUIRE(second.detect_angle());
+                REQUIRE(cache.size() == 2);
+            }
+            THEN("The same geometry is looked up") {
+                BridgeDetector third(bridge, lower_slices, width, 4);
+                third.cache = &cache;
+                bool found = false;
+                double angle = -1;
+                REQUIRE(cache.find(third, &found, &angle));
+                REQUIRE(found);
+                REQUIRE(angle == first.angle);
+                REQUIRE(third.detect_angle());
+                REQUIRE(third.angle == first.angle);
+                REQUIRE(cache.size() == 1);
+            }
+        }
+        WHEN("The bridge has no anchor") {
+            ExPolygonCollection nothing;
+            nothing.expolygons.push_back(rectangle(50, 50, 60, 60));
+            BridgeAngleCache cache;
+            BridgeDetector bd(bridge, nothing, width, 4);
+            bd.cache = &cache;
+            THEN("No angle is detected and nothing is cached") {
+                REQUIRE_FALSE(bd.detect_angle());
+                REQUIRE(bd.angle == -1);
+                REQUIRE(cache.size() == 0);
+            }
+        }
+    }
+}
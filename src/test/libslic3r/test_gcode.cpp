@@ -8,6 +8,7 @@ using namespace Slic3r::Test;
 using namespace Slic3r;
 
 
+#include "GCode/ChunkedGCode.hpp"
 #include "GCode/CoolingBuffer.hpp"
 #include "GCode.hpp"
 
@@ -21,6 +22,183 @@ SCENARIO("Cooling buffer speed factor rewrite enforces precision") {
     }
 }
 
+SCENARIO("ChunkedGCode edits lines without copying the others") {
+    GIVEN("Three lines appended in two chunks, one of them cut in the middle") {
+        ChunkedGCode gcode;
+        gcode.append("G1 X1 Y1\nG1 X2");
+        gcode.append(" Y2\nG1 X3 Y3\n");
+        const std::shared_ptr<const std::string> first { gcode.chunks().front().text };
+        THEN("The lines are the ones of the text") {
+            std::vector<std::string> lines;
+            gcode.for_each_line([&lines] (const char* begin, const char* end) { lines.emplace_back(begin, end); });
+            REQUIRE(lines == std::vector<std::string>({"G1 X1 Y1", "G1 X2 Y2", "G1 X3 Y3"}));
+        }
+        WHEN("The first line is dropped and the cut one is changed") {
+            gcode.edit_lines([] (const char* begin, const char* end, std::string* line) {
+                if (std::string(begin, end) == "G1 X3 Y3") return false;
+                if (std::string(begin, end) == "G1 X2 Y2") *line = "G1 X4 Y4\n";
+                return true;
+            });
+            THEN("The other line is left where it was") {
+                REQUIRE(gcode.str() == "G1 X4 Y4\nG1 X3 Y3\n");
+                REQUIRE(gcode.chunks().size() == 2);
+                REQUIRE(gcode.chunks().back().size() == 9);
+            }
+        }
+        WHEN("No line is changed") {
+            gcode.edit_lines([] (const char*, const char*, std::string*) { return false; });
+            THEN("The chunks still share the appended text") {
+                REQUIRE(gcode.str() == "G1 X1 Y1\nG1 X2 Y2\nG1 X3 Y3\n");
+                REQUIRE(gcode.chunks().front().text == first);
+            }
+        }
+        WHEN("A line is prepended and the text is written to a stream") {
+            gcode.prepend("M107\n");
+            std::ostringstream stream;
+            gcode.write(stream);
+            THEN("It comes first") {
+                REQUIRE(stream.str() == "M107\nG1 X1 Y1\nG1 X2 Y2\nG1 X3 Y3\n");
+                REQUIRE(gcode.size() == stream.str().size());
+            }
+        }
+    }
+}
+
+SCENARIO("Cooling buffer slows down a short layer and consumes its markers") {
+    GIVEN("A layer taking half of the minimum layer time, with bridges, wipes and external perimeters") {
+        const std::string layer {
+            "G1 Z0.3 F7800.000\n"
+            "G1 F2400.000;_EXTRUDE_SET_SPEED\n"
+            "G1 X1 Y1 E1.00000\n"
+            ";_BRIDGE_FAN_START\n"
+            "G1 F1800.000;_EXTRUDE_SET_SPEED\n"
+            "G1 X2 Y2 E2.00000\n"
+            ";_BRIDGE_FAN_END\n"
+            "G1 F1800.000;_EXTRUDE_SET_SPEED;_EXTERNAL_PERIMETER\n"
+            "G1 X3 Y3 E3.00000\n"
+            "G1 F3000.000;_WIPE\n"
+            "G1 X4 Y4 E2.50000\n"
+        };
+        auto cooled = [&layer] (size_t cut) {
+            GCode gcodegen;
+            gcodegen.config.cooling.value = true;
+            gcodegen.config.slowdown_below_layer_time.value = 60;
+            gcodegen.config.fan_below_layer_time.value = 100;
+            gcodegen.config.max_fan_speed.value = 100;
+            gcodegen.config.bridge_fan_speed.value = 50;
+            gcodegen.config.disable_fan_first_layers.value = 1;
+            gcodegen.config.min_print_speed.value = 10;
+            CoolingBuffer buffer(gcodegen);
+            gcodegen.elapsed_time = 30;
+            ChunkedGCode gcode;
+            for (size_t i = 0; i < layer.size(); i += cut)
+                gcode.append(layer.substr(i, cut));
+            ChunkedGCode out;
+            buffer.append(&out, std::move(gcode), "object", 5, 1.5);
+            buffer.flush(&out);
+            return out.str();
+        };
+        THEN("The extrusions are slowed down, but for the bridges and the external perimeters") {
+            REQUIRE_THAT(cooled(layer.size()), Catch::Equals(
+                "M106 S255\n"
+                "G1 Z0.3 F7800.000\n"
+                "G1 F1200.000\n"
+                "G1 X1 Y1 E1.00000\n"
+                "M106 S127.5\n\n"
+                "G1 F1800.000\n"
+                "G1 X2 Y2 E2.00000\n"
+                "M106 S255\n\n"
+                "G1 F1800.000\n"
+                "G1 X3 Y3 E3.00000\n"
+                "G1 F3000.000\n"
+                "G1 X4 Y4 E2.50000\n"));
+        }
+        THEN("The layer is processed the same way when it comes in small chunks") {
+            for (size_t cut : {1, 7, 20})
+                REQUIRE(cooled(cut) == cooled(layer.size()));
+        }
+    }
+}
+
+SCENARIO("Cooling buffer slows down the feed rates recorded by GCode") {
+    GIVEN("A short layer of perimeters, a bridge and an external perimeter extruded by GCode") {
+        auto cooled = [] (bool recorded) {
+            GCode gcodegen;
+            gcodegen.config.cooling.value = true;
+            gcodegen.config.slowdown_below_layer_time.value = 60;
+            gcodegen.config.min_print_speed.value = 10;
+            gcodegen.config.perimeter_speed.value = 33.3337;
+            gcodegen.config.bridge_speed.value = 20;
+            gcodegen.config.external_perimeter_speed.value = 25;
+            gcodegen.config.external_perimeter_speed.percent = false;
+            gcodegen.enable_cooling_markers = true;
+            gcodegen.set_extruders(std::vector<unsigned int> { 0 });
+            gcodegen.writer.toolchange(0);
+            CoolingBuffer buffer(gcodegen);
+
+            std::string layer;
+            for (ExtrusionRole role : { erPerimeter, erBridgeInfill, erExternalPerimeter, erPerimeter }) {
+                ExtrusionPath path(role, 0.05, 0.5, 0.3);
+                path.polyline.append(Point::new_scale(10, 10 + layer.size() / 100.));
+                path.polyline.append(Point::new_scale(30, 10 + layer.size() / 100.));
+                layer += gcodegen.extrude(path, "path");
+            }
+            if (!recorded) gcodegen.cooling_moves.clear();
+            ChunkedGCode out;
+            buffer.append(&out, ChunkedGCode(layer), "object", 5, 1.5);
+            buffer.flush(&out);
+            return out.str();
+        };
+        THEN("Each marked feed rate has been recorded as written") {
+            GCode gcodegen;
+            gcodegen.config.perimeter_speed.value = 33.3337;
+            gcodegen.enable_cooling_markers = true;
+            gcodegen.set_extruders(std::vector<unsigned int> { 0 });
+            gcodegen.writer.toolchange(0);
+            ExtrusionPath path(erPerimeter, 0.05, 0.5, 0.3);
+            path.polyline.append(Point::new_scale(10, 10));
+            path.polyline.append(Point::new_scale(30, 10));
+            const std::string gcode = gcodegen.extrude(path, "path");
+            REQUIRE(gcodegen.cooling_moves.size() == 1);
+            const CoolingMove &move = gcodegen.cooling_moves.front();
+            REQUIRE(move.feedrate == 2000.022);
+            REQUIRE(move.size == std::string("2000.022").size());
+            REQUIRE(move.length == Approx(20));
+            REQUIRE(move.adjustable);
+            REQUIRE(gcode.find("G1 F2000.022;_EXTRUDE_SET_SPEED\n") != std::string::npos);
+        }
+        THEN("The feed rates patched by offset are the ones the G-code lines are rewritten with") {
+            const std::string patched = cooled(true);
+            REQUIRE(patched == cooled(false));
+            REQUIRE(patched.find(";_") == std::string::npos);
+            REQUIRE(patched.find("F2000.022") == std::string::npos);
+            REQUIRE(patched.find("F1200.000") != std::string::npos);
+        }
+    }
+}
+
+SCENARIO("ChunkedGCode patches the text by offset") {
+    GIVEN("A text cut in three chunks") {
+        ChunkedGCode gcode;
+        gcode.append("G1 F1800;_A\nG1 X");
+        gcode.append("1;_B");
+        gcode.append("\nG1 F600;_A\n");
+        WHEN("The occurrences of the markers are looked for") {
+            std::vector<std::pair<size_t, size_t>> found;
+            gcode.for_each_occurrence({ ";_A", ";_B" }, [&found] (size_t offset, size_t text) { found.emplace_back(offset, text); });
+            THEN("They are found at their offsets, even across the chunks") {
+                REQUIRE(found == std::vector<std::pair<size_t, size_t>>({ { 8, 0 }, { 17, 1 }, { 28, 0 } }));
+            }
+        }
+        WHEN("A number and the markers are patched, across the chunks") {
+            gcode.patch({ { 4, 4, "900" }, { 8, 3, "" }, { 16, 1, "2 Y2" }, { 17, 4, "\n" }, { 28, 3, "" }, { 32, 0, "M107\n" } });
+            THEN("The rest of the text is kept") {
+                REQUIRE(gcode.str() == "G1 F900\nG1 X2 Y2\nG1 F600\nM107\n");
+            }
+        }
+    }
+}
+
 SCENARIO( "Test of COG calculation") {
     GIVEN("A default configuration and a print test object") {
         auto config {Slic3r::Config::new_from_defaults()};
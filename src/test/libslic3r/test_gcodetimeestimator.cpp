@@ -0,0 +1,108 @@
+#include <catch.hpp>
+#include "GCodeTimeEstimator.hpp"
+
+using namespace Slic3r;
+
+/// Time of gcode with the default machine limits.
+static double
+estimate(const std::string &gcode)
+{
+    GCodeTimeEstimator estimator;
+    estimator.parse(gcode);
+    return estimator.time;
+}
+
+SCENARIO("GCodeTimeEstimator times a move with a trapezoidal velocity profile") {
+    GIVEN("The default limits: 3000mm/s² and a jerk of 10mm/s on X") {
+        WHEN("A long move starts from a stop") {
+            THEN("It starts at the jerk speed, cruises and slows down to a stop") {
+                REQUIRE(estimate("G1 X100 F6000\n") == Approx(1.0301500));
+            }
+        }
+        WHEN("A short move can't reach its feed rate") {
+            THEN("It accelerates until it has to slow down") {
+                REQUIRE(estimate("G1 X1 F6000\n") == Approx(0.0334679));
+            }
+        }
+        WHEN("The feed rate is above the maximum one of the axis") {
+            THEN("The move is limited to it") {
+                REQUIRE(estimate("G1 X100 F60000\n") > 100.0 / 300);
+                REQUIRE(estimate("M203 X50\nG1 X100 F6000\n") > 2.0);
+            }
+        }
+        WHEN("The acceleration is lowered by M204") {
+            THEN("The move takes longer") {
+                REQUIRE(estimate("M204 S500\nG1 X100 F6000\n") > estimate("G1 X100 F6000\n"));
+            }
+        }
+        WHEN("The move is followed by a dwell") {
+            THEN("The dwell is counted") {
+                REQUIRE(estimate("G1 X100 F6000\nG4 P500\n") == Approx(1.5301500));
+                REQUIRE(estimate("G4 S2\n") == Approx(2.0));
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeTimeEstimator plans the junctions between the moves") {
+    GIVEN("Moves along X") {
+        WHEN("A move is cut in two collinear ones") {
+            THEN("The junction doesn't slow it down") {
+                REQUIRE(estimate("G1 X50 F6000\nG1 X100\n") == Approx(estimate("G1 X100 F6000\n")));
+            }
+        }
+        WHEN("The second move turns by a right angle") {
+            THEN("The corner is taken at the jerk speed") {
+                const double corner = estimate("G1 X50 F6000\nG1 Y50\n");
+                REQUIRE(corner > estimate("G1 X50 F6000\nG1 X100\n"));
+                REQUIRE(corner < 2 * estimate("G1 X50 F6000\n"));
+            }
+        }
+        WHEN("The junction deviation is set") {
+            THEN("A sharper corner is slower") {
+                const std::string jd = "M205 J0.02\nG1 X50 F6000\n";
+                REQUIRE(estimate(jd + "G1 X0 Y1\n") > estimate(jd + "G1 X100 Y1\n"));
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeTimeEstimator follows the G-code as it is written") {
+    const std::string gcode =
+        "G21 ; set units to millimeters\n"
+        "G90\nM83\n"
+        "G1 Z0.3 F7800.000\n"
+        "G1 X10 Y10 E1.5 F1800.000\n"
+        "G1 X20 Y10 E0.5\n"
+        "G1 E-2 F2400 ; retract\n"
+        "G1 Z0.6 F7800.000\n"
+        "G1 X30 Y20 E2 F1800.000\n"
+        "G1 X10 Y20 E1\n";
+    GIVEN("G-code fed all at once") {
+        const double time = estimate(gcode);
+        WHEN("It is fed one character at a time") {
+            GCodeTimeEstimator estimator;
+            for (char c : gcode) estimator.append(&c, 1);
+            estimator.finish();
+            THEN("The time is the same") {
+                REQUIRE(estimator.time == Approx(time));
+            }
+        }
+        WHEN("The layers are started along") {
+            GCodeTimeEstimator estimator;
+            const size_t second_layer = gcode.find("G1 Z0.6");
+            estimator.new_layer();
+            estimator.append(gcode.substr(0, second_layer));
+            estimator.new_layer();
+            estimator.append(gcode.substr(second_layer));
+            estimator.finish();
+            THEN("The times of the layers add up to the total") {
+                REQUIRE(estimator.layer_times.size() == 2);
+                REQUIRE(estimator.layer_times[0] > 0);
+                REQUIRE(estimator.layer_times[1] > 0);
+                REQUIRE(estimator.layer_times[0] + estimator.layer_times[1] == Approx(time));
+                REQUIRE(estimator.time == Approx(time));
+            }
+        }
+    }
+}
@@ -1,6 +1,11 @@
 #include <catch.hpp>
+#include <chrono>
+#include <iomanip>
 #include <memory>
+#include <random>
+#include <sstream>
 
+#include "GCodeFormatter.hpp"
 #include "GCodeWriter.hpp"
 #include "test_options.hpp"
 
@@ -125,3 +130,145 @@ SCENARIO("set_speed emits values with fixed-point output.") {
         }
     }
 }
+
+SCENARIO("GCodeFormatter writes numbers as an output stream does.") {
+    auto streamed = [] (double value, unsigned int precision) {
+        std::ostringstream stream;
+        stream << std::fixed << std::setprecision(precision) << value;
+        return stream.str();
+    };
+    auto formatted = [] (double value, unsigned int precision) {
+        std::string text;
+        GCodeFormatter::append_fixed(&text, value, precision);
+        return text;
+    };
+    GIVEN("Values right on a rounding tie, huge or negative zero") {
+        const std::vector<double> values {0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.0625, 1.0625, -1.0625, 0.00001, -0.0001,
+            203.2005, 1e15, 1e20, -1e300, 9007199254740992.0};
+        THEN("They are written the same way") {
+            for (double value : values) {
+                for (unsigned int precision : {0, 1, 3, 5, 12}) {
+                    REQUIRE(formatted(value, precision) == streamed(value, precision));
+                }
+            }
+        }
+    }
+    GIVEN("Random coordinates and extrusion lengths") {
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<double> coordinates(-500.0, 500.0);
+        std::uniform_int_distribution<long long> thousandths(-1000000, 1000000);
+        THEN("They are written the same way") {
+            for (size_t i = 0; i < 100000; ++i) {
+                const double value = coordinates(generator);
+                REQUIRE(formatted(value, 3) == streamed(value, 3));
+                REQUIRE(formatted(value, 5) == streamed(value, 5));
+                // halves of the last decimal, which aren't exactly ties in binary
+                const double half = (thousandths(generator) + 0.5) / 1000.0;
+                REQUIRE(formatted(half, 3) == streamed(half, 3));
+            }
+        }
+    }
+    GIVEN("Integers") {
+        std::string text;
+        GCodeFormatter gcode(&text);
+        gcode << 0 << " " << -12 << " " << 4294967295U;
+        THEN("They are written in decimal") {
+            REQUIRE(text == "0 -12 4294967295");
+        }
+    }
+}
+
+SCENARIO("GCodeWriter appends the moves to a string.") {
+    GIVEN("A writer with comments and a single extruder") {
+        auto make_writer = [] () {
+            std::unique_ptr<GCodeWriter> writer {new GCodeWriter()};
+            writer->config.set_defaults();
+            writer->config.gcode_comments.value = true;
+            writer->config.retract_lift.values = {0.4};
+            writer->set_extruders(std::vector<unsigned int> {0});
+            writer->set_extruder(0);
+            return writer;
+        };
+        auto returned = make_writer();
+        auto appended = make_writer();
+        WHEN("Both writers are sent the same moves") {
+            std::string expected {"preamble\n"};
+            expected += returned->travel_to_xyz(Pointf3(10, 20.0005, 0.3), "first point");
+            expected += returned->set_speed(1800.0004, "", ";_EXTRUDE_SET_SPEED");
+            expected += returned->extrude_to_xy(Pointf(12.5, 20.5), 0.0123456, "perimeter");
+            expected += returned->retract();
+            expected += returned->reset_e();
+            expected += returned->lift();
+            expected += returned->travel_to_z(0.5);
+            expected += returned->unlift();
+            expected += returned->unretract();
+            expected += returned->extrude_to_xyz(Pointf3(-3.25, 7, 0.6), 1.5);
+
+            std::string gcode {"preamble\n"};
+            appended->travel_to_xyz(&gcode, Pointf3(10, 20.0005, 0.3), "first point");
+            appended->set_speed(&gcode, 1800.0004, "", ";_EXTRUDE_SET_SPEED");
+            appended->extrude_to_xy(&gcode, Pointf(12.5, 20.5), 0.0123456, "perimeter");
+            appended->retract(&gcode);
+            appended->reset_e(&gcode);
+            appended->lift(&gcode);
+            appended->travel_to_z(&gcode, 0.5);
+            appended->unlift(&gcode);
+            appended->unretract(&gcode);
+            appended->extrude_to_xyz(&gcode, Pointf3(-3.25, 7, 0.6), 1.5);
+            THEN("The G-code is the same") {
+                REQUIRE_THAT(gcode, Catch::Equals(expected));
+                REQUIRE(expected.find("G1 E-1.98765 F2400.00000 ; retract extruder 0\n") != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeWriter moves per second", "[.benchmark]") {
+    GIVEN("A writer and a few thousand points") {
+        GCodeWriter writer;
+        writer.config.set_defaults();
+        writer.set_extruders(std::vector<unsigned int> {0});
+        writer.set_extruder(0);
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<double> coordinates(0.0, 200.0);
+        Pointfs points;
+        for (size_t i = 0; i < 4096; ++i)
+            points.emplace_back(coordinates(generator), coordinates(generator));
+        const size_t rounds {250};
+
+        auto moves_per_second = [&points, rounds] (const std::function<void(const Pointf&)>& move) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t round = 0; round < rounds; ++round)
+                for (const Pointf& point : points) move(point);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return points.size() * rounds / elapsed.count();
+        };
+        WHEN("The extrusions are written through a stream, or appended to the G-code") {
+            std::string streamed, appended;
+            double E {0};
+            // what extrude_to_xy() used to do
+            const double before = moves_per_second([&streamed, &E] (const Pointf& point) {
+                E += 0.01;
+                std::ostringstream gcode;
+                gcode << "G1 X" << std::fixed << std::setprecision(3) << point.x
+                      <<   " Y" << std::fixed << std::setprecision(3) << point.y
+                      <<   " E" << std::fixed << std::setprecision(5) << E;
+                gcode << "\n";
+                streamed += gcode.str();
+            });
+            const double returning = moves_per_second([&writer] (const Pointf& point) {
+                std::string gcode;
+                gcode += writer.extrude_to_xy(point, 0.01);
+            });
+            writer.reset_e(true);
+            const double after = moves_per_second([&writer, &appended] (const Pointf& point) {
+                writer.extrude_to_xy(&appended, point, 0.01);
+            });
+            THEN("The G-code is the same, and written faster") {
+                WARN("stream: " << before << " moves/s, returned strings: " << returning << " moves/s, appended: " << after << " moves/s");
+                REQUIRE(appended == streamed);
+                REQUIRE(after > before);
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#include <catch.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "LayerPipeline.hpp"
+
+using namespace Slic3r;
+
+SCENARIO("LayerPipeline: dependency tracking") {
+    GIVEN("A pipeline of 200 layers with two stages") {
+        const size_t layers = 200;
+        std::vector<std::atomic<int>> first(layers), second(layers);
+        for (size_t i = 0; i < layers; ++i) { first[i] = 0; second[i] = 0; }
+        std::atomic<bool> early(false);
+
+        LayerPipeline pipeline(layers);
+        pipeline.add_stage([&first](size_t i) { ++first[i]; });
+        // the second stage of layer i reads the first one of [i-2, i+1]
+        pipeline.add_stage([&](size_t i) {
+            for (size_t j = (i < 2 ? 0 : i - 2); j <= std::min(layers - 1, i + 1); ++j)
+                if (first[j] != 1) early = true;
+            ++second[i];
+        }, 2, 1);
+
+        WHEN("It is run with 4 threads") {
+            pipeline.run(4);
+            THEN("Every task ran exactly once, after the ones it depends on") {
+                for (size_t i = 0; i < layers; ++i) {
+                    REQUIRE(first[i] == 1);
+                    REQUIRE(second[i] == 1);
+                    REQUIRE(pipeline.is_done(1, i));
+                }
+                REQUIRE(!early);
+            }
+        }
+        WHEN("It is started in the background") {
+            pipeline.start(4);
+            THEN("Layers can be waited for one by one") {
+                for (size_t i = 0; i < layers; ++i) {
+                    pipeline.wait(1, i);
+                    REQUIRE(second[i] == 1);
+                }
+                pipeline.join();
+                REQUIRE(!early);
+            }
+        }
+    }
+    GIVEN("A pipeline whose second stage throws on a layer") {
+        LayerPipeline pipeline(100);
+        pipeline.add_stage([](size_t) {});
+        pipeline.add_stage([](size_t i) { if (i == 50) throw std::runtime_error("failure"); });
+        THEN("run() rethrows the exception") {
+            REQUIRE_THROWS_AS(pipeline.run(4), std::runtime_error);
+        }
+        THEN("Waiting for a layer of a background run rethrows it too") {
+            pipeline.start(4);
+            REQUIRE_THROWS_AS(pipeline.wait(1, 50), std::runtime_error);
+            REQUIRE_THROWS_AS(pipeline.join(), std::runtime_error);
+        }
+    }
+    GIVEN("An empty pipeline") {
+        LayerPipeline pipeline(0);
+        pipeline.add_stage([](size_t) {});
+        THEN("Running it does nothing") {
+            pipeline.run(4);
+            pipeline.start(4);
+            pipeline.join();
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #include <catch.hpp>
+#include <algorithm>
 #include <string>
+#include <iterator>
 #include "test_data.hpp"
 #include "libslic3r.h"
 
@@ -144,3 +146,312 @@ SCENARIO("Print: Brim generation") {
         }
     }
 }
+
+SCENARIO("Print: Sharing identical objects") {
+    GIVEN("Two 20mm cubes and a pyramid as three model objects") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        Slic3r::Model model;
+        for (auto m : { TestMesh::cube_20x20x20, TestMesh::pyramid, TestMesh::cube_20x20x20 }) {
+            auto* object {model.add_object()};
+            object->add_volume(mesh(m));
+            object->add_instance();
+        }
+        model.arrange_objects(5);
+        model.center_instances_around_point(Slic3r::Pointf(100,100));
+
+        auto add_objects = [&model, &config] (bool share) {
+            shared_Print print {std::make_shared<Slic3r::Print>()};
+            print->apply_config(config);
+            print->share_identical_objects = share;
+            for (auto* mo : model.objects) {
+                print->auto_assign_extruders(mo);
+                print->add_model_object(mo);
+            }
+            return print;
+        };
+        auto all_copies = [] (const shared_Print &print) {
+            Slic3r::Points copies;
+            for (const auto* object : print->objects)
+                copies.insert(copies.end(), object->_shifted_copies.begin(), object->_shifted_copies.end());
+            std::sort(copies.begin(), copies.end(), [] (const Slic3r::Point &a, const Slic3r::Point &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+            return copies;
+        };
+
+        WHEN("They are added to a print sharing identical objects") {
+            auto print {add_objects(true)};
+            THEN("The second cube is a copy of the first one") {
+                REQUIRE(print->objects.size() == 2);
+                REQUIRE(print->objects.at(0)->copies().size() == 2);
+                REQUIRE(print->objects.at(0)->merged_model_objects().size() == 1);
+                REQUIRE(print->objects.at(0)->merged_model_objects().front() == model.objects.at(2));
+                REQUIRE(print->objects.at(1)->copies().size() == 1);
+            }
+            THEN("The copies are printed where the objects would be") {
+                REQUIRE(all_copies(print) == all_copies(add_objects(false)));
+            }
+        }
+        WHEN("The cubes alone are printed with and without sharing them") {
+            model.delete_object(1);
+            // aligned and nearest seams start from the last seam of the print
+            // object, which the copies of a shared one have in common
+            config->set("seam_position", "rear");
+            auto exported = [&add_objects] (bool share) {
+                std::stringstream gcode;
+                Slic3r::Test::gcode(gcode, add_objects(share));
+                // skip the header, holding the time of the export, the moves
+                // to the current Z that the layer of each print object starts
+                // with and the statistics, summed over differently rounded meshes
+                std::string line, body, z;
+                std::getline(gcode, line);
+                while (std::getline(gcode, line) && line.compare(0, 8, "; cog_x ") != 0) {
+                    if (line.compare(0, 4, "G1 Z") == 0) {
+                        if (line == z) continue;
+                        z = line;
+                    }
+                    body += line + "\n";
+                }
+                return body;
+            };
+            THEN("The G-code is the same") {
+                const auto shared {exported(true)};
+                REQUIRE(shared.find("G1 X") != std::string::npos);
+                REQUIRE(shared == exported(false));
+            }
+        }
+        WHEN("The objects are not shared") {
+            auto print {add_objects(false)};
+            THEN("There is one print object per model object") {
+                REQUIRE(print->objects.size() == 3);
+            }
+            THEN("The cubes hash the same and the pyramid differently") {
+                REQUIRE(print->objects.at(0)->content_hash() == print->objects.at(2)->content_hash());
+                REQUIRE(print->objects.at(0)->content_hash() != print->objects.at(1)->content_hash());
+            }
+        }
+        WHEN("One of the cubes has a different config") {
+            model.objects.at(2)->config.opt<Slic3r::ConfigOptionInt>("perimeters", true)->value = 5;
+            auto print {add_objects(true)};
+            THEN("It is not shared") {
+                REQUIRE(print->objects.size() == 3);
+            }
+        }
+        WHEN("The objects are compared exactly after their hashes") {
+            auto print {add_objects(false)};
+            THEN("Only the cubes have the same content") {
+                REQUIRE(print->objects.at(0)->same_content(*print->objects.at(2)));
+                REQUIRE_FALSE(print->objects.at(0)->same_content(*print->objects.at(1)));
+            }
+        }
+        WHEN("A config change rearranges the regions of a print sharing the cubes") {
+            auto print {add_objects(true)};
+            model.objects.at(1)->config.opt<Slic3r::ConfigOptionPercent>("fill_density", true)->value = 50;
+            print->apply_config(config);
+            THEN("The second cube is still printed as a copy of the first one") {
+                REQUIRE(print->objects.size() == 2);
+                REQUIRE(print->objects.at(0)->copies().size() == 2);
+                REQUIRE(print->objects.at(0)->merged_model_objects().size() == 1);
+                REQUIRE(all_copies(print) == all_copies(add_objects(false)));
+            }
+        }
+        WHEN("The second cube of a print sharing them gets its own region option") {
+            auto print {add_objects(true)};
+            model.objects.at(2)->config.opt<Slic3r::ConfigOptionInt>("perimeters", true)->value = 5;
+            print->apply_config(config);
+            THEN("It is printed on its own again, with its option") {
+                REQUIRE(print->objects.size() == 3);
+                REQUIRE(print->objects.at(0)->copies().size() == 1);
+                REQUIRE(print->objects.at(0)->merged_model_objects().empty());
+                REQUIRE(print->objects.at(2)->model_object() == model.objects.at(2));
+                REQUIRE(print->regions.at(print->objects.at(2)->region_volumes.begin()->first)->config.perimeters == 5);
+                REQUIRE(all_copies(print) == all_copies(add_objects(false)));
+            }
+        }
+        WHEN("The second cube of a print sharing them gets its own object option") {
+            auto print {add_objects(true)};
+            model.objects.at(2)->config.opt<Slic3r::ConfigOptionBool>("support_material", true)->value = true;
+            print->apply_config(config);
+            THEN("It is printed on its own again, with its option") {
+                REQUIRE(print->objects.size() == 3);
+                REQUIRE(print->objects.at(0)->merged_model_objects().empty());
+                REQUIRE(print->objects.at(2)->config.support_material);
+            }
+        }
+    }
+}
+
+SCENARIO("Print: Concurrent processing of objects") {
+    GIVEN("Four different objects with support material, a skirt and a brim") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("support_material", true);
+        config->set("skirts", 1);
+        config->set("brim_width", 2);
+        auto processed = [&config] (int threads, Slic3r::Model &model) {
+            config->set("threads", threads);
+            auto print {Slic3r::Test::init_print({TestMesh::overhang, TestMesh::pyramid, TestMesh::cube_20x20x20, TestMesh::V}, model, config)};
+            print->process();
+            return print;
+        };
+        WHEN("They are processed with one thread and with several") {
+            Slic3r::Model sequential_model, concurrent_model;
+            auto sequential {processed(1, sequential_model)};
+            auto concurrent {processed(4, concurrent_model)};
+            THEN("Every object went through all of its steps") {
+                for (const auto* object : concurrent->objects) {
+                    REQUIRE(object->state.is_done(Slic3r::posInfill));
+                    REQUIRE(object->state.is_done(Slic3r::posSupportMaterial));
+                }
+                REQUIRE(concurrent->state.is_done(Slic3r::psSkirt));
+                REQUIRE(concurrent->state.is_done(Slic3r::psBrim));
+            }
+            THEN("The objects have the same layers, fills and support") {
+                auto exported = [] (const shared_Print &print) {
+                    std::stringstream gcode;
+                    Slic3r::Test::gcode(gcode, print);
+                    // skip the header, holding the time of the export, and the
+                    // config at the end, holding the threads count
+                    std::string line;
+                    std::getline(gcode, line);
+                    std::string body {std::istreambuf_iterator<char>(gcode), std::istreambuf_iterator<char>()};
+                    return body.substr(0, body.find("; threads = "));
+                };
+                const auto serial {exported(sequential)};
+                REQUIRE(serial.find("G1 X") != std::string::npos);
+                REQUIRE(exported(concurrent) == serial);
+            }
+        }
+    }
+}
+
+SCENARIO("Print: Streaming the fills into the G-code export") {
+    GIVEN("Two objects with a skirt") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("skirts", 1);
+        auto exported = [&config] (int threads, bool process_first, Slic3r::Model &model) {
+            config->set("threads", threads);
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, model, config)};
+            if (process_first) print->process();
+            std::stringstream gcode;
+            Slic3r::Test::gcode(gcode, print);
+            // skip the header, holding the time of the export
+            std::string line;
+            std::getline(gcode, line);
+            return std::make_pair(print, std::string(std::istreambuf_iterator<char>(gcode), std::istreambuf_iterator<char>()));
+        };
+        WHEN("G-code is exported without processing the print first") {
+            Slic3r::Model processed_model, streamed_model;
+            auto processed {exported(1, true, processed_model)};
+            auto streamed {exported(1, false, streamed_model)};
+            THEN("Every object has its fills done") {
+                for (const auto* object : streamed.first->objects)
+                    REQUIRE(object->state.is_done(Slic3r::posInfill));
+            }
+            THEN("The G-code is the same as after process()") {
+                REQUIRE(streamed.second == processed.second);
+            }
+        }
+        WHEN("G-code is exported with an interior brim without processing the print first") {
+            config->set("interior_brim_width", 3);
+            Slic3r::Model processed_model, streamed_model;
+            auto processed {exported(1, true, processed_model)};
+            auto streamed {exported(1, false, streamed_model)};
+            THEN("The interior brim is the same as after process()") {
+                REQUIRE(streamed.first->brim.items_count() == processed.first->brim.items_count());
+                REQUIRE(streamed.second == processed.second);
+            }
+        }
+        WHEN("The fills are generated by several threads during the export") {
+            Slic3r::Model processed_model, streamed_model;
+            auto processed {exported(4, true, processed_model)};
+            auto streamed {exported(4, false, streamed_model)};
+            THEN("Every layer has the same fills") {
+                for (size_t i = 0; i < streamed.first->objects.size(); ++i) {
+                    const auto &a = *streamed.first->objects[i];
+                    const auto &b = *processed.first->objects[i];
+                    REQUIRE(a.layers.size() == b.layers.size());
+                    for (size_t l = 0; l < a.layers.size(); ++l)
+                        REQUIRE(a.layers[l]->regions[0]->fills.items_count() == b.layers[l]->regions[0]->fills.items_count());
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Print: Cancelling a running print") {
+    GIVEN("Two objects with a skirt") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("skirts", 1);
+        auto without_header = [] (const std::string &gcode) {
+            // the header holds the time of the export
+            return gcode.substr(gcode.find('\n') + 1);
+        };
+        auto exported = [&without_header] (const shared_Print &print) {
+            std::stringstream gcode;
+            print->export_gcode(gcode, true);
+            return without_header(gcode.str());
+        };
+        Slic3r::CancellationToken cancel;
+        std::vector<std::string> messages;
+        auto cancel_on = [&cancel, &messages] (const shared_Print &print, const std::string &prefix) {
+            print->status_cb = [&cancel, &messages, prefix] (int, const std::string &message) {
+                messages.push_back(message);
+                if (message.compare(0, prefix.size(), prefix) == 0) cancel.cancel();
+            };
+        };
+        auto unfinished_steps = [] (const shared_Print &print) {
+            size_t count = 0;
+            for (const auto* object : print->objects)
+                for (auto step : object->state.started)
+                    if (!object->state.is_done(step)) ++count;
+            for (auto step : print->state.started)
+                if (!print->state.is_done(step)) ++count;
+            return count;
+        };
+
+        WHEN("process() is cancelled while the first object is being infilled") {
+            // a single thread processes the objects one after the other
+            config->set("threads", 1);
+            Slic3r::Model reference_model, model;
+            auto reference {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, reference_model, config)};
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, model, config)};
+            cancel_on(print, "Infilling layers (");
+            REQUIRE_THROWS_AS(print->process(cancel), Slic3r::CancelledError);
+            THEN("The progress was reported as layers done") {
+                REQUIRE(std::any_of(messages.begin(), messages.end(), [] (const std::string &message) {
+                    return message.find("Generating perimeters (") == 0 && message.find("/") != std::string::npos;
+                }));
+            }
+            THEN("The fills are invalidated and the steps before them are kept") {
+                REQUIRE(unfinished_steps(print) == 0);
+                REQUIRE_FALSE(print->objects.at(0)->state.is_done(Slic3r::posInfill));
+                REQUIRE(print->objects.at(0)->state.is_done(Slic3r::posPrepareInfill));
+                REQUIRE_FALSE(print->objects.at(1)->state.is_started(Slic3r::posInfill));
+                REQUIRE_FALSE(print->state.is_done(Slic3r::psSkirt));
+            }
+            THEN("Running it again gives the G-code of an uncancelled run") {
+                print->status_cb = nullptr;
+                print->process();
+                REQUIRE(exported(print) == exported(reference));
+            }
+        }
+        WHEN("The export is cancelled while the layers are being written") {
+            config->set("threads", 4);
+            Slic3r::Model reference_model, model;
+            auto reference {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, reference_model, config)};
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, model, config)};
+            cancel_on(print, "Exporting layers (");
+            std::stringstream cancelled_gcode;
+            REQUIRE_THROWS_AS(print->export_gcode(cancelled_gcode, true, cancel), Slic3r::CancelledError);
+            THEN("The fills are invalidated and the steps before them are kept") {
+                REQUIRE(unfinished_steps(print) == 0);
+                for (const auto* object : print->objects) {
+                    REQUIRE_FALSE(object->state.is_done(Slic3r::posInfill));
+                    REQUIRE(object->state.is_done(Slic3r::posPrepareInfill));
+                }
+            }
+            THEN("Exporting again gives the G-code of an uncancelled run") {
+                print->status_cb = nullptr;
+                REQUIRE(exported(print) == exported(reference));
+            }
+        }
+    }
+}
@@ -270,3 +270,47 @@ SCENARIO( "PrintGCode basic functionality") {
         gcode.clear();
     }
 }
+
+SCENARIO("PrintGCode: Rendering the layers on several threads") {
+    GIVEN("Two objects with skirts, relative E distances, a layer G-code and avoid_crossing_perimeters") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("skirts", 2);
+        config->set("avoid_crossing_perimeters", true);
+        config->set("use_relative_e_distances", true);
+        config->set("layer_gcode", ";Layer:[layer_num] ([layer_z] mm)");
+        auto exported = [] (shared_Print print, int threads) {
+            print->config.threads.value = threads;
+            std::stringstream gcode;
+            Slic3r::Test::gcode(gcode, print);
+            // skip the header, holding the time of the export, and the
+            // config at the end, holding the threads count
+            std::string line;
+            std::getline(gcode, line);
+            std::string body {std::istreambuf_iterator<char>(gcode), std::istreambuf_iterator<char>()};
+            return body.substr(0, body.find("; threads = "));
+        };
+        WHEN("The objects are printed layer by layer") {
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::pyramid}, model, config)};
+            print->process();
+            const auto serial {exported(print, 1)};
+            THEN("The G-code is the same with one thread and with several") {
+                REQUIRE(serial.find(";Layer:") != std::string::npos);
+                REQUIRE(exported(print, 4) == serial);
+                REQUIRE(exported(print, 3) == serial);
+            }
+        }
+        WHEN("The objects are printed one after the other") {
+            config->set("complete_objects", true);
+            config->set("gcode_comments", true);
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::cube_20x20x20}, model, config)};
+            print->process();
+            const auto serial {exported(print, 1)};
+            THEN("The G-code is the same with one thread and with several") {
+                REQUIRE(serial.find("move to origin position for next object") != std::string::npos);
+                REQUIRE(exported(print, 4) == serial);
+            }
+        }
+    }
+}
@@ -3,6 +3,9 @@
 #include "test_data.hpp"
 #include "Log.hpp"
 #include "libslic3r.h"
+#include "ClipperUtils.hpp"
+#include "SupportMaterial.hpp"
+#include <memory>
 
 using namespace Slic3r::Test;
 using namespace std::literals;
@@ -176,3 +179,167 @@ SCENARIO("PrintObject: minimum horizontal shells") {
         }
     }
 }
+
+SCENARIO("PrintObject: horizontal shells and extra perimeters on several threads") {
+    GIVEN("A sphere with solid infill every 5 layers") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("solid_infill_every_layers", 5);
+        config->set("top_solid_layers", 4);
+        config->set("bottom_solid_layers", 3);
+        config->set("extra_perimeters", true);
+        auto prepared = [&config] (int threads, Slic3r::Model &model) {
+            config->set("threads", threads);
+            auto print {Slic3r::Test::init_print({TestMesh::sphere_50mm}, model, config)};
+            print->objects[0]->prepare_infill();
+            return print;
+        };
+        WHEN("Its infill is prepared with one thread and with several") {
+            Slic3r::Model serial_model, parallel_model;
+            auto serial {prepared(1, serial_model)};
+            auto parallel {prepared(4, parallel_model)};
+            THEN("Every layer has the same fill surfaces and extra perimeters") {
+                const auto &a = *parallel->objects[0];
+                const auto &b = *serial->objects[0];
+                REQUIRE(a.layers.size() == b.layers.size());
+                for (size_t l = 0; l < a.layers.size(); ++l) {
+                    const auto &ra = *a.layers[l]->regions[0];
+                    const auto &rb = *b.layers[l]->regions[0];
+                    REQUIRE(ra.fill_surfaces.size() == rb.fill_surfaces.size());
+                    for (size_t s = 0; s < ra.fill_surfaces.size(); ++s) {
+                        REQUIRE(ra.fill_surfaces.surfaces[s].surface_type == rb.fill_surfaces.surfaces[s].surface_type);
+                        REQUIRE(ra.fill_surfaces.surfaces[s].expolygon.contour.points == rb.fill_surfaces.surfaces[s].expolygon.contour.points);
+                    }
+                    REQUIRE(ra.slices.size() == rb.slices.size());
+                    for (size_t s = 0; s < ra.slices.size(); ++s)
+                        REQUIRE(ra.slices.surfaces[s].extra_perimeters == rb.slices.surfaces[s].extra_perimeters);
+                }
+            }
+        }
+        WHEN("Its perimeters and surface types are generated step by step instead") {
+            Slic3r::Model stepped_model, prepared_model;
+            config->set("threads", 4);
+            auto stepped {Slic3r::Test::init_print({TestMesh::sphere_50mm}, stepped_model, config)};
+            stepped->objects[0]->make_perimeters();
+            stepped->objects[0]->detect_surfaces_type();
+            auto prepared_print {prepared(4, prepared_model)};
+            THEN("Every layer has the same perimeters and typed slices") {
+                const auto &a = *prepared_print->objects[0];
+                const auto &b = *stepped->objects[0];
+                REQUIRE(a.layers.size() == b.layers.size());
+                for (size_t l = 0; l < a.layers.size(); ++l) {
+                    const auto &ra = *a.layers[l]->regions[0];
+                    const auto &rb = *b.layers[l]->regions[0];
+                    REQUIRE(ra.perimeters.flatten().entities.size() == rb.perimeters.flatten().entities.size());
+                    REQUIRE(ra.slices.size() == rb.slices.size());
+                    for (size_t s = 0; s < ra.slices.size(); ++s) {
+                        REQUIRE(ra.slices.surfaces[s].surface_type == rb.slices.surfaces[s].surface_type);
+                        REQUIRE(ra.slices.surfaces[s].extra_perimeters == rb.slices.surfaces[s].extra_perimeters);
+                        REQUIRE(ra.slices.surfaces[s].expolygon.contour.points == rb.slices.surfaces[s].expolygon.contour.points);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("PrintObject: support material on several threads") {
+    GIVEN("An overhanging object with support material and raft") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("support_material", true);
+        config->set("raft_layers", 2);
+        config->set("support_material_interface_layers", 3);
+        auto supported = [&config] (int threads, Slic3r::Model &model) {
+            config->set("threads", threads);
+            auto print {Slic3r::Test::init_print({TestMesh::overhang}, model, config)};
+            print->objects[0]->generate_support_material();
+            return print;
+        };
+        WHEN("Its support is generated with one thread and with several") {
+            Slic3r::Model serial_model, parallel_model;
+            auto serial {supported(1, serial_model)};
+            auto parallel {supported(4, parallel_model)};
+            THEN("There is some support") {
+                REQUIRE(serial->objects[0]->support_layers.size() > 2);
+            }
+            THEN("Every support layer has the same islands and toolpaths") {
+                const auto &a = *parallel->objects[0];
+                const auto &b = *serial->objects[0];
+                REQUIRE(a.support_layers.size() == b.support_layers.size());
+                for (size_t l = 0; l < a.support_layers.size(); ++l) {
+                    const auto &la = *a.support_layers[l];
+                    const auto &lb = *b.support_layers[l];
+                    REQUIRE(la.print_z == lb.print_z);
+                    REQUIRE(la.support_islands.size() == lb.support_islands.size());
+                    for (size_t s = 0; s < la.support_islands.size(); ++s)
+                        REQUIRE(la.support_islands.expolygons[s].contour.points == lb.support_islands.expolygons[s].contour.points);
+                    REQUIRE(la.support_fills.entities.size() == lb.support_fills.entities.size());
+                    REQUIRE(la.support_interface_fills.entities.size() == lb.support_interface_fills.entities.size());
+                }
+            }
+        }
+    }
+}
+
+/// 10x10mm square at x = 20 * cell.
+static Slic3r::Polygon
+support_cell(int cell)
+{
+    return Slic3r::Polygon::new_scale({ Slic3r::Pointf(20 * cell, 0), Slic3r::Pointf(20 * cell + 10, 0),
+                                        Slic3r::Pointf(20 * cell + 10, 10), Slic3r::Pointf(20 * cell, 10) });
+}
+
+/// Cells fully covered by areas, followed by -1 if they cover anything else.
+static std::vector<int>
+support_cells(const Slic3r::Polygons &areas)
+{
+    auto area = [] (const Slic3r::Polygons &polygons) {
+        double a = 0;
+        for (const auto &p : polygons)
+            a += p.area() * SCALING_FACTOR * SCALING_FACTOR;
+        return a;
+    };
+    std::vector<int> cells;
+    for (int cell = 0; cell < 5; cell++)
+        if (area(Slic3r::intersection(areas, Slic3r::Polygons { support_cell(cell) })) > 99.9)
+            cells.push_back(cell);
+    if (std::abs(area(areas) - 100 * cells.size()) > 0.1)
+        cells.push_back(-1);
+    return cells;
+}
+
+SCENARIO("PrintObject: support interface layers of overlapping support layers") {
+    GIVEN("Support layers whose print_z overlap, out of order") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("support_material", true);
+        config->set("support_material_interface_layers", 3);
+        config->set("threads", 4);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+        std::unique_ptr<Slic3r::SupportMaterial> support {print->objects[0]->_support_material()};
+
+        // Layer 1 overlaps layers 2 and 3, layer 2 overlaps layer 0 and
+        // layer 3 overlaps layers 0 and 1.
+        Slic3r::SupportLayersAreas layers(5);
+        const std::vector<coordf_t> print_z { 0.8, 0.6, 0.2, 1.2, 1.0 };
+        for (size_t i = 0; i < layers.size(); i++)
+            layers[i].print_z = print_z[i];
+
+        WHEN("Contact areas propagate downwards into interface layers") {
+            layers[1].contact = { support_cell(0), support_cell(2) };
+            layers[2].contact = { support_cell(2) };
+            layers[4].contact = { support_cell(2) };
+            support->generate_interface_layers(layers, {});
+            THEN("Each one is clipped by the contact areas as the ones of the lower contact layers left them") {
+                REQUIRE(support_cells(layers[0]._interface) == std::vector<int>({ 0 }));
+                REQUIRE(support_cells(layers[1]._interface) == std::vector<int>({ 2 }));
+                REQUIRE(support_cells(layers[2]._interface) == std::vector<int>({ 2 }));
+                REQUIRE(support_cells(layers[3]._interface) == std::vector<int>({ 2 }));
+                REQUIRE(layers[4]._interface.empty());
+            }
+            THEN("The contact areas are kept") {
+                REQUIRE(support_cells(layers[1].contact) == std::vector<int>({ 0, 2 }));
+                REQUIRE(support_cells(layers[2].contact) == std::vector<int>({ 2 }));
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include <catch.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "libslic3r.h"
+#include "ThreadPool.hpp"
+
+using namespace Slic3r;
+
+SCENARIO("ThreadPool: parallel_for behavior") {
+    GIVEN("A vector of 10000 counters") {
+        std::vector<int> counters(10000, 0);
+        WHEN("parallel_for is run over it with 4 threads") {
+            ThreadPool::instance().parallel_for(0, counters.size(), [&counters](size_t i) { ++counters[i]; }, 4);
+            THEN("Every counter has been incremented exactly once.") {
+                for (int c : counters) REQUIRE(c == 1);
+            }
+        }
+        WHEN("parallel_for is run over a sub range with chunks of 7 items") {
+            ThreadPool::instance().parallel_for(100, 200, [&counters](size_t i) { ++counters[i]; }, 3, 7);
+            THEN("Only the counters of the sub range have been incremented.") {
+                for (size_t i = 0; i < counters.size(); ++i)
+                    REQUIRE(counters[i] == ((i >= 100 && i < 200) ? 1 : 0));
+            }
+        }
+        WHEN("parallel_for is called recursively from inside a job") {
+            std::atomic<int> total(0);
+            ThreadPool::instance().parallel_for(0, 16, [&total](size_t) {
+                ThreadPool::instance().parallel_for(0, 100, [&total](size_t) { ++total; }, 4);
+            }, 4);
+            THEN("All nested items have been processed.") {
+                REQUIRE(total == 1600);
+            }
+        }
+    }
+    GIVEN("A job throwing on one of its items") {
+        auto func = [](size_t i) { if (i == 500) throw std::runtime_error("failure"); };
+        THEN("The exception is rethrown to the caller.") {
+            REQUIRE_THROWS_AS(ThreadPool::instance().parallel_for(0, 1000, func, 4), std::runtime_error);
+        }
+    }
+    GIVEN("An empty range") {
+        THEN("parallelize() with an end of size()-1 does not call the function.") {
+            std::vector<size_t> none;
+            std::atomic<int> calls(0);
+            parallelize<size_t>(0, none.size() - 1, [&calls](size_t) { ++calls; }, 4);
+            REQUIRE(calls == 0);
+        }
+    }
+}
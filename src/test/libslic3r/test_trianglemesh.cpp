@@ -13,6 +13,10 @@
 #include <algorithm>
 #include <future>
 #include <chrono>
+#include <random>
+#include <cstring>
+#include <fstream>
+#include <boost/filesystem.hpp>
 
 using namespace Slic3r;
 using namespace std;
@@ -223,6 +227,180 @@ SCENARIO( "TriangleMesh: slice behavior.") {
             }
         }
     }
+    GIVEN( "A sphere of radius 10mm") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 60)};
+        std::vector<float> z;
+        for (float h = -9.95f; h < 10.f; h += 0.1f) z.push_back(h);
+        WHEN("it is sliced with one thread and with eight threads") {
+            std::vector<Polygons> serial, threaded;
+            TriangleMeshSlicer<Z>(&sphere, 1).slice(z, &serial);
+            TriangleMeshSlicer<Z>(&sphere, 8).slice(z, &threaded);
+            THEN( "the resulting polygons are identical.") {
+                REQUIRE(serial.size() == threaded.size());
+                for (size_t i = 0; i < serial.size(); ++i) {
+                    REQUIRE(serial[i].size() == threaded[i].size());
+                    for (size_t j = 0; j < serial[i].size(); ++j)
+                        REQUIRE(serial[i][j].points == threaded[i][j].points);
+                }
+            }
+        }
+        WHEN("it is sliced in streaming mode") {
+            std::vector<Polygons> loops;
+            TriangleMeshSlicer<Z>(&sphere, 4).slice(z, &loops);
+            std::vector<size_t> received;
+            std::vector<ExPolygons> streamed(z.size());
+            TriangleMeshSlicer<Z>(&sphere, 4).slice_streaming(z, [&](size_t layer_id, ExPolygons &slices) {
+                received.push_back(layer_id);
+                streamed[layer_id] = std::move(slices);
+            });
+            THEN( "every layer is handed over once, bottom-up.") {
+                REQUIRE(received.size() == z.size());
+                for (size_t i = 0; i < received.size(); ++i)
+                    REQUIRE(received[i] == i);
+            }
+            THEN( "each layer is the single loop slice() finds, a section of the sphere.") {
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(loops[i].size() == 1);
+                    REQUIRE(streamed[i].size() == 1);
+                    REQUIRE(streamed[i].front().holes.empty());
+                    const double area = streamed[i].front().area() * SCALING_FACTOR * SCALING_FACTOR;
+                    REQUIRE(area == Approx(std::abs(loops[i].front().area()) * SCALING_FACTOR * SCALING_FACTOR));
+                    if (std::abs(z[i]) < 9.f)
+                        REQUIRE(area == Approx(PI * (100 - z[i] * z[i])).epsilon(0.01));
+                }
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMeshSlicer: slicing a list of transformed meshes") {
+    GIVEN( "A rotated cylinder and a sphere") {
+        auto cylinder {TriangleMesh::make_cylinder(10, 20, PI / 30)};
+        auto sphere {TriangleMesh::make_sphere(8, PI / 30)};
+        cylinder.repair();
+        sphere.repair();
+        TransformationMatrix cylinder_trafo = TransformationMatrix::mat_rotation(PI / 7, Axis::Z);
+        cylinder_trafo.applyLeft(TransformationMatrix::mat_translation(-5, 3, 0));
+        std::vector<float> z;
+        for (float h = 0.15f; h < 20.f; h += 0.3f) z.push_back(h);
+        
+        // slices without building a merged copy, and the ones of the merged
+        // transformed copy PrintObject::_slice_region() used to build
+        std::vector<Polygons> slices, expected;
+        const auto slice = [&](const TransformationMatrix &sphere_trafo) {
+            TransformedMeshes meshes;
+            meshes.push_back(TransformedMesh(&cylinder, cylinder_trafo));
+            meshes.push_back(TransformedMesh(&sphere, sphere_trafo));
+            TriangleMeshSlicer<Z>(meshes, 4).slice(z, &slices);
+            
+            TriangleMesh merged {cylinder.get_transformed_mesh(cylinder_trafo)};
+            merged.merge(sphere.get_transformed_mesh(sphere_trafo));
+            TriangleMeshSlicer<Z>(&merged, 4).slice(z, &expected);
+            REQUIRE(slices.size() == expected.size());
+        };
+        
+        WHEN( "the sphere is rotated") {
+            TransformationMatrix sphere_trafo = TransformationMatrix::mat_rotation(PI / 5, Axis::Z);
+            sphere_trafo.applyLeft(TransformationMatrix::mat_translation(25, 0, 10));
+            slice(sphere_trafo);
+            
+            // The loops may start from other points and come in another order.
+            // Vertices of the sphere which only coincide once transformed are
+            // merged by the repair of the copy, leaving one point where the
+            // slicer emits the same point twice.
+            const auto normalized = [](Polygons polygons) {
+                const auto less = [](const Point &a, const Point &b) { return a.x < b.x || (a.x == b.x && a.y < b.y); };
+                for (Polygon &polygon : polygons) {
+                    polygon.remove_duplicate_points();
+                    std::rotate(polygon.points.begin(), std::min_element(polygon.points.begin(), polygon.points.end(), less), polygon.points.end());
+                }
+                std::sort(polygons.begin(), polygons.end(), [&less](const Polygon &a, const Polygon &b) {
+                    return less(a.points.front(), b.points.front());
+                });
+                return polygons;
+            };
+            THEN( "the slices are the polygons of the merged transformed meshes.") {
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(slices[i].size() == (std::abs(z[i] - 10) < 8 ? 2 : 1));
+                    const Polygons a = normalized(slices[i]), b = normalized(expected[i]);
+                    REQUIRE(a.size() == b.size());
+                    for (size_t j = 0; j < a.size(); ++j)
+                        REQUIRE(a[j].points == b[j].points);
+                }
+            }
+        }
+        WHEN( "the sphere is mirrored") {
+            TransformationMatrix sphere_trafo = TransformationMatrix::mat_mirror(Axis::X);
+            sphere_trafo.applyLeft(TransformationMatrix::mat_translation(25, 0, 10));
+            slice(sphere_trafo);
+            THEN( "the slices have the loops and the signed areas of the merged transformed meshes.") {
+                for (size_t i = 0; i < z.size(); ++i) {
+                    REQUIRE(slices[i].size() == (std::abs(z[i] - 10) < 8 ? 2 : 1));
+                    REQUIRE(slices[i].size() == expected[i].size());
+                    double area = 0, expected_area = 0;
+                    for (const Polygon &polygon : slices[i]) area += polygon.area();
+                    for (const Polygon &polygon : expected[i]) expected_area += polygon.area();
+                    REQUIRE(area > 0);
+                    REQUIRE(area == Approx(expected_area));
+                }
+            }
+        }
+        WHEN( "a mesh isn't repaired") {
+            constexpr std::array<Pointf3, 8> vertices { Pointf3(20,20,0), Pointf3(20,0,0), Pointf3(0,0,0), Pointf3(0,20,0), Pointf3(20,20,20), Pointf3(0,20,20), Pointf3(0,0,20), Pointf3(20,0,20) };
+            constexpr std::array<Point3, 12> facets { Point3(0,1,2), Point3(0,2,3), Point3(4,5,6), Point3(4,6,7), Point3(0,4,7), Point3(0,7,1), Point3(1,7,6), Point3(1,6,2), Point3(2,6,5), Point3(2,5,3), Point3(4,0,3), Point3(4,3,5) };
+            auto unrepaired {TriangleMesh(vertices, facets)};
+            TransformedMeshes meshes;
+            meshes.push_back(TransformedMesh(&unrepaired, TransformationMatrix()));
+            THEN( "the slicer refuses it instead of repairing it.") {
+                REQUIRE_THROWS(TriangleMeshSlicer<Z>(meshes, 4));
+                REQUIRE_FALSE(unrepaired.repaired);
+            }
+        }
+    }
+}
+
+SCENARIO( "intersect_facets matches the scalar intersection formula") {
+    GIVEN( "1003 random facets, some of them touching the plane") {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coord(-1e7f, 1e7f);
+        const float slice_z = 12345.f;
+        FacetsSoA soa;
+        soa.resize(1003);
+        for (size_t f = 0; f < soa.size(); ++f) {
+            for (int k = 0; k < 3; ++k) {
+                soa.x[k][f] = coord(rng);
+                soa.y[k][f] = coord(rng);
+                soa.z[k][f] = (int(f % 17) == k) ? slice_z : coord(rng);
+            }
+        }
+        // visit the facets in reverse, to exercise the gathers
+        std::vector<int> facets;
+        for (int f = soa.size() - 1; f >= 0; --f) facets.push_back(f);
+        WHEN( "the facets are intersected with a plane") {
+            std::vector<FacetCrossing> out(facets.size());
+            intersect_facets(soa, facets.data(), facets.size(), slice_z, out.data());
+            THEN( "every crossing is bit-for-bit the one computed one facet at a time.") {
+                for (size_t i = 0; i < facets.size(); ++i) {
+                    const int f = facets[i];
+                    unsigned char edges = 0, vertices = 0;
+                    for (int a = 0; a < 3; ++a) {
+                        const int b = (a + 1) % 3;
+                        const float za = soa.z[a][f], zb = soa.z[b][f];
+                        if (za == slice_z) vertices |= 1 << a;
+                        if ((za < slice_z && zb > slice_z) || (zb < slice_z && za > slice_z)) {
+                            edges |= 1 << a;
+                            const float x = soa.x[b][f] + (soa.x[a][f] - soa.x[b][f]) * (slice_z - zb) / (za - zb);
+                            const float y = soa.y[b][f] + (soa.y[a][f] - soa.y[b][f]) * (slice_z - zb) / (za - zb);
+                            REQUIRE(out[i].x[a] == x);
+                            REQUIRE(out[i].y[a] == y);
+                        }
+                    }
+                    REQUIRE(out[i].edges == edges);
+                    REQUIRE(out[i].vertices == vertices);
+                }
+            }
+        }
+    }
 }
 
 SCENARIO( "make_xxx functions produce meshes.") {
@@ -290,6 +468,396 @@ SCENARIO( "make_xxx functions produce meshes.") {
     }
 }
 
+SCENARIO( "TriangleMesh: reading binary STL files") {
+    GIVEN( "A sphere saved as binary STL") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 60)};
+        sphere.translate(3, -4, 12);
+        const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.stl")).string();
+        sphere.write_binary(path);
+        WHEN( "it is read back with ReadSTLFile() and with stl_open()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            stl_file expected;
+            stl_open(&expected, path.c_str());
+            THEN( "the facets and the statistics are the same.") {
+                REQUIRE(expected.error == 0);
+                REQUIRE(mesh.stl.stats.type == binary);
+                REQUIRE(mesh.stl.stats.number_of_facets == expected.stats.number_of_facets);
+                for (int i = 0; i < expected.stats.number_of_facets; ++i)
+                    REQUIRE(memcmp(&mesh.stl.facet_start[i], &expected.facet_start[i], SIZEOF_STL_FACET) == 0);
+                REQUIRE(memcmp(&mesh.stl.stats.min, &expected.stats.min, sizeof(stl_vertex)) == 0);
+                REQUIRE(memcmp(&mesh.stl.stats.max, &expected.stats.max, sizeof(stl_vertex)) == 0);
+                REQUIRE(mesh.stl.stats.shortest_edge == expected.stats.shortest_edge);
+                REQUIRE(mesh.stl.stats.bounding_diameter == expected.stats.bounding_diameter);
+                REQUIRE(std::string(mesh.stl.stats.header) == std::string(expected.stats.header));
+            }
+            stl_close(&expected);
+        }
+        boost::filesystem::remove(path);
+    }
+}
+
+/// Compare a STL read by ReadSTLFile() with the one stl_open() reads.
+/// ASCII facets leave their extra bytes undefined in admesh, so only the
+/// normal and the vertices are compared.
+static void
+require_same_stl(const stl_file &stl, const stl_file &expected)
+{
+    REQUIRE(expected.error == 0);
+    REQUIRE(stl.stats.type == expected.stats.type);
+    REQUIRE(stl.stats.number_of_facets == expected.stats.number_of_facets);
+    REQUIRE(stl.stats.original_num_facets == expected.stats.original_num_facets);
+    for (int i = 0; i < expected.stats.number_of_facets; ++i)
+        REQUIRE(memcmp(&stl.facet_start[i], &expected.facet_start[i], 12 * sizeof(float)) == 0);
+    REQUIRE(memcmp(&stl.stats.min, &expected.stats.min, sizeof(stl_vertex)) == 0);
+    REQUIRE(memcmp(&stl.stats.max, &expected.stats.max, sizeof(stl_vertex)) == 0);
+    REQUIRE(stl.stats.shortest_edge == expected.stats.shortest_edge);
+    REQUIRE(stl.stats.bounding_diameter == expected.stats.bounding_diameter);
+    REQUIRE(std::string(stl.stats.header) == std::string(expected.stats.header));
+}
+
+SCENARIO( "TriangleMesh: reading ASCII STL files") {
+    GIVEN( "The ASCII STL files of the test inputs") {
+        THEN( "The facets and the statistics are the same as read by admesh.") {
+            for (const std::string name : { "test_trianglemesh/4486/100_000.stl", "test_trianglemesh/4486/10_000.stl" }) {
+                const std::string path = std::string(testfile_dir) + name;
+                TriangleMesh mesh;
+                mesh.ReadSTLFile(path);
+                stl_file expected;
+                stl_open(&expected, path.c_str());
+                REQUIRE(mesh.stl.stats.type == ascii);
+                require_same_stl(mesh.stl, expected);
+                stl_close(&expected);
+            }
+        }
+    }
+    GIVEN( "A sphere saved as ASCII STL, large enough to be parsed in several chunks") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 90)};
+        sphere.translate(-3.3, 4.7, 10.1);
+        const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.stl")).string();
+        sphere.write_ascii(path);
+        REQUIRE(boost::filesystem::file_size(path) > 4 * 65536);
+        WHEN( "it is read back with ReadSTLFile() and with stl_open()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            stl_file expected;
+            stl_open(&expected, path.c_str());
+            THEN( "the facets and the statistics are the same.") {
+                require_same_stl(mesh.stl, expected);
+            }
+            stl_close(&expected);
+        }
+        boost::filesystem::remove(path);
+    }
+    GIVEN( "An ASCII STL file with several solids and numbers in various formats") {
+        const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.stl")).string();
+        {
+            std::ofstream file(path);
+            file << "solid first part\n";
+            for (int i = 0; i < 10; ++i) {
+                file << " facet normal 0 -0 1\n  outer loop\n"
+                     << "   vertex 1.5 -0.000000 3e-2\n"
+                     << "   vertex +12345678901234567890 1.0000000000000000000001 0.1\n"
+                     << "   vertex 3.4028235e38 1.17549435E-38 -7.00000025\n"
+                     << "  endloop\n endfacet\n";
+                if (i == 4) file << "endsolid\nsolid\n";
+            }
+            file << "endsolid first part\n";
+        }
+        WHEN( "it is read back with ReadSTLFile() and with stl_open()") {
+            TriangleMesh mesh;
+            mesh.ReadSTLFile(path);
+            stl_file expected;
+            stl_open(&expected, path.c_str());
+            THEN( "the facets and the statistics are the same.") {
+                REQUIRE(expected.stats.number_of_facets == 10);
+                require_same_stl(mesh.stl, expected);
+            }
+            stl_close(&expected);
+        }
+        boost::filesystem::remove(path);
+    }
+}
+
+SCENARIO( "TriangleMesh: repair() matches the admesh passes") {
+    GIVEN( "A sphere with holes, flipped, degenerate, duplicated and moved facets") {
+        auto sphere {TriangleMesh::make_sphere(10, PI / 120)};
+        Pointf3s vertices {sphere.vertices()};
+        const Point3s sphere_facets {sphere.facets()};
+        Point3s facets;
+        for (size_t i = 0; i < sphere_facets.size(); ++i) {
+            Point3 f = sphere_facets[i];
+            if (i % 97 == 5) continue;
+            if (i % 7 == 3) std::swap(f.x, f.y);
+            if (i % 53 == 11) {
+                const Pointf3 &v = vertices[f.z];
+                vertices.push_back(Pointf3(v.x + 1e-4, v.y - 1e-4, v.z));
+                f.z = vertices.size() - 1;
+            }
+            facets.push_back(f);
+            if (i % 61 == 17) facets.push_back(Point3(f.x, f.x, f.y));
+            if (i % 89 == 23) facets.push_back(f);
+        }
+        TriangleMesh mesh(vertices, facets);
+        TriangleMesh reference(mesh);
+        WHEN( "it is repaired with repair() and with the admesh passes") {
+            mesh.repair();
+
+            stl_file &stl = reference.stl;
+            stl_check_facets_exact(&stl);
+            float tolerance = stl.stats.shortest_edge;
+            for (int i = 0; i < 2 && stl.stats.connected_facets_3_edge < stl.stats.number_of_facets; ++i) {
+                stl_check_facets_nearby(&stl, tolerance);
+                tolerance += stl.stats.bounding_diameter / 10000.0;
+            }
+            stl_repair(&stl, true, true, false, 0.0, false, 0.0, true, 10, true, true, true, true, false, 0);
+
+            THEN( "the mesh needed every kind of fix") {
+                REQUIRE(stl.stats.degenerate_facets > 0);
+                REQUIRE(stl.stats.edges_fixed > 0);
+                REQUIRE(stl.stats.facets_added > 0);
+                REQUIRE(stl.stats.facets_reversed > 0);
+                REQUIRE(stl.stats.normals_fixed > 0);
+            }
+            THEN( "the facets, the neighbors and the statistics are the same") {
+                REQUIRE(mesh.stl.stats.number_of_facets == stl.stats.number_of_facets);
+                // the facets added by stl_fill_holes() leave their extra bytes undefined
+                int different_facets = 0, different_neighbors = 0;
+                for (int i = 0; i < stl.stats.number_of_facets; ++i) {
+                    if (memcmp(&mesh.stl.facet_start[i], &stl.facet_start[i], 12 * sizeof(float)) != 0)
+                        ++different_facets;
+                    for (int j = 0; j < 3; ++j) {
+                        const stl_neighbors &n1 = mesh.stl.neighbors_start[i], &n2 = stl.neighbors_start[i];
+                        if (n1.neighbor[j] != n2.neighbor[j]
+                            || (n2.neighbor[j] != -1 && n1.which_vertex_not[j] != n2.which_vertex_not[j]))
+                            ++different_neighbors;
+                    }
+                }
+                REQUIRE(different_facets == 0);
+                REQUIRE(different_neighbors == 0);
+                REQUIRE(mesh.stl.stats.connected_edges == stl.stats.connected_edges);
+                REQUIRE(mesh.stl.stats.connected_facets_1_edge == stl.stats.connected_facets_1_edge);
+                REQUIRE(mesh.stl.stats.connected_facets_2_edge == stl.stats.connected_facets_2_edge);
+                REQUIRE(mesh.stl.stats.connected_facets_3_edge == stl.stats.connected_facets_3_edge);
+                REQUIRE(mesh.stl.stats.facets_w_1_bad_edge == stl.stats.facets_w_1_bad_edge);
+                REQUIRE(mesh.stl.stats.facets_w_2_bad_edge == stl.stats.facets_w_2_bad_edge);
+                REQUIRE(mesh.stl.stats.facets_w_3_bad_edge == stl.stats.facets_w_3_bad_edge);
+                REQUIRE(mesh.stl.stats.shortest_edge == stl.stats.shortest_edge);
+                REQUIRE(mesh.stl.stats.volume == stl.stats.volume);
+                const mesh_stats stats = mesh.stats();
+                REQUIRE(stats.number_of_parts == size_t(stl.stats.number_of_parts));
+                REQUIRE(stats.degenerate_facets == size_t(stl.stats.degenerate_facets));
+                REQUIRE(stats.edges_fixed == size_t(stl.stats.edges_fixed));
+                REQUIRE(stats.facets_removed == size_t(stl.stats.facets_removed));
+                REQUIRE(stats.facets_added == size_t(stl.stats.facets_added));
+                REQUIRE(stats.facets_reversed == size_t(stl.stats.facets_reversed));
+                REQUIRE(stats.backwards_edges == size_t(stl.stats.backwards_edges));
+                REQUIRE(stats.normals_fixed == size_t(stl.stats.normals_fixed));
+            }
+            THEN( "the time spent in the passes is reported") {
+                const mesh_repair_timings timings = mesh.stats().repair_timings;
+                REQUIRE(timings.check_exact > 0);
+                REQUIRE(timings.check_nearby > 0);
+                REQUIRE(timings.normal_directions > 0);
+                REQUIRE(timings.normal_values > 0);
+                REQUIRE(timings.volume > 0);
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMesh: indexed triangle set") {
+    GIVEN( "A 20mm cube") {
+        auto cube {TriangleMesh::make_cube(20, 20, 20)};
+        THEN( "The indexed triangle set is built by repair().") {
+            REQUIRE(cube.its.vertices.size() == 8);
+            REQUIRE(cube.its.indices.size() == 12);
+            REQUIRE(cube.stl.v_shared == nullptr);
+        }
+        THEN( "Every indexed facet has the vertices of the matching stl facet.") {
+            for (size_t i = 0; i < cube.its.indices.size(); ++i) {
+                for (int j = 0; j <= 2; ++j) {
+                    const stl_vertex &v = cube.its.vertices[cube.its.indices[i].vertex[j]];
+                    REQUIRE(v.x == cube.stl.facet_start[i].vertex[j].x);
+                    REQUIRE(v.y == cube.stl.facet_start[i].vertex[j].y);
+                    REQUIRE(v.z == cube.stl.facet_start[i].vertex[j].z);
+                }
+            }
+        }
+        WHEN( "The mesh is translated") {
+            cube.translate(5, 0, 0);
+            THEN( "The indexed triangle set is dropped.") {
+                REQUIRE(cube.its.empty());
+            }
+            THEN( "require_shared_vertices() rebuilds it with the new coordinates.") {
+                cube.require_shared_vertices();
+                REQUIRE(cube.its.vertices.size() == 8);
+                for (const stl_vertex &v : cube.its.vertices)
+                    REQUIRE((v.x == 5 || v.x == 25));
+            }
+        }
+        WHEN( "The mesh is copied") {
+            TriangleMesh copy {cube};
+            THEN( "The copy has the same indexed triangle set.") {
+                REQUIRE(copy.its.vertices.size() == cube.its.vertices.size());
+                REQUIRE(copy.its.indices.size() == cube.its.indices.size());
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMesh: AABB tree queries") {
+    GIVEN( "A sphere of radius 10") {
+        auto sphere {TriangleMesh::make_sphere(10, PI/60)};
+        WHEN( "The facets crossing 2 <= z <= 3 are queried") {
+            const std::vector<int> facets {sphere.facets_in_range(Z, 2, 3)};
+            THEN( "They are the ones a scan of all facets finds, in increasing order") {
+                std::vector<int> expected;
+                for (int i = 0; i < sphere.stl.stats.number_of_facets; ++i) {
+                    const stl_facet &f = sphere.stl.facet_start[i];
+                    const float min_z = std::min(f.vertex[0].z, std::min(f.vertex[1].z, f.vertex[2].z));
+                    const float max_z = std::max(f.vertex[0].z, std::max(f.vertex[1].z, f.vertex[2].z));
+                    if (max_z >= 2 && min_z <= 3) expected.push_back(i);
+                }
+                REQUIRE(!expected.empty());
+                REQUIRE(facets == expected);
+            }
+        }
+        WHEN( "A ray is cast from outside towards the center") {
+            Pointf3 hit;
+            const bool found {sphere.intersect_ray(Linef3(Pointf3(30, 1, 2), Pointf3(0, 1, 2)), &hit)};
+            THEN( "It hits the near side of the sphere") {
+                REQUIRE(found);
+                REQUIRE(hit.x > 9.5);
+                REQUIRE(hit.x < 10);
+                REQUIRE(hit.y == Approx(1));
+                REQUIRE(hit.z == Approx(2));
+            }
+        }
+    }
+    GIVEN( "A 20mm cube with one corner on the origin") {
+        auto cube {TriangleMesh::make_cube(20, 20, 20)};
+        WHEN( "A ray is cast down onto the top face") {
+            Pointf3 hit;
+            int facet_idx {-1};
+            const bool found {cube.intersect_ray(Linef3(Pointf3(5, 7, 50), Pointf3(5, 7, 40)), &hit, &facet_idx)};
+            THEN( "It hits the top face under the ray") {
+                REQUIRE(found);
+                REQUIRE(hit.x == Approx(5));
+                REQUIRE(hit.y == Approx(7));
+                REQUIRE(hit.z == Approx(20));
+                REQUIRE(cube.stl.facet_start[facet_idx].normal.z == Approx(1));
+            }
+        }
+        THEN( "Rays passing beside the cube or pointing away from it miss it") {
+            Pointf3 hit;
+            REQUIRE(!cube.intersect_ray(Linef3(Pointf3(30, 30, 50), Pointf3(30, 30, 40)), &hit));
+            REQUIRE(!cube.intersect_ray(Linef3(Pointf3(5, 7, 50), Pointf3(5, 7, 60)), &hit));
+        }
+        THEN( "The closest points lie on the nearest face, edge or corner") {
+            const Pointf3 below {cube.closest_point(Pointf3(5, 7, -3))};
+            REQUIRE(below.x == Approx(5));
+            REQUIRE(below.y == Approx(7));
+            REQUIRE(below.z == Approx(0));
+            const Pointf3 corner {cube.closest_point(Pointf3(25, 25, 25))};
+            REQUIRE(corner.x == Approx(20));
+            REQUIRE(corner.y == Approx(20));
+            REQUIRE(corner.z == Approx(20));
+        }
+        WHEN( "The mesh is translated after a query") {
+            cube.facets_in_range(Z, 0, 1);
+            cube.translate(0, 0, 100);
+            THEN( "The queries see the new coordinates") {
+                REQUIRE(cube.facets_in_range(Z, 0, 20).empty());
+                REQUIRE(cube.closest_point(Pointf3(5, 7, 0)).z == Approx(100));
+            }
+        }
+        WHEN( "The mesh is copied after a query") {
+            const AABBTree &tree {cube.aabb_tree()};
+            TriangleMesh copy {cube};
+            THEN( "The copy shares the tree") {
+                REQUIRE(&copy.aabb_tree() == &tree);
+            }
+        }
+    }
+}
+
+SCENARIO( "TriangleMesh: horizontal projection and convex hull") {
+    GIVEN( "A square frame made of four overlapping 10mm bars") {
+        TriangleMesh frame;
+        for (const Pointf3 &size : { Pointf3(30, 10, 10), Pointf3(10, 30, 10) }) {
+            for (double shift : { 0., 20. }) {
+                auto bar {TriangleMesh::make_cube(size.x, size.y, size.z)};
+                bar.translate(size.x > size.y ? 0 : shift, size.x > size.y ? shift : 0, 0);
+                frame.merge(bar);
+            }
+        }
+        frame.repair();
+        WHEN( "The horizontal projection is computed") {
+            const ExPolygons projection {frame.horizontal_projection()};
+            THEN( "It is the outline of the frame, with its hole") {
+                REQUIRE(projection.size() == 1);
+                REQUIRE(projection.front().holes.size() == 1);
+                REQUIRE(projection.front().area() * SCALING_FACTOR * SCALING_FACTOR == Approx(800).epsilon(0.01));
+            }
+        }
+        WHEN( "The convex hull is computed") {
+            const Polygon hull {frame.convex_hull()};
+            THEN( "It is the outer square") {
+                REQUIRE(hull.points.size() == 4);
+                REQUIRE(hull.area() * SCALING_FACTOR * SCALING_FACTOR == Approx(900));
+            }
+        }
+        WHEN( "The mesh is translated after computing them") {
+            frame.horizontal_projection();
+            frame.convex_hull();
+            frame.translate(100, 0, 0);
+            THEN( "They follow the mesh") {
+                REQUIRE(BoundingBox(frame.convex_hull().points).min.x == scale_(100));
+                REQUIRE(BoundingBox(frame.horizontal_projection().front().contour.points).min.x == Approx(scale_(100 - 0.01)).epsilon(0.001));
+            }
+        }
+    }
+    GIVEN( "A sphere of radius 10") {
+        auto sphere {TriangleMesh::make_sphere(10, PI/60)};
+        WHEN( "It is projected before and after its repair") {
+            TriangleMesh raw {sphere};
+            const ExPolygons from_facets {raw.horizontal_projection()};
+            sphere.repair();
+            const ExPolygons from_silhouette {sphere.horizontal_projection()};
+            THEN( "The footprints match") {
+                REQUIRE(from_facets.size() == 1);
+                REQUIRE(from_silhouette.size() == 1);
+                REQUIRE(from_silhouette.front().holes.empty());
+                REQUIRE(from_silhouette.front().area() == Approx(from_facets.front().area()).epsilon(0.001));
+            }
+        }
+        WHEN( "It is projected and split by several threads at once after being moved") {
+            sphere.repair();
+            sphere.translate(5, 0, 0);
+            std::vector<std::future<ExPolygons>> projections;
+            std::vector<std::future<size_t>> parts;
+            for (int i = 0; i < 4; ++i) {
+                projections.push_back(std::async(std::launch::async, [&sphere] () { return sphere.horizontal_projection(); }));
+                parts.push_back(std::async(std::launch::async, [&sphere] () {
+                    TriangleMeshPtrs meshes {sphere.split()};
+                    for (auto mesh : meshes) delete mesh;
+                    return meshes.size();
+                }));
+            }
+            THEN( "Every thread gets the footprint and the single part of the sphere") {
+                for (auto &projection : projections) {
+                    const ExPolygons footprint {projection.get()};
+                    REQUIRE(footprint.size() == 1);
+                    REQUIRE(footprint.front().area() * SCALING_FACTOR * SCALING_FACTOR == Approx(PI * 100).epsilon(0.01));
+                }
+                for (auto &count : parts)
+                    REQUIRE(count.get() == 1);
+            }
+        }
+    }
+}
+
 SCENARIO( "TriangleMesh: split functionality.") {
     GIVEN( "A 20mm cube with one corner on the origin") {
         const Pointf3s vertices { Pointf3(20,20,0), Pointf3(20,0,0), Pointf3(0,0,0), Pointf3(0,20,0), Pointf3(20,20,20), Pointf3(0,20,20), Pointf3(0,0,20), Pointf3(20,0,20) };
@@ -323,6 +891,27 @@ SCENARIO( "TriangleMesh: split functionality.") {
             }
         }
     }
+    GIVEN( "A row of 50 disjoint 10mm cubes merged into a single TriangleMesh") {
+        TriangleMesh row;
+        for (int i = 0; i < 50; ++i) {
+            auto cube {TriangleMesh::make_cube(10, 10, 10)};
+            cube.translate(i * 15, 0, 0);
+            row.merge(cube);
+        }
+        row.repair();
+        WHEN( "The mesh is split") {
+            auto meshes {row.split()};
+            THEN( "Every cube is a part, in the order of the merge") {
+                REQUIRE(meshes.size() == 50);
+                for (size_t i = 0; i < meshes.size(); ++i) {
+                    REQUIRE(meshes[i]->stats().number_of_facets == 12);
+                    REQUIRE(meshes[i]->bounding_box().min.x == Approx(i * 15));
+                    REQUIRE(meshes[i]->bounding_box().max.x == Approx(i * 15 + 10));
+                }
+            }
+            for (auto mesh : meshes) delete mesh;
+        }
+    }
 }
 
 SCENARIO( "TriangleMesh: Mesh merge functions") {
@@ -375,6 +964,24 @@ SCENARIO( "TriangleMeshSlicer: Cut behavior.") {
             }
         }
     }
+    GIVEN( "A sphere of radius 10") {
+        auto sphere {TriangleMesh::make_sphere(10, PI/60)};
+        WHEN( "It is cut along each axis") {
+            THEN( "The volumes of the halves add up to the volume of the sphere") {
+                auto coord = [](const Pointf3 &p, Axis axis) { return axis == X ? p.x : (axis == Y ? p.y : p.z); };
+                for (Axis axis : {X, Y, Z}) {
+                    TriangleMesh upper {};
+                    TriangleMesh lower {};
+                    sphere.cut(axis, 3.3, &upper, &lower);
+                    upper.repair();
+                    lower.repair();
+                    REQUIRE(upper.volume() + lower.volume() == Approx(sphere.volume()));
+                    REQUIRE(coord(upper.bounding_box().min, axis) == Approx(3.3));
+                    REQUIRE(coord(lower.bounding_box().max, axis) == Approx(3.3));
+                }
+            }
+        }
+    }
 }
 #ifdef TEST_PERFORMANCE
 TEST_CASE("Regression test for issue #4486 - files take forever to slice") {
@@ -0,0 +1,326 @@
+#include "AABBTree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace Slic3r {
+
+namespace {
+
+/// Facets per leaf: below this a node is cheaper to test facet by facet.
+const int LEAF_SIZE = 4;
+
+inline Pointf3
+to_pointf3(const stl_vertex &v)
+{
+    return Pointf3(v.x, v.y, v.z);
+}
+
+inline Pointf3
+sub(const Pointf3 &a, const Pointf3 &b)
+{
+    return Pointf3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+inline Pointf3
+cross(const Pointf3 &a, const Pointf3 &b)
+{
+    return Pointf3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+inline double
+dot(const Pointf3 &a, const Pointf3 &b)
+{
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+inline double
+coord(const Pointf3 &p, int axis)
+{
+    return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+}
+
+inline float
+coord(const stl_vertex &v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+/// Möller-Trumbore: position of the hit of the ray (origin, dir) with the
+/// triangle along the ray, or a negative value if it misses.
+double
+ray_triangle(const Pointf3 &origin, const Pointf3 &dir, const stl_facet &facet)
+{
+    const Pointf3 v0 = to_pointf3(facet.vertex[0]);
+    const Pointf3 e1 = sub(to_pointf3(facet.vertex[1]), v0);
+    const Pointf3 e2 = sub(to_pointf3(facet.vertex[2]), v0);
+    const Pointf3 p  = cross(dir, e2);
+    const double det = dot(e1, p);
+    if (det == 0) return -1;  // ray parallel to the facet or degenerate facet
+    const double inv_det = 1. / det;
+    const Pointf3 s = sub(origin, v0);
+    const double u = dot(s, p) * inv_det;
+    if (u < 0 || u > 1) return -1;
+    const Pointf3 q = cross(s, e1);
+    const double v = dot(dir, q) * inv_det;
+    if (v < 0 || u + v > 1) return -1;
+    return dot(e2, q) * inv_det;
+}
+
+/// Point of the triangle closest to p, after Ericson's Real-Time Collision
+/// Detection: find the Voronoi region of the triangle p falls in.
+Pointf3
+closest_on_triangle(const Pointf3 &p, const stl_facet &facet)
+{
+    const Pointf3 a = to_pointf3(facet.vertex[0]);
+    const Pointf3 b = to_pointf3(facet.vertex[1]);
+    const Pointf3 c = to_pointf3(facet.vertex[2]);
+    const Pointf3 ab = sub(b, a), ac = sub(c, a), ap = sub(p, a);
+
+    const double d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    const Pointf3 bp = sub(p, b);
+    const double d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+
+    const double vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        const double v = d1 / (d1 - d3);
+        return Pointf3(a.x + v*ab.x, a.y + v*ab.y, a.z + v*ab.z);
+    }
+
+    const Pointf3 cp = sub(p, c);
+    const double d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+
+    const double vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        const double w = d2 / (d2 - d6);
+        return Pointf3(a.x + w*ac.x, a.y + w*ac.y, a.z + w*ac.z);
+    }
+
+    const double va = d3*d6 - d5*d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        const double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return Pointf3(b.x + w*(c.x - b.x), b.y + w*(c.y - b.y), b.z + w*(c.z - b.z));
+    }
+
+    // inside the face region
+    const double denom = va + vb + vc;
+    if (denom == 0) return a;  // degenerate facet
+    const double v = vb / denom, w = vc / denom;
+    return Pointf3(a.x + ab.x*v + ac.x*w, a.y + ab.y*v + ac.y*w, a.z + ab.z*v + ac.z*w);
+}
+
+}
+
+AABBTree::AABBTree(const stl_file &stl)
+{
+    const int n = stl.stats.number_of_facets;
+    if (n == 0) return;
+
+    this->facet_boxes.resize(n);
+    this->facets.resize(n);
+    std::vector<Pointf3> centroids(n);
+    for (int i = 0; i < n; ++i) {
+        const stl_facet &facet = stl.facet_start[i];
+        Box &box = this->facet_boxes[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            const float a = coord(facet.vertex[0], axis);
+            const float b = coord(facet.vertex[1], axis);
+            const float c = coord(facet.vertex[2], axis);
+            box.min[axis] = std::min(a, std::min(b, c));
+            box.max[axis] = std::max(a, std::max(b, c));
+        }
+        centroids[i] = Pointf3(
+            (box.min[0] + box.max[0]) / 2.,
+            (box.min[1] + box.max[1]) / 2.,
+            (box.min[2] + box.max[2]) / 2.);
+        this->facets[i] = i;
+    }
+
+    // a binary tree with leaves of LEAF_SIZE facets has at most 2n/LEAF_SIZE nodes
+    this->nodes.reserve(2 * (n / LEAF_SIZE + 1));
+    this->build(centroids, 0, n);
+}
+
+int
+AABBTree::build(const std::vector<Pointf3> &centroids, int begin, int end)
+{
+    const int idx = this->nodes.size();
+    this->nodes.push_back(Node());
+
+    Box box;
+    std::fill(box.min, box.min + 3, std::numeric_limits<float>::max());
+    std::fill(box.max, box.max + 3, -std::numeric_limits<float>::max());
+    for (int i = begin; i < end; ++i) {
+        const Box &facet_box = this->facet_boxes[this->facets[i]];
+        for (int axis = 0; axis < 3; ++axis) {
+            box.min[axis] = std::min(box.min[axis], facet_box.min[axis]);
+            box.max[axis] = std::max(box.max[axis], facet_box.max[axis]);
+        }
+    }
+
+    int right = -1;
+    if (end - begin > LEAF_SIZE) {
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+            if (box.max[a] - box.min[a] > box.max[axis] - box.min[axis]) axis = a;
+
+        const int mid = begin + (end - begin) / 2;
+        std::nth_element(this->facets.begin() + begin, this->facets.begin() + mid, this->facets.begin() + end,
+            [&centroids, axis](int a, int b) { return coord(centroids[a], axis) < coord(centroids[b], axis); });
+
+        this->build(centroids, begin, mid);
+        right = this->build(centroids, mid, end);
+    }
+
+    // the children were pushed after this node, so it is only filled in now
+    Node &node = this->nodes[idx];
+    node.box   = box;
+    node.begin = begin;
+    node.end   = end;
+    node.right = right;
+    return idx;
+}
+
+std::vector<int>
+AABBTree::facets_in_range(Axis axis, float min, float max) const
+{
+    std::vector<int> out;
+    if (this->nodes.empty()) return out;
+
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node &node = this->nodes[stack.back()];
+        const int idx = stack.back();
+        stack.pop_back();
+        if (node.box.max[axis] < min || node.box.min[axis] > max) continue;
+
+        if (node.box.min[axis] >= min && node.box.max[axis] <= max) {
+            // all the facets of the node lie in the range
+            out.insert(out.end(), this->facets.begin() + node.begin, this->facets.begin() + node.end);
+        } else if (node.right == -1) {
+            for (int i = node.begin; i < node.end; ++i) {
+                const Box &box = this->facet_boxes[this->facets[i]];
+                if (box.max[axis] >= min && box.min[axis] <= max)
+                    out.push_back(this->facets[i]);
+            }
+        } else {
+            stack.push_back(node.right);
+            stack.push_back(idx + 1);
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+int
+AABBTree::intersect_ray(const stl_file &stl, const Linef3 &ray, double* t) const
+{
+    if (this->nodes.empty()) return -1;
+
+    const Pointf3 &origin = ray.a;
+    const Pointf3 dir = sub(ray.b, ray.a);
+    const double inv_dir[3] = { 1. / dir.x, 1. / dir.y, 1. / dir.z };
+    const double o[3] = { origin.x, origin.y, origin.z };
+
+    // position along the ray where it enters the box, or infinity if it misses it
+    auto enter = [&](const Box &box) {
+        double tmin = 0, tmax = std::numeric_limits<double>::infinity();
+        for (int axis = 0; axis < 3; ++axis) {
+            // fmin/fmax drop the NaN given by a ray lying in the plane of a side
+            const double t1 = (box.min[axis] - o[axis]) * inv_dir[axis];
+            const double t2 = (box.max[axis] - o[axis]) * inv_dir[axis];
+            tmin = std::max(tmin, std::fmin(t1, t2));
+            tmax = std::min(tmax, std::fmax(t1, t2));
+        }
+        return tmin <= tmax ? tmin : std::numeric_limits<double>::infinity();
+    };
+
+    int best_facet = -1;
+    double best_t = std::numeric_limits<double>::infinity();
+    std::vector<std::pair<double,int> > stack;
+    stack.push_back(std::make_pair(enter(this->nodes.front().box), 0));
+    while (!stack.empty()) {
+        const std::pair<double,int> entry = stack.back();
+        stack.pop_back();
+        if (entry.first >= best_t) continue;
+
+        const Node &node = this->nodes[entry.second];
+        if (node.right == -1) {
+            for (int i = node.begin; i < node.end; ++i) {
+                const double hit = ray_triangle(origin, dir, stl.facet_start[this->facets[i]]);
+                if (hit >= 0 && hit < best_t) {
+                    best_t = hit;
+                    best_facet = this->facets[i];
+                }
+            }
+        } else {
+            // visit the nearest child first, so that the farther one is likely pruned
+            std::pair<double,int> left (enter(this->nodes[entry.second + 1].box), entry.second + 1);
+            std::pair<double,int> right(enter(this->nodes[node.right].box), node.right);
+            if (left.first > right.first) std::swap(left, right);
+            if (right.first < best_t) stack.push_back(right);
+            if (left.first  < best_t) stack.push_back(left);
+        }
+    }
+
+    if (best_facet != -1 && t != NULL) *t = best_t;
+    return best_facet;
+}
+
+int
+AABBTree::closest_point(const stl_file &stl, const Pointf3 &point, Pointf3* closest) const
+{
+    if (this->nodes.empty()) return -1;
+
+    // squared distance from point to the box
+    auto distance2 = [&point](const Box &box) {
+        double d2 = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const double c = coord(point, axis);
+            const double d = std::max(0., std::max(box.min[axis] - c, c - box.max[axis]));
+            d2 += d*d;
+        }
+        return d2;
+    };
+
+    int best_facet = -1;
+    double best_d2 = std::numeric_limits<double>::infinity();
+    Pointf3 best_point;
+    std::vector<std::pair<double,int> > stack;
+    stack.push_back(std::make_pair(distance2(this->nodes.front().box), 0));
+    while (!stack.empty()) {
+        const std::pair<double,int> entry = stack.back();
+        stack.pop_back();
+        if (entry.first >= best_d2) continue;
+
+        const Node &node = this->nodes[entry.second];
+        if (node.right == -1) {
+            for (int i = node.begin; i < node.end; ++i) {
+                const Pointf3 p = closest_on_triangle(point, stl.facet_start[this->facets[i]]);
+                const Pointf3 v = sub(p, point);
+                const double d2 = dot(v, v);
+                if (d2 < best_d2) {
+                    best_d2 = d2;
+                    best_facet = this->facets[i];
+                    best_point = p;
+                }
+            }
+        } else {
+            std::pair<double,int> left (distance2(this->nodes[entry.second + 1].box), entry.second + 1);
+            std::pair<double,int> right(distance2(this->nodes[node.right].box), node.right);
+            if (left.first > right.first) std::swap(left, right);
+            if (right.first < best_d2) stack.push_back(right);
+            if (left.first  < best_d2) stack.push_back(left);
+        }
+    }
+
+    if (closest != NULL) *closest = best_point;
+    return best_facet;
+}
+
+}
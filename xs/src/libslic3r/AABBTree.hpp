@@ -0,0 +1,66 @@
+#ifndef slic3r_AABBTree_hpp_
+#define slic3r_AABBTree_hpp_
+
+#include "libslic3r.h"
+#include <admesh/stl.h>
+#include <vector>
+#include "Line.hpp"
+#include "Point.hpp"
+
+namespace Slic3r {
+
+/// \brief Bounding volume hierarchy over the facets of a mesh.
+/// Every node holds the axis aligned box of a contiguous range of facets; the
+/// nodes are stored depth first so that the left child of a node directly
+/// follows it. The tree only keeps the boxes: the queries needing the actual
+/// triangles take the stl_file the tree was built from.
+class AABBTree
+{
+    public:
+    /// Build the tree over the facets of stl, splitting every node at the
+    /// median of the facet centroids along its longest side.
+    explicit AABBTree(const stl_file &stl);
+
+    /// Number of facets indexed by the tree.
+    size_t size() const { return this->facet_boxes.size(); }
+
+    /// Indices of the facets whose extent along axis overlaps [min, max],
+    /// in increasing order.
+    std::vector<int> facets_in_range(Axis axis, float min, float max) const;
+
+    /// First facet hit by the ray starting at ray.a and going through ray.b.
+    /// \param t receives the position of the hit along the ray, 0 being ray.a and 1 ray.b.
+    /// \return the index of the facet, or -1 if the ray misses the mesh.
+    int intersect_ray(const stl_file &stl, const Linef3 &ray, double* t) const;
+
+    /// Facet closest to point.
+    /// \param closest receives the point of that facet closest to point.
+    /// \return the index of the facet, or -1 if the mesh is empty.
+    int closest_point(const stl_file &stl, const Pointf3 &point, Pointf3* closest) const;
+
+    private:
+    struct Box {
+        float min[3];
+        float max[3];
+    };
+    struct Node {
+        Box box;
+        /// Range of this->facets covered by the node.
+        int begin, end;
+        /// Index of the right child, -1 for leaves.
+        int right;
+    };
+
+    std::vector<Node> nodes;
+    /// Facet indices, ordered so that every node covers a contiguous range.
+    std::vector<int> facets;
+    /// Box of every facet, indexed by facet index.
+    std::vector<Box> facet_boxes;
+
+    /// Build the subtree covering facets[begin, end) and return its index.
+    int build(const std::vector<Pointf3> &centroids, int begin, int end);
+};
+
+}
+
+#endif
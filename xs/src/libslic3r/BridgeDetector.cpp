@@ -6,9 +6,9 @@
 namespace Slic3r {
 
 BridgeDetector::BridgeDetector(const ExPolygon &_expolygon, const ExPolygonCollection &_lower_slices,
-    coord_t _extrusion_width)
+    coord_t _extrusion_width, int _threads)
     : expolygon(_expolygon), extrusion_width(_extrusion_width),
-        resolution(PI/36.0), angle(-1)
+        resolution(PI/36.0), angle(-1), threads(_threads), cache(nullptr)
 {
     /*  outset our bridge by an arbitrary amount; we'll use this outer margin
         for detecting anchors */
@@ -59,6 +59,22 @@ BridgeDetector::detect_angle()
     // and there are no anchors available at the layer below.
     if (this->_edges.empty() || this->_anchors.empty()) return false;
     
+    bool found;
+    double angle;
+    if (this->cache != nullptr && this->cache->find(*this, &found, &angle)) {
+        if (found) this->angle = angle;
+        return found;
+    }
+    
+    found = this->_detect_angle();
+    if (this->cache != nullptr)
+        this->cache->insert(*this, found, this->angle);
+    return found;
+}
+
+bool
+BridgeDetector::_detect_angle()
+{
     /*  Outset the bridge expolygon by half the amount we used for detecting anchors;
         we'll use this one to clip our test lines and be sure that their endpoints
         are inside the anchors and not on their contours leading to false negatives. */
@@ -106,9 +122,11 @@ BridgeDetector::detect_angle()
             candidates.push_back(BridgeDirection(angle));
     }
     
+    // evaluate the candidates in parallel, each one rotating its own copy
+    // of the clip area and anchors
     const coord_t line_increment = this->extrusion_width;
-    bool have_coverage = false;
-    for (BridgeDirection &candidate : candidates) {
+    parallelize<size_t>(0, candidates.size() - 1, [&](size_t i) {
+        BridgeDirection &candidate = candidates[i];
         Polygons my_clip_area = clip_area;
         ExPolygons my_anchors = this->_anchors;
         
@@ -146,15 +164,16 @@ BridgeDetector::detect_angle()
                 offset((Polyline)line, +this->extrusion_width/2)
             ));
         }
-        if (candidate.coverage > 0) have_coverage = true;
-        
         #if 0
         std::cout << "angle = "  << Slic3r::Geometry::rad2deg(candidate.angle)
             << "; coverage = "   << candidate.coverage
             << "; max_length = " << candidate.max_length
             << std::endl;
         #endif
-    }
+    }, this->threads);
+    
+    const bool have_coverage = std::any_of(candidates.begin(), candidates.end(),
+        [](const BridgeDirection &candidate) { return candidate.coverage > 0; });
     
     // if no direction produced coverage, then there's no bridge direction
     if (!have_coverage) return false;
@@ -303,4 +322,83 @@ BridgeDetector::unsupported_edges(double angle) const
     */
 }
 
+bool
+BridgeAngleCache::find(const BridgeDetector &bd, bool* found, double* angle) const
+{
+    const uint64_t key = BridgeAngleCache::hash(bd);
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    const auto range = this->entries.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (!BridgeAngleCache::matches(it->second, bd)) continue;
+        *found = it->second.found;
+        *angle = it->second.angle;
+        return true;
+    }
+    return false;
+}
+
+void
+BridgeAngleCache::insert(const BridgeDetector &bd, bool found, double angle)
+{
+    Entry entry { bd.expolygon, bd._anchors, bd._edges, bd.extrusion_width, bd.resolution, found, angle };
+    const uint64_t key = BridgeAngleCache::hash(bd);
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    const auto range = this->entries.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+        if (BridgeAngleCache::matches(it->second, bd)) return;
+    this->entries.insert(std::make_pair(key, std::move(entry)));
+}
+
+size_t
+BridgeAngleCache::size() const
+{
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return this->entries.size();
+}
+
+uint64_t
+BridgeAngleCache::hash(const BridgeDetector &bd)
+{
+    uint64_t hash = hash_value(bd.extrusion_width);
+    hash = hash_value(bd.resolution, hash);
+    const auto hash_points = [&hash](const Points &points) {
+        hash = hash_value(points.size(), hash);
+        for (const Point &p : points) {
+            hash = hash_value(p.x, hash);
+            hash = hash_value(p.y, hash);
+        }
+    };
+    for (const Polygon &p : (Polygons)bd.expolygon)
+        hash_points(p.points);
+    for (const ExPolygon &e : bd._anchors)
+        for (const Polygon &p : (Polygons)e)
+            hash_points(p.points);
+    for (const Polyline &p : bd._edges)
+        hash_points(p.points);
+    return hash;
+}
+
+bool
+BridgeAngleCache::matches(const Entry &entry, const BridgeDetector &bd)
+{
+    const auto same = [](const Polygons &a, const Polygons &b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i)
+            if (a[i].points != b[i].points) return false;
+        return true;
+    };
+    if (entry.extrusion_width != bd.extrusion_width || entry.resolution != bd.resolution
+        || entry.anchors.size() != bd._anchors.size() || entry.edges.size() != bd._edges.size())
+        return false;
+    if (!same(entry.expolygon, bd.expolygon))
+        return false;
+    for (size_t i = 0; i < entry.anchors.size(); ++i)
+        if (!same(entry.anchors[i], bd._anchors[i]))
+            return false;
+    for (size_t i = 0; i < entry.edges.size(); ++i)
+        if (entry.edges[i].points != bd._edges[i].points)
+            return false;
+    return true;
+}
+
 }
@@ -4,10 +4,14 @@
 #include "libslic3r.h"
 #include "ExPolygon.hpp"
 #include "ExPolygonCollection.hpp"
+#include <map>
 #include <string>
+#include <boost/thread.hpp>
 
 namespace Slic3r {
 
+class BridgeAngleCache;
+
 class BridgeDetector {
 public:
     /// The non-grown hole.
@@ -20,8 +24,13 @@ public:
     double resolution;
     /// The final optimal angle.
     double angle;
+    /// Number of threads evaluating the candidate angles, usually PrintConfig::threads.
+    int threads;
+    /// Outcomes of detect_angle() for other bridges, if any.
+    BridgeAngleCache* cache;
     
-    BridgeDetector(const ExPolygon &_expolygon, const ExPolygonCollection &_lower_slices, coord_t _extrusion_width);
+    BridgeDetector(const ExPolygon &_expolygon, const ExPolygonCollection &_lower_slices, coord_t _extrusion_width,
+        int _threads);
     bool detect_angle();
     Polygons coverage() const;
     Polygons coverage(double angle) const;
@@ -31,6 +40,11 @@ public:
     Polylines unsupported_edges(double angle = -1) const;
     
 private:
+    friend class BridgeAngleCache;
+
+    /// Brute force search of the best bridging angle.
+    bool _detect_angle();
+
     /// Open lines representing the supporting edges.
     Polylines _edges;
     /// Closed polygons representing the supporting areas.
@@ -50,6 +64,35 @@ private:
     };
 };
 
+/// Outcomes of BridgeDetector::detect_angle() by bridge geometry: identical
+/// bridges over identical anchors, like those of consecutive layers of a
+/// prismatic part, are only evaluated once. Safe to share between threads.
+class BridgeAngleCache
+{
+    public:
+    /// Set found and angle to the outcome of detect_angle() for a bridge
+    /// like bd's. Returns false if there is none yet.
+    bool find(const BridgeDetector &bd, bool* found, double* angle) const;
+    void insert(const BridgeDetector &bd, bool found, double angle);
+    size_t size() const;
+
+    private:
+    struct Entry {
+        ExPolygon expolygon;
+        ExPolygons anchors;
+        Polylines edges;
+        coord_t extrusion_width;
+        double resolution;
+        bool found;
+        double angle;
+    };
+    static uint64_t hash(const BridgeDetector &bd);
+    static bool matches(const Entry &entry, const BridgeDetector &bd);
+
+    mutable boost::mutex mutex;
+    std::multimap<uint64_t, Entry> entries;
+};
+
 }
 
 #endif
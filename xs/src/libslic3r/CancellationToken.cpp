@@ -0,0 +1,34 @@
+#include "CancellationToken.hpp"
+
+namespace Slic3r {
+
+namespace {
+
+thread_local const CancellationToken* current_token = nullptr;
+
+}
+
+const CancellationToken*
+CancellationToken::current()
+{
+    return current_token;
+}
+
+void
+CancellationToken::check_current()
+{
+    if (current_token != nullptr) current_token->check();
+}
+
+CancellationScope::CancellationScope(const CancellationToken* token)
+    : previous(current_token)
+{
+    current_token = token;
+}
+
+CancellationScope::~CancellationScope()
+{
+    current_token = this->previous;
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef slic3r_CancellationToken_hpp_
+#define slic3r_CancellationToken_hpp_
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace Slic3r {
+
+/// Thrown by the per-layer loops of an operation whose token was cancelled.
+class CancelledError : public std::runtime_error
+{
+    public:
+    CancelledError() : std::runtime_error("The operation was cancelled") {}
+};
+
+/// Cooperative cancellation flag: the caller of a long operation keeps a
+/// copy and may cancel() it from any thread, while the operation checks it
+/// between the layers it processes. Copies share the same flag.
+/// The token made current by a CancellationScope is handed over to the
+/// threads of ThreadPool::parallel_for(), so every parallelize() loop run
+/// on behalf of the operation checks it before each item.
+class CancellationToken
+{
+    public:
+    CancellationToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { *this->flag = true; }
+    bool is_cancelled() const { return *this->flag; }
+    /// Throw CancelledError if cancel() was called.
+    void check() const { if (this->is_cancelled()) throw CancelledError(); }
+
+    /// The token of the innermost CancellationScope of the calling thread,
+    /// if any.
+    static const CancellationToken* current();
+    /// check() the current token, if any.
+    static void check_current();
+
+    private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+/// Make a token the current one of the calling thread for the lifetime of
+/// the scope. A null token clears it.
+class CancellationScope
+{
+    public:
+    explicit CancellationScope(const CancellationToken* token);
+    ~CancellationScope();
+
+    private:
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+    const CancellationToken* previous;
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "ConfigBase.hpp"
 #include "Log.hpp"
+#include <algorithm>
 #include <assert.h>
 #include <ctime>
 #include <fstream>
@@ -433,6 +434,21 @@ ConfigBase::diff(const ConfigBase &other) const {
     return diff;
 }
 
+uint64_t
+ConfigBase::hash() const {
+    t_config_option_keys keys = this->keys();
+    std::sort(keys.begin(), keys.end());
+    
+    uint64_t hash = hash_value(keys.size());
+    for (const t_config_option_key &opt_key : keys) {
+        const std::string value = this->serialize(opt_key);
+        // the lengths keep "a" "bc" apart from "ab" "c"
+        hash = hash_value(opt_key.size(), hash_bytes(opt_key.data(), opt_key.size(), hash));
+        hash = hash_value(value.size(), hash_bytes(value.data(), value.size(), hash));
+    }
+    return hash;
+}
+
 std::string
 ConfigBase::serialize(const t_config_option_key &opt_key) const {
     const ConfigOption* opt = this->option(opt_key);
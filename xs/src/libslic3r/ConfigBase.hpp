@@ -796,6 +796,9 @@ class ConfigBase
     void apply_only(const ConfigBase &other, const t_config_option_keys &opt_keys, bool ignore_nonexistent = false, bool default_nonexistent = false);
     bool equals(const ConfigBase &other) const;
     t_config_option_keys diff(const ConfigBase &other) const;
+    /// Stable hash of the serialized options, in key order: configs that
+    /// are equal() over the same keys hash the same.
+    uint64_t hash() const;
     std::string serialize(const t_config_option_key &opt_key) const;
     bool set_deserialize(t_config_option_key opt_key, std::string str, bool append = false);
     void set_deserialize_throw(t_config_option_key opt_key, std::string str, bool append = false);
@@ -48,7 +48,10 @@ class Extruder
     double retract_restart_extra_toolchange() const;
     
     private:
+    /// Points to the config of the GCodeWriter owning this extruder.
     GCodeConfig *config;
+    
+    friend class GCodeWriter;
 };
 
 }
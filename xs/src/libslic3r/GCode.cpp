@@ -1,7 +1,9 @@
 #include "GCode.hpp"
 #include "ExtrusionEntity.hpp"
+#include "GCodeFormatter.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <math.h>
 
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
@@ -9,32 +11,20 @@
 namespace Slic3r {
 
 AvoidCrossingPerimeters::AvoidCrossingPerimeters()
-    : use_external_mp(false), use_external_mp_once(false), disable_once(true),
-        _external_mp(NULL), _layer_mp(NULL)
+    : use_external_mp(false), use_external_mp_once(false), disable_once(true)
 {
 }
 
-AvoidCrossingPerimeters::~AvoidCrossingPerimeters()
-{
-    delete this->_external_mp;
-    
-    delete this->_layer_mp;
-}
-
 void
 AvoidCrossingPerimeters::init_external_mp(const ExPolygons &islands)
 {
-    delete this->_external_mp;
-    
-    this->_external_mp = new MotionPlanner(islands);
+    this->_external_mp = std::make_shared<MotionPlanner>(islands);
 }
 
 void
 AvoidCrossingPerimeters::init_layer_mp(const ExPolygons &islands)
 {
-    delete this->_layer_mp;
-    
-    this->_layer_mp = new MotionPlanner(islands);
+    this->_layer_mp = std::make_shared<MotionPlanner>(islands);
 }
 
 Polyline
@@ -176,8 +166,9 @@ Wipe::wipe(GCode &gcodegen, bool toolchange)
             /*  Reduce retraction length a bit to avoid effective retraction speed to be greater than the configured one
                 due to rounding (TODO: test and/or better math for this)  */
             double dE = length * (segment_length / wipe_dist) * 0.95;
-            gcode += gcodegen.writer.set_speed(wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
-            gcode += gcodegen.writer.extrude_to_xy(
+            gcodegen.writer.set_speed(&gcode, wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
+            gcodegen.writer.extrude_to_xy(
+                &gcode,
                 gcodegen.point_to_gcode(line->b),
                 -dE,
                 "wipe and retract"
@@ -199,7 +190,7 @@ GCode::GCode()
     : placeholder_parser(NULL), enable_loop_clipping(true), enable_cooling_markers(false), layer_count(0),
         layer_index(-1), layer(NULL), first_layer(false), elapsed_time(0.0),
         elapsed_time_bridges(0.0), elapsed_time_external(0.0), volumetric_speed(0),
-        _last_pos_defined(false)
+        region(NULL), _extrusion_length(0), _last_pos_defined(false)
 {
 }
 
@@ -229,6 +220,91 @@ GCode::apply_print_config(const PrintConfig &print_config)
     this->config.apply(print_config);
 }
 
+void
+GCode::apply_region_config(const PrintRegion &region)
+{
+    this->config.apply(region.config);
+    this->region = &region;
+}
+
+GCodeTotals
+GCode::take_totals()
+{
+    GCodeTotals totals;
+    std::swap(totals.cog, this->_cog);
+    std::swap(totals.extrusion_length, this->_extrusion_length);
+    std::swap(totals.elapsed_time, this->elapsed_time);
+    std::swap(totals.elapsed_time_bridges, this->elapsed_time_bridges);
+    std::swap(totals.elapsed_time_external, this->elapsed_time_external);
+    std::swap(totals.cooling_moves, this->cooling_moves);
+    for (auto &pair : this->writer.extruders) {
+        totals.absolute_E[pair.first] = pair.second.absolute_E;
+        pair.second.absolute_E = 0;
+    }
+    return totals;
+}
+
+void
+GCode::add_totals(const GCodeTotals &totals)
+{
+    this->_cog.x += totals.cog.x;
+    this->_cog.y += totals.cog.y;
+    this->_cog.z += totals.cog.z;
+    this->_extrusion_length      += totals.extrusion_length;
+    this->elapsed_time           += totals.elapsed_time;
+    this->elapsed_time_bridges   += totals.elapsed_time_bridges;
+    this->elapsed_time_external  += totals.elapsed_time_external;
+    // the moves of totals came first
+    this->cooling_moves.insert(this->cooling_moves.begin(), totals.cooling_moves.begin(), totals.cooling_moves.end());
+    for (const auto &pair : totals.absolute_E) {
+        auto extruder = this->writer.extruders.find(pair.first);
+        if (extruder != this->writer.extruders.end())
+            extruder->second.absolute_E += pair.second;
+    }
+}
+
+bool
+GCode::same_state(const GCode &other) const
+{
+    const AvoidCrossingPerimeters &acp = this->avoid_crossing_perimeters;
+    const AvoidCrossingPerimeters &other_acp = other.avoid_crossing_perimeters;
+    return this->origin.x == other.origin.x
+        && this->origin.y == other.origin.y
+        && this->region == other.region
+        && this->writer.same_state(other.writer)
+        && this->wipe.enable == other.wipe.enable
+        && this->wipe.path.points == other.wipe.path.points
+        && acp.use_external_mp == other_acp.use_external_mp
+        && acp.use_external_mp_once == other_acp.use_external_mp_once
+        && acp.disable_once == other_acp.disable_once
+        && this->enable_loop_clipping == other.enable_loop_clipping
+        && this->enable_cooling_markers == other.enable_cooling_markers
+        && this->layer_count == other.layer_count
+        && this->layer_index == other.layer_index
+        && this->layer == other.layer
+        && this->_seam_position == other._seam_position
+        && this->first_layer == other.first_layer
+        && this->volumetric_speed == other.volumetric_speed
+        && this->_last_pos_defined == other._last_pos_defined
+        && this->_last_pos == other._last_pos;
+}
+
+void
+GCode::take_over(const GCode &other)
+{
+    const GCodeTotals totals = this->take_totals();
+    PlaceholderParser* placeholder_parser = this->placeholder_parser;
+    const unsigned int fan_speed = this->writer.get_fan_speed();
+    
+    *this = other;
+    this->placeholder_parser = placeholder_parser;
+    if (placeholder_parser != NULL && other.placeholder_parser != NULL)
+        *placeholder_parser = *other.placeholder_parser;
+    // only remember the speed, the fan was left alone by other
+    this->writer.set_fan(fan_speed);
+    this->add_totals(totals);
+}
+
 void
 GCode::set_origin(const Pointf &pointf)
 {    
@@ -426,8 +502,14 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
     if (paths.back().role == erExternalPerimeter && this->layer != NULL && this->config.perimeters > 1) {
         // detect angle between last and first segment
         // the side depends on the original winding order of the polygon (left for contours, right for holes)
+        // the last path may be too short to hold the point, which is then
+        // taken from the loop as a whole
+        Points tail;
+        for (ExtrusionPaths::const_reverse_iterator path = paths.rbegin(); path != paths.rend() && tail.size() < 3; ++path)
+            for (Points::const_reverse_iterator p = path->polyline.points.rbegin(); p != path->polyline.points.rend() && tail.size() < 3; ++p)
+                if (tail.empty() || *p != tail.back()) tail.push_back(*p);
         Point a = paths.front().polyline.points[1];  // second point
-        Point b = *(paths.back().polyline.points.end()-3);       // second to last point
+        Point b = tail[std::min<size_t>(2, tail.size() - 1)];  // second to last point
         if (was_clockwise) {
             // swap points
             Point c = a; a = b; b = c;
@@ -570,7 +652,15 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
         gcode += ";_BRIDGE_FAN_START\n";
     std::string comment = ";_EXTRUDE_SET_SPEED";
     if (path.role == erExternalPerimeter) comment += ";_EXTERNAL_PERIMETER";
-    gcode += this->writer.set_speed(F, "", this->enable_cooling_markers ? comment : "");
+    const size_t set_speed = gcode.size();
+    this->writer.set_speed(&gcode, F, "", this->enable_cooling_markers ? comment : "");
+    CoolingMove move;
+    if (this->enable_cooling_markers) {
+        move.size = gcode.size() - set_speed - std::strlen("G1 F") - comment.size() - 1;
+        move.role = path.role;
+        move.feedrate = GCodeFormatter::rounded(F, 3);
+        move.adjustable = !path.is_bridge();
+    }
     Pointf start;
     double path_length = 0;
     {
@@ -585,7 +675,8 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
             this->_cog.z += this->writer.get_position().z * line_length;
             this->_extrusion_length += line_length;
 
-            gcode += this->writer.extrude_to_xy(
+            this->writer.extrude_to_xy(
+                &gcode,
                 this->point_to_gcode(line->b),
                 e_per_mm * line_length,
                 comment
@@ -598,6 +689,10 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
     }
     if (path.is_bridge() && this->enable_cooling_markers)
         gcode += ";_BRIDGE_FAN_END\n";
+    if (this->enable_cooling_markers) {
+        move.length = path_length;
+        this->cooling_moves.push_back(move);
+    }
     
     this->set_last_pos(path.last_point());
     
@@ -648,7 +743,7 @@ GCode::travel_to(const Point &point, ExtrusionRole role, std::string comment)
     // use G1 because we rely on paths being straight (G0 may make round paths)
     Lines lines = travel.lines();
     for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line)
-        gcode += this->writer.travel_to_xy(this->point_to_gcode(line->b), comment);
+        this->writer.travel_to_xy(&gcode, this->point_to_gcode(line->b), comment);
     
     /*  While this makes the estimate more accurate, CoolingBuffer calculates the slowdown
         factor on the whole elapsed time but only alters non-travel moves, thus the resulting
@@ -707,11 +802,15 @@ GCode::retract(bool toolchange)
         (the extruder might be already retracted fully or partially). We call these 
         methods even if we performed wipe, since this will ensure the entire retraction
         length is honored in case wipe path was too short.  */
-    gcode += toolchange ? this->writer.retract_for_toolchange() : this->writer.retract();
+    if (toolchange) {
+        this->writer.retract_for_toolchange(&gcode);
+    } else {
+        this->writer.retract(&gcode);
+    }
     if (!(FLAVOR_IS(gcfSmoothie) && this->config.use_firmware_retraction))
-        gcode += this->writer.reset_e();
+        this->writer.reset_e(&gcode);
     if (this->writer.extruder()->retract_length() > 0 || this->config.use_firmware_retraction)
-        gcode += this->writer.lift();
+        this->writer.lift(&gcode);
     
     return gcode;
 }
@@ -720,8 +819,8 @@ std::string
 GCode::unretract()
 {
     std::string gcode;
-    gcode += this->writer.unlift();
-    gcode += this->writer.unretract();
+    this->writer.unlift(&gcode);
+    this->writer.unretract(&gcode);
     return gcode;
 }
 
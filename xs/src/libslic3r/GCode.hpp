@@ -11,6 +11,8 @@
 #include "Print.hpp"
 #include "PrintConfig.hpp"
 #include "ConditionalGCode.hpp"
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
@@ -31,14 +33,14 @@ class AvoidCrossingPerimeters {
     bool disable_once;
     
     AvoidCrossingPerimeters();
-    ~AvoidCrossingPerimeters();
     void init_external_mp(const ExPolygons &islands);
     void init_layer_mp(const ExPolygons &islands);
     Polyline travel_to(GCode &gcodegen, Point point);
     
     private:
-    MotionPlanner* _external_mp;
-    MotionPlanner* _layer_mp;
+    // shared by the copies of a GCode, see MotionPlanner::shortest_path()
+    std::shared_ptr<MotionPlanner> _external_mp;
+    std::shared_ptr<MotionPlanner> _layer_mp;
 };
 
 class OozePrevention {
@@ -65,6 +67,42 @@ class Wipe {
     std::string wipe(GCode &gcodegen, bool toolchange = false);
 };
 
+/// A feed rate set by GCode::_extrude() along with a cooling marker, recorded
+/// so that CoolingBuffer can slow the extrusion down without parsing the G-code.
+class CoolingMove {
+    public:
+    /// Where the feed rate is written in the G-code buffered by CoolingBuffer,
+    /// which finds it from the marker following it.
+    size_t offset;
+    /// Count of characters of the feed rate, which is written between "G1 F"
+    /// and the marker.
+    size_t size;
+    ExtrusionRole role;
+    double feedrate; // mm/min, as written
+    double length; // mm extruded at this feed rate
+    /// Whether the feed rate may be lowered to cool the layer down, which
+    /// bridges are not.
+    bool adjustable;
+    
+    CoolingMove()
+        : offset(0), size(0), role(erNone), feedrate(0), length(0), adjustable(false) {};
+};
+
+/// Running totals of a GCode, which unlike the rest of its state have no
+/// effect on the G-code it writes.
+class GCodeTotals {
+    public:
+    Pointf3 cog;
+    float extrusion_length;
+    float elapsed_time, elapsed_time_bridges, elapsed_time_external;
+    std::map<unsigned int,double> absolute_E;
+    std::vector<CoolingMove> cooling_moves;
+    
+    GCodeTotals()
+        : extrusion_length(0), elapsed_time(0), elapsed_time_bridges(0),
+            elapsed_time_external(0) {};
+};
+
 class GCode {
     public:
     
@@ -93,13 +131,33 @@ class GCode {
     // it does not account for wipe, retract / unretract moves.
     // second it does not account for the velocity profiles of the printer.
     float elapsed_time, elapsed_time_bridges, elapsed_time_external; // seconds
+    // Feed rates set with a cooling marker since CoolingBuffer took the last ones.
+    std::vector<CoolingMove> cooling_moves;
     double volumetric_speed;
+    // Region whose config was applied last over config, see apply_region_config().
+    const PrintRegion* region;
     
     GCode();
     const Point& last_pos() const;
     void set_last_pos(const Point &pos);
     bool last_pos_defined() const;
     void apply_print_config(const PrintConfig &print_config);
+    void apply_region_config(const PrintRegion &region);
+    
+    /// Zero the running totals and return what they were.
+    GCodeTotals take_totals();
+    void add_totals(const GCodeTotals &totals);
+    /// Whether this generator would go on writing the same G-code as other,
+    /// given the same placeholder parser. The running totals and the fan
+    /// speed are left aside, and config is assumed to only differ by the
+    /// object and region applied last; the object one is applied again
+    /// before each layer.
+    bool same_state(const GCode &other) const;
+    /// Carry on from the state other ended up in, having started from the
+    /// same state as this one with its totals taken. The placeholder parser
+    /// is updated, while the fan speed, which CoolingBuffer drives through
+    /// this generator, is kept.
+    void take_over(const GCode &other);
 
     /// Template function.
     template <typename Iter>
@@ -0,0 +1,121 @@
+#include "ChunkedGCode.hpp"
+#include <algorithm>
+
+namespace Slic3r {
+
+void
+ChunkedGCode::push(std::vector<Chunk>* chunks, const std::shared_ptr<const std::string> &text, size_t begin, size_t end)
+{
+    if (begin >= end) return;
+    if (!chunks->empty() && chunks->back().text == text && chunks->back().end == begin) {
+        chunks->back().end = end;
+    } else {
+        chunks->push_back(Chunk { text, begin, end });
+    }
+}
+
+void
+ChunkedGCode::append(std::string text)
+{
+    if (text.empty()) return;
+    const size_t size = text.size();
+    push(&this->_chunks, std::make_shared<const std::string>(std::move(text)), 0, size);
+}
+
+void
+ChunkedGCode::append(ChunkedGCode other)
+{
+    if (this->_chunks.empty()) {
+        this->_chunks = std::move(other._chunks);
+        return;
+    }
+    this->_chunks.reserve(this->_chunks.size() + other._chunks.size());
+    for (Chunk &chunk : other._chunks)
+        push(&this->_chunks, chunk.text, chunk.begin, chunk.end);
+}
+
+void
+ChunkedGCode::prepend(std::string text)
+{
+    if (text.empty()) return;
+    const size_t size = text.size();
+    this->_chunks.insert(this->_chunks.begin(), Chunk { std::make_shared<const std::string>(std::move(text)), 0, size });
+}
+
+size_t
+ChunkedGCode::size() const
+{
+    size_t size = 0;
+    for (const Chunk &chunk : this->_chunks)
+        size += chunk.size();
+    return size;
+}
+
+bool
+ChunkedGCode::matches(size_t chunk, size_t pos, const std::string &text) const
+{
+    size_t matched = 0;
+    for (; chunk < this->_chunks.size() && matched < text.size(); ++chunk, pos = 0) {
+        const Chunk &c = this->_chunks[chunk];
+        const size_t size = std::min(c.size() - pos, text.size() - matched);
+        if (std::memcmp(c.data() + pos, text.data() + matched, size) != 0)
+            return false;
+        matched += size;
+    }
+    return matched == text.size();
+}
+
+void
+ChunkedGCode::patch(const std::vector<Patch> &patches)
+{
+    if (patches.empty()) return;
+    std::vector<Chunk> patched;
+    patched.reserve(this->_chunks.size() + 2 * patches.size());
+    // the texts of the patches, written one after the other
+    const auto texts = std::make_shared<std::string>();
+    auto push_text = [&patched, &texts] (const std::string &text) {
+        const size_t begin = texts->size();
+        texts->append(text);
+        push(&patched, texts, begin, texts->size());
+    };
+
+    // offset of the chunk, and end of the last patch, which may be in a following chunk
+    size_t offset = 0, skipped = 0;
+    std::vector<Patch>::const_iterator patch = patches.begin();
+    for (const Chunk &chunk : this->_chunks) {
+        const size_t end = offset + chunk.size();
+        size_t kept = std::max(offset, skipped);
+        for (; patch != patches.end() && patch->offset < end; ++patch) {
+            if (patch->offset > kept)
+                push(&patched, chunk.text, chunk.begin + (kept - offset), chunk.begin + (patch->offset - offset));
+            push_text(patch->text);
+            kept = skipped = patch->offset + patch->size;
+        }
+        if (kept < end)
+            push(&patched, chunk.text, chunk.begin + (kept - offset), chunk.end);
+        offset = end;
+    }
+    // the patches at the very end
+    for (; patch != patches.end(); ++patch)
+        push_text(patch->text);
+    this->_chunks = std::move(patched);
+}
+
+std::string
+ChunkedGCode::str() const
+{
+    std::string text;
+    text.reserve(this->size());
+    for (const Chunk &chunk : this->_chunks)
+        text.append(chunk.data(), chunk.size());
+    return text;
+}
+
+void
+ChunkedGCode::write(std::ostream &out) const
+{
+    for (const Chunk &chunk : this->_chunks)
+        out.write(chunk.data(), chunk.size());
+}
+
+}
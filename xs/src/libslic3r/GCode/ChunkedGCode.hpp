@@ -0,0 +1,204 @@
+#ifndef slic3r_ChunkedGCode_hpp_
+#define slic3r_ChunkedGCode_hpp_
+
+#include "libslic3r.h"
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/*
+G-code text kept as a list of chunks, as it is passed along the filters of the export.
+Appending a layer moves its string in and editing some lines only cuts the chunks around
+them, so that the text of a layer is never copied as a whole. The edited lines are
+written to a string shared by the chunks cut out of it.
+*/
+
+class ChunkedGCode {
+    public:
+    /// Characters [begin, end) of a string shared by the chunks cut out of it.
+    struct Chunk {
+        std::shared_ptr<const std::string> text;
+        size_t begin;
+        size_t end;
+
+        const char* data() const { return this->text->data() + this->begin; };
+        size_t size() const { return this->end - this->begin; };
+    };
+
+    /// Text replacing size characters from offset, counted from the start of the text.
+    struct Patch {
+        size_t offset;
+        size_t size;
+        std::string text;
+    };
+
+    ChunkedGCode() {};
+    explicit ChunkedGCode(std::string text) { this->append(std::move(text)); };
+
+    void append(std::string text);
+    void append(ChunkedGCode other);
+    void prepend(std::string text);
+    void clear() { this->_chunks.clear(); };
+    bool empty() const { return this->_chunks.empty(); };
+    size_t size() const;
+    const std::vector<Chunk>& chunks() const { return this->_chunks; };
+
+    /// A copy of the whole text, for the callers which need a string.
+    std::string str() const;
+    /// Write the chunks one after the other to out.
+    void write(std::ostream &out) const;
+
+    /// Call visit(begin, end) on every line, without its '\n'.
+    template <typename Visit>
+    void for_each_line(Visit visit) const;
+
+    /// Call edit(begin, end, &line) on every line, without its '\n'. When edit
+    /// returns true, the line and its '\n' are replaced by line, which may be
+    /// empty to drop it.
+    template <typename Edit>
+    void edit_lines(Edit edit);
+
+    /// Call found(offset, i) on every occurrence of texts[i] from left to
+    /// right, offset being counted from the start of the text. The texts all
+    /// start with the same character, and an occurrence of the first of them
+    /// is preferred to the other ones at the same offset.
+    template <typename Found>
+    void for_each_occurrence(const std::vector<std::string> &texts, Found found) const;
+
+    /// Apply patches, sorted by offset and not overlapping, at once.
+    void patch(const std::vector<Patch> &patches);
+
+    private:
+    std::vector<Chunk> _chunks;
+
+    /// Whether text is found from position pos of the chunk at index chunk on.
+    bool matches(size_t chunk, size_t pos, const std::string &text) const;
+
+    /// Append a chunk, merging it with the last one if it follows it in the same string.
+    static void push(std::vector<Chunk>* chunks, const std::shared_ptr<const std::string> &text, size_t begin, size_t end);
+};
+
+template <typename Visit>
+void
+ChunkedGCode::for_each_line(Visit visit) const
+{
+    // start of a line cut by the end of a chunk
+    std::string carried;
+    for (const Chunk &chunk : this->_chunks) {
+        const char* const data = chunk.text->data();
+        size_t begin = chunk.begin;
+        while (begin < chunk.end) {
+            const char* newline = static_cast<const char*>(std::memchr(data + begin, '\n', chunk.end - begin));
+            if (newline == nullptr) {
+                carried.append(data + begin, chunk.end - begin);
+                break;
+            }
+            const size_t end = newline - data;
+            if (carried.empty()) {
+                visit(data + begin, data + end);
+            } else {
+                carried.append(data + begin, end - begin);
+                visit(carried.data(), carried.data() + carried.size());
+                carried.clear();
+            }
+            begin = end + 1;
+        }
+    }
+    if (!carried.empty())
+        visit(carried.data(), carried.data() + carried.size());
+}
+
+template <typename Edit>
+void
+ChunkedGCode::edit_lines(Edit edit)
+{
+    std::vector<Chunk> edited;
+    edited.reserve(this->_chunks.size());
+    std::shared_ptr<std::string> edits;
+    auto push_edit = [&edited, &edits] (const std::string &text) {
+        if (text.empty()) return;
+        if (!edits) edits = std::make_shared<std::string>();
+        const size_t begin = edits->size();
+        edits->append(text);
+        push(&edited, edits, begin, edits->size());
+    };
+
+    // a line cut by the end of a chunk is edited as a copy
+    std::string carried, line;
+    for (const Chunk &chunk : this->_chunks) {
+        const char* const data = chunk.text->data();
+        // start of the text kept as it is
+        size_t kept = chunk.begin;
+        size_t begin = chunk.begin;
+        while (begin < chunk.end) {
+            const char* newline = static_cast<const char*>(std::memchr(data + begin, '\n', chunk.end - begin));
+            if (newline == nullptr) {
+                push(&edited, chunk.text, kept, begin);
+                carried.append(data + begin, chunk.end - begin);
+                kept = chunk.end;
+                break;
+            }
+            const size_t end = newline - data;
+            line.clear();
+            if (!carried.empty()) {
+                carried.append(data + begin, end - begin);
+                if (!edit(carried.data(), carried.data() + carried.size(), &line))
+                    line = carried + '\n';
+                push_edit(line);
+                carried.clear();
+                kept = end + 1;
+            } else if (edit(data + begin, data + end, &line)) {
+                push(&edited, chunk.text, kept, begin);
+                push_edit(line);
+                kept = end + 1;
+            }
+            begin = end + 1;
+        }
+        push(&edited, chunk.text, kept, chunk.end);
+    }
+    if (!carried.empty()) {
+        line.clear();
+        if (!edit(carried.data(), carried.data() + carried.size(), &line))
+            line = carried;
+        push_edit(line);
+    }
+    this->_chunks = std::move(edited);
+}
+
+template <typename Found>
+void
+ChunkedGCode::for_each_occurrence(const std::vector<std::string> &texts, Found found) const
+{
+    if (texts.empty() || texts.front().empty()) return;
+    const char first = texts.front().front();
+    // offset of the chunk, and end of the last occurrence, which may be in a following chunk
+    size_t offset = 0, skipped = 0;
+    for (size_t i = 0; i < this->_chunks.size(); ++i) {
+        const char* const data = this->_chunks[i].data();
+        const size_t size = this->_chunks[i].size();
+        size_t pos = skipped > offset ? skipped - offset : 0;
+        while (pos < size) {
+            const char* c = static_cast<const char*>(std::memchr(data + pos, first, size - pos));
+            if (c == nullptr) break;
+            pos = c - data;
+            size_t text = 0;
+            while (text < texts.size() && !this->matches(i, pos, texts[text])) ++text;
+            if (text < texts.size()) {
+                found(offset + pos, text);
+                pos += texts[text].size();
+                skipped = offset + pos;
+            } else {
+                ++pos;
+            }
+        }
+        offset += size;
+    }
+}
+
+}
+
+#endif
@@ -1,22 +1,55 @@
 #include "CoolingBuffer.hpp"
+#include "GCodeFormatter.hpp"
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 namespace Slic3r {
 
+/// The markers written by GCode, consumed here.
+enum CoolingMarker { cmExtrudeSetSpeed, cmExternalPerimeter, cmWipe, cmBridgeFanStart, cmBridgeFanEnd };
+static const std::vector<std::string> markers {
+    ";_EXTRUDE_SET_SPEED", ";_EXTERNAL_PERIMETER", ";_WIPE", ";_BRIDGE_FAN_START", ";_BRIDGE_FAN_END"
+};
+
 std::string
 CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z)
 {
-    std::string out;
+    ChunkedGCode out;
+    this->append(&out, ChunkedGCode(gcode), obj_id, layer_id, print_z);
+    return out.str();
+}
+
+void
+CoolingBuffer::append(ChunkedGCode* out, ChunkedGCode gcode, const std::string &obj_id, size_t layer_id, float print_z)
+{
     if (this->_last_z.find(obj_id) != this->_last_z.end()) {
         // A layer was finished, Z of the object's layer changed. Process the layer.
-        out = this->flush();
+        this->flush(out);
     }
     
     this->_layer_id = layer_id;
     this->_last_z[obj_id] = print_z;
-    this->_gcode += gcode;
+    
+    // Find the markers once and for all, each marked feed rate being the
+    // next one GCode recorded.
+    const size_t offset = this->_gcode.size();
+    std::vector<CoolingMove> moves;
+    std::swap(moves, this->_gcodegen->cooling_moves);
+    std::vector<CoolingMove>::const_iterator move = moves.begin();
+    gcode.for_each_occurrence(markers, [this, offset, &moves, &move] (size_t found, size_t marker) {
+        this->_markers.push_back(Marker { offset + found, marker });
+        if (marker != cmExtrudeSetSpeed) return;
+        if (move == moves.end() || move->size > found) {
+            this->_unrecorded = true;
+            return;
+        }
+        this->_moves.push_back(*move++);
+        this->_moves.back().offset = offset + found - this->_moves.back().size;
+    });
+    this->_gcode.append(std::move(gcode));
     // This is a very rough estimate of the print time, 
     // not taking into account the acceleration curves generated by the printer firmware.
     this->_elapsed_time          += this->_gcodegen->elapsed_time;
@@ -25,8 +58,13 @@ CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer
     this->_gcodegen->elapsed_time          = 0;
     this->_gcodegen->elapsed_time_bridges  = 0;
     this->_gcodegen->elapsed_time_external = 0;
-    
-    return out;
+}
+
+static float
+slow_down(float speed, float speed_factor, float min_print_speed)
+{
+    speed *= speed_factor;
+    return std::max(speed, min_print_speed);
 }
 
 void
@@ -43,9 +81,7 @@ apply_speed_factor(std::string &line, float speed_factor, float min_print_speed)
         iss >> speed;
     }
     
-    // change speed
-    speed *= speed_factor;
-    speed = std::max(speed, min_print_speed);
+    speed = slow_down(speed, speed_factor, min_print_speed);
     
     // replace speed in string
     {
@@ -56,16 +92,56 @@ apply_speed_factor(std::string &line, float speed_factor, float min_print_speed)
     }
 }
 
+/// Whether the text in [begin, end) starts with text.
+static bool
+starts_with(const char* begin, const char* end, const char* text)
+{
+    const size_t size = std::strlen(text);
+    return static_cast<size_t>(end - begin) >= size && std::memcmp(begin, text, size) == 0;
+}
+
+/// Whether the text in [begin, end) contains text.
+static bool
+contains(const char* begin, const char* end, const char* text)
+{
+    return std::search(begin, end, text, text + std::strlen(text)) != end;
+}
+
 std::string
 CoolingBuffer::flush()
+{
+    ChunkedGCode out;
+    this->flush(&out);
+    return out.str();
+}
+
+void
+CoolingBuffer::flush(ChunkedGCode* out)
 {
     GCode &gg = *this->_gcodegen;
-    std::string gcode = this->_gcode;
+    ChunkedGCode gcode;
+    std::swap(gcode, this->_gcode);
     
     int fan_speed           = gg.config.fan_always_on ? gg.config.min_fan_speed.value : 0;
     float speed_factor      = 1.0;
     bool slowdown_external  = true;
     
+    if (gg.config.cooling && this->_time_estimator != nullptr) {
+        // Plan the moves of the layer after the ones exported so far, scaling the
+        // shares of the bridges and of the external perimeters along.
+        GCodeTimeEstimator estimator(*this->_time_estimator);
+        estimator.new_layer();
+        for (const ChunkedGCode::Chunk &chunk : gcode.chunks())
+            estimator.append(chunk.data(), chunk.size());
+        estimator.finish();
+        const float layer_time = estimator.layer_times.back();
+        if (this->_elapsed_time > 0) {
+            this->_elapsed_time_bridges  *= layer_time / this->_elapsed_time;
+            this->_elapsed_time_external *= layer_time / this->_elapsed_time;
+        }
+        this->_elapsed_time = layer_time;
+    }
+    
     if (gg.config.cooling) {
         #ifdef SLIC3R_DEBUG
         printf("Layer %zu estimated printing time: %f seconds\n", this->_layer_id, this->_elapsed_time);
@@ -100,55 +176,95 @@ CoolingBuffer::flush()
         #ifdef SLIC3R_DEBUG
         printf("  fan = %d%%, speed = %f%%\n", fan_speed, speed_factor * 100);
         #endif
-        
-        if (speed_factor < 1.0) {
-            // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
-            // as long as they are not _WIPE moves (they cannot if they are _EXTRUDE_SET_SPEED)
-            // and they are not preceded directly by _BRIDGE_FAN_START (do not adjust bridging speed).
-            std::string new_gcode;
-            std::istringstream ss(gcode);
-            std::string line;
-            bool bridge_fan_start = false;
-            while (std::getline(ss, line)) {
-                if (boost::starts_with(line, "G1")
-                    && boost::contains(line, ";_EXTRUDE_SET_SPEED")
-                    && !boost::contains(line, ";_WIPE")
-                    && !bridge_fan_start
-                    && (slowdown_external || !boost::contains(line, ";_EXTERNAL_PERIMETER"))) {
-                    apply_speed_factor(line, speed_factor, this->_min_print_speed);
-                    boost::replace_first(line, ";_EXTRUDE_SET_SPEED", "");
-                }
-                bridge_fan_start = boost::starts_with(line, ";_BRIDGE_FAN_START");
-                new_gcode += line + '\n';
-            }
-            gcode = new_gcode;
-        }
     }
-    if (this->_layer_id < gg.config.disable_fan_first_layers)
+    if (static_cast<int>(this->_layer_id) < gg.config.disable_fan_first_layers)
         fan_speed = 0;
     
-    gcode = gg.writer.set_fan(fan_speed) + gcode;
+    const std::string set_fan = gg.writer.set_fan(fan_speed);
     
     // bridge fan speed
-    if (!gg.config.cooling || gg.config.bridge_fan_speed == 0 || this->_layer_id < gg.config.disable_fan_first_layers) {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", "");
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END", "");
+    std::string bridge_fan_start, bridge_fan_end;
+    if (gg.config.cooling && gg.config.bridge_fan_speed != 0 && static_cast<int>(this->_layer_id) >= gg.config.disable_fan_first_layers) {
+        bridge_fan_start = gg.writer.set_fan(gg.config.bridge_fan_speed, true);
+        bridge_fan_end   = gg.writer.set_fan(fan_speed, true);
+    }
+    
+    if (this->_unrecorded) {
+        this->_edit_lines(&gcode, speed_factor, slowdown_external, bridge_fan_start, bridge_fan_end);
     } else {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", gg.writer.set_fan(gg.config.bridge_fan_speed, true));
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END",   gg.writer.set_fan(fan_speed, true));
+        this->_patch(&gcode, speed_factor, slowdown_external, bridge_fan_start, bridge_fan_end);
     }
-    boost::replace_all(gcode, ";_WIPE", "");
-    boost::replace_all(gcode, ";_EXTRUDE_SET_SPEED", "");
-    boost::replace_all(gcode, ";_EXTERNAL_PERIMETER", "");
+    gcode.prepend(set_fan);
+    out->append(std::move(gcode));
     
     // Reset the buffer.
     this->_elapsed_time          = 0;
     this->_elapsed_time_bridges  = 0;
     this->_elapsed_time_external = 0;
-    this->_gcode = "";
     this->_last_z.clear(); // reset the whole table otherwise we would compute overlapping times
-    
-    return gcode;
+    this->_markers.clear();
+    this->_moves.clear();
+    this->_unrecorded = false;
+}
+
+void
+CoolingBuffer::_patch(ChunkedGCode* gcode, float speed_factor, bool slowdown_external,
+    const std::string &bridge_fan_start, const std::string &bridge_fan_end) const
+{
+    std::vector<ChunkedGCode::Patch> patches;
+    patches.reserve(this->_markers.size() + this->_moves.size());
+    std::vector<CoolingMove>::const_iterator move = this->_moves.begin();
+    for (const Marker &marker : this->_markers) {
+        // the feed rates come before their markers
+        for (; move != this->_moves.end() && move->offset < marker.offset; ++move) {
+            if (speed_factor < 1.0 && move->adjustable
+                && (slowdown_external || move->role != erExternalPerimeter)) {
+                ChunkedGCode::Patch patch { move->offset, move->size, "" };
+                GCodeFormatter::append_fixed(&patch.text, slow_down(move->feedrate, speed_factor, this->_min_print_speed), 3);
+                patches.push_back(std::move(patch));
+            }
+        }
+        patches.push_back(ChunkedGCode::Patch { marker.offset, markers[marker.kind].size(),
+            marker.kind == cmBridgeFanStart ? bridge_fan_start
+                : marker.kind == cmBridgeFanEnd ? bridge_fan_end : "" });
+    }
+    gcode->patch(patches);
+}
+
+void
+CoolingBuffer::_edit_lines(ChunkedGCode* gcode, float speed_factor, bool slowdown_external,
+    const std::string &bridge_fan_start, const std::string &bridge_fan_end) const
+{
+    // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
+    // as long as they are not _WIPE moves (they cannot if they are _EXTRUDE_SET_SPEED)
+    // and they are not preceded directly by _BRIDGE_FAN_START (do not adjust bridging speed).
+    // Then consume the markers, all of them starting with ";_", which leaves the other
+    // lines as they are.
+    bool bridge_fan_started = false;
+    gcode->edit_lines([&] (const char* begin, const char* end, std::string* line) {
+        const bool slow_down = speed_factor < 1.0
+            && starts_with(begin, end, "G1")
+            && contains(begin, end, ";_EXTRUDE_SET_SPEED")
+            && !contains(begin, end, ";_WIPE")
+            && !bridge_fan_started
+            && (slowdown_external || !contains(begin, end, ";_EXTERNAL_PERIMETER"));
+        bridge_fan_started = starts_with(begin, end, ";_BRIDGE_FAN_START");
+        if (!slow_down && !contains(begin, end, ";_"))
+            return false;
+        
+        line->assign(begin, end);
+        if (slow_down) {
+            apply_speed_factor(*line, speed_factor, this->_min_print_speed);
+            boost::replace_first(*line, ";_EXTRUDE_SET_SPEED", "");
+        }
+        boost::replace_all(*line, ";_BRIDGE_FAN_START", bridge_fan_start);
+        boost::replace_all(*line, ";_BRIDGE_FAN_END", bridge_fan_end);
+        boost::replace_all(*line, ";_WIPE", "");
+        boost::replace_all(*line, ";_EXTRUDE_SET_SPEED", "");
+        boost::replace_all(*line, ";_EXTERNAL_PERIMETER", "");
+        *line += '\n';
+        return true;
+    });
 }
 
 }
@@ -3,8 +3,11 @@
 
 #include "libslic3r.h"
 #include "GCode.hpp"
+#include "GCode/ChunkedGCode.hpp"
+#include "GCodeTimeEstimator.hpp"
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Slic3r {
 
@@ -12,29 +15,57 @@ namespace Slic3r {
 A standalone G-code filter, to control cooling of the print.
 The G-code is processed per layer. Once a layer is collected, fan start / stop commands are edited
 and the print is modified to stretch over a minimum layer time.
+The feed rates are slowed down from the moves GCode recorded while writing them, patched by offset;
+G-code appended without them, written by hand, goes through a slower pass parsing its lines.
+When an estimator follows the exported G-code, the time of the layer is the one it plans for the
+layer's moves instead of the rough sum of their lengths over their speeds.
 */
 
 class CoolingBuffer {
     public:
     CoolingBuffer(GCode &gcodegen)
-        : _gcodegen(&gcodegen), _elapsed_time(0.), _elapsed_time_bridges(0.),
-          _elapsed_time_external(0.), _layer_id(0)
+        : _gcodegen(&gcodegen), _unrecorded(false), _elapsed_time(0.), _elapsed_time_bridges(0.),
+          _elapsed_time_external(0.), _layer_id(0), _time_estimator(nullptr)
     {
         this->_min_print_speed = this->_gcodegen->config.min_print_speed * 60;
     };
     std::string append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z);
     std::string flush();
+    /// Same as above, appending the processed layer to out without copying the G-code.
+    void append(ChunkedGCode* out, ChunkedGCode gcode, const std::string &obj_id, size_t layer_id, float print_z);
+    void flush(ChunkedGCode* out);
     GCode* gcodegen() { return this->_gcodegen; };
+    /// Time the layers with a copy of estimator, which the flushed G-code is
+    /// written through; its per-layer times must be left empty.
+    void set_time_estimator(const GCodeTimeEstimator* estimator) { this->_time_estimator = estimator; };
     
     private:
+    /// A cooling marker found in the buffered G-code, kind indexing the markers in CoolingBuffer.cpp.
+    struct Marker {
+        size_t offset;
+        size_t kind;
+    };
+    
     GCode*                      _gcodegen;
-    std::string                 _gcode;
+    ChunkedGCode                _gcode;
+    std::vector<Marker>         _markers;
+    std::vector<CoolingMove>    _moves;
+    /// Whether a marked feed rate of the buffered G-code wasn't recorded.
+    bool                        _unrecorded;
     float                       _elapsed_time;
     float                       _elapsed_time_bridges;
     float                       _elapsed_time_external;
     size_t                      _layer_id;
+    const GCodeTimeEstimator*   _time_estimator;
     std::map<std::string,float> _last_z;
     float                       _min_print_speed;
+    
+    /// Patch the markers and the feed rates to slow down in gcode.
+    void _patch(ChunkedGCode* gcode, float speed_factor, bool slowdown_external,
+        const std::string &bridge_fan_start, const std::string &bridge_fan_end) const;
+    /// Same as above, parsing the lines of gcode.
+    void _edit_lines(ChunkedGCode* gcode, float speed_factor, bool slowdown_external,
+        const std::string &bridge_fan_start, const std::string &bridge_fan_end) const;
 };
 
 #ifdef SLIC3R_TEST
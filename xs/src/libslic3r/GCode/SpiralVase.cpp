@@ -14,6 +14,14 @@ _format_z(float z)
 
 std::string
 SpiralVase::process_layer(const std::string &gcode)
+{
+    ChunkedGCode chunks(gcode);
+    this->process_layer(&chunks);
+    return chunks.str();
+}
+
+void
+SpiralVase::process_layer(ChunkedGCode* gcode)
 {
     /*  This post-processor relies on several assumptions:
         - all layers are processed through it, including those that are not supposed
@@ -26,8 +34,10 @@ SpiralVase::process_layer(const std::string &gcode)
     // If we're not going to modify G-code, just feed it to the reader
     // in order to update positions.
     if (!this->enable) {
-        this->_reader.parse(gcode, {});
-        return gcode;
+        gcode->for_each_line([this] (const char* begin, const char* end) {
+            this->_reader.parse_line(std::string(begin, end), {});
+        });
+        return;
     }
     
     // Get total XY length for this layer by summing all extrusion moves.
@@ -38,7 +48,7 @@ SpiralVase::process_layer(const std::string &gcode)
     
     {
         GCodeReader r = this->_reader;  // clone
-        r.parse(gcode, [&total_layer_length, &layer_height, &z, &set_z]
+        const GCodeReader::callback_t callback = [&total_layer_length, &layer_height, &z, &set_z]
             (GCodeReader &, const GCodeReader::GCodeLine &line) {
             if (line.cmd == "G1") {
                 if (line.extruding()) {
@@ -51,21 +61,27 @@ SpiralVase::process_layer(const std::string &gcode)
                     }
                 }
             }
+        };
+        gcode->for_each_line([&r, &callback] (const char* begin, const char* end) {
+            r.parse_line(std::string(begin, end), callback);
         });
     }
     
-    // Remove layer height from initial Z.
+    // Remove layer height from initial Z.
     z -= layer_height;
     
-    std::string new_gcode;
-    this->_reader.parse(gcode, [&new_gcode, &z, &layer_height, &total_layer_length]
+    // the lines left as they are aren't copied
+    std::string* new_line;
+    bool edited;
+    const GCodeReader::callback_t callback = [&new_line, &edited, &z, &layer_height, &total_layer_length]
         (GCodeReader &, GCodeReader::GCodeLine line) {
         if (line.cmd == "G1") {
             if (line.has('Z')) {
                 // If this is the initial Z move of the layer, replace it with a
                 // (redundant) move to the last Z of previous layer.
                 line.set('Z', _format_z(z));
-                new_gcode += line.raw + '\n';
+                *new_line = line.raw + '\n';
+                edited = true;
                 return;
             } else {
                 float dist_XY = line.dist_XY();
@@ -74,8 +90,9 @@ SpiralVase::process_layer(const std::string &gcode)
                     if (line.extruding()) {
                         z += dist_XY * layer_height / total_layer_length;
                         line.set('Z', _format_z(z));
-                        new_gcode += line.raw + '\n';
+                        *new_line = line.raw + '\n';
                     }
+                    edited = true;
                     return;
                 
                     /*  Skip travel moves: the move to first perimeter point will
@@ -86,10 +103,13 @@ SpiralVase::process_layer(const std::string &gcode)
                 }
             }
         }
-        new_gcode += line.raw + '\n';
+    };
+    gcode->edit_lines([this, &new_line, &edited, &callback] (const char* begin, const char* end, std::string* line) {
+        new_line = line;
+        edited = false;
+        this->_reader.parse_line(std::string(begin, end), callback);
+        return edited;
     });
-    
-    return new_gcode;
 }
 
 }
@@ -3,6 +3,7 @@
 
 #include "libslic3r.h"
 #include "GCode.hpp"
+#include "GCode/ChunkedGCode.hpp"
 #include "GCodeReader.hpp"
 
 namespace Slic3r {
@@ -18,6 +19,8 @@ class SpiralVase {
         this->_reader.apply_config(*this->_config);
     };
     std::string process_layer(const std::string &gcode);
+    /// Same as above, editing gcode in place.
+    void process_layer(ChunkedGCode* gcode);
     
     private:
     const PrintConfig* _config;
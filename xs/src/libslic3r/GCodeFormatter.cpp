@@ -0,0 +1,97 @@
+#include "GCodeFormatter.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace Slic3r {
+
+static const unsigned long long powers[] { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+bool
+GCodeFormatter::fixed_digits(double value, unsigned int precision, unsigned long long* digits)
+{
+    if (precision >= sizeof(powers) / sizeof(powers[0]) || !std::isfinite(value))
+        return false;
+
+    // value scaled to an integer count of the last decimal, with a rounding
+    // error of half an ulp at most, so that it's rounded the same way as
+    // the exact value unless it's right on a tie
+    const double scaled = std::abs(value) * powers[precision];
+    if (scaled >= 1e15)
+        return false;
+    const double whole = std::floor(scaled);
+    const double fraction = scaled - whole;
+    if (std::abs(fraction - 0.5) <= scaled * std::ldexp(1.0, -52))
+        return false;
+    *digits = static_cast<unsigned long long>(whole) + (fraction > 0.5 ? 1 : 0);
+    return true;
+}
+
+void
+GCodeFormatter::append_fixed(std::string* out, double value, unsigned int precision)
+{
+    unsigned long long digits;
+    if (fixed_digits(value, precision, &digits)) {
+        unsigned long long integer = digits / powers[precision];
+        unsigned long long decimals = digits % powers[precision];
+
+        char buffer[32];
+        char* const end = buffer + sizeof(buffer);
+        char* begin = end;
+        for (unsigned int i = 0; i < precision; ++i) {
+            *--begin = '0' + decimals % 10;
+            decimals /= 10;
+        }
+        if (precision > 0) *--begin = '.';
+        do {
+            *--begin = '0' + integer % 10;
+            integer /= 10;
+        } while (integer > 0);
+        if (std::signbit(value)) *--begin = '-';
+        out->append(begin, end - begin);
+        return;
+    }
+
+    // huge numbers and ties, which need the exact decimal expansion
+    char buffer[512];
+    const int length = std::snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+    if (length < 0) return;
+    if (static_cast<size_t>(length) < sizeof(buffer)) {
+        out->append(buffer, length);
+    } else {
+        std::string text(length + 1, '\0');
+        std::snprintf(&text[0], text.size(), "%.*f", precision, value);
+        out->append(text, 0, length);
+    }
+}
+
+double
+GCodeFormatter::rounded(double value, unsigned int precision)
+{
+    unsigned long long digits;
+    if (fixed_digits(value, precision, &digits)) {
+        // both are exact, so that the quotient is the closest double to the decimal number
+        const double number = static_cast<double>(digits) / powers[precision];
+        return std::signbit(value) ? -number : number;
+    }
+    std::string text;
+    append_fixed(&text, value, precision);
+    return std::strtod(text.c_str(), nullptr);
+}
+
+void
+GCodeFormatter::append_int(std::string* out, long long value)
+{
+    unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value) : value;
+    char buffer[24];
+    char* const end = buffer + sizeof(buffer);
+    char* begin = end;
+    do {
+        *--begin = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) *--begin = '-';
+    out->append(begin, end - begin);
+}
+
+}
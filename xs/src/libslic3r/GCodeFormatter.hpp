@@ -0,0 +1,53 @@
+#ifndef slic3r_GCodeFormatter_hpp_
+#define slic3r_GCodeFormatter_hpp_
+
+#include <string>
+
+namespace Slic3r {
+
+/// Appends G-code text to a string owned by the caller, writing the numbers
+/// itself instead of going through a stream, so that the moves don't need
+/// any temporary string or stream. The text is the same as the one written
+/// by an std::ostream in the classic locale.
+class GCodeFormatter
+{
+    public:
+    /// A number to write with a fixed count of decimals, as written by
+    /// std::fixed << std::setprecision(precision).
+    struct Fixed {
+        double value;
+        unsigned int precision;
+    };
+
+    explicit GCodeFormatter(std::string* out) : out(out) {};
+
+    static Fixed fixed(double value, unsigned int precision) { return Fixed { value, precision }; }
+
+    /// Append value to out as written by "%.*f" with precision decimals.
+    static void append_fixed(std::string* out, double value, unsigned int precision);
+    /// The number append_fixed() writes for value, as a double.
+    static double rounded(double value, unsigned int precision);
+    /// Append value to out in decimal.
+    static void append_int(std::string* out, long long value);
+
+    GCodeFormatter& operator<<(const std::string &text) { this->out->append(text); return *this; }
+    GCodeFormatter& operator<<(const char* text) { this->out->append(text); return *this; }
+    GCodeFormatter& operator<<(char c) { this->out->push_back(c); return *this; }
+    GCodeFormatter& operator<<(int value) { append_int(this->out, value); return *this; }
+    GCodeFormatter& operator<<(unsigned int value) { append_int(this->out, value); return *this; }
+    GCodeFormatter& operator<<(const Fixed &number) {
+        append_fixed(this->out, number.value, number.precision);
+        return *this;
+    }
+
+    private:
+    std::string* out;
+
+    /// The decimals of the absolute value written for value, when they can
+    /// be told without the exact decimal expansion of value.
+    static bool fixed_digits(double value, unsigned int precision, unsigned long long* digits);
+};
+
+}
+
+#endif
@@ -1,82 +1,446 @@
 #include "GCodeTimeEstimator.hpp"
+#include <algorithm>
+#include <cctype>
 #include <cmath>
-#include <boost/version.hpp>
-#if BOOST_VERSION >= 107300
-#include <boost/bind/bind.hpp>
-#endif
+#include <cstring>
+#include <fstream>
 
 namespace Slic3r {
 
-#if BOOST_VERSION >= 107300
-using boost::placeholders::_1;
-using boost::placeholders::_2;
-#endif
+// Marlin's MINIMUM_PLANNER_SPEED, in mm/s: the speed the machine stops from.
+static const double minimum_planner_speed = 0.05;
+
+GCodeTimeEstimator::GCodeTimeEstimator()
+    : _position { 0, 0, 0, 0 }, _feedrate(1500. / 60), _relative(false), _relative_e(false),
+      _previous(false), _previous_speed { 0, 0, 0, 0 }, _previous_unit { 0, 0, 0, 0 },
+      _previous_nominal_speed(0), _previous_safe_speed(0)
+{
+    this->apply_config(GCodeConfig());
+}
+
+void
+GCodeTimeEstimator::apply_config(const PrintConfigBase &config)
+{
+    GCodeConfig gcode_config;
+    gcode_config.apply(config, true);
+    const std::string extrusion_axis = gcode_config.get_extrusion_axis();
+    this->_extrusion_axis = extrusion_axis.empty() ? '\0' : extrusion_axis[0];
+    this->_relative_e = gcode_config.use_relative_e_distances.value;
+
+    this->_max_feedrate[X] = gcode_config.machine_max_feedrate_x.value;
+    this->_max_feedrate[Y] = gcode_config.machine_max_feedrate_y.value;
+    this->_max_feedrate[Z] = gcode_config.machine_max_feedrate_z.value;
+    this->_max_feedrate[E] = gcode_config.machine_max_feedrate_e.value;
+    this->_max_acceleration[X] = gcode_config.machine_max_acceleration_x.value;
+    this->_max_acceleration[Y] = gcode_config.machine_max_acceleration_y.value;
+    this->_max_acceleration[Z] = gcode_config.machine_max_acceleration_z.value;
+    this->_max_acceleration[E] = gcode_config.machine_max_acceleration_e.value;
+    this->_max_jerk[X] = gcode_config.machine_max_jerk_x.value;
+    this->_max_jerk[Y] = gcode_config.machine_max_jerk_y.value;
+    this->_max_jerk[Z] = gcode_config.machine_max_jerk_z.value;
+    this->_max_jerk[E] = gcode_config.machine_max_jerk_e.value;
+    this->_acceleration = gcode_config.machine_max_acceleration_extruding.value;
+    this->_travel_acceleration = this->_acceleration;
+    this->_retract_acceleration = gcode_config.machine_max_acceleration_retracting.value;
+    this->_junction_deviation = gcode_config.machine_junction_deviation.value;
+}
 
 void
 GCodeTimeEstimator::parse(const std::string &gcode)
 {
-    GCodeReader::parse(gcode, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    this->append(gcode);
+    this->finish();
 }
 
 void
 GCodeTimeEstimator::parse_file(const std::string &file)
 {
-    GCodeReader::parse_file(file, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    std::ifstream f(file, std::ios::binary);
+    char buffer[65536];
+    while (f.read(buffer, sizeof(buffer)) || f.gcount() > 0)
+        this->append(buffer, f.gcount());
+    this->finish();
+}
+
+void
+GCodeTimeEstimator::append(const char* data, size_t size)
+{
+    const char* const end = data + size;
+    while (data < end) {
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', end - data));
+        if (newline == nullptr) {
+            this->_line.append(data, end);
+            break;
+        }
+        if (this->_line.empty()) {
+            this->parse_line(data, newline);
+        } else {
+            this->_line.append(data, newline);
+            this->parse_line(this->_line.data(), this->_line.data() + this->_line.size());
+            this->_line.clear();
+        }
+        data = newline + 1;
+    }
+}
+
+/// Parse a number without exponent, as written in G-code.
+static bool
+parse_number(const char** p, const char* end, double* value)
+{
+    const char* c = *p;
+    const bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) ++c;
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    for (bool decimals = false; c < end; ++c) {
+        if (*c >= '0' && *c <= '9') {
+            digits = true;
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*c - '0');
+                if (decimals) --exponent;
+            } else if (!decimals) {
+                ++exponent;
+            }
+        } else if (*c == '.' && !decimals) {
+            decimals = true;
+        } else {
+            break;
+        }
+    }
+    *p = c;
+    if (!digits) return false;
+    const double number = exponent < 0 ? mantissa / std::pow(10., -exponent) : mantissa * std::pow(10., exponent);
+    *value = negative ? -number : number;
+    return true;
+}
+
+static inline bool
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
 }
 
 void
-GCodeTimeEstimator::_parser(GCodeReader&, const GCodeReader::GCodeLine &line)
-{
-    // std::cout << "[" << this->time << "] " << line.raw << std::endl;
-    if (line.cmd == "G1") {
-        const float dist_XY = line.dist_XY();
-        const float new_F = line.new_F();
-        
-        if (dist_XY > 0) {
-            //this->time += dist_XY / new_F * 60;
-            this->time += _accelerated_move(dist_XY, new_F/60, this->acceleration);
+GCodeTimeEstimator::parse_line(const char* begin, const char* end)
+{
+    const char* p = begin;
+    while (p < end && is_blank(*p)) ++p;
+    if (p == end) return;
+    const char letter = std::toupper(*p++);
+    if (letter != 'G' && letter != 'M') return;
+    double code;
+    if (!parse_number(&p, end, &code)) return;
+
+    // the arguments, by letter
+    bool has[26] = {};
+    double value[26];
+    while (p < end && *p != ';') {
+        if (is_blank(*p)) {
+            ++p;
+            continue;
+        }
+        const char arg = std::toupper(*p++);
+        double number;
+        if (arg >= 'A' && arg <= 'Z' && parse_number(&p, end, &number)) {
+            has[arg - 'A'] = true;
+            value[arg - 'A'] = number;
         } else {
-            //this->time += std::abs(line.dist_E()) / new_F * 60;
-            this->time += _accelerated_move(std::abs(line.dist_E()), new_F/60, this->acceleration);
+            while (p < end && !is_blank(*p) && *p != ';') ++p;
+        }
+    }
+    auto arg = [&has, &value] (char c, double* v) {
+        if (c == '\0' || !has[c - 'A']) return false;
+        *v = value[c - 'A'];
+        return true;
+    };
+    static const char axes[num_axes] { 'X', 'Y', 'Z', '\0' };
+    const char e = this->_extrusion_axis >= 'A' && this->_extrusion_axis <= 'Z' ? this->_extrusion_axis : '\0';
+    double v;
+
+    if (letter == 'G') {
+        switch (static_cast<int>(code)) {
+        case 0:
+        case 1: {
+            double target[num_axes];
+            std::copy(this->_position, this->_position + num_axes, target);
+            for (int i = X; i <= Z; ++i)
+                if (arg(axes[i], &v)) target[i] = this->_relative ? target[i] + v : v;
+            if (arg(e, &v)) target[E] = this->_relative || this->_relative_e ? target[E] + v : v;
+            if (arg('F', &v) && v > 0) this->_feedrate = v / 60;
+            this->_move(target);
+            break;
+        }
+        case 4:
+            if (arg('S', &v)) {
+                this->_dwell(v);
+            } else if (arg('P', &v)) {
+                this->_dwell(v / 1000);
+            }
+            break;
+        case 28: {
+            // the time to home isn't known
+            this->finish();
+            const bool all = !has['X' - 'A'] && !has['Y' - 'A'] && !has['Z' - 'A'];
+            for (int i = X; i <= Z; ++i)
+                if (all || has[axes[i] - 'A']) this->_position[i] = 0;
+            break;
+        }
+        case 90: this->_relative = false; break;
+        case 91: this->_relative = true; break;
+        case 92: {
+            const bool all = !has['X' - 'A'] && !has['Y' - 'A'] && !has['Z' - 'A'] && (e == '\0' || !has[e - 'A']);
+            for (int i = X; i <= Z; ++i)
+                this->_position[i] = arg(axes[i], &v) ? v : all ? 0 : this->_position[i];
+            this->_position[E] = arg(e, &v) ? v : all ? 0 : this->_position[E];
+            break;
+        }
+        }
+    } else {
+        double* limits = nullptr;
+        switch (static_cast<int>(code)) {
+        case 82: this->_relative_e = false; break;
+        case 83: this->_relative_e = true; break;
+        case 109:
+        case 190:
+        case 400:
+            // waits for the moves to be done
+            this->finish();
+            break;
+        case 201: limits = this->_max_acceleration; break;
+        case 203: limits = this->_max_feedrate; break;
+        case 204:
+            if (arg('S', &v)) this->_acceleration = this->_travel_acceleration = v;
+            if (arg('P', &v)) this->_acceleration = v;
+            if (arg('R', &v)) this->_retract_acceleration = v;
+            if (arg('T', &v)) this->_travel_acceleration = v;
+            break;
+        case 205:
+            limits = this->_max_jerk;
+            if (arg('J', &v)) this->_junction_deviation = v;
+            break;
+        }
+        if (limits != nullptr) {
+            for (int i = X; i <= Z; ++i)
+                if (arg(axes[i], &v)) limits[i] = v;
+            if (arg('E', &v)) limits[E] = v;
+        }
+    }
+}
+
+void
+GCodeTimeEstimator::new_layer()
+{
+    this->layer_times.push_back(0);
+}
+
+void
+GCodeTimeEstimator::finish()
+{
+    if (!this->_line.empty()) {
+        const std::string line = std::move(this->_line);
+        this->_line.clear();
+        this->parse_line(line.data(), line.data() + line.size());
+    }
+    while (!this->_blocks.empty())
+        this->_time_first();
+    this->_previous = false;
+}
+
+void
+GCodeTimeEstimator::_move(const double target[num_axes])
+{
+    double delta[num_axes];
+    for (int i = 0; i < num_axes; ++i) {
+        delta[i] = target[i] - this->_position[i];
+        this->_position[i] = target[i];
+    }
+    const double length_xyz = std::sqrt(delta[X] * delta[X] + delta[Y] * delta[Y] + delta[Z] * delta[Z]);
+    const bool moves_xyz = length_xyz > EPSILON;
+    Block block;
+    block.length = moves_xyz ? length_xyz : std::abs(delta[E]);
+    if (block.length <= EPSILON) return;
+    block.layer = static_cast<int>(this->layer_times.size()) - 1;
+
+    // the speed of each axis, limited by its maximum feedrate
+    double speed[num_axes], unit[num_axes];
+    double speed_factor = 1;
+    for (int i = 0; i < num_axes; ++i) {
+        unit[i] = delta[i] / block.length;
+        speed[i] = unit[i] * this->_feedrate;
+        if (this->_max_feedrate[i] > 0 && std::abs(speed[i]) > this->_max_feedrate[i])
+            speed_factor = std::min(speed_factor, this->_max_feedrate[i] / std::abs(speed[i]));
+    }
+    for (double &s : speed) s *= speed_factor;
+    block.nominal_speed = this->_feedrate * speed_factor;
+
+    // the acceleration of the move, limited by the one of each axis
+    block.acceleration = !moves_xyz ? this->_retract_acceleration
+        : delta[E] != 0 ? this->_acceleration : this->_travel_acceleration;
+    for (int i = 0; i < num_axes; ++i)
+        if (this->_max_acceleration[i] > 0 && std::abs(unit[i]) > EPSILON)
+            block.acceleration = std::min(block.acceleration, this->_max_acceleration[i] / std::abs(unit[i]));
+
+    // the speed the move may start from after a full stop, as Marlin's planner
+    double safe_speed = block.nominal_speed;
+    bool limited = false;
+    for (int i = 0; i < num_axes; ++i) {
+        const double jerk = std::abs(speed[i]), max_jerk = this->_max_jerk[i];
+        if (jerk > max_jerk) {
+            if (limited) {
+                if (jerk * safe_speed > max_jerk * block.nominal_speed)
+                    safe_speed = max_jerk * block.nominal_speed / jerk;
+            } else {
+                limited = true;
+                safe_speed = max_jerk;
+            }
+        }
+    }
+
+    // the speed at the junction with the previous move
+    double max_junction_speed;
+    if (this->_junction_deviation > 0) {
+        max_junction_speed = 0;
+        if (this->_previous && this->_previous_nominal_speed > EPSILON) {
+            double cos_theta = 0;
+            for (int i = 0; i < num_axes; ++i)
+                cos_theta -= this->_previous_unit[i] * unit[i];
+            if (cos_theta > 0.999999) {
+                max_junction_speed = minimum_planner_speed;
+            } else {
+                cos_theta = std::max(cos_theta, -0.999999);
+                const double sin_theta_d2 = std::sqrt(0.5 * (1 - cos_theta));
+                max_junction_speed = std::sqrt(block.acceleration * this->_junction_deviation * sin_theta_d2 / (1 - sin_theta_d2));
+            }
+            max_junction_speed = std::min(max_junction_speed, std::min(block.nominal_speed, this->_previous_nominal_speed));
         }
-        //this->time += std::abs(line.dist_Z()) / new_F * 60;
-        this->time += _accelerated_move(std::abs(line.dist_Z()), new_F/60, this->acceleration);
-    } else if (line.cmd == "M204" && line.has('S')) {
-        this->acceleration = line.get_float('S');
-    } else if (line.cmd == "G4") { // swell
-        if (line.has('S')) {
-            this->time += line.get_float('S');
-        } else if (line.has('P')) {
-            this->time += line.get_float('P')/1000;
+    } else if (this->_previous && this->_previous_nominal_speed > EPSILON) {
+        // limit the jerk of each axis at the smaller of both nominal speeds
+        max_junction_speed = std::min(block.nominal_speed, this->_previous_nominal_speed);
+        const double smaller_speed_factor = max_junction_speed / this->_previous_nominal_speed;
+        double v_factor = 1;
+        bool limited = false;
+        for (int i = 0; i < num_axes; ++i) {
+            double v_exit = this->_previous_speed[i] * smaller_speed_factor, v_entry = speed[i];
+            if (limited) {
+                v_exit *= v_factor;
+                v_entry *= v_factor;
+            }
+            // coasting, or reversal of the axis
+            const double jerk = v_exit > v_entry
+                ? ((v_entry > 0 || v_exit < 0) ? v_exit - v_entry : std::max(v_exit, -v_entry))
+                : ((v_entry < 0 || v_exit > 0) ? v_entry - v_exit : std::max(-v_exit, v_entry));
+            if (jerk > this->_max_jerk[i]) {
+                v_factor *= this->_max_jerk[i] / jerk;
+                limited = true;
+            }
         }
+        if (limited) max_junction_speed *= v_factor;
+        // not coasting: the machine stops and starts the moves anyway
+        const double threshold = max_junction_speed * 0.99;
+        if (this->_previous_safe_speed > threshold && safe_speed > threshold)
+            max_junction_speed = safe_speed;
+    } else {
+        max_junction_speed = safe_speed;
+    }
+
+    const double allowable_speed = std::sqrt(minimum_planner_speed * minimum_planner_speed + 2 * block.acceleration * block.length);
+    block.max_entry_speed = max_junction_speed;
+    block.entry_speed = std::min(max_junction_speed, allowable_speed);
+    block.nominal_length = block.nominal_speed <= allowable_speed;
+
+    this->_previous = true;
+    std::copy(speed, speed + num_axes, this->_previous_speed);
+    std::copy(unit, unit + num_axes, this->_previous_unit);
+    this->_previous_nominal_speed = block.nominal_speed;
+    this->_previous_safe_speed = safe_speed;
+
+    this->_blocks.push_back(block);
+    this->_plan();
+    while (this->_blocks.size() > planner_blocks)
+        this->_time_first();
+}
+
+void
+GCodeTimeEstimator::_plan()
+{
+    // Backwards, the entry speeds from which each block can slow down to the
+    // next one, the last one stopping. The first block is being executed.
+    double next_entry_speed = minimum_planner_speed;
+    for (size_t i = this->_blocks.size() - 1; i > 0; --i) {
+        Block &block = this->_blocks[i];
+        block.entry_speed = block.nominal_length || block.max_entry_speed <= minimum_planner_speed
+            ? block.max_entry_speed
+            : std::min(block.max_entry_speed, std::sqrt(next_entry_speed * next_entry_speed + 2 * block.acceleration * block.length));
+        next_entry_speed = block.entry_speed;
+    }
+    // Forwards, the entry speeds each block can accelerate to from the previous one.
+    for (size_t i = 1; i < this->_blocks.size(); ++i) {
+        const Block &previous = this->_blocks[i - 1];
+        Block &block = this->_blocks[i];
+        if (!previous.nominal_length && previous.entry_speed < block.entry_speed)
+            block.entry_speed = std::min(block.entry_speed,
+                std::sqrt(previous.entry_speed * previous.entry_speed + 2 * previous.acceleration * previous.length));
     }
 }
 
-// Wildly optimistic acceleration "bell" curve modeling.
-// Returns an estimate of how long the move with a given accel
-// takes in seconds.
-// It is assumed that the movement is smooth and uniform.
-float
-GCodeTimeEstimator::_accelerated_move(double length, double v, double acceleration) 
-{
-    // for half of the move, there are 2 zones, where the speed is increasing/decreasing and 
-    // where the speed is constant.
-    // Since the slowdown is assumed to be uniform, calculate the average velocity for half of the 
-    // expected displacement.
-    // final velocity v = a*t => a * (dx / 0.5v) => v^2 = 2*a*dx
-    // v_avg = 0.5v => 2*v_avg = v
-    // d_x = v_avg*t => t = d_x / v_avg
-    acceleration = (acceleration == 0.0 ? 4000.0 : acceleration); // Set a default accel to use for print time in case it's 0 somehow.
-    auto half_length = length / 2.0;
-    auto t_init = v / acceleration; // time to final velocity
-    auto dx_init = (0.5*v*t_init); // Initial displacement for the time to get to final velocity
-    auto t = 0.0;
-    if (half_length >= dx_init) {
-        half_length -= (0.5*v*t_init);
-        t += t_init;
+void
+GCodeTimeEstimator::_time_first()
+{
+    const Block &block = this->_blocks.front();
+    const double exit_speed = this->_blocks.size() > 1 ? this->_blocks[1].entry_speed : minimum_planner_speed;
+    const double t = _trapezoid_time(block.length, block.entry_speed, block.nominal_speed, exit_speed, block.acceleration);
+    this->time += t;
+    if (block.layer >= 0) this->layer_times[block.layer] += t;
+    this->_blocks.pop_front();
+}
+
+void
+GCodeTimeEstimator::_dwell(double seconds)
+{
+    this->finish();
+    this->time += seconds;
+    if (!this->layer_times.empty()) this->layer_times.back() += seconds;
+}
+
+double
+GCodeTimeEstimator::_trapezoid_time(double length, double entry_speed, double nominal_speed,
+    double exit_speed, double acceleration)
+{
+    if (nominal_speed <= 0) return 0;
+    if (acceleration <= 0) return length / nominal_speed;
+    entry_speed = std::min(entry_speed, nominal_speed);
+    exit_speed = std::min(exit_speed, nominal_speed);
+
+    const double accelerate_distance = (nominal_speed * nominal_speed - entry_speed * entry_speed) / (2 * acceleration);
+    const double decelerate_distance = (nominal_speed * nominal_speed - exit_speed * exit_speed) / (2 * acceleration);
+    if (accelerate_distance + decelerate_distance <= length) {
+        return (nominal_speed - entry_speed) / acceleration
+            + (length - accelerate_distance - decelerate_distance) / nominal_speed
+            + (nominal_speed - exit_speed) / acceleration;
     }
-    t += (half_length / v); // constant speed for rest of the time and too short displacements
-    return 2.0*t; // cut in half before, so double to get full time spent.
+    // triangle: accelerating until it has to slow down to the exit speed
+    const double distance = std::min(length, std::max(0.,
+        (2 * acceleration * length + exit_speed * exit_speed - entry_speed * entry_speed) / (4 * acceleration)));
+    const double peak_speed = std::sqrt(entry_speed * entry_speed + 2 * acceleration * distance);
+    return (peak_speed - entry_speed) / acceleration + std::max(0., peak_speed - exit_speed) / acceleration;
+}
+
+std::streamsize
+GCodeTimeEstimatorBuffer::xsputn(const char* data, std::streamsize size)
+{
+    this->_estimator->append(data, size);
+    return this->_out->sputn(data, size);
+}
+
+GCodeTimeEstimatorBuffer::int_type
+GCodeTimeEstimatorBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+    const char ch = traits_type::to_char_type(c);
+    this->_estimator->append(&ch, 1);
+    return this->_out->sputc(ch);
 }
 
 }
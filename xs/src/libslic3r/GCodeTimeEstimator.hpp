@@ -2,21 +2,117 @@
 #define slic3r_GCodeTimeEstimator_hpp_
 
 #include "libslic3r.h"
-#include "GCodeReader.hpp"
+#include "PrintConfig.hpp"
+#include <deque>
+#include <streambuf>
+#include <string>
+#include <vector>
 
 namespace Slic3r {
 
-class GCodeTimeEstimator : public GCodeReader {
+/*
+Estimates the print time of G-code the way the firmware plans the moves: every move is a block
+with a trapezoidal velocity profile, its speed and acceleration limited per axis, and the speed
+at the junction with the previous one limited by the jerk (or the junction deviation). The blocks
+are planned ahead over a window of the same size as the planner buffer of Marlin, so that a block
+is timed once the moves after it can't change its exit speed anymore.
+The G-code is fed as it is written, and the time is counted per layer as well as in total.
+*/
+
+class GCodeTimeEstimator {
     public:
-    float time = 0;  // in seconds
-    
+    double time = 0;  // in seconds, of the moves timed so far
+    /// Time of each layer started by new_layer(), in seconds.
+    std::vector<double> layer_times;
+
+    GCodeTimeEstimator();
+    /// Take the machine limits and the extrusion axis from config.
+    void apply_config(const PrintConfigBase &config);
+
+    /// Time all of gcode, as if the machine stopped after it.
     void parse(const std::string &gcode);
     void parse_file(const std::string &file);
-    
+    /// Feed G-code as it is written, cut anywhere.
+    void append(const char* data, size_t size);
+    void append(const std::string &gcode) { this->append(gcode.data(), gcode.size()); };
+    /// Feed a whole line, without its '\n'.
+    void parse_line(const char* begin, const char* end);
+    /// Count the time of the moves fed from now on in a new layer.
+    void new_layer();
+    /// Time the moves left as if the machine stopped after them.
+    void finish();
+
+    /// Blocks planned ahead, as many as Marlin's BLOCK_BUFFER_SIZE.
+    static const size_t planner_blocks = 16;
+
+    private:
+    enum Axis { X, Y, Z, E, num_axes };
+
+    /// A move, as planned.
+    struct Block {
+        double length;          // mm
+        double nominal_speed;   // mm/s
+        double acceleration;    // mm/s²
+        double max_entry_speed; // mm/s
+        double entry_speed;     // mm/s
+        /// Whether the nominal speed is reached from any entry speed.
+        bool nominal_length;
+        /// Index of the layer it's counted in, or -1 before the first one.
+        int layer;
+    };
+
+    double _max_feedrate[num_axes];
+    double _max_acceleration[num_axes];
+    double _max_jerk[num_axes];
+    double _acceleration;
+    double _retract_acceleration;
+    double _travel_acceleration;
+    double _junction_deviation;
+    char _extrusion_axis;
+
+    double _position[num_axes];
+    double _feedrate;  // mm/s
+    bool _relative;
+    bool _relative_e;
+
+    /// Blocks not timed yet; the first one is being executed, so that its
+    /// entry speed is settled.
+    std::deque<Block> _blocks;
+    /// Of the previous block, for the junction speed of the next one.
+    bool _previous;
+    double _previous_speed[num_axes];
+    double _previous_unit[num_axes];
+    double _previous_nominal_speed;
+    double _previous_safe_speed;
+
+    /// Start of a line cut by the end of the text appended last.
+    std::string _line;
+
+    void _move(const double target[num_axes]);
+    void _plan();
+    /// Time the first block, which goes on at the entry speed of the next one.
+    void _time_first();
+    void _dwell(double seconds);
+
+    static double _trapezoid_time(double length, double entry_speed, double nominal_speed,
+        double exit_speed, double acceleration);
+};
+
+/// Passes what's written to it along to another stream buffer and to an
+/// estimator, so that the G-code is timed as it is exported.
+class GCodeTimeEstimatorBuffer : public std::streambuf {
+    public:
+    GCodeTimeEstimatorBuffer(std::streambuf* out, GCodeTimeEstimator* estimator)
+        : _out(out), _estimator(estimator) {};
+
     protected:
-    float acceleration = 9000;
-    void _parser(GCodeReader&, const GCodeReader::GCodeLine &line);
-    static float _accelerated_move(double length, double v, double acceleration);
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+    int_type overflow(int_type c) override;
+    int sync() override { return this->_out->pubsync(); };
+
+    private:
+    std::streambuf* _out;
+    GCodeTimeEstimator* _estimator;
 };
 
 } /* namespace Slic3r */
@@ -1,4 +1,5 @@
 #include "GCodeWriter.hpp"
+#include "GCodeFormatter.hpp"
 #include "utils.hpp"
 #include <algorithm>
 #include <iomanip>
@@ -8,12 +9,58 @@
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
 #define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
-#define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
+#define PRECISION(val, precision) GCodeFormatter::fixed(val, precision)
 #define XYZF_NUM(val) PRECISION(val, 3)
 #define E_NUM(val) PRECISION(val, 5)
 
 namespace Slic3r {
 
+GCodeWriter&
+GCodeWriter::operator=(const GCodeWriter &other)
+{
+    if (this == &other) return *this;
+
+    this->config             = other.config;
+    this->extruders          = other.extruders;
+    this->multiple_extruders = other.multiple_extruders;
+    for (auto &pair : this->extruders)
+        pair.second.config = &this->config;
+
+    this->_extrusion_axis    = other._extrusion_axis;
+    this->_extruder          = other._extruder == NULL
+        ? NULL
+        : &this->extruders.find(other._extruder->id)->second;
+    this->_last_acceleration = other._last_acceleration;
+    this->_last_fan_speed    = other._last_fan_speed;
+    this->_lifted            = other._lifted;
+    this->_pos               = other._pos;
+    return *this;
+}
+
+bool
+GCodeWriter::same_state(const GCodeWriter &other) const
+{
+    if ((this->_extruder == NULL) != (other._extruder == NULL)
+        || (this->_extruder != NULL && this->_extruder->id != other._extruder->id))
+        return false;
+    if (this->extruders.size() != other.extruders.size())
+        return false;
+    for (auto it = this->extruders.cbegin(), it2 = other.extruders.cbegin(); it != this->extruders.cend(); ++it, ++it2) {
+        if (it->first != it2->first
+            || it->second.E != it2->second.E
+            || it->second.retracted != it2->second.retracted
+            || it->second.restart_extra != it2->second.restart_extra)
+            return false;
+    }
+    return this->multiple_extruders == other.multiple_extruders
+        && this->_extrusion_axis == other._extrusion_axis
+        && this->_last_acceleration == other._last_acceleration
+        && this->_lifted == other._lifted
+        && this->_pos.x == other._pos.x
+        && this->_pos.y == other._pos.y
+        && this->_pos.z == other._pos.z;
+}
+
 void
 GCodeWriter::apply_print_config(const PrintConfig &print_config)
 {
@@ -225,25 +272,30 @@ GCodeWriter::set_acceleration(unsigned int acceleration)
 
 std::string
 GCodeWriter::reset_e(bool force)
+{
+    std::string gcode;
+    this->reset_e(&gcode, force);
+    return gcode;
+}
+
+void
+GCodeWriter::reset_e(std::string* out, bool force)
 {
     if (FLAVOR_IS(gcfMach3)
         || FLAVOR_IS(gcfMakerWare)
         || FLAVOR_IS(gcfSailfish))
-        return "";
+        return;
     
     if (this->_extruder != NULL) {
-        if (this->_extruder->E == 0 && !force) return "";
+        if (this->_extruder->E == 0 && !force) return;
         this->_extruder->E = 0;
     }
     
     if (!this->_extrusion_axis.empty() && !this->config.use_relative_e_distances) {
-        std::ostringstream gcode;
+        GCodeFormatter gcode(out);
         gcode << "G92 " << this->_extrusion_axis << "0";
         if (this->config.gcode_comments) gcode << " ; reset extrusion distance";
         gcode << "\n";
-        return gcode.str();
-    } else {
-        return "";
     }
 }
 
@@ -309,32 +361,54 @@ std::string
 GCodeWriter::set_speed(double F, const std::string &comment,
                        const std::string &cooling_marker) const
 {
-    std::ostringstream gcode;
-    gcode.precision(3);
-    gcode << "G1 F" << std::fixed << F;
+    std::string gcode;
+    this->set_speed(&gcode, F, comment, cooling_marker);
+    return gcode;
+}
+
+void
+GCodeWriter::set_speed(std::string* out, double F, const std::string &comment,
+                       const std::string &cooling_marker) const
+{
+    GCodeFormatter gcode(out);
+    gcode << "G1 F" << XYZF_NUM(F);
     COMMENT(comment);
     gcode << cooling_marker;
     gcode << "\n";
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::travel_to_xy(const Pointf &point, const std::string &comment)
+{
+    std::string gcode;
+    this->travel_to_xy(&gcode, point, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::travel_to_xy(std::string* out, const Pointf &point, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     
-    std::ostringstream gcode;
+    GCodeFormatter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
+{
+    std::string gcode;
+    this->travel_to_xyz(&gcode, point, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::travel_to_xyz(std::string* out, const Pointf3 &point, const std::string &comment)
 {
     /*  If target Z is lower than current Z but higher than nominal Z we
         don't perform the Z move but we only move in the XY plane and
@@ -343,7 +417,8 @@ GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
     if (!this->will_move_z(point.z)) {
         double nominal_z = this->_pos.z - this->_lifted;
         this->_lifted = this->_lifted - (point.z - nominal_z);
-        return this->travel_to_xy(point);
+        this->travel_to_xy(out, point);
+        return;
     }
     
     /*  In all the other cases, we perform an actual XYZ move and cancel
@@ -351,18 +426,25 @@ GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
     this->_lifted = 0;
     this->_pos = point;
     
-    std::ostringstream gcode;
+    GCodeFormatter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " Z" << XYZF_NUM(point.z)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::travel_to_z(double z, const std::string &comment)
+{
+    std::string gcode;
+    this->travel_to_z(&gcode, z, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::travel_to_z(std::string* out, double z, const std::string &comment)
 {
     /*  If target Z is lower than current Z but higher than nominal Z
         we don't perform the move but we only adjust the nominal Z by
@@ -370,26 +452,25 @@ GCodeWriter::travel_to_z(double z, const std::string &comment)
     if (!this->will_move_z(z)) {
         double nominal_z = this->_pos.z - this->_lifted;
         this->_lifted -= (z - nominal_z);
-        return "";
+        return;
     }
     
     /*  In all the other cases, we perform an actual Z move and cancel
         the lift. */
     this->_lifted = 0;
-    return this->_travel_to_z(z, comment);
+    this->_travel_to_z(out, z, comment);
 }
 
-std::string
-GCodeWriter::_travel_to_z(double z, const std::string &comment)
+void
+GCodeWriter::_travel_to_z(std::string* out, double z, const std::string &comment)
 {
     this->_pos.z = z;
     
-    std::ostringstream gcode;
+    GCodeFormatter gcode(out);
     gcode << "G1 Z" << XYZF_NUM(z)
           <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 bool
@@ -407,41 +488,64 @@ GCodeWriter::will_move_z(double z) const
 
 std::string
 GCodeWriter::extrude_to_xy(const Pointf &point, double dE, const std::string &comment)
+{
+    std::string gcode;
+    this->extrude_to_xy(&gcode, point, dE, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::extrude_to_xy(std::string* out, const Pointf &point, double dE, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
+    GCodeFormatter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment)
+{
+    std::string gcode;
+    this->extrude_to_xyz(&gcode, point, dE, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::extrude_to_xyz(std::string* out, const Pointf3 &point, double dE, const std::string &comment)
 {
     this->_pos = point;
     this->_lifted = 0;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
+    GCodeFormatter gcode(out);
     gcode << "G1 X" << XYZF_NUM(point.x)
           <<   " Y" << XYZF_NUM(point.y)
           <<   " Z" << XYZF_NUM(point.z)
           <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
     COMMENT(comment);
     gcode << "\n";
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::retract()
 {
-    return this->_retract(
+    std::string gcode;
+    this->retract(&gcode);
+    return gcode;
+}
+
+void
+GCodeWriter::retract(std::string* gcode)
+{
+    this->_retract(
+        gcode,
         this->_extruder->retract_length(),
         this->_extruder->retract_restart_extra(),
         "retract"
@@ -451,7 +555,16 @@ GCodeWriter::retract()
 std::string
 GCodeWriter::retract_for_toolchange()
 {
-    return this->_retract(
+    std::string gcode;
+    this->retract_for_toolchange(&gcode);
+    return gcode;
+}
+
+void
+GCodeWriter::retract_for_toolchange(std::string* gcode)
+{
+    this->_retract(
+        gcode,
         this->_extruder->retract_length_toolchange(),
         this->_extruder->retract_restart_extra_toolchange(),
         "retract for toolchange",
@@ -459,13 +572,10 @@ GCodeWriter::retract_for_toolchange()
     );
 }
 
-std::string
-GCodeWriter::_retract(double length, double restart_extra, const std::string &comment, bool long_retract)
+void
+GCodeWriter::_retract(std::string* out, double length, double restart_extra, const char* comment, bool long_retract)
 {
-    std::ostringstream gcode;
-    std::ostringstream outcomment;
-
-    outcomment << comment;
+    GCodeFormatter gcode(out);
     
     /*  If firmware retraction is enabled, we use a fake value of 1
         since we ignore the actual configured retract_length which 
@@ -482,7 +592,6 @@ GCodeWriter::_retract(double length, double restart_extra, const std::string &co
 
     double dE = this->_extruder->retract(length, restart_extra);
     if (dE != 0) {
-        outcomment << " extruder " << this->_extruder->id;
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
                 gcode << "G22";
@@ -491,23 +600,30 @@ GCodeWriter::_retract(double length, double restart_extra, const std::string &co
             else
                 gcode << "G10";
         } else {
+            // the speed has always been written with the precision of E
             gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
+                           << " F" << E_NUM(this->_extruder->retract_speed_mm_min);
         }
-        COMMENT(outcomment.str());
+        if (this->config.gcode_comments) gcode << " ; " << comment << " extruder " << this->_extruder->id;
         gcode << "\n";
     }
     
     if (FLAVOR_IS(gcfMakerWare))
         gcode << "M103 ; extruder off\n";
-    
-    return gcode.str();
 }
 
 std::string
 GCodeWriter::unretract()
 {
-    std::ostringstream gcode;
+    std::string gcode;
+    this->unretract(&gcode);
+    return gcode;
+}
+
+void
+GCodeWriter::unretract(std::string* out)
+{
+    GCodeFormatter gcode(out);
     
     if (FLAVOR_IS(gcfMakerWare))
         gcode << "M101 ; extruder on\n";
@@ -521,17 +637,15 @@ GCodeWriter::unretract()
                  gcode << "G11";
             if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
             gcode << "\n";
-            gcode << this->reset_e();
+            this->reset_e(out);
         } else {
             // use G1 instead of G0 because G0 will blend the restart with the previous travel move
             gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
+                           << " F" << E_NUM(this->_extruder->retract_speed_mm_min);
             if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
             gcode << "\n";
         }
     }
-    
-    return gcode.str();
 }
 
 /*  If this method is called more than once before calling unlift(),
@@ -539,6 +653,14 @@ GCodeWriter::unretract()
     (i.e. with travel_to_z()) and thus _lifted was reduced. */
 std::string
 GCodeWriter::lift()
+{
+    std::string gcode;
+    this->lift(&gcode);
+    return gcode;
+}
+
+void
+GCodeWriter::lift(std::string* gcode)
 {
     // check whether the above/below conditions are met
     double target_lift = 0;
@@ -554,21 +676,25 @@ GCodeWriter::lift()
     // exactly zero
     if (std::abs(this->_lifted) < EPSILON && target_lift > 0) {
         this->_lifted = target_lift;
-        return this->_travel_to_z(this->_pos.z + target_lift, "lift Z");
+        this->_travel_to_z(gcode, this->_pos.z + target_lift, "lift Z");
     }
-    
-    return "";
 }
 
 std::string
 GCodeWriter::unlift()
 {
     std::string gcode;
+    this->unlift(&gcode);
+    return gcode;
+}
+
+void
+GCodeWriter::unlift(std::string* gcode)
+{
     if (this->_lifted > 0) {
-        gcode += this->_travel_to_z(this->_pos.z - this->_lifted, "restore layer Z");
+        this->_travel_to_z(gcode, this->_pos.z - this->_lifted, "restore layer Z");
         this->_lifted = 0;
     }
-    return gcode;
 }
 
 }
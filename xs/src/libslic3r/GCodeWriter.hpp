@@ -19,6 +19,9 @@ public:
         : multiple_extruders(false), _extrusion_axis("E"), _extruder(NULL),
             _last_acceleration(0), _last_fan_speed(0), _lifted(0)
         {};
+    /// Copies get their own extruders, bound to their own config.
+    GCodeWriter(const GCodeWriter &other) : GCodeWriter() { *this = other; }
+    GCodeWriter& operator=(const GCodeWriter &other);
     Extruder* extruder() const { return this->_extruder; }
     std::string extrusion_axis() const { return this->_extrusion_axis; }
     void apply_print_config(const PrintConfig &print_config);
@@ -67,7 +70,27 @@ public:
     std::string unretract();
     std::string lift();
     std::string unlift();
+
+    /// Same as above, appending to gcode instead of returning a new string.
+    void reset_e(std::string* gcode, bool force = false);
+    void set_speed(std::string* gcode, double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
+    void travel_to_xy(std::string* gcode, const Pointf &point, const std::string &comment = std::string());
+    void travel_to_xyz(std::string* gcode, const Pointf3 &point, const std::string &comment = std::string());
+    void travel_to_z(std::string* gcode, double z, const std::string &comment = std::string());
+    void extrude_to_xy(std::string* gcode, const Pointf &point, double dE, const std::string &comment = std::string());
+    void extrude_to_xyz(std::string* gcode, const Pointf3 &point, double dE, const std::string &comment = std::string());
+    void retract(std::string* gcode);
+    void retract_for_toolchange(std::string* gcode);
+    void unretract(std::string* gcode);
+    void lift(std::string* gcode);
+    void unlift(std::string* gcode);
+
     Pointf3 get_position() const { return this->_pos; }
+    unsigned int get_fan_speed() const { return this->_last_fan_speed; }
+    /// Whether this writer would go on writing the same G-code as other.
+    /// The fan speed is left aside, as well as the absolute E of the
+    /// extruders, which is only used for the statistics.
+    bool same_state(const GCodeWriter &other) const;
 private:
     std::string _extrusion_axis;
     Extruder* _extruder;
@@ -76,8 +99,8 @@ private:
     double _lifted;
     Pointf3 _pos;
     
-    std::string _travel_to_z(double z, const std::string &comment);
-    std::string _retract(double length, double restart_extra, const std::string &comment, bool long_retract = false);
+    void _travel_to_z(std::string* gcode, double z, const std::string &comment);
+    void _retract(std::string* gcode, double length, double restart_extra, const char* comment, bool long_retract = false);
 };
 
 } /* namespace Slic3r */
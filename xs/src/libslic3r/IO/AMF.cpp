@@ -569,8 +569,8 @@ AMF::write(const Model& model, std::string output_file)
         for (ModelVolume *volume : object->volumes) {
             volume->mesh.require_shared_vertices();
             vertices_offsets.push_back(num_vertices);
-            const auto &stl = volume->mesh.stl;
-            for (size_t i = 0; i < static_cast<size_t>(stl.stats.shared_vertices); ++i)
+            const auto &its = volume->mesh.its;
+            for (size_t i = 0; i < its.vertices.size(); ++i)
                 // Subtract origin_translation in order to restore the coordinates of the parts
                 // before they were imported. Otherwise, when this AMF file is reimported parts
                 // will be placed in the plater correctly, but we will have lost origin_translation
@@ -579,13 +579,13 @@ AMF::write(const Model& model, std::string output_file)
                 // below.
                 file << "         <vertex>" << endl
                      << "           <coordinates>" << endl
-                     << "             <x>" << (stl.v_shared[i].x - origin_translation.x) << "</x>" << endl
-                     << "             <y>" << (stl.v_shared[i].y - origin_translation.y) << "</y>" << endl
-                     << "             <z>" << (stl.v_shared[i].z - origin_translation.z) << "</z>" << endl
+                     << "             <x>" << (its.vertices[i].x - origin_translation.x) << "</x>" << endl
+                     << "             <y>" << (its.vertices[i].y - origin_translation.y) << "</y>" << endl
+                     << "             <z>" << (its.vertices[i].z - origin_translation.z) << "</z>" << endl
                      << "           </coordinates>" << endl
                      << "         </vertex>" << endl;
             
-            num_vertices += stl.stats.shared_vertices;
+            num_vertices += its.vertices.size();
         }
         file << "      </vertices>" << endl;
         
@@ -612,7 +612,7 @@ AMF::write(const Model& model, std::string output_file)
                 file << "        <triangle>" << endl;
                 for (int j = 0; j < 3; ++ j)
                     file << "          <v" << (j+1) << ">"
-                         << (volume->mesh.stl.v_indices[i].vertex[j] + vertices_offset)
+                         << (volume->mesh.its.indices[i].vertex[j] + vertices_offset)
                          << "</v" << (j+1) << ">" << endl;
                 file << "        </triangle>" << endl;
             }
@@ -0,0 +1,506 @@
+#include "STL.hpp"
+#include <admesh/portable_endian.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace Slic3r { namespace IO {
+
+namespace {
+
+/// Bounding box of the facets of one chunk.
+struct ChunkBounds
+{
+    stl_vertex min, max;
+};
+
+/// Facets of a slice of an ASCII file, and the number of lines
+/// stl_count_facets() would count in it.
+struct AsciiChunk
+{
+    const char* begin;
+    const char* end;
+    std::vector<stl_facet> facets;
+    int lines;
+    bool valid;
+};
+
+// Windows opens ASCII files in text mode, which reads "\r\n" as "\n".
+#ifdef _WIN32
+const bool text_mode_crlf = true;
+#else
+const bool text_mode_crlf = false;
+#endif
+
+void
+unify_zeros(stl_facet* facet)
+{
+    // unify -0 and +0, as stl_read() does, so that memcmp() treats them as equal
+    uint32_t bits[12];
+    memcpy(bits, facet, sizeof(bits));
+    for (int j = 0; j < 12; ++j)
+        if (bits[j] == 0x80000000) bits[j] = 0;
+    memcpy(facet, bits, sizeof(bits));
+}
+
+void
+decode_facet(const unsigned char* src, stl_facet* facet)
+{
+    float* floats[12] = {
+        &facet->normal.x,    &facet->normal.y,    &facet->normal.z,
+        &facet->vertex[0].x, &facet->vertex[0].y, &facet->vertex[0].z,
+        &facet->vertex[1].x, &facet->vertex[1].y, &facet->vertex[1].z,
+        &facet->vertex[2].x, &facet->vertex[2].y, &facet->vertex[2].z,
+    };
+    for (int j = 0; j < 12; ++j) {
+        uint32_t bits;
+        memcpy(&bits, src + j * sizeof(float), 4);
+        bits = le32toh(bits);
+        memcpy(floats[j], &bits, 4);
+    }
+    memcpy(facet->extra, src + 12 * sizeof(float), 2);
+    unify_zeros(facet);
+}
+
+void
+merge_vertex(const stl_vertex &v, ChunkBounds* bounds)
+{
+    bounds->min.x = std::min(bounds->min.x, v.x);
+    bounds->min.y = std::min(bounds->min.y, v.y);
+    bounds->min.z = std::min(bounds->min.z, v.z);
+    bounds->max.x = std::max(bounds->max.x, v.x);
+    bounds->max.y = std::max(bounds->max.y, v.y);
+    bounds->max.z = std::max(bounds->max.z, v.z);
+}
+
+/// Bounding box of a non-empty range of facets.
+ChunkBounds
+facets_bounds(const stl_facet* first, const stl_facet* last)
+{
+    ChunkBounds bounds;
+    bounds.min = bounds.max = first->vertex[0];
+    for (const stl_facet* facet = first; facet != last; ++facet)
+        for (int k = 0; k <= 2; ++k) merge_vertex(facet->vertex[k], &bounds);
+    return bounds;
+}
+
+/// Fill the statistics stl_read() computes while reading the facets.
+void
+finish_stats(stl_file* stl, const std::vector<ChunkBounds> &bounds)
+{
+    ChunkBounds total = bounds.front();
+    for (const ChunkBounds &b : bounds) {
+        merge_vertex(b.min, &total);
+        merge_vertex(b.max, &total);
+    }
+    stl->stats.min = total.min;
+    stl->stats.max = total.max;
+
+    // stl_facet_stats() takes the shortest edge from the first facet only
+    const stl_facet &first_facet = stl->facet_start[0];
+    stl->stats.shortest_edge = std::max(
+        std::fabs(first_facet.vertex[0].z - first_facet.vertex[1].z),
+        std::max(
+            std::fabs(first_facet.vertex[0].x - first_facet.vertex[1].x),
+            std::fabs(first_facet.vertex[0].y - first_facet.vertex[1].y)
+        )
+    );
+
+    stl->stats.size.x = stl->stats.max.x - stl->stats.min.x;
+    stl->stats.size.y = stl->stats.max.y - stl->stats.min.y;
+    stl->stats.size.z = stl->stats.max.z - stl->stats.min.z;
+    stl->stats.bounding_diameter = sqrt(
+        stl->stats.size.x * stl->stats.size.x +
+        stl->stats.size.y * stl->stats.size.y +
+        stl->stats.size.z * stl->stats.size.z
+    );
+}
+
+bool
+read_binary(const unsigned char* data, size_t file_size, stl_file* stl, int threads)
+{
+    // a binary file must be made of whole facets, as counted in the header
+    if (file_size < STL_MIN_FILE_SIZE || (file_size - HEADER_SIZE) % SIZEOF_STL_FACET != 0) return false;
+    const size_t facets_count = (file_size - HEADER_SIZE) / SIZEOF_STL_FACET;
+    {
+        uint32_t header_facets;
+        memcpy(&header_facets, data + LABEL_SIZE, sizeof(uint32_t));
+        if (le32toh(header_facets) != facets_count) return false;
+    }
+
+    stl_initialize(stl);
+    stl->stats.type = binary;
+    memcpy(stl->stats.header, data, LABEL_SIZE);
+    stl->stats.header[80] = '\0';
+    stl->stats.number_of_facets    = facets_count;
+    stl->stats.original_num_facets = facets_count;
+    stl_allocate(stl);
+    if (stl->facet_start == NULL || stl->neighbors_start == NULL) {
+        stl->error = 1;
+        return true;
+    }
+
+    // decode contiguous chunks, each one reducing its own bounding box
+    const size_t chunk_size   = 65536;
+    const size_t chunks_count = (facets_count + chunk_size - 1) / chunk_size;
+    std::vector<ChunkBounds> bounds(chunks_count);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const size_t first = chunk_idx * chunk_size;
+            const size_t last  = std::min(facets_count, first + chunk_size);
+            for (size_t i = first; i < last; ++i)
+                decode_facet(data + HEADER_SIZE + i * SIZEOF_STL_FACET, &stl->facet_start[i]);
+            bounds[chunk_idx] = facets_bounds(stl->facet_start + first, stl->facet_start + last);
+        },
+        threads
+    );
+
+    finish_stats(stl, bounds);
+    return true;
+}
+
+// The ASCII tokenizer accepts the layout every exporter writes: whitespace
+// separated keywords and numbers, with solid/endsolid lines in between facets.
+// Whatever it does not understand makes the whole read fail, so that
+// stl_open() gets to decide what to do with the file.
+
+inline bool
+is_space(char c)
+{
+    // isspace() of the C locale, which is what scanf() skips
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline void
+skip_spaces(const char* &p, const char* end)
+{
+    while (p < end && is_space(*p)) ++p;
+}
+
+inline bool
+starts_with(const char* p, const char* end, const char* prefix, size_t len)
+{
+    return size_t(end - p) >= len && memcmp(p, prefix, len) == 0;
+}
+
+/// Consume a whitespace delimited keyword, skipping the whitespace before it.
+template <size_t N> bool
+match_keyword(const char* &p, const char* end, const char (&keyword)[N])
+{
+    skip_spaces(p, end);
+    if (!starts_with(p, end, keyword, N - 1)) return false;
+    if (p + N - 1 < end && !is_space(p[N - 1])) return false;
+    p += N - 1;
+    return true;
+}
+
+/// Parse a number as scanf("%f") does, skipping the whitespace before it.
+/// Decimal numbers whose value can be computed with a single correctly
+/// rounded double operation and then rounded once to float are converted
+/// inline (Clinger's fast path); anything else goes through strtof().
+bool
+parse_float(const char* &p, const char* end, float* out)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    skip_spaces(p, end);
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '+' || *q == '-')) negative = *q++ == '-';
+
+    uint64_t mantissa    = 0;
+    int      significant = 0;
+    int      exp10       = 0;
+    bool     digits      = false;
+    bool     exact       = true;
+    bool     fraction    = false;
+    for (; q < end; ++q) {
+        if (is_digit(*q)) {
+            digits = true;
+            const int d = *q - '0';
+            if (mantissa == 0 && d == 0) {
+                if (fraction) --exp10;
+            } else if (significant < 19) {
+                mantissa = mantissa * 10 + d;
+                ++significant;
+                if (fraction) --exp10;
+            } else {
+                exact = false;
+            }
+        } else if (*q == '.' && !fraction) {
+            fraction = true;
+        } else {
+            break;
+        }
+    }
+    if (digits && q < end && (*q == 'e' || *q == 'E')) {
+        const char* r = q + 1;
+        bool negative_exp = false;
+        if (r < end && (*r == '+' || *r == '-')) negative_exp = *r++ == '-';
+        if (r < end && is_digit(*r)) {
+            int e = 0;
+            for (; r < end && is_digit(*r); ++r) e = std::min(e * 10 + (*r - '0'), 100000);
+            exp10 += negative_exp ? -e : e;
+            q = r;
+        } else {
+            exact = false;
+        }
+    }
+    if (q < end && !is_space(*q)) exact = false;
+
+    if (digits && exact) {
+        if (mantissa == 0) {
+            *out = negative ? -0.f : 0.f;
+            p = q;
+            return true;
+        }
+        if ((mantissa >> 53) == 0 && exp10 >= -22 && exp10 <= 22) {
+            double d = double(mantissa);
+            d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+            // rounding the double to float gives the correctly rounded float
+            // unless the double landed exactly halfway between two floats
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            if (d >= FLT_MIN && d <= FLT_MAX && (bits & 0x1FFFFFFF) != 0x10000000) {
+                *out = negative ? -float(d) : float(d);
+                p = q;
+                return true;
+            }
+        }
+    }
+
+    // slow path on a NUL terminated copy of the token
+    const char* token_end = p;
+    while (token_end < end && !is_space(*token_end)) ++token_end;
+    char buffer[64];
+    const size_t len = token_end - p;
+    if (len == 0 || len >= sizeof(buffer)) return false;
+    memcpy(buffer, p, len);
+    buffer[len] = '\0';
+    char* parsed_end;
+    *out = strtof(buffer, &parsed_end);
+    if (parsed_end != buffer + len) return false;
+    p = token_end;
+    return true;
+}
+
+bool
+parse_vertex(const char* &p, const char* end, stl_vertex* v)
+{
+    return parse_float(p, end, &v->x) && parse_float(p, end, &v->y) && parse_float(p, end, &v->z);
+}
+
+/// Parse the facets of [chunk->begin, chunk->end). Only the last chunk may
+/// end with something else than a facet: stl_read() stops reading after the
+/// facets it counted, whatever follows them.
+bool
+parse_ascii_chunk(AsciiChunk* chunk, bool last)
+{
+    const char* p   = chunk->begin;
+    const char* end = chunk->end;
+    while (true) {
+        skip_spaces(p, end);
+        if (p == end) return true;
+
+        // stl_read() skips an "endsolid" and then a "solid" line before every facet
+        if (starts_with(p, end, "endsolid", 8)) {
+            p += 8;
+            skip_spaces(p, end);
+        }
+        if (starts_with(p, end, "solid", 5)) {
+            p = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (p == NULL) p = end;
+            skip_spaces(p, end);
+        }
+        if (p == end) return true;
+
+        if (!match_keyword(p, end, "facet")) return last;
+        stl_facet facet;
+        memset(&facet, 0, sizeof(facet));
+        if (!(match_keyword(p, end, "normal") && parse_vertex(p, end, &facet.normal)
+            && match_keyword(p, end, "outer") && match_keyword(p, end, "loop")
+            && match_keyword(p, end, "vertex") && parse_vertex(p, end, &facet.vertex[0])
+            && match_keyword(p, end, "vertex") && parse_vertex(p, end, &facet.vertex[1])
+            && match_keyword(p, end, "vertex") && parse_vertex(p, end, &facet.vertex[2])
+            && match_keyword(p, end, "endloop") && match_keyword(p, end, "endfacet")))
+            return false;
+        unify_zeros(&facet);
+        chunk->facets.push_back(facet);
+    }
+}
+
+/// Count the lines of [begin, end) the way stl_count_facets() does: lines are
+/// read with fgets() into a 100 bytes buffer, and the pieces not longer than
+/// 4 characters or starting with "solid" or "endsolid" are not counted.
+/// \return false if the text contains a NUL character, which fgets() would
+/// not handle the same.
+bool
+count_ascii_lines(const char* begin, const char* end, int* lines)
+{
+    if (memchr(begin, '\0', end - begin) != NULL) return false;
+    *lines = 0;
+    for (const char* line = begin; line < end; ) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        const char* line_end = eol == NULL ? end : eol + 1;
+        size_t length = line_end - line;
+        if (text_mode_crlf && eol != NULL && eol > line && eol[-1] == '\r') --length;
+        for (size_t offset = 0; offset < length; offset += 99) {
+            const size_t piece = std::min<size_t>(99, length - offset);
+            if (piece <= 4) continue;
+            const char* s = line + offset;
+            if (memcmp(s, "solid", 5) == 0 || (piece >= 8 && memcmp(s, "endsolid", 8) == 0)) continue;
+            ++*lines;
+        }
+        line = line_end;
+    }
+    return true;
+}
+
+/// First line start at or after pos whose first token is the "facet" keyword.
+const char*
+next_facet_line(const char* pos, const char* begin, const char* end)
+{
+    while (pos < end) {
+        if (pos > begin && pos[-1] != '\n') {
+            pos = static_cast<const char*>(memchr(pos, '\n', end - pos));
+            if (pos == NULL) return end;
+            ++pos;
+            continue;
+        }
+        const char* p = pos;
+        if (match_keyword(p, end, "facet")) return pos;
+        pos = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (pos == NULL) return end;
+        ++pos;
+    }
+    return end;
+}
+
+bool
+read_ascii(const char* data, size_t file_size, stl_file* stl, int threads)
+{
+    const char* end = data + file_size;
+
+    // split at lines starting a facet, aiming at a few chunks per thread
+    const size_t chunk_bytes = std::max<size_t>(65536, file_size / (std::max(threads, 1) * 4));
+    std::vector<AsciiChunk> chunks;
+    for (const char* begin = data; begin < end; ) {
+        AsciiChunk chunk;
+        chunk.begin = begin;
+        chunk.end   = next_facet_line(std::min(end, begin + chunk_bytes), data, end);
+        chunk.lines = 0;
+        chunk.valid = false;
+        chunks.push_back(chunk);
+        begin = chunk.end;
+    }
+
+    parallelize<size_t>(
+        0,
+        chunks.size() - 1,
+        [&chunks](size_t chunk_idx) {
+            AsciiChunk &chunk = chunks[chunk_idx];
+            chunk.valid = count_ascii_lines(chunk.begin, chunk.end, &chunk.lines)
+                && parse_ascii_chunk(&chunk, chunk_idx + 1 == chunks.size());
+        },
+        threads
+    );
+
+    // stl_read() reads as many facets as stl_count_facets() counted, so only
+    // take the file when that count is exactly the number of facets found
+    int lines = 1;
+    std::vector<size_t> offsets;
+    size_t facets_count = 0;
+    for (const AsciiChunk &chunk : chunks) {
+        if (!chunk.valid) return false;
+        lines += chunk.lines;
+        offsets.push_back(facets_count);
+        facets_count += chunk.facets.size();
+    }
+    if (facets_count == 0 || facets_count != size_t(lines / ASCII_LINES_PER_FACET)) return false;
+
+    stl_initialize(stl);
+    stl->stats.type = ascii;
+    {
+        // the header is the first line, up to 80 characters
+        int i = 0;
+        for (const char* p = data; i < 80 && p < end && *p != '\n'; ++p) {
+            if (text_mode_crlf && *p == '\r' && p + 1 < end && p[1] == '\n') break;
+            stl->stats.header[i++] = *p;
+        }
+        stl->stats.header[i]  = '\0';
+        stl->stats.header[80] = '\0';
+    }
+    stl->stats.number_of_facets    = facets_count;
+    stl->stats.original_num_facets = facets_count;
+    stl_allocate(stl);
+    if (stl->facet_start == NULL || stl->neighbors_start == NULL) {
+        stl->error = 1;
+        return true;
+    }
+
+    std::vector<ChunkBounds> bounds(chunks.size());
+    parallelize<size_t>(
+        0,
+        chunks.size() - 1,
+        [&](size_t chunk_idx) {
+            const std::vector<stl_facet> &facets = chunks[chunk_idx].facets;
+            if (facets.empty()) return;
+            stl_facet* first = stl->facet_start + offsets[chunk_idx];
+            std::copy(facets.begin(), facets.end(), first);
+            bounds[chunk_idx] = facets_bounds(first, first + facets.size());
+        },
+        threads
+    );
+
+    // chunks without facets have no bounds
+    std::vector<ChunkBounds> nonempty_bounds;
+    for (size_t i = 0; i < chunks.size(); ++i)
+        if (!chunks[i].facets.empty()) nonempty_bounds.push_back(bounds[i]);
+    finish_stats(stl, nonempty_bounds);
+    return true;
+}
+
+}
+
+bool
+read_stl(const std::string &input_file, stl_file* stl, int threads)
+{
+    namespace bip = boost::interprocess;
+
+    bip::file_mapping file;
+    bip::mapped_region region;
+    try {
+        file = bip::file_mapping(input_file.c_str(), bip::read_only);
+        region = bip::mapped_region(file, bip::read_only);
+    } catch (const bip::interprocess_exception &) {
+        return false;
+    }
+    const unsigned char* data = static_cast<const unsigned char*>(region.get_address());
+    const size_t file_size = region.get_size();
+
+    // same test as stl_count_facets(): any byte past 127 after the header
+    // means binary; shorter files are left to stl_open() to complain about
+    if (file_size < HEADER_SIZE + 128) return false;
+    region.advise(bip::mapped_region::advice_sequential);
+    if (std::any_of(data + HEADER_SIZE, data + HEADER_SIZE + 128, [](unsigned char c) { return c > 127; }))
+        return read_binary(data, file_size, stl, threads);
+    return read_ascii(reinterpret_cast<const char*>(data), file_size, stl, threads);
+}
+
+} }
@@ -0,0 +1,22 @@
+#ifndef slic3r_IO_STL_hpp_
+#define slic3r_IO_STL_hpp_
+
+#include "../libslic3r.h"
+#include <admesh/stl.h>
+#include <string>
+
+namespace Slic3r { namespace IO {
+
+/// \brief Read a STL file through a memory mapping.
+/// Binary files are decoded in parallel chunks straight into stl->facet_start.
+/// ASCII files are split at facet boundaries and the chunks are tokenized
+/// concurrently. In both cases the bounding box is reduced per chunk and the
+/// result is the same as the one of stl_open().
+/// \return false, leaving stl untouched, if the file can't be mapped or does
+/// not follow the layout these readers expect; the caller should then fall
+/// back to stl_open().
+bool read_stl(const std::string &input_file, stl_file* stl, int threads);
+
+} }
+
+#endif
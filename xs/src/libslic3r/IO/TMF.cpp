@@ -151,8 +151,8 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
         volume->mesh.require_shared_vertices();
 
         vertices_offsets.push_back(num_vertices);
-        const auto &stl = volume->mesh.stl;
-        for (int i = 0; i < stl.stats.shared_vertices; ++i)
+        const auto &its = volume->mesh.its;
+        for (size_t i = 0; i < its.vertices.size(); ++i)
         {
 
             // Subtract origin_translation in order to restore the coordinates of the parts
@@ -162,11 +162,11 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
             // In order to do this we compensate for this translation in the instance placement
             // below.
             fout << "                    <vertex";
-            fout << " x=\"" << (stl.v_shared[i].x - origin_translation.x) << "\"";
-            fout << " y=\"" << (stl.v_shared[i].y - origin_translation.y) << "\"";
-            fout << " z=\"" << (stl.v_shared[i].z - origin_translation.z) << "\"/>\n";
+            fout << " x=\"" << (its.vertices[i].x - origin_translation.x) << "\"";
+            fout << " y=\"" << (its.vertices[i].y - origin_translation.y) << "\"";
+            fout << " z=\"" << (its.vertices[i].z - origin_translation.z) << "\"/>\n";
         }
-        num_vertices += stl.stats.shared_vertices;
+        num_vertices += its.vertices.size();
     }
 
     // Close the vertices element.
@@ -188,7 +188,7 @@ TMFEditor::write_object(boost::nowide::ofstream& fout, const ModelObject* object
         for (int i = 0; i < volume->mesh.stl.stats.number_of_facets; ++i){
             fout << "                    <triangle";
             for (int j = 0; j < 3; j++){
-                fout << " v" << (j+1) << "=\"" << (volume->mesh.stl.v_indices[i].vertex[j] + vertices_offset) << "\"";
+                fout << " v" << (j+1) << "=\"" << (volume->mesh.its.indices[i].vertex[j] + vertices_offset) << "\"";
             }
             fout << "/>\n";
             num_triangles++;
@@ -439,10 +439,10 @@ Layer::detect_surfaces_type()
 
 ///Iterates over all LayerRegions and invokes LayerRegion->process_external_surfaces
 void
-Layer::process_external_surfaces()
+Layer::process_external_surfaces(BridgeAngleCache* bridge_angles)
 {
     for (LayerRegion* &layerm : this->regions)
-        layerm->process_external_surfaces();
+        layerm->process_external_surfaces(bridge_angles);
 }
 
 }
@@ -15,6 +15,7 @@ namespace Slic3r {
 typedef std::pair<coordf_t,coordf_t> t_layer_height_range;
 typedef std::map<t_layer_height_range,coordf_t> t_layer_height_ranges;
 
+class BridgeAngleCache;
 class Layer;
 class PrintRegion;
 class PrintObject;
@@ -66,8 +67,9 @@ class LayerRegion
     void make_perimeters(const SurfaceCollection &slices, SurfaceCollection* fill_surfaces);
     /// Generate infills for a LayerRegion.
     void make_fill();
-    /// Processes external surfaces for bridges and top/bottom surfaces
-    void process_external_surfaces();
+    /// Processes external surfaces for bridges and top/bottom surfaces.
+    /// The bridge angles are looked up in and added to bridge_angles, if any.
+    void process_external_surfaces(BridgeAngleCache* bridge_angles = nullptr);
     /// Gets the smallest fillable area
     double infill_area_threshold() const;
     
@@ -136,7 +138,7 @@ class Layer {
     /// Determines the type of surface (top/bottombridge/bottom/internal) each region is
     void detect_surfaces_type();
     /// Processes the external surfaces
-    void process_external_surfaces();
+    void process_external_surfaces(BridgeAngleCache* bridge_angles = nullptr);
 
     /// polymorphic id
     virtual bool is_support() const { return false;}
@@ -0,0 +1,234 @@
+#include "LayerPipeline.hpp"
+#include "CancellationToken.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+namespace Slic3r {
+
+LayerPipeline::LayerPipeline(size_t layers_count)
+    : n_layers(layers_count), pending(0), cancelled(false)
+{}
+
+LayerPipeline::~LayerPipeline()
+{
+    if (this->thread.joinable()) {
+        this->cancel();
+        this->thread.join();
+    }
+}
+
+void
+LayerPipeline::add_stage(const Task &task, size_t below, size_t above)
+{
+    Stage stage;
+    stage.task  = task;
+    stage.below = this->stages.empty() ? 0 : below;
+    stage.above = this->stages.empty() ? 0 : above;
+    this->stages.push_back(stage);
+}
+
+void
+LayerPipeline::run(int threads_count)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        this->ready.clear();
+        this->blockers.assign(this->stages.size(), std::vector<size_t>(this->n_layers, 0));
+        this->done.assign(this->stages.size(), std::vector<bool>(this->n_layers, false));
+        this->pending   = this->stages.size() * this->n_layers;
+        this->cancelled = false;
+        this->error     = std::exception_ptr();
+
+        for (size_t s = 1; s < this->stages.size(); ++s) {
+            const Stage &stage = this->stages[s];
+            for (size_t i = 0; i < this->n_layers; ++i) {
+                const size_t lo = i - std::min(i, stage.below);
+                const size_t hi = std::min(this->n_layers - 1, i + stage.above);
+                this->blockers[s][i] = hi - lo + 1;
+            }
+        }
+        if (this->pending > 0)
+            for (size_t i = 0; i < this->n_layers; ++i)
+                this->ready.insert(std::make_pair(i, size_t(0)));
+    }
+    if (this->pending == 0) return;
+
+    // every thread keeps picking ready tasks until the graph is over, so
+    // each one is handed a single item
+    const size_t threads = std::max(threads_count, 1);
+    ThreadPool::instance().parallel_for(0, threads, [this](size_t) { this->work(); }, threads, 1);
+
+    if (this->error) std::rethrow_exception(this->error);
+}
+
+void
+LayerPipeline::start(int threads_count)
+{
+    if (this->thread.joinable())
+        throw std::logic_error("LayerPipeline::start(): already running");
+    // mark the graph as running before returning, so that early calls to
+    // wait() don't see it as over
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        this->pending   = this->stages.size() * this->n_layers;
+        this->cancelled = false;
+        this->done.assign(this->stages.size(), std::vector<bool>(this->n_layers, false));
+    }
+    // hand the token of the caller over to the background thread
+    const CancellationToken* cancel = CancellationToken::current();
+    this->thread = boost::thread([this, threads_count, cancel]() {
+        CancellationScope scope(cancel);
+        try {
+            this->run(threads_count);
+        } catch (...) {
+            // kept in this->error for join() and wait()
+        }
+        // wake up the consumers of a graph which stopped early
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        this->cancelled = this->cancelled || this->pending > 0;
+        this->changed.notify_all();
+    });
+}
+
+void
+LayerPipeline::wait(size_t stage, size_t layer)
+{
+    boost::unique_lock<boost::mutex> lock(this->mutex);
+    while (!this->done.at(stage).at(layer) && !this->over())
+        this->changed.wait(lock);
+    if (this->error) std::rethrow_exception(this->error);
+    if (!this->done[stage][layer])
+        throw std::runtime_error("LayerPipeline::wait(): the pipeline was cancelled");
+}
+
+void
+LayerPipeline::join()
+{
+    if (this->thread.joinable()) this->thread.join();
+    if (this->error) std::rethrow_exception(this->error);
+}
+
+void
+LayerPipeline::cancel()
+{
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    this->cancelled = true;
+    this->changed.notify_all();
+}
+
+bool
+LayerPipeline::is_done(size_t stage, size_t layer) const
+{
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return stage < this->done.size() && layer < this->n_layers && this->done[stage][layer];
+}
+
+void
+LayerPipeline::work()
+{
+    boost::unique_lock<boost::mutex> lock(this->mutex);
+    while (true) {
+        while (this->ready.empty() && !this->over())
+            this->changed.wait(lock);
+        if (this->over()) return;
+
+        const size_t layer = this->ready.begin()->first;
+        const size_t stage = this->ready.begin()->second;
+        this->ready.erase(this->ready.begin());
+
+        lock.unlock();
+        try {
+            CancellationToken::check_current();
+            this->stages[stage].task(layer);
+        } catch (...) {
+            lock.lock();
+            if (!this->error) this->error = std::current_exception();
+            this->cancelled = true;
+            this->changed.notify_all();
+            return;
+        }
+        lock.lock();
+        this->complete(stage, layer);
+    }
+}
+
+void
+LayerPipeline::complete(size_t stage, size_t layer)
+{
+    this->done[stage][layer] = true;
+    --this->pending;
+
+    // the next stage's tasks whose window contains this layer
+    if (stage + 1 < this->stages.size()) {
+        const Stage &next = this->stages[stage + 1];
+        const size_t lo = layer - std::min(layer, next.above);
+        const size_t hi = std::min(this->n_layers - 1, layer + next.below);
+        for (size_t i = lo; i <= hi; ++i)
+            if (--this->blockers[stage + 1][i] == 0)
+                this->ready.insert(std::make_pair(i, stage + 1));
+    }
+    this->changed.notify_all();
+}
+
+LayerChains::LayerChains(size_t layers_count)
+    : visits(layers_count, 0)
+{}
+
+size_t
+LayerChains::add_chain(const std::vector<size_t> &layers)
+{
+    std::vector<size_t> turns;
+    turns.reserve(layers.size());
+    for (size_t layer : layers)
+        turns.push_back(this->visits.at(layer)++);
+    this->layers.push_back(layers);
+    this->turns.push_back(turns);
+    return this->layers.size() - 1;
+}
+
+void
+LayerChains::run(const Visit &visit, int threads_count) const
+{
+    std::vector<size_t> turns(this->visits.size(), 0);
+    std::atomic<size_t> next_chain(0);
+    boost::mutex mutex;
+    boost::condition_variable turn_taken;
+    bool failed = false;
+    std::exception_ptr error;
+
+    // every thread takes the next chain until none is left and waits for
+    // the turn of each of its visits on the layer
+    const auto work = [&](size_t) {
+        for (size_t c = next_chain++; c < this->layers.size(); c = next_chain++) {
+            for (size_t v = 0; v < this->layers[c].size(); ++v) {
+                size_t &turn = turns[this->layers[c][v]];
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (turn != this->turns[c][v] && !failed) turn_taken.wait(lock);
+                    if (failed) return;
+                }
+                try {
+                    CancellationToken::check_current();
+                    visit(c, v);
+                } catch (...) {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    if (!failed) error = std::current_exception();
+                    failed = true;
+                    turn_taken.notify_all();
+                    return;
+                }
+                boost::lock_guard<boost::mutex> lock(mutex);
+                ++turn;
+                turn_taken.notify_all();
+            }
+        }
+    };
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(std::max(threads_count, 1), this->layers.size()));
+    ThreadPool::instance().parallel_for(0, threads, work, threads, 1);
+
+    if (error) std::rethrow_exception(error);
+}
+
+}
@@ -0,0 +1,131 @@
+#ifndef slic3r_LayerPipeline_hpp_
+#define slic3r_LayerPipeline_hpp_
+
+#include <cstddef>
+#include <exception>
+#include <set>
+#include <utility>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+/// Dependency-tracked graph of per-layer tasks.
+/// The graph is a chain of stages, each one calling its function once for
+/// every layer. The task of a stage for layer i becomes ready as soon as the
+/// previous stage is done for the layers [i - below, i + above], so the
+/// bottom layers flow through all of the stages while the upper ones are
+/// still being worked on. Ready tasks are run lowest layer first on the
+/// threads of the shared ThreadPool, and consumers may block on any single
+/// (stage, layer) pair while the graph is running in the background.
+class LayerPipeline
+{
+    public:
+    typedef boost::function<void(size_t)> Task;
+
+    explicit LayerPipeline(size_t layers_count);
+    /// Cancels and joins a background run still going on.
+    ~LayerPipeline();
+
+    /// Append a stage whose task for layer i depends on the layers
+    /// [i - below, i + above] of the previous stage (clamped to the
+    /// existing layers). The window of the first stage is ignored.
+    void add_stage(const Task &task, size_t below = 0, size_t above = 0);
+
+    /// Run every task using at most threads_count threads, the calling one
+    /// included. The first exception thrown by a task stops the graph and
+    /// is rethrown here, a cancelled current CancellationToken included.
+    void run(int threads_count);
+
+    /// Same as run(), on a background thread, which gets the current
+    /// CancellationToken of the caller. Use wait() to consume the
+    /// layers as they get done and join() to collect the outcome.
+    void start(int threads_count);
+
+    /// Block until the given stage is done for the given layer. Rethrows
+    /// the exception that stopped the graph, if any.
+    void wait(size_t stage, size_t layer);
+
+    /// Wait for the end of a background run and rethrow its failure.
+    void join();
+
+    /// Don't start any new task; the running ones are let finish.
+    void cancel();
+
+    bool is_done(size_t stage, size_t layer) const;
+    size_t stages_count() const { return this->stages.size(); }
+    size_t layers_count() const { return this->n_layers; }
+
+    private:
+    struct Stage {
+        Task task;
+        size_t below;
+        size_t above;
+    };
+
+    LayerPipeline(const LayerPipeline&) = delete;
+    LayerPipeline& operator=(const LayerPipeline&) = delete;
+
+    /// Loop of a single thread: run ready tasks until the graph is over.
+    void work();
+    /// Mark a task as done and queue the tasks it was the last blocker of.
+    void complete(size_t stage, size_t layer);
+    bool over() const { return this->pending == 0 || this->cancelled; }
+
+    size_t n_layers;
+    std::vector<Stage> stages;
+
+    /// Guards everything below.
+    mutable boost::mutex mutex;
+    boost::condition_variable changed;
+    /// Ready tasks as (layer, stage) pairs, so the lowest layer comes first.
+    std::set<std::pair<size_t, size_t>> ready;
+    /// Per stage and layer: number of tasks of the previous stage still
+    /// blocking it.
+    std::vector<std::vector<size_t>> blockers;
+    std::vector<std::vector<bool>> done;
+    size_t pending;
+    bool cancelled;
+    std::exception_ptr error;
+
+    boost::thread thread;
+};
+
+/// Chains of per-layer visits run on several threads with the outcome of
+/// running them one after the other. Each chain visits its layers in order,
+/// and every layer is visited by the chains in the order they were added,
+/// so chains working on distinct layers overlap while the successive states
+/// of any single layer stay those of the serial run.
+class LayerChains
+{
+    public:
+    /// Called with the chain index and the rank of the visit in that chain.
+    typedef boost::function<void(size_t, size_t)> Visit;
+
+    explicit LayerChains(size_t layers_count);
+
+    /// Append a chain visiting the given layers in that order and return
+    /// its index.
+    size_t add_chain(const std::vector<size_t> &layers);
+
+    /// Run every visit using at most threads_count threads, the calling one
+    /// included. The first exception thrown by a visit stops the run and is
+    /// rethrown here, a cancelled current CancellationToken included.
+    void run(const Visit &visit, int threads_count) const;
+
+    size_t chains_count() const { return this->layers.size(); }
+    size_t layers_count() const { return this->visits.size(); }
+
+    private:
+    /// Per chain: the layers it visits.
+    std::vector<std::vector<size_t>> layers;
+    /// Per chain: rank of each visit among all of the visits of its layer.
+    std::vector<std::vector<size_t>> turns;
+    /// Per layer: number of visits so far.
+    std::vector<size_t> visits;
+};
+
+}
+
+#endif
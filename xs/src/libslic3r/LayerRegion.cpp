@@ -76,7 +76,7 @@ LayerRegion::make_perimeters(const SurfaceCollection &slices, SurfaceCollection*
 /// This function reads layer->slices and lower_layer->slices
 /// and writes this->bridged and this->fill_surfaces, so it's thread-safe.
 void
-LayerRegion::process_external_surfaces()
+LayerRegion::process_external_surfaces(BridgeAngleCache* bridge_angles)
 {
     Surfaces &surfaces = this->fill_surfaces.surfaces;
     
@@ -127,8 +127,10 @@ LayerRegion::process_external_surfaces()
             BridgeDetector bd(
                 surface.expolygon,
                 this->layer()->lower_layer->slices,
-                this->flow(frInfill, true).scaled_width()
+                this->flow(frInfill, true).scaled_width(),
+                this->layer()->object()->print()->config.threads.value
             );
+            bd.cache = bridge_angles;
             
             #ifdef SLIC3R_DEBUG
             printf("Processing bridge at layer %zu (z = %f):\n", this->layer()->id(), this->layer()->print_z);
@@ -0,0 +1,472 @@
+#include "MeshRepair.hpp"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+namespace Slic3r { namespace MeshRepair {
+
+namespace {
+
+/// An edge keyed by its two vertices, the lower one first, as loaded by
+/// stl_load_edge_exact().
+struct HashEdge
+{
+    uint32_t key[6];
+    int facet_number;
+    /// Index of the edge in its facet, plus 3 if it is stored backwards.
+    int which_edge;
+};
+
+/// Facets handled by one task of the parallel loops.
+const size_t facets_per_chunk = 16384;
+
+/// Copy of a facet with -0 unified to +0, as the admesh checks compare
+/// vertices with memcmp().
+stl_facet
+unified_facet(const stl_facet &facet)
+{
+    stl_facet unified = facet;
+    uint32_t bits[12];
+    memcpy(bits, &unified, sizeof(bits));
+    for (int j = 0; j < 12; ++j)
+        if (bits[j] == 0x80000000) bits[j] = 0;
+    memcpy(&unified, bits, sizeof(bits));
+    return unified;
+}
+
+bool
+is_degenerate(const stl_facet &facet)
+{
+    return !memcmp(&facet.vertex[0], &facet.vertex[1], sizeof(stl_vertex))
+        || !memcmp(&facet.vertex[1], &facet.vertex[2], sizeof(stl_vertex))
+        || !memcmp(&facet.vertex[0], &facet.vertex[2], sizeof(stl_vertex));
+}
+
+void
+load_edge_exact(const stl_vertex &a, const stl_vertex &b, HashEdge* edge)
+{
+    if ((a.x != b.x) ? (a.x < b.x) : ((a.y != b.y) ? (a.y < b.y) : (a.z < b.z))) {
+        memcpy(&edge->key[0], &a, sizeof(stl_vertex));
+        memcpy(&edge->key[3], &b, sizeof(stl_vertex));
+    } else {
+        memcpy(&edge->key[0], &b, sizeof(stl_vertex));
+        memcpy(&edge->key[3], &a, sizeof(stl_vertex));
+        edge->which_edge += 3;
+    }
+}
+
+size_t
+edge_hash(const HashEdge &edge)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (int k = 0; k < 6; ++k)
+        h = (h ^ edge.key[k]) * 1099511628211ULL;
+    return size_t(h ^ (h >> 32));
+}
+
+/// Same as stl_record_neighbors() without the statistics, which are counted
+/// once all the edges are matched. Concurrent calls never write the same slot.
+void
+record_neighbors(stl_file* stl, const HashEdge &edge_a, const HashEdge &edge_b)
+{
+    stl_neighbors &a = stl->neighbors_start[edge_a.facet_number];
+    stl_neighbors &b = stl->neighbors_start[edge_b.facet_number];
+    a.neighbor[edge_a.which_edge % 3]         = edge_b.facet_number;
+    a.which_vertex_not[edge_a.which_edge % 3] = (edge_b.which_edge + 2) % 3;
+    b.neighbor[edge_b.which_edge % 3]         = edge_a.facet_number;
+    b.which_vertex_not[edge_b.which_edge % 3] = (edge_a.which_edge + 2) % 3;
+    if ((edge_a.which_edge < 3) == (edge_b.which_edge < 3)) {
+        // the facets are oriented in opposite directions
+        a.which_vertex_not[edge_a.which_edge % 3] += 3;
+        b.which_vertex_not[edge_b.which_edge % 3] += 3;
+    }
+}
+
+/// Same as stl_check_normal_vector().
+int
+check_normal_vector(stl_facet* facet, bool normal_fix_flag, int* normals_fixed)
+{
+    float normal[3];
+    stl_calculate_normal(normal, facet);
+    stl_normalize_vector(normal);
+
+    if (   (ABS(normal[0] - facet->normal.x) < 0.001)
+        && (ABS(normal[1] - facet->normal.y) < 0.001)
+        && (ABS(normal[2] - facet->normal.z) < 0.001)) {
+        facet->normal.x = normal[0];
+        facet->normal.y = normal[1];
+        facet->normal.z = normal[2];
+        return 0;
+    }
+
+    float test_norm[3] = { facet->normal.x, facet->normal.y, facet->normal.z };
+    stl_normalize_vector(test_norm);
+    int status = 4;
+    if (   (ABS(normal[0] - test_norm[0]) < 0.001)
+        && (ABS(normal[1] - test_norm[1]) < 0.001)
+        && (ABS(normal[2] - test_norm[2]) < 0.001)) {
+        status = 1;
+    } else {
+        test_norm[0] *= -1;
+        test_norm[1] *= -1;
+        test_norm[2] *= -1;
+        if (   (ABS(normal[0] - test_norm[0]) < 0.001)
+            && (ABS(normal[1] - test_norm[1]) < 0.001)
+            && (ABS(normal[2] - test_norm[2]) < 0.001))
+            status = 2;
+    }
+    if (normal_fix_flag) {
+        facet->normal.x = normal[0];
+        facet->normal.y = normal[1];
+        facet->normal.z = normal[2];
+        ++*normals_fixed;
+    }
+    return status;
+}
+
+/// Same as stl_reverse_facet().
+void
+reverse_facet(stl_file* stl, int facet_num, int* facets_reversed)
+{
+    ++*facets_reversed;
+
+    stl_neighbors &neighbors = stl->neighbors_start[facet_num];
+    int  neighbor[3];
+    char vnot[3];
+    for (int j = 0; j < 3; ++j) {
+        neighbor[j] = neighbors.neighbor[j];
+        vnot[j]     = neighbors.which_vertex_not[j];
+    }
+
+    stl_facet &facet = stl->facet_start[facet_num];
+    std::swap(facet.vertex[0], facet.vertex[1]);
+
+    // fix the vnots of the neighboring facets
+    static const int shift[3] = { 3, 4, 2 };
+    for (int j = 0; j < 3; ++j)
+        if (neighbor[j] != -1) {
+            char &v = stl->neighbors_start[neighbor[j]].which_vertex_not[(vnot[j] + 1) % 3];
+            v = (v + shift[j]) % 6;
+        }
+
+    // swap the neighbors and the vnots of the facet being reversed, and reverse its vnots
+    neighbors.neighbor[1] = neighbor[2];
+    neighbors.neighbor[2] = neighbor[1];
+    neighbors.which_vertex_not[1] = vnot[2];
+    neighbors.which_vertex_not[2] = vnot[1];
+    for (int j = 0; j < 3; ++j)
+        neighbors.which_vertex_not[j] = (neighbors.which_vertex_not[j] + 3) % 6;
+}
+
+/// Walk one connected component the way stl_fix_normal_directions() walks
+/// the whole mesh. facets lists the component in increasing order.
+void
+fix_component_directions(stl_file* stl, const int* facets, size_t count, std::vector<char> &norm_sw,
+    int* number_of_parts, int* facets_reversed)
+{
+    std::vector<int> stack;
+    size_t checked    = 0;
+    size_t next_start = 0;
+    int facet_num = facets[0];
+    if (check_normal_vector(&stl->facet_start[facet_num], false, NULL) == 2)
+        reverse_facet(stl, facet_num, facets_reversed);
+    norm_sw[facet_num] = 1;
+    ++checked;
+
+    while (true) {
+        for (int j = 0; j < 3; ++j) {
+            const stl_neighbors &neighbors = stl->neighbors_start[facet_num];
+            // reverse the neighboring facets if necessary
+            if (neighbors.which_vertex_not[j] > 2 && neighbors.neighbor[j] != -1)
+                reverse_facet(stl, neighbors.neighbor[j], facets_reversed);
+            if (neighbors.neighbor[j] != -1 && norm_sw[neighbors.neighbor[j]] != 1)
+                stack.push_back(neighbors.neighbor[j]);
+        }
+        if (!stack.empty()) {
+            facet_num = stack.back();
+            stack.pop_back();
+            if (norm_sw[facet_num] != 1) {
+                norm_sw[facet_num] = 1;
+                ++checked;
+            }
+        } else {
+            // a part is done, start the next one from its first facet
+            ++*number_of_parts;
+            if (checked >= count) break;
+            while (norm_sw[facets[next_start]] != 0) ++next_start;
+            facet_num = facets[next_start];
+            if (check_normal_vector(&stl->facet_start[facet_num], false, NULL) == 2)
+                reverse_facet(stl, facet_num, facets_reversed);
+            norm_sw[facet_num] = 1;
+            ++checked;
+        }
+    }
+}
+
+int
+find_root(std::vector<int> &parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+}
+
+void
+check_facets_exact(stl_file* stl, int threads)
+{
+    if (stl->error) return;
+
+    stl->stats.connected_edges         = 0;
+    stl->stats.connected_facets_1_edge = 0;
+    stl->stats.connected_facets_2_edge = 0;
+    stl->stats.connected_facets_3_edge = 0;
+
+    for (int i = 0; i < stl->stats.number_of_facets; ++i)
+        for (int j = 0; j < 3; ++j)
+            stl->neighbors_start[i].neighbor[j] = -1;
+
+    // Degenerate facets are replaced by the last facet, which is checked in
+    // turn, as stl_remove_facet() does. No facet is connected yet, so the
+    // removal doesn't change any neighbor.
+    {
+        std::vector<char> degenerate(stl->stats.number_of_facets);
+        parallelize<int>(
+            0,
+            stl->stats.number_of_facets - 1,
+            [stl, &degenerate](int i) { degenerate[i] = is_degenerate(unified_facet(stl->facet_start[i])); },
+            threads
+        );
+        for (int i = 0; i < stl->stats.number_of_facets; ) {
+            if (!degenerate[i]) {
+                ++i;
+                continue;
+            }
+            const int last = stl->stats.number_of_facets - 1;
+            stl->facet_start[i]     = stl->facet_start[last];
+            stl->neighbors_start[i] = stl->neighbors_start[last];
+            degenerate[i]           = degenerate[last];
+            stl->stats.number_of_facets -= 1;
+            stl->stats.degenerate_facets += 1;
+            stl->stats.facets_removed += 1;
+        }
+    }
+
+    const size_t facets_count = stl->stats.number_of_facets;
+    if (facets_count == 0) return;
+    const size_t chunks_count = (facets_count + facets_per_chunk - 1) / facets_per_chunk;
+
+    // enough partitions to keep them cache sized, a power of two to mask the hash
+    size_t partitions = 1;
+    while (partitions < (3 * facets_count) / 2048 && partitions < 4096) partitions *= 2;
+
+    // load the edges in facet order, counting them per chunk and partition
+    std::vector<HashEdge> edges(3 * facets_count);
+    std::vector<std::vector<size_t>> counts(chunks_count, std::vector<size_t>(partitions, 0));
+    std::vector<float> shortest_edges(chunks_count, FLT_MAX);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const size_t first = chunk_idx * facets_per_chunk;
+            const size_t last  = std::min(facets_count, first + facets_per_chunk);
+            for (size_t i = first; i < last; ++i) {
+                const stl_facet facet = unified_facet(stl->facet_start[i]);
+                for (int j = 0; j < 3; ++j) {
+                    const stl_vertex &a = facet.vertex[j];
+                    const stl_vertex &b = facet.vertex[(j + 1) % 3];
+                    float max_diff = STL_MAX(ABS(a.x - b.x), ABS(a.y - b.y));
+                    max_diff = STL_MAX(ABS(a.z - b.z), max_diff);
+                    shortest_edges[chunk_idx] = STL_MIN(max_diff, shortest_edges[chunk_idx]);
+
+                    HashEdge &edge = edges[3 * i + j];
+                    edge.facet_number = i;
+                    edge.which_edge   = j;
+                    load_edge_exact(a, b, &edge);
+                    ++counts[chunk_idx][edge_hash(edge) & (partitions - 1)];
+                }
+            }
+        },
+        threads
+    );
+    for (float shortest : shortest_edges)
+        stl->stats.shortest_edge = STL_MIN(shortest, stl->stats.shortest_edge);
+
+    // scatter the edges to their partitions, keeping them in facet order
+    std::vector<size_t> partition_start(partitions + 1, 0);
+    std::vector<std::vector<size_t>> offsets(chunks_count, std::vector<size_t>(partitions));
+    {
+        size_t offset = 0;
+        for (size_t p = 0; p < partitions; ++p) {
+            partition_start[p] = offset;
+            for (size_t c = 0; c < chunks_count; ++c) {
+                offsets[c][p] = offset;
+                offset += counts[c][p];
+            }
+        }
+        partition_start[partitions] = offset;
+    }
+    std::vector<HashEdge> partitioned(edges.size());
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            std::vector<size_t> &offset = offsets[chunk_idx];
+            const size_t first = 3 * chunk_idx * facets_per_chunk;
+            const size_t last  = std::min(edges.size(), first + 3 * facets_per_chunk);
+            for (size_t e = first; e < last; ++e)
+                partitioned[offset[edge_hash(edges[e]) & (partitions - 1)]++] = edges[e];
+        },
+        threads
+    );
+    std::vector<HashEdge>().swap(edges);
+
+    // Within a partition, admesh matches every edge with the oldest unmatched
+    // edge having the same key, so equal keys pair up in facet order.
+    parallelize<size_t>(
+        0,
+        partitions - 1,
+        [&](size_t p) {
+            HashEdge* first = partitioned.data() + partition_start[p];
+            HashEdge* last  = partitioned.data() + partition_start[p + 1];
+            std::stable_sort(first, last, [](const HashEdge &e1, const HashEdge &e2) {
+                return memcmp(e1.key, e2.key, sizeof(e1.key)) < 0;
+            });
+            for (HashEdge* edge = first; edge + 1 < last; ) {
+                if (memcmp(edge[0].key, edge[1].key, sizeof(edge->key)) == 0) {
+                    record_neighbors(stl, edge[1], edge[0]);
+                    edge += 2;
+                } else {
+                    edge += 1;
+                }
+            }
+        },
+        threads
+    );
+
+    // count the connections as stl_record_neighbors() does while matching
+    std::vector<std::array<int, 4>> connected(chunks_count);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            std::array<int, 4> &c = connected[chunk_idx];
+            c.fill(0);
+            const size_t first = chunk_idx * facets_per_chunk;
+            const size_t last  = std::min(facets_count, first + facets_per_chunk);
+            for (size_t i = first; i < last; ++i) {
+                const int *neighbor = stl->neighbors_start[i].neighbor;
+                const int edges_connected = (neighbor[0] != -1) + (neighbor[1] != -1) + (neighbor[2] != -1);
+                c[0] += edges_connected;
+                for (int k = 1; k <= edges_connected; ++k) ++c[k];
+            }
+        },
+        threads
+    );
+    for (const std::array<int, 4> &c : connected) {
+        stl->stats.connected_edges         += c[0];
+        stl->stats.connected_facets_1_edge += c[1];
+        stl->stats.connected_facets_2_edge += c[2];
+        stl->stats.connected_facets_3_edge += c[3];
+    }
+}
+
+void
+fix_normal_directions(stl_file* stl, int threads)
+{
+    if (stl->error) return;
+    const int facets_count = stl->stats.number_of_facets;
+    if (facets_count == 0) {
+        stl->stats.number_of_parts += 1;
+        return;
+    }
+
+    // group the facets by connected component, following the links both ways
+    std::vector<int> parent(facets_count);
+    std::iota(parent.begin(), parent.end(), 0);
+    for (int i = 0; i < facets_count; ++i)
+        for (int j = 0; j < 3; ++j) {
+            const int neighbor = stl->neighbors_start[i].neighbor[j];
+            if (neighbor == -1) continue;
+            const int root_i = find_root(parent, i);
+            const int root_n = find_root(parent, neighbor);
+            if (root_i != root_n) parent[std::max(root_i, root_n)] = std::min(root_i, root_n);
+        }
+
+    // list the facets of every component in increasing order, the components
+    // ordered by their first facet, which is the one admesh starts from
+    std::vector<int> component(facets_count);
+    std::vector<size_t> component_start;
+    for (int i = 0; i < facets_count; ++i) {
+        const int root = find_root(parent, i);
+        if (root == i) {
+            component[i] = component_start.size();
+            component_start.push_back(0);
+        } else {
+            component[i] = component[root];
+        }
+        ++component_start[component[i]];
+    }
+    const size_t components_count = component_start.size();
+    {
+        size_t offset = 0;
+        for (size_t &start : component_start) {
+            const size_t size = start;
+            start = offset;
+            offset += size;
+        }
+        component_start.push_back(offset);
+    }
+    std::vector<int> component_facets(facets_count);
+    {
+        std::vector<size_t> next(component_start.begin(), component_start.end() - 1);
+        for (int i = 0; i < facets_count; ++i)
+            component_facets[next[component[i]]++] = i;
+    }
+
+    std::vector<char> norm_sw(facets_count, 0);
+    std::vector<int> parts(components_count, 0), reversed(components_count, 0);
+    parallelize<size_t>(
+        0,
+        components_count - 1,
+        [&](size_t c) {
+            fix_component_directions(stl, component_facets.data() + component_start[c],
+                component_start[c + 1] - component_start[c], norm_sw, &parts[c], &reversed[c]);
+        },
+        threads
+    );
+    for (size_t c = 0; c < components_count; ++c) {
+        stl->stats.number_of_parts += parts[c];
+        stl->stats.facets_reversed += reversed[c];
+    }
+}
+
+void
+fix_normal_values(stl_file* stl, int threads)
+{
+    if (stl->error) return;
+    const size_t facets_count = stl->stats.number_of_facets;
+    const size_t chunks_count = (facets_count + facets_per_chunk - 1) / facets_per_chunk;
+    std::vector<int> normals_fixed(chunks_count, 0);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const size_t first = chunk_idx * facets_per_chunk;
+            const size_t last  = std::min(facets_count, first + facets_per_chunk);
+            for (size_t i = first; i < last; ++i)
+                check_normal_vector(&stl->facet_start[i], true, &normals_fixed[chunk_idx]);
+        },
+        threads
+    );
+    for (int fixed : normals_fixed)
+        stl->stats.normals_fixed += fixed;
+}
+
+} }
@@ -0,0 +1,27 @@
+#ifndef slic3r_MeshRepair_hpp_
+#define slic3r_MeshRepair_hpp_
+
+#include "libslic3r.h"
+#include <admesh/stl.h>
+
+namespace Slic3r { namespace MeshRepair {
+
+/// \brief Same as stl_check_facets_exact(): remove the degenerate facets and
+/// connect the facets sharing an edge with exactly the same vertices.
+/// The edges are partitioned by the hash of their vertices, and every
+/// partition is sorted and matched on its own. Edges having the same
+/// vertices are paired in facet order, which is the order admesh's chained
+/// hash table pairs them in, so the neighbors come out the same.
+void check_facets_exact(stl_file* stl, int threads);
+
+/// \brief Same as stl_fix_normal_directions().
+/// The walk of a connected component only ever reverses facets of that
+/// component, so the components are walked concurrently.
+void fix_normal_directions(stl_file* stl, int threads);
+
+/// Same as stl_fix_normal_values(), checking the facets in parallel.
+void fix_normal_values(stl_file* stl, int threads);
+
+} }
+
+#endif
@@ -947,11 +947,11 @@ ModelObject::cut(Axis axis, coordf_t z, Model* model) const
             TriangleMesh upper_mesh, lower_mesh;
             
             if (axis == X) {
-                TriangleMeshSlicer<X>(&volume->mesh).cut(z, &upper_mesh, &lower_mesh);
+                TriangleMeshSlicer<X>(&volume->mesh, 1).cut(z, &upper_mesh, &lower_mesh);
             } else if (axis == Y) {
-                TriangleMeshSlicer<Y>(&volume->mesh).cut(z, &upper_mesh, &lower_mesh);
+                TriangleMeshSlicer<Y>(&volume->mesh, 1).cut(z, &upper_mesh, &lower_mesh);
             } else if (axis == Z) {
-                TriangleMeshSlicer<Z>(&volume->mesh).cut(z, &upper_mesh, &lower_mesh);
+                TriangleMeshSlicer<Z>(&volume->mesh, 1).cut(z, &upper_mesh, &lower_mesh);
             }
             
             upper_mesh.repair();
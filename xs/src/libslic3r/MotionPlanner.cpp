@@ -83,6 +83,8 @@ MotionPlanner::get_env(int island_idx) const
 Polyline
 MotionPlanner::shortest_path(const Point &from, const Point &to)
 {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    
     // if we have an empty configuration space, return a straight move
     if (this->islands.empty())
         return Line(from, to);
@@ -8,6 +8,7 @@
 #include <map>
 #include <utility>
 #include <vector>
+#include <boost/thread.hpp>
 
 namespace Slic3r {
 
@@ -57,6 +58,8 @@ class MotionPlanner
     public:
     MotionPlanner(const ExPolygons &islands);
     ~MotionPlanner();
+    /// Safe to call from several threads at once: the configuration space
+    /// is generated lazily under the lock.
     Polyline shortest_path(const Point &from, const Point &to);
     size_t islands_count() const;
     
@@ -65,6 +68,7 @@ class MotionPlanner
     std::vector<MotionPlannerEnv> islands;
     MotionPlannerEnv outer;
     std::vector<MotionPlannerGraph*> graphs;
+    boost::mutex mutex;
     
     void initialize();
     MotionPlannerGraph* init_graph(int island_idx);
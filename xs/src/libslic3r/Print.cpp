@@ -104,35 +104,94 @@ Print::delete_object(size_t idx)
 }
 
 void
-Print::process() 
+Print::process(const CancellationToken &cancel)
+{
+    CancellationScope scope(&cancel);
+    try {
+        this->_process(true);
+    } catch (...) {
+        this->_invalidate_unfinished_steps();
+        throw;
+    }
+}
+
+void
+Print::_process(bool infill)
 {
     /// No need to call this as we call it as part of prepare_infill()
     /// until we fix the idempotency issue.
 //    if (this->status_cb != nullptr)
 //        this->status_cb(20, "Generating perimeters");
   //  for(auto& obj : this->objects) { obj->make_perimeters(); }
-    if (this->status_cb != nullptr)
-        this->status_cb(70, "Infilling layers");
-    for(auto& obj : this->objects) { obj->infill(); }
-    for(auto& obj : this->objects) { obj->generate_support_material(); }
+    if (infill)
+        this->report_status(70, "Infilling layers");
+    
+    // Objects only depend on each other through the skirt and the brim, so
+    // their step chains run concurrently. The per-layer loops of each step
+    // are nested in the same thread pool, so they all share one budget of
+    // config.threads threads. Status reports are serialized by report_status().
+    parallelize<PrintObject*>(
+        this->objects,
+        [infill](PrintObject* object) {
+            if (infill)
+                object->infill();
+            else
+                object->prepare_infill();
+            object->generate_support_material();
+        },
+        this->config.threads.value
+    );
 
+    // barriers: these need all the objects
     this->make_skirt();
     this->make_brim(); // must follow make_skirt
 }
 
+void
+Print::report_status(int percent, const std::string &message)
+{
+    if (this->status_cb == nullptr) return;
+    boost::lock_guard<boost::mutex> lock(this->status_mutex);
+    this->status_cb(percent, message);
+}
+
+void
+Print::_invalidate_unfinished_steps()
+{
+    for (PrintObject* object : this->objects) {
+        std::vector<PrintObjectStep> unfinished;
+        for (PrintObjectStep step : object->state.started)
+            if (!object->state.is_done(step)) unfinished.push_back(step);
+        for (PrintObjectStep step : unfinished) {
+            // these steps rework the slices in place, so slicing again is
+            // the only way back to a known state
+            if (step == posPerimeters || step == posDetectSurfaces || step == posPrepareInfill)
+                step = posSlice;
+            object->invalidate_step(step);
+        }
+    }
+
+    std::vector<PrintStep> unfinished;
+    for (PrintStep step : this->state.started)
+        if (!this->state.is_done(step)) unfinished.push_back(step);
+    for (PrintStep step : unfinished)
+        this->invalidate_step(step);
+}
+
 void
 Print::make_brim() 
 {
     if (this->state.is_done(psBrim)) return;
-    // prereqs
+    // prereqs (the fills don't contribute to the brim, but the interior
+    // brim fills the first layer of the regions left without any)
     for(auto& obj: this->objects) {
-        obj->make_perimeters();
-        obj->infill();
+        obj->prepare_infill();
         obj->generate_support_material();
+        if (this->config.interior_brim_width > 0 && !obj->state.is_done(posInfill) && !obj->layers.empty())
+            obj->get_layer(0)->make_fills();
     }
     this->state.set_started(psBrim);
-    if (this->status_cb != nullptr)
-        this->status_cb(88, "Generating brim");
+    this->report_status(88, "Generating brim");
     this->_make_brim();
     this->state.set_done(psBrim);
 }
@@ -143,10 +202,9 @@ Print::make_skirt()
     if (this->state.is_done(psSkirt)) return;
     this->state.set_started(psSkirt);
     
-    // prereqs
+    // prereqs (the fills don't contribute to the skirt)
     for (auto* obj: this->objects) {
-        obj->make_perimeters();
-        obj->infill();
+        obj->prepare_infill();
         obj->generate_support_material();
     }
 
@@ -159,8 +217,7 @@ Print::make_skirt()
         return;
     }
 
-    if (this->status_cb != nullptr)
-        this->status_cb(88, "Generating skirt");
+    this->report_status(88, "Generating skirt");
 
     // First off we need to decide how tall the skirt must be.
     // The skirt_height option from config is expressed in layers, but our
@@ -282,6 +339,7 @@ Print::reload_object(size_t idx)
     ModelObjectPtrs model_objects;
     FOREACH_OBJECT(this, object) {
         model_objects.push_back((*object)->model_object());
+        append_to(model_objects, (*object)->merged_model_objects());
     }
     
     // remove our print objects
@@ -391,6 +449,21 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
             || opt_key == "infill_acceleration"
             || opt_key == "infill_first"
             || opt_key == "layer_gcode"
+            || opt_key == "machine_junction_deviation"
+            || opt_key == "machine_max_acceleration_e"
+            || opt_key == "machine_max_acceleration_extruding"
+            || opt_key == "machine_max_acceleration_retracting"
+            || opt_key == "machine_max_acceleration_x"
+            || opt_key == "machine_max_acceleration_y"
+            || opt_key == "machine_max_acceleration_z"
+            || opt_key == "machine_max_feedrate_e"
+            || opt_key == "machine_max_feedrate_x"
+            || opt_key == "machine_max_feedrate_y"
+            || opt_key == "machine_max_feedrate_z"
+            || opt_key == "machine_max_jerk_e"
+            || opt_key == "machine_max_jerk_x"
+            || opt_key == "machine_max_jerk_y"
+            || opt_key == "machine_max_jerk_z"
             || opt_key == "min_fan_speed"
             || opt_key == "max_fan_speed"
             || opt_key == "min_print_speed"
@@ -466,11 +539,13 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
 bool
 Print::invalidate_step(PrintStep step)
 {
+    // the objects processed concurrently by process() may invalidate these
+    boost::lock_guard<boost::mutex> lock(this->state_mutex);
     bool invalidated = this->state.invalidate(step);
     
     // propagate to dependent steps
     if (step == psSkirt) {
-        invalidated |= this->invalidate_step(psBrim);
+        invalidated |= this->state.invalidate(psBrim);
     }
     
     return invalidated;
@@ -629,6 +704,10 @@ Print::add_model_object(ModelObject* model_object, int idx)
         size_t volume_id = v_i - model_object->volumes.begin();
         ModelVolume* volume = *v_i;
         
+        // the objects are sliced concurrently, reading the volume meshes
+        // as they are, so they are repaired once here
+        if (!volume->mesh.repaired) volume->mesh.repair(this->config.threads.value);
+        
         // get the config applied to this volume
         PrintRegionConfig config = this->_region_config_from_model_volume(*volume);
         
@@ -656,6 +735,23 @@ Print::add_model_object(ModelObject* model_object, int idx)
     o->config.apply(this->default_object_config);
     o->config.apply(object_config, true);
     
+    // print an object identical to one already added as extra copies of it
+    if (idx == -1 && this->share_identical_objects) {
+        o->_content_hash = o->content_hash();
+        for (PrintObject* object : this->objects) {
+            if (object == o || object->_content_hash != o->_content_hash || !object->same_content(*o)) continue;
+            
+            Point shift = o->_copies_shift;
+            shift.translate(object->_copies_shift.negative());
+            object->_merged_model_objects.push_back(std::make_pair(model_object, shift));
+            object->reload_model_instances();
+            
+            this->objects.pop_back();
+            delete o;
+            break;
+        }
+    }
+    
     // update placeholders
     {
         // get the first input file name
@@ -681,19 +777,89 @@ Print::add_model_object(ModelObject* model_object, int idx)
 }
 
 void
-Print::export_gcode(std::ostream& output, bool quiet)
+Print::export_gcode(std::ostream& output, bool quiet, const CancellationToken &cancel)
 {
-    // prerequisites
-    this->process();
-    
-    if (this->status_cb != nullptr) 
-        this->status_cb(90, "Exporting G-Code...");
-    
-    Slic3r::PrintGCode(*this, output).output();
+    CancellationScope scope(&cancel);
+    try {
+        // prerequisites, the fills excepted: PrintGCode waits for them layer
+        // by layer, so that the first layers are written while the upper ones
+        // are still being infilled. The earlier steps can't be streamed the
+        // same way: the support, the skirt and the brim of the first layer
+        // depend on the slices of every layer above, and so do the
+        // horizontal shells of each layer on its solid layers.
+        this->_process(false);
+        this->_start_fills_pipeline();
+        
+        this->report_status(90, "Exporting G-Code...");
+        
+        try {
+            Slic3r::PrintGCode(*this, output).output();
+        } catch (...) {
+            this->_finish_fills_pipeline(true);
+            throw;
+        }
+        this->_finish_fills_pipeline(false);
+    } catch (...) {
+        this->_invalidate_unfinished_steps();
+        throw;
+    }
+}
+
+void
+Print::_start_fills_pipeline()
+{
+    // the layers of all of the objects still lacking their fills, in the
+    // order PrintGCode needs them
+    LayerPtrs layers;
+    for (PrintObject* object : this->objects) {
+        if (object->state.is_done(posInfill)) continue;
+        object->state.set_started(posInfill);
+        append_to(layers, object->layers);
+    }
+    std::stable_sort(layers.begin(), layers.end(),
+        [](const Layer* a, const Layer* b) { return a->print_z < b->print_z; });
+
+    this->fills_pipeline_layers.clear();
+    for (size_t i = 0; i < layers.size(); ++i)
+        this->fills_pipeline_layers[layers[i]] = i;
+
+    this->fills_pipeline.reset(new LayerPipeline(layers.size()));
+    this->fills_pipeline->add_stage([layers](size_t i) { layers[i]->make_fills(); });
+    this->fills_pipeline->start(this->config.threads.value);
 }
 
 void
-Print::export_gcode(std::string outfile, bool quiet)
+Print::_finish_fills_pipeline(bool failed)
+{
+    if (!this->fills_pipeline) return;
+
+    std::unique_ptr<LayerPipeline> pipeline;
+    pipeline.swap(this->fills_pipeline);
+    this->fills_pipeline_layers.clear();
+    if (failed) {
+        // the original failure is the one worth reporting
+        pipeline->cancel();
+        try { pipeline->join(); } catch (...) {}
+        return;
+    }
+    pipeline->join();
+
+    for (PrintObject* object : this->objects)
+        if (object->state.is_started(posInfill))
+            object->state.set_done(posInfill);
+}
+
+void
+Print::wait_for_layer(const Layer* layer) const
+{
+    if (!this->fills_pipeline) return;
+    const auto it = this->fills_pipeline_layers.find(layer);
+    if (it != this->fills_pipeline_layers.end())
+        this->fills_pipeline->wait(0, it->second);
+}
+
+void
+Print::export_gcode(std::string outfile, bool quiet, const CancellationToken &cancel)
 {
     // compute the actual output filepath
     outfile = this->output_filepath(outfile);
@@ -701,7 +867,14 @@ Print::export_gcode(std::string outfile, bool quiet)
     // write G-code to a temporary file in order to make the export atomic
     const std::string tempfile{ outfile + ".tmp" };
     std::ofstream outstream(tempfile);
-    this->export_gcode(outstream);
+    try {
+        this->export_gcode(outstream, quiet, cancel);
+    } catch (...) {
+        // don't leave a partial file behind
+        outstream.close();
+        std::remove(tempfile.c_str());
+        throw;
+    }
     
     // rename the temporary file to the destination file
     // When renaming, some other application (thank you, Windows Explorer) 
@@ -720,8 +893,7 @@ Print::export_gcode(std::string outfile, bool quiet)
     
     // run post-processing scripts
     if (!this->config.post_process.values.empty()) {
-        if (this->status_cb != nullptr) 
-            this->status_cb(95, "Running post-processing scripts...");
+        this->report_status(95, "Running post-processing scripts...");
         
         this->config.setenv_();
         for (std::string ppscript : this->config.post_process.values) {
@@ -844,12 +1016,33 @@ Print::apply_config(DynamicPrintConfig config)
         ModelObjectPtrs model_objects;
         FOREACH_OBJECT(this, o) {
             model_objects.push_back((*o)->model_object());
+            append_to(model_objects, (*o)->merged_model_objects());
         }
         this->clear_objects();
         for (ModelObjectPtrs::iterator it = model_objects.begin(); it != model_objects.end(); ++it) {
             this->add_model_object(*it);
         }
         invalidated = true;
+    } else {
+        // a model object printed as copies of another one whose config now
+        // resolves differently is printed on its own again
+        ModelObjectPtrs diverged;
+        for (PrintObject* object : this->objects) {
+            std::vector< std::pair<ModelObject*,Point> > &merged = object->_merged_model_objects;
+            const size_t merged_count = merged.size();
+            merged.erase(std::remove_if(merged.begin(), merged.end(),
+                [this, object, &diverged] (const std::pair<ModelObject*,Point> &m) {
+                    if (this->_same_configs(*object->model_object(), *m.first)) return false;
+                    diverged.push_back(m.first);
+                    return true;
+                }), merged.end());
+            if (merged.size() != merged_count && object->reload_model_instances())
+                invalidated = true;
+        }
+        for (ModelObject* model_object : diverged) {
+            this->add_model_object(model_object);
+            invalidated = true;
+        }
     }
     
     return invalidated;
@@ -885,7 +1078,7 @@ Print::validate() const
                     Polygons mesh_convex_hulls;
                     for (size_t i = 0; i < this->regions.size(); ++i) {
                         for (std::vector<int>::const_iterator it = object->region_volumes[i].begin(); it != object->region_volumes[i].end(); ++it) {
-                            Polygon hull = object->model_object()->volumes[*it]->mesh.convex_hull();
+                            Polygon hull = object->model_object()->volumes[*it]->mesh.convex_hull(this->config.threads.value);
                             mesh_convex_hulls.push_back(hull);
                         }
                     }
@@ -1384,6 +1577,24 @@ Print::_region_config_from_model_volume(const ModelVolume &volume)
     return config;
 }
 
+bool
+Print::_same_configs(const ModelObject &object, const ModelObject &other)
+{
+    DynamicPrintConfig object_config = object.config, other_config = other.config;
+    object_config.normalize();
+    other_config.normalize();
+    PrintObjectConfig resolved = this->default_object_config, other_resolved = this->default_object_config;
+    resolved.apply(object_config, true);
+    other_resolved.apply(other_config, true);
+    if (!resolved.equals(other_resolved) || object.volumes.size() != other.volumes.size())
+        return false;
+    for (size_t i = 0; i < object.volumes.size(); ++i)
+        if (!this->_region_config_from_model_volume(*object.volumes[i])
+                .equals(this->_region_config_from_model_volume(*other.volumes[i])))
+            return false;
+    return true;
+}
+
 bool
 Print::has_support_material() const
 {
@@ -1441,4 +1652,23 @@ Print::output_filepath(const std::string &path)
     return path;
 }
 
+LayerProgress::LayerProgress(Print* print, int percent, const std::string &message, size_t layers_count)
+    : print(print), percent(percent), message(message), total(layers_count), done(0), reported(0)
+{}
+
+void
+LayerProgress::layer_done()
+{
+    const size_t n = ++this->done;
+    if (this->print->status_cb == nullptr || this->total == 0) return;
+    if (n * 100 / this->total == (n - 1) * 100 / this->total) return;
+
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    if (n <= this->reported) return;
+    this->reported = n;
+    std::ostringstream ss;
+    ss << this->message << " (" << n << "/" << this->total << ")";
+    this->print->report_status(this->percent, ss.str());
+}
+
 }
@@ -6,15 +6,18 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <exception>
 #include <stdexcept>
 #include <boost/thread.hpp>
 #include "BoundingBox.hpp"
+#include "CancellationToken.hpp"
 #include "Flow.hpp"
 #include "PrintConfig.hpp"
 #include "Config.hpp"
 #include "Point.hpp"
 #include "Layer.hpp"
+#include "LayerPipeline.hpp"
 #include "Model.hpp"
 #include "PlaceholderParser.hpp"
 #include "SlicingAdaptive.hpp"
@@ -123,6 +126,18 @@ class PrintObject
     bool delete_all_copies();
     bool set_copies(const Points &points);
     bool reload_model_instances();
+    
+    /// Model objects printed as extra copies of this one, see Print::share_identical_objects.
+    ModelObjectPtrs merged_model_objects() const;
+    
+    /// Stable hash of everything the layers of this object are computed from:
+    /// the volume meshes relative to the object corner, the transformation of
+    /// the first instance, the regions, the resolved config and the layer
+    /// heights. Objects hashing the same slice the same.
+    uint64_t content_hash() const;
+    /// Whether other is computed from exactly the same content, which equal
+    /// content hashes only make very likely.
+    bool same_content(const PrintObject &other) const;
     BoundingBox bounding_box() const;
     std::set<size_t> extruders() const;
     std::set<size_t> support_material_extruders() const;
@@ -162,7 +177,9 @@ class PrintObject
     coordf_t adjust_layer_height(coordf_t layer_height) const;
     std::vector<coordf_t> generate_object_layers(coordf_t first_layer_height);
     void _slice();
-    std::vector<ExPolygons> _slice_region(size_t region_id, std::vector<float> z, bool modifier);
+    std::vector<ExPolygons> _slice_region(size_t region_id, const std::vector<float> &z, bool modifier);
+    /// Slice the volumes of a region, handing each layer to callback as soon as it is done.
+    void _slice_region(size_t region_id, const std::vector<float> &z, bool modifier, const SliceCallback &callback);
 
     void _infill();
 
@@ -205,15 +222,32 @@ class PrintObject
     ModelObject* _model_object;
     Points _copies;      // Slic3r::Point objects in scaled G-code coordinates
 
+    // identical model objects whose instances are copies of this object, with
+    // the offset of their copies relative to ours
+    std::vector< std::pair<ModelObject*,Point> > _merged_model_objects;
+    // content_hash() when the object was added to the print
+    uint64_t _content_hash;
+
     // TODO: call model_object->get_bounding_box() instead of accepting
         // parameter
     PrintObject(Print* print, ModelObject* model_object, const BoundingBoxf3 &modobj_bbox);
     ~PrintObject();
 
-    /// Outer loop of logic for horizontal shell discovery
-    void _discover_external_horizontal_shells(LayerRegion* layerm, const size_t& i, const size_t& region_id);
-    /// Inner loop of logic for horizontal shell discovery
-    void _discover_neighbor_horizontal_shells(LayerRegion* layerm, const size_t& i, const size_t& region_id, const SurfaceType& type, Polygons& solid, const size_t& solid_layers);  
+    /// Number of layers the top or bottom surfaces of layer i are propagated to,
+    /// itself included; above layers.size() when they can't honor the minimum shell
+    /// thickness.
+    int _solid_layers(LayerRegion* layerm, const size_t& i, const SurfaceType& type) const;
+    /// Surfaces of the given type of layer i to be propagated as horizontal shells.
+    Polygons _external_horizontal_shell(LayerRegion* layerm, const size_t& i, const SurfaceType& type) const;
+    /// Propagate solid, the shell of layerm, to neighbor layer n. Returns false when
+    /// the layers beyond n must not be searched.
+    bool _discover_neighbor_horizontal_shell(LayerRegion* layerm, const size_t& n, const size_t& region_id, Polygons& solid);
+    /// Start posPerimeters from untyped slices, as make_perimeters() and
+    /// prepare_infill() both need them.
+    void _start_perimeters();
+    /// Add the extra perimeters of a layer, which read the untyped slices of
+    /// the layer above, and generate its perimeters.
+    void _make_perimeters(Layer* layer);
 
 };
 
@@ -233,6 +267,11 @@ class Print
     
     std::function<void(int, const std::string&)> status_cb {nullptr};
 
+    /// When set, add_model_object() turns an object identical to one already
+    /// added into extra copies of it, so that its layers are only computed
+    /// once. print.objects then no longer matches the objects of the model.
+    bool share_identical_objects {false};
+
     /// Function pointer for the UI side to call post-processing scripts.
     /// Vector is assumed to be the executable script and all arguments.
     std::function<void(std::vector<std::string>)> post_process_cb {nullptr};
@@ -261,14 +300,21 @@ class Print
     const PrintRegion* get_region(size_t idx) const { return this->regions.at(idx); };
     PrintRegion* add_region();
 
-    /// Triggers the rest of the print process
-    void process(); 
+    /// Triggers the rest of the print process.
+    /// Cancelling the token from another thread (or from status_cb) makes
+    /// the per-layer loops throw CancelledError. The steps left unfinished
+    /// are then invalidated, while the finished ones are kept for the next run.
+    void process(const CancellationToken &cancel = CancellationToken());
 
     /// Performs a gcode export.
-    void export_gcode(std::ostream& output, bool quiet = false);
+    /// The fills are generated layer by layer in the background while the
+    /// G-code of the layers below them is being written.
+    void export_gcode(std::ostream& output, bool quiet = false,
+        const CancellationToken &cancel = CancellationToken());
     
     /// Performs a gcode export and then runs post-processing scripts (if any)
-    void export_gcode(std::string filename, bool quiet = false);
+    void export_gcode(std::string filename, bool quiet = false,
+        const CancellationToken &cancel = CancellationToken());
 
     /// commands a gcode export to a temporary file and return its name
     std::string export_gcode(bool quiet = false);
@@ -302,6 +348,13 @@ class Print
 
     /// Generates a brim around all of the objects in the print.
     void make_brim();
+
+    /// Calls status_cb, if any. Safe to call from several threads at once.
+    void report_status(int percent, const std::string &message);
+
+    /// Blocks until the fills of the given layer have been generated by the
+    /// pipeline of export_gcode(). Returns at once for any other layer.
+    void wait_for_layer(const Layer* layer) const;
     
     
     std::set<size_t> object_extruders() const;
@@ -315,13 +368,58 @@ class Print
     std::string output_filename();
     std::string output_filepath(const std::string &path);
     private:
+    /// Guards state against the concurrent invalidations of the objects.
+    boost::mutex state_mutex;
+    /// Serializes the calls to status_cb.
+    boost::mutex status_mutex;
+
+    /// Generates the fills of the objects bottom up during export_gcode(),
+    /// and the index of each of the layers it covers.
+    std::unique_ptr<LayerPipeline> fills_pipeline;
+    std::map<const Layer*, size_t> fills_pipeline_layers;
+
+    /// Run the steps of every object, the fills excepted when infill is
+    /// false, then the skirt and the brim.
+    void _process(bool infill);
+    void _start_fills_pipeline();
+    /// Join the fills pipeline; it is cancelled first when failed is set.
+    void _finish_fills_pipeline(bool failed);
+    /// Invalidate the steps that were started but not finished by a run
+    /// which failed or was cancelled, so that the next one redoes them.
+    void _invalidate_unfinished_steps();
+
     void clear_regions();
     void delete_region(size_t idx);
     PrintRegionConfig _region_config_from_model_volume(const ModelVolume &volume);
+    /// Whether the configs of both model objects, and of their volumes one by
+    /// one, resolve to the same object and region configs.
+    bool _same_configs(const ModelObject &object, const ModelObject &other);
 };
 
 using shared_Print = std::shared_ptr<Print>;
 
+/// Counts the layers done by a step of a print, on any number of threads,
+/// and reports them through Print::report_status() every time the share of
+/// the layers done grows by a whole percent.
+class LayerProgress
+{
+    public:
+    LayerProgress(Print* print, int percent, const std::string &message, size_t layers_count);
+
+    void layer_done();
+    size_t layers_done() const { return this->done; }
+
+    private:
+    Print* print;
+    int percent;
+    std::string message;
+    size_t total;
+    std::atomic<size_t> done;
+    /// Last count reported, so that the reports never go backwards.
+    size_t reported;
+    boost::mutex mutex;
+};
+
 #define FOREACH_BASE(type, container, iterator) for (type::const_iterator iterator = (container).begin(); iterator != (container).end(); ++iterator)
 #define FOREACH_REGION(print, region)       FOREACH_BASE(PrintRegionPtrs, (print)->regions, region)
 #define FOREACH_OBJECT(print, object)       FOREACH_BASE(PrintObjectPtrs, (print)->objects, object)
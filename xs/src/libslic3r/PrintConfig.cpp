@@ -811,6 +811,141 @@ PrintConfigDef::PrintConfigDef()
     def->cli = "match-horizontal-surfaces!";
     def->default_value = new ConfigOptionBool(false);
 
+    def = this->add("machine_junction_deviation", coFloat);
+    def->label = __TRANS("Junction deviation");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Junction deviation of the firmware, which is used instead of the jerk limits to estimate the print time when set to a non-zero value (M205 J).");
+    def->sidetext = "mm";
+    def->cli = "machine-junction-deviation=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0);
+
+    def = this->add("machine_max_acceleration_e", coFloat);
+    def->label = __TRANS("Maximum acceleration E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the extruder axis, used to estimate the print time (M201 E).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10000);
+
+    def = this->add("machine_max_acceleration_extruding", coFloat);
+    def->label = __TRANS("Maximum acceleration when extruding");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Acceleration of the printing moves, used to estimate the print time until the G-code sets another one (M204 S).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-extruding=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(3000);
+
+    def = this->add("machine_max_acceleration_retracting", coFloat);
+    def->label = __TRANS("Maximum acceleration when retracting");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Acceleration of the retractions, used to estimate the print time (M204 R).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-retracting=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(3000);
+
+    def = this->add("machine_max_acceleration_x", coFloat);
+    def->label = __TRANS("Maximum acceleration X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the X axis, used to estimate the print time (M201 X).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(3000);
+
+    def = this->add("machine_max_acceleration_y", coFloat);
+    def->label = __TRANS("Maximum acceleration Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the Y axis, used to estimate the print time (M201 Y).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(3000);
+
+    def = this->add("machine_max_acceleration_z", coFloat);
+    def->label = __TRANS("Maximum acceleration Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum acceleration of the Z axis, used to estimate the print time (M201 Z).");
+    def->sidetext = "mm/s²";
+    def->cli = "machine-max-acceleration-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(100);
+
+    def = this->add("machine_max_feedrate_e", coFloat);
+    def->label = __TRANS("Maximum feedrate E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the E axis, used to estimate the print time (M203 E).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(25);
+
+    def = this->add("machine_max_feedrate_x", coFloat);
+    def->label = __TRANS("Maximum feedrate X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the X axis, used to estimate the print time (M203 X).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(300);
+
+    def = this->add("machine_max_feedrate_y", coFloat);
+    def->label = __TRANS("Maximum feedrate Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the Y axis, used to estimate the print time (M203 Y).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(300);
+
+    def = this->add("machine_max_feedrate_z", coFloat);
+    def->label = __TRANS("Maximum feedrate Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum feedrate of the Z axis, used to estimate the print time (M203 Z).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-feedrate-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(5);
+
+    def = this->add("machine_max_jerk_e", coFloat);
+    def->label = __TRANS("Maximum jerk E");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum instantaneous change of speed of the E axis, used to estimate the print time (M205 E).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-e=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(5);
+
+    def = this->add("machine_max_jerk_x", coFloat);
+    def->label = __TRANS("Maximum jerk X");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum instantaneous change of speed of the X axis, used to estimate the print time (M205 X).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-x=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10);
+
+    def = this->add("machine_max_jerk_y", coFloat);
+    def->label = __TRANS("Maximum jerk Y");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum instantaneous change of speed of the Y axis, used to estimate the print time (M205 Y).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-y=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(10);
+
+    def = this->add("machine_max_jerk_z", coFloat);
+    def->label = __TRANS("Maximum jerk Z");
+    def->category = __TRANS("Machine limits");
+    def->tooltip = __TRANS("Maximum instantaneous change of speed of the Z axis, used to estimate the print time (M205 Z).");
+    def->sidetext = "mm/s";
+    def->cli = "machine-max-jerk-z=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0.3);
+
     def = this->add("max_fan_speed", coInt);
     def->label = __TRANS("Max");
     def->tooltip = __TRANS("This setting represents the maximum speed of your fan.");
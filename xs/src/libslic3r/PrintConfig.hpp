@@ -341,6 +341,21 @@ class GCodeConfig : public virtual StaticPrintConfig
     ConfigOptionEnum<GCodeFlavor>   gcode_flavor;
     ConfigOptionBool                label_printed_objects;
     ConfigOptionString              layer_gcode;
+    ConfigOptionFloat               machine_junction_deviation;
+    ConfigOptionFloat               machine_max_acceleration_e;
+    ConfigOptionFloat               machine_max_acceleration_extruding;
+    ConfigOptionFloat               machine_max_acceleration_retracting;
+    ConfigOptionFloat               machine_max_acceleration_x;
+    ConfigOptionFloat               machine_max_acceleration_y;
+    ConfigOptionFloat               machine_max_acceleration_z;
+    ConfigOptionFloat               machine_max_feedrate_e;
+    ConfigOptionFloat               machine_max_feedrate_x;
+    ConfigOptionFloat               machine_max_feedrate_y;
+    ConfigOptionFloat               machine_max_feedrate_z;
+    ConfigOptionFloat               machine_max_jerk_e;
+    ConfigOptionFloat               machine_max_jerk_x;
+    ConfigOptionFloat               machine_max_jerk_y;
+    ConfigOptionFloat               machine_max_jerk_z;
     ConfigOptionFloat               max_print_speed;
     ConfigOptionFloat               max_volumetric_speed;
     ConfigOptionString              notes;
@@ -386,6 +401,21 @@ class GCodeConfig : public virtual StaticPrintConfig
         OPT_PTR(gcode_flavor);
         OPT_PTR(label_printed_objects);
         OPT_PTR(layer_gcode);
+        OPT_PTR(machine_junction_deviation);
+        OPT_PTR(machine_max_acceleration_e);
+        OPT_PTR(machine_max_acceleration_extruding);
+        OPT_PTR(machine_max_acceleration_retracting);
+        OPT_PTR(machine_max_acceleration_x);
+        OPT_PTR(machine_max_acceleration_y);
+        OPT_PTR(machine_max_acceleration_z);
+        OPT_PTR(machine_max_feedrate_e);
+        OPT_PTR(machine_max_feedrate_x);
+        OPT_PTR(machine_max_feedrate_y);
+        OPT_PTR(machine_max_feedrate_z);
+        OPT_PTR(machine_max_jerk_e);
+        OPT_PTR(machine_max_jerk_x);
+        OPT_PTR(machine_max_jerk_y);
+        OPT_PTR(machine_max_jerk_z);
         OPT_PTR(max_print_speed);
         OPT_PTR(max_volumetric_speed);
         OPT_PTR(notes);
@@ -1,6 +1,8 @@
 #include "PrintGCode.hpp"
 #include "PrintConfig.hpp"
+#include "ThreadPool.hpp"
 #include "Log.hpp"
+#include <cmath>
 #include <ctime>
 #include <iostream>
 
@@ -200,6 +202,7 @@ PrintGCode::output()
     }
 
     // Do all objects for each layer.
+    std::vector<LayerJob> jobs;
 
     if (config.complete_objects) {
         // print objects from the smallest to the tallest to avoid collisions
@@ -212,17 +215,6 @@ PrintGCode::output()
         for (size_t obj_idx {0}; obj_idx < _print.objects.size(); ++obj_idx) {
             PrintObject& object {*(this->objects.at(obj_idx))};
             for (const Point& copy : object._shifted_copies) {
-                if (finished_objects > 0) {
-                    _gcodegen.set_origin(Pointf::new_unscale(copy));
-                    _gcodegen.enable_cooling_markers = false;
-                    _gcodegen.avoid_crossing_perimeters.use_external_mp_once = true;
-                    fh << _gcodegen.retract();
-                    fh << _gcodegen.travel_to(Point(0,0), erNone, "move to origin position for next object");
-
-                    _gcodegen.enable_cooling_markers = true;
-                    // disable motion planner when traveling to first object point
-                    _gcodegen.avoid_crossing_perimeters.disable_once = true;
-                }
                 std::vector<Layer*> layers;
                 layers.reserve(object.layers.size() + object.support_layers.size());
                 for (auto l : object.layers) {
@@ -233,27 +225,24 @@ PrintGCode::output()
                 }
                 std::sort(layers.begin(), layers.end(), [] (const Layer* a, const Layer* b) { return a->print_z < b->print_z; });
                 for (Layer* layer : layers) {
+                    LayerJob job;
+                    job.obj_idx = obj_idx;
+                    job.layer = layer;
+                    job.copies = Points({copy});
+                    job.next_copy = finished_objects > 0 && layer == layers.front();
                     // if we are printing the bottom layer of an object, and we have already finished
                     // another one, set first layer temperatures. this happens before the Z move
                     // is triggered, so machine has more time to reach such temperatures
-                    if (layer->id() == 0 && finished_objects > 0) {
-                        if (config.first_layer_bed_temperature > 0 &&
-                                config.has_heatbed &&
-                                std::regex_search(config.between_objects_gcode.getString(), bed_temp_regex))
-                        {
-                            fh << _gcodegen.writer.set_bed_temperature(config.first_layer_bed_temperature);
-                        }
-                        if (std::regex_search(config.between_objects_gcode.getString(), ex_temp_regex)) {
-                            _print_first_layer_temperature(false);
-                        }
-                    }
-                    this->process_layer(obj_idx, layer, Points({copy}));
+                    job.first_layer_temperature = layer->id() == 0 && finished_objects > 0;
+                    job.copy_done = layer == layers.back();
+                    this->_plan_layer(&job);
+                    jobs.emplace_back(std::move(job));
                 }
-                this->flush_filters();
                 finished_objects++;
                 this->_second_layer_things_done = false;
             }
         }
+        this->_export_layers(jobs, jobs.size());
     } else {
         // order objects using a nearest neighbor search
         std::vector<Points::size_type> obj_idx {};
@@ -292,12 +281,18 @@ PrintGCode::output()
         for (const auto& print_z : z) {
             for (const auto& idx : obj_idx) {
                 for (const auto* layer : layers[print_z][idx] ) {
-                    this->process_layer(idx, layer, layer->object()->_shifted_copies);
+                    LayerJob job;
+                    job.obj_idx = idx;
+                    job.layer = layer;
+                    job.copies = layer->object()->_shifted_copies;
+                    this->_plan_layer(&job);
+                    jobs.emplace_back(std::move(job));
                 }
             }
-            _gcodegen.placeholder_parser->set("layer_z", unscale(print_z));
-            _gcodegen.placeholder_parser->set("layer_num", _gcodegen.layer_index);
+            jobs.back().z_done = true;
+            jobs.back().print_z = print_z;
         }
+        this->_export_layers(jobs, z.size());
 
         this->flush_filters();
     }
@@ -322,6 +317,14 @@ PrintGCode::output()
 
     fh << _gcodegen.cog_stats();
 
+    // the end G-code is timed as well
+    _time_estimator.finish();
+    {
+        const long seconds = std::lround(_time_estimator.time);
+        fh << "; estimated printing time = "
+           << seconds / 3600 << "h " << seconds / 60 % 60 << "m " << seconds % 60 << "s\n";
+    }
+
     // Get filament stats
     _print.filament_stats.clear();
     _print.total_used_filament = 0.0;
@@ -370,35 +373,262 @@ PrintGCode::output()
     _print_config(_print.default_region_config);
 }
 
-std::string
-PrintGCode::filter(const std::string& in, bool wait)
+void
+PrintGCode::flush_filters()
 {
-    return in;
+    ChunkedGCode gcode;
+    this->_cooling_buffer.flush(&gcode);
+    this->filter(&gcode, true);
+    gcode.write(fh);
 }
 
 void
-PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
+PrintGCode::filter(ChunkedGCode*, bool)
 {
-    std::string gcode {""};
+}
 
+void
+PrintGCode::_plan_layer(LayerJob* job)
+{
+    const Layer* layer { job->layer };
     const PrintObject& obj { *layer->object() };
-    _gcodegen.config.apply(obj.config, true);
+
+    // set the second layer + temp
+    if (!this->_second_layer_things_done && layer->id() == 1) {
+        job->second_layer_things = true;
+        this->_second_layer_things_done = true;
+    }
+
+    // extrude skirt along raft layers and normal obj layers
+    // (not along interlaced support material layers)
+    if (layer->id() < static_cast<size_t>(obj.config.raft_layers)
+        || ((_print.has_infinite_skirt()
+        || _skirt_done.size() == 0
+        || (_skirt_done.rbegin())->first < scale_(_print.skirt_height_z))
+        && _skirt_done.count(scale_(layer->print_z)) == 0
+        && typeid(layer) != typeid(SupportLayer*)) ) {
+        job->skirt = true;
+        this->_skirt_done[scale_(layer->print_z)] = true;
+    }
+
+    // extrude brim
+    if (!this->_brim_done) {
+        job->brim = true;
+        this->_brim_done = true;
+    }
+
+    // when starting a new object, use the external motion planner for the first travel move
+    for (const auto& copy : job->copies) {
+        job->external_mp.push_back(this->_last_obj_copy.first != copy && this->_last_obj_copy.second);
+        this->_last_obj_copy.first = copy;
+        this->_last_obj_copy.second = true;
+    }
+}
+
+void
+PrintGCode::_export_layers(const std::vector<LayerJob>& jobs, size_t progress_steps)
+{
+    LayerProgress progress(&_print, 90, "Exporting layers", progress_steps);
+
+    // random seams are drawn from rand(), so that the layers have to be rendered in order
+    int threads = config.threads.value;
+    for (const auto* object : this->objects) {
+        if (object->config.seam_position.value == spRandom) threads = 1;
+    }
+    // with absolute E distances, the first retraction of a layer is written
+    // from the E the previous one ended with, so that the passes would only
+    // get one more layer of a batch right each
+    if (!config.use_relative_e_distances) threads = 1;
+    // the batches are rendered ahead of time in a few passes, see _render_ahead()
+    const size_t batch_size = threads > 1 ? 4 * threads : 1;
+
+    for (size_t begin = 0; begin < jobs.size(); begin += batch_size) {
+        const size_t end = std::min(jobs.size(), begin + batch_size);
+        std::vector<std::unique_ptr<Fragment>> fragments(end - begin);
+        if (end - begin > 1)
+            this->_render_ahead(jobs, begin, end, &fragments);
+
+        for (size_t i = begin; i < end; ++i) {
+            const LayerJob& job { jobs[i] };
+            fh << this->_begin_layer(_gcodegen, job);
+            if (job.first_layer_temperature) {
+                if (config.first_layer_bed_temperature > 0 &&
+                        config.has_heatbed &&
+                        std::regex_search(config.between_objects_gcode.getString(), bed_temp_regex))
+                {
+                    fh << _gcodegen.writer.set_bed_temperature(config.first_layer_bed_temperature);
+                }
+                if (std::regex_search(config.between_objects_gcode.getString(), ex_temp_regex)) {
+                    _print_first_layer_temperature(false);
+                }
+            }
+            this->process_layer(job, fragments[i - begin].get());
+            fragments[i - begin].reset();
+            this->_end_layer(_gcodegen, job);
+
+            if (job.copy_done) this->flush_filters();
+            if (config.complete_objects || job.z_done) progress.layer_done();
+        }
+    }
+}
+
+void
+PrintGCode::_render_ahead(const std::vector<LayerJob>& jobs, size_t begin, size_t end,
+    std::vector<std::unique_ptr<Fragment>>* fragments)
+{
+    std::vector<std::unique_ptr<Fragment>>& rendered { *fragments };
+    const int threads { config.threads.value };
+
+    // first pass: each layer is changed to once and ends its print_z, if
+    // any, whatever the state was
+    ThreadPool::instance().parallel_for(0, end - begin, [this, &jobs, begin, &rendered] (size_t i) {
+        rendered[i] = this->_render_fragment(jobs[begin + i], _gcodegen, [this, &jobs, begin, i] (GCode& gcodegen) {
+            for (size_t k = begin; k < begin + i; ++k) {
+                gcodegen.layer_index++;
+                this->_end_layer(gcodegen, jobs[k]);
+            }
+        }, nullptr);
+    }, threads, 1);
+
+    // next passes: render again the layers which didn't start from the state
+    // the previous one was left in by the last pass
+    std::vector<std::unique_ptr<Fragment>> again(end - begin);
+    for (size_t pass = 1; pass < max_render_passes; ++pass) {
+        ThreadPool::instance().parallel_for(1, end - begin, [this, &jobs, begin, &rendered, &again] (size_t i) {
+            again[i] = this->_render_fragment(jobs[begin + i], rendered[i - 1]->end, [this, &jobs, begin, i, &rendered] (GCode& gcodegen) {
+                // the seams are aligned per object, on the last layer of each one
+                std::set<const PrintObject*> seen { jobs[begin + i - 1].layer->object() };
+                for (size_t k = i - 1; k-- > 0; ) {
+                    const PrintObject* object { jobs[begin + k].layer->object() };
+                    if (!seen.insert(object).second) continue;
+                    const auto& seams = rendered[k]->end._seam_position;
+                    if (seams.count(object) > 0) gcodegen._seam_position[object] = seams.at(object);
+                }
+                this->_end_layer(gcodegen, jobs[begin + i - 1]);
+            }, rendered[i].get());
+        }, threads, 1);
+
+        bool converged { true };
+        for (size_t i = 1; i < end - begin; ++i) {
+            if (!again[i]) continue;
+            rendered[i] = std::move(again[i]);
+            converged = false;
+        }
+        if (converged) break;
+    }
+}
+
+std::unique_ptr<PrintGCode::Fragment>
+PrintGCode::_render_fragment(const LayerJob& job, const GCode& from, const std::function<void(GCode&)>& catch_up,
+    const Fragment* rendered)
+{
+    std::unique_ptr<Fragment> fragment(new Fragment());
+    GCode& gcodegen { fragment->end };
+    fragment->end_parser = *from.placeholder_parser;
+    gcodegen = from;
+    gcodegen.placeholder_parser = &fragment->end_parser;
+    catch_up(gcodegen);
+    this->_begin_layer(gcodegen, job);
+    if (rendered != nullptr && rendered->starts_from(gcodegen)) return nullptr;
+
+    fragment->start_parser = fragment->end_parser;
+    fragment->start = gcodegen;
+    fragment->start.placeholder_parser = &fragment->start_parser;
+
+    gcodegen.take_totals();
+    fragment->gcode = this->_render_layer(gcodegen, job);
+    return fragment;
+}
+
+std::string
+PrintGCode::_begin_layer(GCode& gcodegen, const LayerJob& job)
+{
+    std::string gcode {""};
+    if (job.next_copy) {
+        gcodegen.set_origin(Pointf::new_unscale(job.copies.front()));
+        gcodegen.enable_cooling_markers = false;
+        gcodegen.avoid_crossing_perimeters.use_external_mp_once = true;
+        gcode += gcodegen.retract();
+        gcode += gcodegen.travel_to(Point(0,0), erNone, "move to origin position for next object");
+
+        gcodegen.enable_cooling_markers = true;
+        // disable motion planner when traveling to first object point
+        gcodegen.avoid_crossing_perimeters.disable_once = true;
+    }
+    return gcode;
+}
+
+void
+PrintGCode::_end_layer(GCode& gcodegen, const LayerJob& job)
+{
+    if (job.z_done) {
+        gcodegen.placeholder_parser->set("layer_z", unscale(job.print_z));
+        gcodegen.placeholder_parser->set("layer_num", gcodegen.layer_index);
+    }
+}
+
+bool
+PrintGCode::_spiral_vase_enabled(const Layer* layer) const
+{
+    return layer->id() > 0
+        && (_print.config.skirts == 0 || (static_cast<int>(layer->id()) >= _print.config.skirt_height && !_print.has_infinite_skirt()))
+        && std::find_if(layer->regions.cbegin(), layer->regions.cend(), [layer] (const LayerRegion* l)
+            { return    l->region()->config.bottom_solid_layers > static_cast<int>(layer->id())
+                     || l->perimeters.items_count() > 1
+                     || l->fills.items_count() > 0;
+            }) == layer->regions.cend();
+}
+
+void
+PrintGCode::process_layer(const LayerJob& job, Fragment* fragment)
+{
+    CancellationToken::check_current();
+    const Layer* layer { job.layer };
+
+    ChunkedGCode gcode;
+    if (fragment != nullptr && fragment->starts_from(_gcodegen)) {
+        gcode.append(std::move(fragment->gcode));
+        _gcodegen.take_over(fragment->end);
+    } else {
+        // the totals are summed up by layer, as the ones rendered ahead of time
+        const GCodeTotals totals { _gcodegen.take_totals() };
+        gcode.append(this->_render_layer(_gcodegen, job));
+        _gcodegen.add_totals(totals);
+    }
 
     // check for usage of spiralvase logic.
-    this->_spiral_vase.enable = (
-            layer->id() > 0
-            && (_print.config.skirts == 0 || (layer->id() >= _print.config.skirt_height && !_print.has_infinite_skirt()))
-            && std::find_if(layer->regions.cbegin(), layer->regions.cend(), [layer] (const LayerRegion* l)
-                { return    l->region()->config.bottom_solid_layers > layer->id()
-                         || l->perimeters.items_count() > 1
-                         || l->fills.items_count() > 0;
-                }) == layer->regions.cend()
-            );
-    this->_gcodegen.enable_loop_clipping = this->_spiral_vase.enable;
+    this->_spiral_vase.enable = this->_spiral_vase_enabled(layer);
+
+    // Apply spiral vase post-processing if this layer contains suitable geometry
+    // (we must feed all the G-code into the post-processor, including the first
+    // bottom non-spiral layers otherwise it will mess with positions)
+    // we apply spiral vase at this stage because it requires a full layer
+    this->_spiral_vase.process_layer(&gcode);
+    // Apply the cooling logic.
+    ChunkedGCode cooled;
+    this->_cooling_buffer.append(&cooled, std::move(gcode), std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()),
+                                 layer->id(), layer->print_z);
 
+    // write the resulting gcode
+    this->filter(&cooled);
+    cooled.write(fh);
+}
+
+std::string
+PrintGCode::_render_layer(GCode& gcodegen, const LayerJob& job)
+{
+    CancellationToken::check_current();
+    const Layer* layer { job.layer };
+    // the fills may still be in the works, see Print::export_gcode()
+    _print.wait_for_layer(layer);
+
+    std::string gcode {""};
 
+    const PrintObject& obj { *layer->object() };
+    gcodegen.config.apply(obj.config, true);
 
     // if using spiralvase, disable loop clipping.
+    gcodegen.enable_loop_clipping = this->_spiral_vase_enabled(layer);
 
     // initialize autospeed.
     {
@@ -456,41 +686,40 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
             if (config.max_volumetric_speed > 0) {
                 volumetric_speed = std::min(volumetric_speed, config.max_volumetric_speed.getFloat());
             }
-            _gcodegen.volumetric_speed = volumetric_speed;
+            gcodegen.volumetric_speed = volumetric_speed;
         }
     }
     // set the second layer + temp
-    if (!this->_second_layer_things_done && layer->id() == 1) {
-        for (const auto& extruder_ref : _gcodegen.writer.extruders) {
+    if (job.second_layer_things) {
+        for (const auto& extruder_ref : gcodegen.writer.extruders) {
             const Extruder& extruder { extruder_ref.second };
             auto temp = config.temperature.get_at(extruder.id);
 
             if (temp > 0 && temp != config.first_layer_temperature.get_at(extruder.id) )
-                gcode += _gcodegen.writer.set_temperature(temp, 0, extruder.id);
+                gcode += gcodegen.writer.set_temperature(temp, 0, extruder.id);
 
         }
         if (config.has_heatbed && _print.config.first_layer_bed_temperature > 0 && _print.config.bed_temperature != _print.config.first_layer_bed_temperature) {
-            gcode += _gcodegen.writer.set_bed_temperature(_print.config.bed_temperature);
+            gcode += gcodegen.writer.set_bed_temperature(_print.config.bed_temperature);
         }
-        this->_second_layer_things_done = true;
     }
 
     // set new layer - this will change Z and force a retraction if retract_layer_change is enabled
     if (_print.config.before_layer_gcode.getString().size() > 0) {
-        PlaceholderParser pp { *_gcodegen.placeholder_parser };
+        PlaceholderParser pp { *gcodegen.placeholder_parser };
         pp.set("layer_num", layer->id());
         pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", _gcodegen.writer.extruder()->retracted);
+        pp.set("current_retraction", gcodegen.writer.extruder()->retracted);
 
         gcode += apply_math(pp.process(_print.config.before_layer_gcode.getString()));
         gcode += "\n";
     }
-    gcode += _gcodegen.change_layer(*layer);
+    gcode += gcodegen.change_layer(*layer);
     if (_print.config.layer_gcode.getString().size() > 0) {
-        PlaceholderParser pp { *_gcodegen.placeholder_parser };
+        PlaceholderParser pp { *gcodegen.placeholder_parser };
         pp.set("layer_num", layer->id());
         pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", _gcodegen.writer.extruder()->retracted);
+        pp.set("current_retraction", gcodegen.writer.extruder()->retracted);
 
         gcode += apply_math(pp.process(_print.config.layer_gcode.getString()));
         gcode += "\n";
@@ -500,41 +729,34 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
     // extrude skirt along raft layers and normal obj layers
     // (not along interlaced support material layers)
 
-    if (layer->id() < static_cast<size_t>(obj.config.raft_layers)
-        || ((_print.has_infinite_skirt()
-        || _skirt_done.size() == 0
-        || (_skirt_done.rbegin())->first < scale_(_print.skirt_height_z))
-        && _skirt_done.count(scale_(layer->print_z)) == 0
-        && typeid(layer) != typeid(SupportLayer*)) ) {
-
-
-        _gcodegen.set_origin(Pointf(0,0));
-        _gcodegen.avoid_crossing_perimeters.use_external_mp = true;
+    if (job.skirt) {
+        gcodegen.set_origin(Pointf(0,0));
+        gcodegen.avoid_crossing_perimeters.use_external_mp = true;
 
         /// data load
         std::vector<size_t> extruder_ids;
-        extruder_ids.reserve(_gcodegen.writer.extruders.size());
-        std::transform(_gcodegen.writer.extruders.cbegin(), _gcodegen.writer.extruders.cend(), std::back_inserter(extruder_ids),
+        extruder_ids.reserve(gcodegen.writer.extruders.size());
+        std::transform(gcodegen.writer.extruders.cbegin(), gcodegen.writer.extruders.cend(), std::back_inserter(extruder_ids),
                        [] (const std::pair<unsigned int, Extruder>& z) -> std::size_t { return z.second.id; } );
-        gcode += _gcodegen.set_extruder(extruder_ids.at(0));
+        gcode += gcodegen.set_extruder(extruder_ids.at(0));
 
         // skip skirt if a large brim
         if (_print.has_infinite_skirt() || layer->id() < static_cast<size_t>(_print.config.skirt_height)) {
             const Flow skirt_flow { _print.skirt_flow() };
 
             // distribute skirt loops across all extruders in layer 0
-            const auto skirt_loops = _print.skirt.flatten().entities;
-            for (size_t i = 0; i < skirt_loops.size(); ++i) {
+            const ExtrusionEntityCollection skirt_loops { _print.skirt.flatten() };
+            for (size_t i = 0; i < skirt_loops.entities.size(); ++i) {
 
                 // when printing layers > 0 ignore 'min_skirt_length' and
                 // just use the 'skirts' setting; also just use the current extruder
                 if (layer->id() > 0 && i >= static_cast<size_t>(_print.config.skirts)) break;
                 const size_t extruder_id { extruder_ids.at((i / extruder_ids.size()) % extruder_ids.size()) };
                 if (layer->id() == 0)
-                    gcode += _gcodegen.set_extruder(extruder_id);
+                    gcode += gcodegen.set_extruder(extruder_id);
 
                 // adjust flow according to layer height
-                auto& loop = *dynamic_cast<ExtrusionLoop*>(skirt_loops.at(i));
+                auto& loop = *dynamic_cast<ExtrusionLoop*>(skirt_loops.entities.at(i));
                 {
                     Flow layer_skirt_flow(skirt_flow);
                     layer_skirt_flow.height = layer->height;
@@ -546,44 +768,40 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
                         path.mm3_per_mm = mm3_per_mm;
                     }
                 }
-                gcode += _gcodegen.extrude(loop, "skirt", obj.config.support_material_speed);
+                gcode += gcodegen.extrude(loop, "skirt", obj.config.support_material_speed);
             }
 
         }
 
-        this->_skirt_done[scale_(layer->print_z)] = true;
-        _gcodegen.avoid_crossing_perimeters.use_external_mp = false;
+        gcodegen.avoid_crossing_perimeters.use_external_mp = false;
 
-        if (layer->id() == 0) _gcodegen.avoid_crossing_perimeters.disable_once = true;
+        if (layer->id() == 0) gcodegen.avoid_crossing_perimeters.disable_once = true;
     }
 
     // extrude brim
-    if (!this->_brim_done) {
-        gcode += _gcodegen.set_extruder(_print.brim_extruder() - 1);
-        _gcodegen.set_origin(Pointf(0,0));
-        _gcodegen.avoid_crossing_perimeters.use_external_mp = true;
+    if (job.brim) {
+        gcode += gcodegen.set_extruder(_print.brim_extruder() - 1);
+        gcodegen.set_origin(Pointf(0,0));
+        gcodegen.avoid_crossing_perimeters.use_external_mp = true;
         for (const auto& b : _print.brim.entities) {
-            gcode += _gcodegen.extrude(*b, "brim", obj.config.get_abs_value("support_material_speed"));
+            gcode += gcodegen.extrude(*b, "brim", obj.config.get_abs_value("support_material_speed"));
         }
-        this->_brim_done = true;
-        _gcodegen.avoid_crossing_perimeters.use_external_mp = false;
+        gcodegen.avoid_crossing_perimeters.use_external_mp = false;
 
         // allow a straight travel move to the first object point
-        _gcodegen.avoid_crossing_perimeters.disable_once = true;
+        gcodegen.avoid_crossing_perimeters.disable_once = true;
     }
 
     auto copy_idx = 0U;
-    for (const auto& copy : copies) {
+    for (const auto& copy : job.copies) {
         if (config.label_printed_objects) {
-            gcode +=   "; printing object " + obj.model_object().name + " id:" + std::to_string(idx) + " copy "  + std::to_string(copy_idx) + "\n";
+            gcode +=   "; printing object " + obj.model_object().name + " id:" + std::to_string(job.obj_idx) + " copy "  + std::to_string(copy_idx) + "\n";
         }
 
         // when starting a new object, use the external motion planner for the first travel move
-        if (this->_last_obj_copy.first != copy && this->_last_obj_copy.second )
-            _gcodegen.avoid_crossing_perimeters.use_external_mp = true;
-        this->_last_obj_copy.first = copy;
-        this->_last_obj_copy.second = true;
-        _gcodegen.set_origin(Pointf::new_unscale(copy));
+        if (job.external_mp.at(copy_idx))
+            gcodegen.avoid_crossing_perimeters.use_external_mp = true;
+        gcodegen.set_origin(Pointf::new_unscale(copy));
 
         // extrude support material before other things because it might use a lower Z
         // and also because we avoid travelling on other things when printing it
@@ -591,17 +809,17 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
             const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
             ExtrusionEntityCollection paths;
             if (slayer->support_interface_fills.size() > 0) {
-                gcode += _gcodegen.set_extruder(obj.config.support_material_interface_extruder - 1);
-                slayer->support_interface_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
+                gcode += gcodegen.set_extruder(obj.config.support_material_interface_extruder - 1);
+                slayer->support_interface_fills.chained_path_from(gcodegen.last_pos(), &paths, false);
                 for (const auto& path : paths) {
-                    gcode += _gcodegen.extrude(*path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
+                    gcode += gcodegen.extrude(*path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
                 }
             }
             if (slayer->support_fills.size() > 0) {
-                gcode += _gcodegen.set_extruder(obj.config.support_material_extruder - 1);
-                slayer->support_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
+                gcode += gcodegen.set_extruder(obj.config.support_material_extruder - 1);
+                slayer->support_fills.chained_path_from(gcodegen.last_pos(), &paths, false);
                 for (const auto& path : paths) {
-                    gcode += _gcodegen.extrude(*path, "support material", obj.config.get_abs_value("support_material_speed"));
+                    gcode += gcodegen.extrude(*path, "support material", obj.config.get_abs_value("support_material_speed"));
                 }
             }
         }
@@ -686,60 +904,51 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
 
         // tweak extruder ordering to save toolchanges
 
-        auto last_extruder = _gcodegen.writer.extruder()->id;
+        auto last_extruder = gcodegen.writer.extruder()->id;
         if (by_extruder.count(last_extruder)) {
             for(auto &island : by_extruder[last_extruder]) {
                if (_print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
+                    gcode += this->_extrude_infill(gcodegen, std::get<1>(island.second));
+                    gcode += this->_extrude_perimeters(gcodegen, std::get<0>(island.second));
                 } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+                    gcode += this->_extrude_perimeters(gcodegen, std::get<0>(island.second));
+                    gcode += this->_extrude_infill(gcodegen, std::get<1>(island.second));
                 }
             }
         }
         for(auto &pair : by_extruder) {
             if(pair.first == last_extruder)continue;
-            gcode += _gcodegen.set_extruder(pair.first);
+            gcode += gcodegen.set_extruder(pair.first);
             for(auto &island : pair.second) {
                if (_print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
+                    gcode += this->_extrude_infill(gcodegen, std::get<1>(island.second));
+                    gcode += this->_extrude_perimeters(gcodegen, std::get<0>(island.second));
                 } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+                    gcode += this->_extrude_perimeters(gcodegen, std::get<0>(island.second));
+                    gcode += this->_extrude_infill(gcodegen, std::get<1>(island.second));
                 }
             }
         }
         if (config.label_printed_objects) {
-            gcode +=   "; stop printing object " + obj.model_object().name + " id:" + std::to_string(idx) + " copy "  + std::to_string(copy_idx) + "\n";
+            gcode +=   "; stop printing object " + obj.model_object().name + " id:" + std::to_string(job.obj_idx) + " copy "  + std::to_string(copy_idx) + "\n";
         }
         copy_idx++;
     }
 
-    // Apply spiral vase post-processing if this layer contains suitable geometry
-    // (we must feed all the G-code into the post-processor, including the first
-    // bottom non-spiral layers otherwise it will mess with positions)
-    // we apply spiral vase at this stage because it requires a full layer
-    gcode = this->_spiral_vase.process_layer(gcode);
-    // Apply the cooling logic.
-    gcode = this->_cooling_buffer.append(gcode, std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()),
-                                         layer->id(), layer->print_z);
 
-    // write the resulting gcode
-    fh << this->filter(gcode);
+    return gcode;
 }
 
 
 // Extrude perimeters: Decide where to put seams (hide or align seams).
 std::string
-PrintGCode::_extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region)
+PrintGCode::_extrude_perimeters(GCode& gcodegen, std::map<size_t,ExtrusionEntityCollection> &by_region)
 {
     std::string gcode = "";
     for(auto& pair : by_region) {
-        this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
+        gcodegen.apply_region_config(*this->_print.get_region(pair.first));
         for(auto& ee : pair.second){
-            gcode += this->_gcodegen.extrude(*ee, "perimeter");
+            gcode += gcodegen.extrude(*ee, "perimeter");
         }
     }
     return gcode;
@@ -747,15 +956,15 @@ PrintGCode::_extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_r
 
 // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
 std::string
-PrintGCode::_extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region)
+PrintGCode::_extrude_infill(GCode& gcodegen, std::map<size_t,ExtrusionEntityCollection> &by_region)
 {
     std::string gcode = "";
     for(auto& pair : by_region) {
-        this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
+        gcodegen.apply_region_config(*this->_print.get_region(pair.first));
         ExtrusionEntityCollection tmp;
-        pair.second.chained_path_from(this->_gcodegen.last_pos(),&tmp);
+        pair.second.chained_path_from(gcodegen.last_pos(),&tmp);
         for(auto& ee : tmp){
-            gcode += this->_gcodegen.extrude(*ee, "infill");
+            gcode += gcodegen.extrude(*ee, "infill");
         }
     }
     return gcode;
@@ -787,7 +996,8 @@ PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) :
         config(_print.config),
         _gcodegen(Slic3r::GCode()),
         objects(_print.objects),
-        fh(_fh),
+        _timed_buffer(_fh.rdbuf(), &this->_time_estimator),
+        fh(&_timed_buffer),
         _cooling_buffer(Slic3r::CoolingBuffer(this->_gcodegen)),
         _spiral_vase(Slic3r::SpiralVase(this->config))
 {
@@ -801,6 +1011,8 @@ PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) :
     _gcodegen.layer_count = layer_count;
     _gcodegen.enable_cooling_markers = true;
     _gcodegen.apply_print_config(config);
+    _time_estimator.apply_config(config);
+    _cooling_buffer.set_time_estimator(&_time_estimator);
 
     if (config.spiral_vase) _spiral_vase.enable = true;
 
@@ -4,14 +4,18 @@
 #include "GCode.hpp"
 #include "GCode/CoolingBuffer.hpp"
 #include "GCode/SpiralVase.hpp"
+#include "GCodeTimeEstimator.hpp"
 #include "Geometry.hpp"
 #include "Flow.hpp"
 #include "ExtrusionEntity.hpp"
 #include "libslic3r.h"
 
 #include <string>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <regex>
+#include <vector>
 
 namespace Slic3r {
 
@@ -20,16 +24,59 @@ public:
     /// Constructor.
     PrintGCode(Slic3r::Print& print, std::ostream& _fh);
 
+    /// A layer of an object to export, along with what was decided for it
+    /// ahead of time so that it can be rendered on any thread.
+    struct LayerJob {
+        size_t obj_idx {0};
+        const Layer* layer {nullptr};
+        Points copies {};
+        bool second_layer_things {false};
+        bool skirt {false};
+        bool brim {false};
+        /// Per copy: travel to it through the external motion planner.
+        std::vector<bool> external_mp {};
+        /// complete_objects: first layer of a copy printed after another one,
+        /// which has to be travelled to first.
+        bool next_copy {false};
+        /// complete_objects: set the first layer temperatures again.
+        bool first_layer_temperature {false};
+        /// complete_objects: last layer of a copy.
+        bool copy_done {false};
+        /// Last layer at its print_z, which is then passed to the custom G-code.
+        bool z_done {false};
+        size_t print_z {0};
+    };
+
+    /// G-code of a layer rendered ahead of time on a copy of the generator.
+    struct Fragment {
+        /// State the layer was rendered from and state it left, each one
+        /// pointing to its own copy of the placeholder parser.
+        GCode start;
+        GCode end;
+        PlaceholderParser start_parser;
+        PlaceholderParser end_parser;
+        std::string gcode;
+
+        /// Whether this fragment is what gcodegen would render next.
+        bool starts_from(const GCode& gcodegen) const {
+            return this->start.same_state(gcodegen)
+                && this->start_parser._single == gcodegen.placeholder_parser->_single
+                && this->start_parser._multiple == gcodegen.placeholder_parser->_multiple;
+        }
+    };
+
     /// Perform the export. export is a reserved name in C++, so changed to output
     void output();
 
     /// Process an individual output for export. Writes to the ostream.
-    void process_layer(size_t idx, const Layer* layer, const Points& copies);
+    /// The fragment rendered ahead of time for the layer, if any, is used
+    /// when it started from the current state of the generator.
+    void process_layer(const LayerJob& job, Fragment* fragment = nullptr);
 
-    void flush_filters() { fh << this->filter(this->_cooling_buffer.flush(), true); }
+    void flush_filters();
 
-    /// Applies various filters, if enabled.
-    std::string filter(const std::string& in, bool wait = false);
+    /// Applies various filters, if enabled, in place.
+    void filter(ChunkedGCode* gcode, bool wait = false);
 
 private:
 
@@ -40,7 +87,10 @@ private:
 
     const PrintObjectPtrs& objects;
 
-    std::ostream& fh;
+    /// Times the G-code written to fh, for the cooling buffer and the footer.
+    Slic3r::GCodeTimeEstimator _time_estimator;
+    Slic3r::GCodeTimeEstimatorBuffer _timed_buffer;
+    std::ostream fh;
 
     Slic3r::CoolingBuffer _cooling_buffer;
     Slic3r::SpiralVase _spiral_vase;
@@ -61,11 +111,45 @@ private:
     /// Utility function to print config options as gcode comments
     void _print_config(const ConfigBase& config);
 
+    /// Decide what goes along with the layer of job, which comes next in
+    /// the export order.
+    void _plan_layer(LayerJob* job);
+
+    /// Export the layers in order. With several threads and relative E
+    /// distances, they are rendered ahead of time in batches, see
+    /// _render_ahead().
+    void _export_layers(const std::vector<LayerJob>& jobs, size_t progress_steps);
+
+    /// Render jobs [begin, end) on copies of the generator, in a few passes.
+    /// The first one starts every layer from the current state, which is
+    /// only right for the first one; but as a layer mostly leaves the same
+    /// state whatever it started from, the next passes start each layer
+    /// from the state the last one left the previous layer in, until they
+    /// agree.
+    void _render_ahead(const std::vector<LayerJob>& jobs, size_t begin, size_t end,
+        std::vector<std::unique_ptr<Fragment>>* fragments);
+    /// Render job on a copy of from, first brought by catch_up to where the
+    /// previous layer is supposed to have left it; nothing if the fragment
+    /// rendered already starts from there.
+    std::unique_ptr<Fragment> _render_fragment(const LayerJob& job, const GCode& from,
+        const std::function<void(GCode&)>& catch_up, const Fragment* rendered);
+    /// Passes of _render_ahead(); what's left is rendered again in order.
+    static const size_t max_render_passes {3};
+
+    /// G-code of the layer of job, which only depends on the state of gcodegen.
+    std::string _render_layer(GCode& gcodegen, const LayerJob& job);
+
+    /// Moves to the copy of job if it's a new one; written out of the cooling buffer.
+    std::string _begin_layer(GCode& gcodegen, const LayerJob& job);
+    void _end_layer(GCode& gcodegen, const LayerJob& job);
+
+    bool _spiral_vase_enabled(const Layer* layer) const;
+
     // Extrude perimeters: Decide where to put seams (hide or align seams).
-    std::string _extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    std::string _extrude_perimeters(GCode& gcodegen, std::map<size_t,ExtrusionEntityCollection> &by_region);
 
     // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
-    std::string _extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    std::string _extrude_infill(GCode& gcodegen, std::map<size_t,ExtrusionEntityCollection> &by_region);
 
     /// regular expression to match heater gcodes
     std::regex bed_temp_regex { std::regex("M(?:190|140)", std::regex_constants::icase)};
@@ -1,5 +1,6 @@
 #include "Print.hpp"
 #include "BoundingBox.hpp"
+#include "BridgeDetector.hpp"
 #include "ClipperUtils.hpp"
 #include "Geometry.hpp"
 #include "Log.hpp"
@@ -23,7 +24,8 @@ PrintObject::PrintObject(Print* print, ModelObject* model_object, const Bounding
 :   layer_height_spline(model_object->layer_height_spline),
     typed_slices(false),
     _print(print),
-    _model_object(model_object)
+    _model_object(model_object),
+    _content_hash(0)
 {
     // Compute the translation to be applied to our meshes so that we work with smaller coordinates
     {
@@ -110,9 +112,112 @@ PrintObject::reload_model_instances()
     for (ModelInstancePtrs::const_iterator i = this->_model_object->instances.begin(); i != this->_model_object->instances.end(); ++i) {
         copies.push_back(Point::new_scale((*i)->offset.x, (*i)->offset.y));
     }
+    for (const std::pair<ModelObject*,Point> &merged : this->_merged_model_objects) {
+        for (const ModelInstance* instance : merged.first->instances) {
+            Point copy = Point::new_scale(instance->offset.x, instance->offset.y);
+            copy.translate(merged.second);
+            copies.push_back(copy);
+        }
+    }
     return this->set_copies(copies);
 }
 
+ModelObjectPtrs
+PrintObject::merged_model_objects() const
+{
+    ModelObjectPtrs objects;
+    for (const std::pair<ModelObject*,Point> &merged : this->_merged_model_objects)
+        objects.push_back(merged.first);
+    return objects;
+}
+
+/// Corner of the bounding box of the volumes, which the meshes are hashed relative to.
+static Pointf3
+volumes_origin(const ModelObject &object)
+{
+    BoundingBoxf3 bb;
+    for (const ModelVolume* volume : object.volumes) bb.merge(volume->mesh.bounding_box());
+    return bb.min;
+}
+
+uint64_t
+PrintObject::content_hash() const
+{
+    const ModelObject &object = this->model_object();
+    uint64_t hash = this->config.hash();
+    
+    for (const auto &region : this->region_volumes) {
+        hash = hash_value(region.first, hash_value(region.second.size(), hash));
+        for (int volume_id : region.second) hash = hash_value(volume_id, hash);
+    }
+    
+    // the meshes are sliced once shifted to the corner of the object
+    const Pointf3 origin = volumes_origin(object);
+    for (const ModelVolume* volume : object.volumes)
+        hash = hash_value(volume->mesh.content_hash(origin, this->_print->config.threads.value),
+            hash_value(volume->modifier, hash));
+    
+    const TransformationMatrix trafo = object.instances.front()->get_trafo_matrix(true);
+    for (double m : { trafo.m00, trafo.m01, trafo.m02, trafo.m03, trafo.m10, trafo.m11,
+        trafo.m12, trafo.m13, trafo.m20, trafo.m21, trafo.m22, trafo.m23 })
+        hash = hash_value(m, hash);
+    
+    for (const auto &range : this->layer_height_ranges) {
+        hash = hash_value(range.first.first, hash_value(range.first.second, hash));
+        hash = hash_value(range.second, hash);
+    }
+    for (coordf_t z : this->layer_height_spline.getOriginalLayers()) hash = hash_value(z, hash);
+    if (this->layer_height_spline.layerHeightsUpdated())
+        for (coordf_t z : this->layer_height_spline.getInterpolatedLayers()) hash = hash_value(z, hash);
+    
+    return hash;
+}
+
+bool
+PrintObject::same_content(const PrintObject &other) const
+{
+    if (!this->config.equals(other.config)
+        || this->region_volumes != other.region_volumes
+        || this->layer_height_ranges != other.layer_height_ranges
+        || this->layer_height_spline.getOriginalLayers() != other.layer_height_spline.getOriginalLayers()
+        || this->layer_height_spline.layerHeightsUpdated() != other.layer_height_spline.layerHeightsUpdated()
+        || (this->layer_height_spline.layerHeightsUpdated()
+            && this->layer_height_spline.getInterpolatedLayers() != other.layer_height_spline.getInterpolatedLayers()))
+        return false;
+    
+    const ModelObject &object = this->model_object();
+    const ModelObject &other_object = other.model_object();
+    const TransformationMatrix trafo = object.instances.front()->get_trafo_matrix(true);
+    const TransformationMatrix other_trafo = other_object.instances.front()->get_trafo_matrix(true);
+    // exactly, as hashed, unlike TransformationMatrix::operator==
+    if (trafo.m00 != other_trafo.m00 || trafo.m01 != other_trafo.m01 || trafo.m02 != other_trafo.m02
+        || trafo.m03 != other_trafo.m03 || trafo.m10 != other_trafo.m10 || trafo.m11 != other_trafo.m11
+        || trafo.m12 != other_trafo.m12 || trafo.m13 != other_trafo.m13 || trafo.m20 != other_trafo.m20
+        || trafo.m21 != other_trafo.m21 || trafo.m22 != other_trafo.m22 || trafo.m23 != other_trafo.m23)
+        return false;
+    
+    // the facets, relative to the corner of the object as they are hashed
+    if (object.volumes.size() != other_object.volumes.size()) return false;
+    const Pointf3 origin = volumes_origin(object), other_origin = volumes_origin(other_object);
+    for (size_t i = 0; i < object.volumes.size(); ++i) {
+        const ModelVolume &volume = *object.volumes[i], &other_volume = *other_object.volumes[i];
+        const stl_file &stl = volume.mesh.stl, &other_stl = other_volume.mesh.stl;
+        if (volume.modifier != other_volume.modifier
+            || stl.stats.number_of_facets != other_stl.stats.number_of_facets)
+            return false;
+        for (int f = 0; f < stl.stats.number_of_facets; ++f) {
+            for (int v = 0; v < 3; ++v) {
+                const stl_vertex &a = stl.facet_start[f].vertex[v], &b = other_stl.facet_start[f].vertex[v];
+                if (float(a.x - origin.x) != float(b.x - other_origin.x)
+                    || float(a.y - origin.y) != float(b.y - other_origin.y)
+                    || float(a.z - origin.z) != float(b.z - other_origin.z))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
 BoundingBox
 PrintObject::bounding_box() const
 {
@@ -353,7 +458,7 @@ PrintObject::detect_surfaces_type()
     this->slice();
     
     parallelize<Layer*>(
-        std::queue<Layer*>(std::deque<Layer*>(this->layers.begin(), this->layers.end())),  // cast LayerPtrs to std::queue<Layer*>
+        this->layers,
         boost::bind(&Slic3r::Layer::detect_surfaces_type, _1),
         this->_print->config.threads.value
     );
@@ -365,9 +470,11 @@ PrintObject::detect_surfaces_type()
 void
 PrintObject::process_external_surfaces()
 {
+    // bridges repeated over several layers get their angle detected once
+    BridgeAngleCache bridge_angles;
     parallelize<Layer*>(
-        std::queue<Layer*>(std::deque<Layer*>(this->layers.begin(), this->layers.end())),  // cast LayerPtrs to std::queue<Layer*>
-        boost::bind(&Slic3r::Layer::process_external_surfaces, _1),
+        this->layers,
+        boost::bind(&Slic3r::Layer::process_external_surfaces, _1, &bridge_angles),
         this->_print->config.threads.value
     );
 }
@@ -815,33 +922,28 @@ void PrintObject::_slice()
         }
     }
 
-    if (this->print()->regions.size() == 1) {
-        // Optimized for a single region. Slice the single non-modifier mesh.
-        std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(0, slice_zs, false);
-        for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id)
-            this->layers[layer_id]->regions.front()->slices.append(std::move(expolygons_by_layer[layer_id]), stInternal);
-    } else {
-        // Slice all non-modifier volumes.
-        for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
-            std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(region_id, slice_zs, false);
-            for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id)
-                this->layers[layer_id]->regions[region_id]->slices.append(std::move(expolygons_by_layer[layer_id]), stInternal);
-        }
+    // Slice all non-modifier volumes, storing each layer as soon as it is sliced.
+    // With a single region there are no modifiers to look at.
+    for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
+        this->_slice_region(region_id, slice_zs, false, [this, region_id](size_t layer_id, ExPolygons &slices) {
+            this->layers[layer_id]->regions[region_id]->slices.append(std::move(slices), stInternal);
+        });
+    }
+    if (this->print()->regions.size() > 1) {
         // Slice all modifier volumes.
         for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
-            std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(region_id, slice_zs, true);
-            // loop through the other regions and 'steal' the slices belonging to this one
-            for (size_t other_region_id = 0; other_region_id < this->print()->regions.size(); ++ other_region_id) {
-                if (region_id == other_region_id)
-                    continue;
-                for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id) {
-                    Layer       *layer = layers[layer_id];
+            this->_slice_region(region_id, slice_zs, true, [this, region_id](size_t layer_id, ExPolygons &slices) {
+                // loop through the other regions and 'steal' the slices belonging to this one
+                for (size_t other_region_id = 0; other_region_id < this->print()->regions.size(); ++ other_region_id) {
+                    if (region_id == other_region_id)
+                        continue;
+                    Layer       *layer = this->layers[layer_id];
                     LayerRegion *layerm = layer->regions[region_id];
                     LayerRegion *other_layerm = layer->regions[other_region_id];
                     if (layerm == nullptr || other_layerm == nullptr)
                         continue;
                     Polygons other_slices = to_polygons(other_layerm->slices);
-                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(expolygons_by_layer[layer_id]));
+                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(slices));
                     if (my_parts.empty())
                         continue;
                     // Remove such parts from original region.
@@ -849,7 +951,7 @@ void PrintObject::_slice()
                     // Append new parts to our region.
                     layerm->slices.append(std::move(my_parts), stInternal);
                 }
-            }
+            });
         }
     }
 
@@ -869,14 +971,14 @@ void PrintObject::_slice()
     }
 
     // remove collinear points from slice polygons (artifacts from stl-triangulation)
-    std::queue<SurfaceCollection*> queue;
+    std::vector<SurfaceCollection*> collections;
     for (Layer* layer : this->layers) {
         for (LayerRegion* layerm : layer->regions) {
-            queue.push(&layerm->slices);
+            collections.push_back(&layerm->slices);
         }
     }
     parallelize<SurfaceCollection*>(
-        queue,
+        collections,
         boost::bind(&Slic3r::SurfaceCollection::remove_collinear_points, _1),
         this->_print->config.threads.value
     );
@@ -936,16 +1038,23 @@ void PrintObject::_slice()
 
 // called from slice()
 std::vector<ExPolygons>
-PrintObject::_slice_region(size_t region_id, std::vector<float> z, bool modifier)
+PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier)
 {
     std::vector<ExPolygons> layers;
+    this->_slice_region(region_id, z, modifier, [&layers, &z](size_t layer_id, ExPolygons &slices) {
+        if (layers.empty()) layers.resize(z.size());
+        layers[layer_id] = std::move(slices);
+    });
+    return layers;
+}
+
+void
+PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier, const SliceCallback &callback)
+{
     std::vector<int> &region_volumes = this->region_volumes[region_id];
-    if (region_volumes.empty()) return layers;
+    if (region_volumes.empty()) return;
     
     ModelObject &object = *this->model_object();
-    
-    // compose mesh
-    TriangleMesh mesh;
 
     // we ignore the per-instance transformations currently and only 
     // consider the first one
@@ -958,19 +1067,21 @@ PrintObject::_slice_region(size_t region_id, std::vector<float> z, bool modifier
         -object.bounding_box().min.z
     ));
 
+    // the slicer reads the volume meshes, repaired by Print::add_model_object(),
+    // through the transformation instead of slicing a merged copy of them
+    TransformedMeshes meshes;
     for (const auto& i : region_volumes) {
         
         const ModelVolume &volume = *(object.volumes[i]);
 
-        if (volume.modifier != modifier) continue;
+        if (volume.modifier != modifier || volume.mesh.facets_count() == 0) continue;
         
-        mesh.merge(volume.get_transformed_mesh(trafo));
+        meshes.push_back(TransformedMesh(&volume.mesh, trafo));
     }
-    if (mesh.facets_count() == 0) return layers;
+    if (meshes.empty()) return;
 
     // perform actual slicing
-    TriangleMeshSlicer<Z>(&mesh).slice(z, &layers);
-    return layers;
+    TriangleMeshSlicer<Z>(meshes, this->_print->config.threads.value).slice_streaming(z, callback);
 }
 
 /*
@@ -989,9 +1100,7 @@ PrintObject::slice()
 {
     if (this->state.is_done(posSlice)) return;
     this->state.set_started(posSlice);
-    if (_print->status_cb != nullptr) {
-        _print->status_cb(10, "Processing triangulated mesh");
-    }
+    _print->report_status(10, "Processing triangulated mesh");
     
     this->_slice(); 
 
@@ -1079,7 +1188,31 @@ void
 PrintObject::make_perimeters()
 {
     if (this->state.is_done(posPerimeters)) return;
+    this->_start_perimeters();
+    
+    LayerProgress progress(this->_print, 20, "Generating perimeters", this->layers.size());
+    parallelize<Layer*>(
+        this->layers,
+        [this, &progress](Layer* layer) {
+            this->_make_perimeters(layer);
+            progress.layer_done();
+        },
+        this->_print->config.threads.value
+    );
     
+    /*
+        simplify slices (both layer and region slices),
+        we only need the max resolution for perimeters
+    ### This makes this method not-idempotent, so we keep it disabled for now.
+    ###$self->_simplify_slices(&Slic3r::SCALED_RESOLUTION);
+    */
+    
+    this->state.set_done(posPerimeters);
+}
+
+void
+PrintObject::_start_perimeters()
+{
     // Temporary workaround for detect_surfaces_type() not being idempotent (see #3764).
     // We can remove this when idempotence is restored. This make_perimeters() method
     // will just call merge_slices() to undo the typed slices and invalidate posDetectSurfaces.
@@ -1102,7 +1235,11 @@ PrintObject::make_perimeters()
         this->typed_slices = false;
         this->state.invalidate(posDetectSurfaces);
     }
-    
+}
+
+void
+PrintObject::_make_perimeters(Layer* layer)
+{
     // compare each layer to the one below, and mark those slices needing
     // one additional inner perimeter, like the top of domed objects-
     
@@ -1117,11 +1254,13 @@ PrintObject::make_perimeters()
         if (!region.config.extra_perimeters
             || region.config.perimeters == 0
             || region.config.fill_density == 0
-            || this->layer_count() < 2) continue;
+            || layer->upper_layer == nullptr) continue;
         
-        for (size_t i = 0; i <= (this->layer_count()-2); ++i) {
-            LayerRegion &layerm                     = *this->get_layer(i)->get_region(region_id);
-            const LayerRegion &upper_layerm         = *this->get_layer(i+1)->get_region(region_id);
+        // a layer only reads the slices of the layer above, which are left untouched,
+        // and only marks its own, so the layers are all independent
+        {
+            LayerRegion &layerm                     = *layer->get_region(region_id);
+            const LayerRegion &upper_layerm         = *layer->upper_layer->get_region(region_id);
             
             // In order to avoid diagonal gaps (GH #3732) we ignore the external half of the upper
             // perimeter, since it's not truly covering this layer.
@@ -1187,26 +1326,13 @@ PrintObject::make_perimeters()
                 
                 #ifdef DEBUG
                     if (slice->extra_perimeters > 0)
-                        printf("  adding %d more perimeter(s) at layer %zu\n", slice->extra_perimeters, i);
+                        printf("  adding %d more perimeter(s) at layer %zu\n", slice->extra_perimeters, layer->id());
                 #endif
             }
         }
     }
     
-    parallelize<Layer*>(
-        std::queue<Layer*>(std::deque<Layer*>(this->layers.begin(), this->layers.end())),  // cast LayerPtrs to std::queue<Layer*>
-        boost::bind(&Slic3r::Layer::make_perimeters, _1),
-        this->_print->config.threads.value
-    );
-    
-    /*
-        simplify slices (both layer and region slices),
-        we only need the max resolution for perimeters
-    ### This makes this method not-idempotent, so we keep it disabled for now.
-    ###$self->_simplify_slices(&Slic3r::SCALED_RESOLUTION);
-    */
-    
-    this->state.set_done(posPerimeters);
+    layer->make_perimeters();
 }
 
 void
@@ -1218,9 +1344,13 @@ PrintObject::infill()
     // prerequisites
     this->prepare_infill();
     
+    LayerProgress progress(this->_print, 70, "Infilling layers", this->layers.size());
     parallelize<Layer*>(
-        std::queue<Layer*>(std::deque<Layer*>(this->layers.begin(), this->layers.end())),  // cast LayerPtrs to std::queue<Layer*>
-        boost::bind(&Slic3r::Layer::make_fills, _1),
+        this->layers,
+        [&progress](Layer* layer) {
+            layer->make_fills();
+            progress.layer_done();
+        },
         this->_print->config.threads.value
     );
     
@@ -1241,24 +1371,41 @@ PrintObject::prepare_infill()
     // instead of modifying it in place.
 
     this->state.invalidate(posPerimeters);
-    this->make_perimeters();
+    this->_start_perimeters();
 
     this->state.set_started(posPrepareInfill);
+    this->state.set_started(posDetectSurfaces);
 
-    // prerequisites
-    this->detect_surfaces_type();
-
-    if (this->_print->status_cb != nullptr) 
-        this->_print->status_cb(30, "Preparing infill");
-    
-    // decide what surfaces are to be filled
-    for (auto& layer : this->layers)
+    // The layers flow through the perimeters and then the steps preparing
+    // their own surfaces, without waiting for each other in between. The
+    // surfaces of a layer only get typed once the layer below is done with
+    // its extra perimeters, which read the untyped slices above them.
+    LayerProgress progress(this->_print, 20, "Generating perimeters", this->layers.size());
+    BridgeAngleCache bridge_angles;
+    LayerPipeline pipeline(this->layers.size());
+    pipeline.add_stage([this, &progress](size_t i) {
+        this->_make_perimeters(this->layers[i]);
+        progress.layer_done();
+    });
+    pipeline.add_stage([this, &bridge_angles](size_t i) {
+        Layer* layer = this->layers[i];
+        layer->detect_surfaces_type();
+        
+        // decide what surfaces are to be filled
         for (auto& layerm : layer->regions)
             layerm->prepare_fill_surfaces();
+        
+        // this will detect bridges and reverse bridges
+        // and rearrange top/bottom/internal surfaces
+        layer->process_external_surfaces(&bridge_angles);
+    }, 1, 0);
+    pipeline.run(this->_print->config.threads.value);
+    
+    this->state.set_done(posPerimeters);
+    this->typed_slices = true;
+    this->state.set_done(posDetectSurfaces);
 
-    // this will detect bridges and reverse bridges
-    // and rearrange top/bottom/internal surfaces
-    this->process_external_surfaces();
+    this->_print->report_status(30, "Preparing infill");
 
     // detect which fill surfaces are near external layers
     // they will be split in internal and internal-solid surfaces
@@ -1476,8 +1623,7 @@ PrintObject::generate_support_material()
         this->state.set_done(posSupportMaterial);
         return;
     }
-    if (_print->status_cb != nullptr)
-        _print->status_cb(85, "Generating support material");
+    _print->report_status(85, "Generating support material");
 
     this->_support_material()->generate(this);
 
@@ -1485,211 +1631,267 @@ PrintObject::generate_support_material()
 
     std::stringstream stats {""};
 
-    if (_print->status_cb != nullptr)
-        _print->status_cb(85, stats.str().c_str());
+    _print->report_status(85, stats.str());
 
 }
 
 
-void 
+namespace {
+
+/// The work of discover_horizontal_shells() starting from a single layer:
+/// either the solid_infill_every_layers conversion of its internal surfaces
+/// or the propagation of its top or bottom surfaces to its neighbors.
+struct ShellChain {
+    size_t region_id;
+    size_t layer_id;
+    SurfaceType type;
+    bool conversion;
+    /// Layers visited in order, layer_id first.
+    std::vector<size_t> layers;
+    /// Shell propagated by the visits so far.
+    Polygons solid;
+    bool stopped;
+};
+
+}
+
+void
 PrintObject::discover_horizontal_shells()
 {
     #ifdef SLIC3R_DEBUG
     std::cout << "==> DISCOVERING HORIZONTAL SHELLS" << std::endl;
     #endif
-    
+
+    // Lay out the serial algorithm as chains of visits of single layers.
+    // A layer having no top or bottom surface of a type never gets one, as
+    // the visits only ever shrink them, so its chains are known to be empty.
+    const size_t layer_count = this->layer_count();
+    std::vector<ShellChain> chains;
+    LayerChains order(_print->regions.size() * layer_count);
+    const auto add_chain = [&chains, &order, layer_count](const ShellChain &chain) {
+        std::vector<size_t> keys;
+        for (size_t layer_id : chain.layers)
+            keys.push_back(chain.region_id * layer_count + layer_id);
+        order.add_chain(keys);
+        chains.push_back(chain);
+    };
     for (size_t region_id = 0U; region_id < _print->regions.size(); ++region_id) {
-        for (size_t i = 0; i < this->layer_count(); ++i) {
+        for (size_t i = 0; i < layer_count; ++i) {
             auto* layerm = this->get_layer(i)->get_region(region_id);
             const auto& region_config = layerm->region()->config;
 
             if (region_config.solid_infill_every_layers() > 0 && region_config.fill_density() > 0
                 && (i % region_config.solid_infill_every_layers()) == 0) {
-                const auto type = region_config.fill_density() == 100 ? (stInternal | stSolid) : (stInternal | stBridge);
-                for (auto* s : layerm->fill_surfaces.filter_by_type(stInternal))
-                    s->surface_type = type;
+                add_chain(ShellChain { region_id, i, stInternal, true, { i }, Polygons(), false });
+            }
+            for (auto& type : { stTop, stBottom, (stBottom | stBridge) }) {
+                if (layerm->slices.filter_by_type(type).empty()
+                    && layerm->fill_surfaces.filter_by_type(type).empty()) continue;
+
+                ShellChain chain { region_id, i, type, false, { i }, Polygons(), false };
+                const int solid_layers = this->_solid_layers(layerm, i, type);
+                for (int n = ((type & stTop) != 0 ? i-1 : i+1); std::abs(n-int(i)) < solid_layers; ((type & stTop) != 0 ? n-- : n++))
+                    if (n >= 0 && static_cast<size_t>(n) < layer_count)
+                        chain.layers.push_back(n);
+                add_chain(chain);
             }
-            this->_discover_external_horizontal_shells(layerm, i, region_id);
         }
     }
+
+    // Run the chains in that order on several threads: every layer goes
+    // through the same states as in the serial algorithm, while the chains
+    // of distant layers overlap.
+    order.run([this, &chains](size_t c, size_t v) {
+        ShellChain &chain = chains[c];
+        LayerRegion* layerm = this->get_layer(chain.layer_id)->get_region(chain.region_id);
+        if (chain.stopped) {
+            // only let the next chains have their turn
+        } else if (chain.conversion) {
+            const auto& region_config = layerm->region()->config;
+            const auto type = region_config.fill_density() == 100 ? (stInternal | stSolid) : (stInternal | stBridge);
+            for (auto* s : layerm->fill_surfaces.filter_by_type(stInternal))
+                s->surface_type = type;
+        } else if (v == 0) {
+            chain.solid = this->_external_horizontal_shell(layerm, chain.layer_id, chain.type);
+            chain.stopped = chain.solid.empty();
+        } else {
+            chain.stopped = !this->_discover_neighbor_horizontal_shell(layerm, chain.layers[v], chain.region_id, chain.solid);
+        }
+    }, this->_print->config.threads.value);
 }
 
-void
-PrintObject::_discover_external_horizontal_shells(LayerRegion* layerm, const size_t& i, const size_t& region_id)
+int
+PrintObject::_solid_layers(LayerRegion* layerm, const size_t& i, const SurfaceType& type) const
 {
     const auto& region_config = layerm->region()->config;
-    for (auto& type : { stTop, stBottom, (stBottom | stBridge) }) {
-        // find slices of current type for current layer
-        // use slices instead of fill_surfaces because they also include the perimeter area
-        // which needs to be propagated in shells; we need to grow slices like we did for
-        // fill_surfaces though.  Using both ungrown slices and grown fill_surfaces will
-        // not work in some situations, as there won't be any grown region in the perimeter 
-        // area (this was seen in a model where the top layer had one extra perimeter, thus
-        // its fill_surfaces were thinner than the lower layer's infill), however it's the best
-        // solution so far. Growing the external slices by EXTERNAL_INFILL_MARGIN will put
-        // too much solid infill inside nearly-vertical slopes.
-      
-        Polygons solid; 
-        polygons_append(solid, to_polygons(layerm->slices.filter_by_type(type)));
-        polygons_append(solid, to_polygons(layerm->fill_surfaces.filter_by_type(type)));
-        if (solid.empty()) continue;
-        
-        #ifdef SLIC3R_DEBUG
-        std::cout << "Layer " << i << " has " << (type == stTop ? "top" : "bottom") << " surfaces" << std::endl;
-        #endif
-        
-        size_t solid_layers = type == stTop
-            ? region_config.top_solid_layers()
-            : region_config.bottom_solid_layers();
-        solid_layers = min(solid_layers, this->layers.size());
-
-        if (region_config.min_top_bottom_shell_thickness() > 0) {
-            auto current_shell_thickness = static_cast<coordf_t>(solid_layers) * this->get_layer(i)->height;
-            const auto min_shell_thickness = region_config.min_top_bottom_shell_thickness();
-            Slic3r::Log::debug("vertical_shell_thickness") << "Initial shell thickness for layer " << i << " " 
-                                                           << current_shell_thickness << " "
-                                                           << "Minimum: " << min_shell_thickness << "\n";
-            while (std::abs(min_shell_thickness - current_shell_thickness) > Slic3r::Geometry::epsilon && current_shell_thickness < min_shell_thickness) {
-                solid_layers++;
-                current_shell_thickness = static_cast<coordf_t>(solid_layers) * this->get_layer(i)->height;
-                Slic3r::Log::debug("vertical_shell_thickness") << "Solid layer count: "
-                                                               << solid_layers << "; "
-                                                               << "current_shell_thickness: "
-                                                               << current_shell_thickness
-                                                               << "\n";
-                if (solid_layers > this->layers.size()) {
-                    throw std::runtime_error("Infinite loop when determining vertical shell thickness");
-                }
-            }
+    size_t solid_layers = type == stTop
+        ? region_config.top_solid_layers()
+        : region_config.bottom_solid_layers();
+    solid_layers = min(solid_layers, this->layers.size());
+
+    if (region_config.min_top_bottom_shell_thickness() > 0) {
+        auto current_shell_thickness = static_cast<coordf_t>(solid_layers) * this->get_layer(i)->height;
+        const auto min_shell_thickness = region_config.min_top_bottom_shell_thickness();
+        Slic3r::Log::debug("vertical_shell_thickness") << "Initial shell thickness for layer " << i << " "
+                                                       << current_shell_thickness << " "
+                                                       << "Minimum: " << min_shell_thickness << "\n";
+        while (std::abs(min_shell_thickness - current_shell_thickness) > Slic3r::Geometry::epsilon && current_shell_thickness < min_shell_thickness) {
+            solid_layers++;
+            current_shell_thickness = static_cast<coordf_t>(solid_layers) * this->get_layer(i)->height;
+            Slic3r::Log::debug("vertical_shell_thickness") << "Solid layer count: "
+                                                           << solid_layers << "; "
+                                                           << "current_shell_thickness: "
+                                                           << current_shell_thickness
+                                                           << "\n";
+            if (solid_layers > this->layers.size()) break;
         }
-        _discover_neighbor_horizontal_shells(layerm, i, region_id, type, solid, solid_layers);
     }
+    return int(solid_layers);
 }
 
-void
-PrintObject::_discover_neighbor_horizontal_shells(LayerRegion* layerm, const size_t& i, const size_t& region_id, const SurfaceType& type, Polygons& solid, const size_t& solid_layers)
+Polygons
+PrintObject::_external_horizontal_shell(LayerRegion* layerm, const size_t& i, const SurfaceType& type) const
+{
+    // find slices of current type for current layer
+    // use slices instead of fill_surfaces because they also include the perimeter area
+    // which needs to be propagated in shells; we need to grow slices like we did for
+    // fill_surfaces though.  Using both ungrown slices and grown fill_surfaces will
+    // not work in some situations, as there won't be any grown region in the perimeter
+    // area (this was seen in a model where the top layer had one extra perimeter, thus
+    // its fill_surfaces were thinner than the lower layer's infill), however it's the best
+    // solution so far. Growing the external slices by EXTERNAL_INFILL_MARGIN will put
+    // too much solid infill inside nearly-vertical slopes.
+    Polygons solid;
+    polygons_append(solid, to_polygons(layerm->slices.filter_by_type(type)));
+    polygons_append(solid, to_polygons(layerm->fill_surfaces.filter_by_type(type)));
+    if (solid.empty()) return solid;
+
+    #ifdef SLIC3R_DEBUG
+    std::cout << "Layer " << i << " has " << (type == stTop ? "top" : "bottom") << " surfaces" << std::endl;
+    #endif
+
+    if (size_t(this->_solid_layers(layerm, i, type)) > this->layers.size())
+        throw std::runtime_error("Infinite loop when determining vertical shell thickness");
+    return solid;
+}
+
+bool
+PrintObject::_discover_neighbor_horizontal_shell(LayerRegion* layerm, const size_t& n, const size_t& region_id, Polygons& solid)
 {
     const auto& region_config = layerm->region()->config;
 
-    for (int n = ((type & stTop) != 0 ? i-1 : i+1); std::abs(n-int(i)) < solid_layers; ((type & stTop) != 0 ? n-- : n++)) {
-        if (n < 0 || static_cast<size_t>(n) >= this->layer_count()) continue;
+    LayerRegion* neighbor_layerm { this->get_layer(n)->get_region(region_id) };
+    // make a copy so we can use them even after clearing the original collection
+    SurfaceCollection neighbor_fill_surfaces{ neighbor_layerm->fill_surfaces };
+    
+    // find intersection between neighbor and current layer's surfaces
+    // intersections have contours and holes
+    Polygons new_internal_solid = intersection(
+        solid,
+        to_polygons(neighbor_fill_surfaces.filter_by_type({stInternal, (stInternal | stSolid)})),
+        true
+    );
+    if (new_internal_solid.empty()) {
+        // No internal solid needed on this layer. In order to decide whether to continue
+        // searching on the next neighbor (thus enforcing the configured number of solid
+        // layers, use different strategies according to configured infill density.
+        // If we have internal infill, we can generate internal solid shells freely.
+        // If user expects the object to be void (for example a hollow sloping vase),
+        // don't continue the search. In this case, we only generate the external solid
+        // shell if the object would otherwise show a hole (gap between perimeters of 
+        // the two layers), and internal solid shells are a subset of the shells found 
+        // on each previous layer.
+        return region_config.fill_density != 0;
+    }
 
-        LayerRegion* neighbor_layerm { this->get_layer(n)->get_region(region_id) };
-        // make a copy so we can use them even after clearing the original collection
-        SurfaceCollection neighbor_fill_surfaces{ neighbor_layerm->fill_surfaces };
-        
-        // find intersection between neighbor and current layer's surfaces
-        // intersections have contours and holes
-        Polygons new_internal_solid = intersection(
-            solid,
-            to_polygons(neighbor_fill_surfaces.filter_by_type({stInternal, (stInternal | stSolid)})),
+    if (region_config.fill_density == 0) {
+        // if we're printing a hollow object we discard any solid shell thinner
+        // than a perimeter width, since it's probably just crossing a sloping wall
+        // and it's not wanted in a hollow print even if it would make sense when
+        // obeying the solid shell count option strictly (DWIM!)
+        const auto margin = neighbor_layerm->flow(frExternalPerimeter).scaled_width();
+        const auto too_narrow = diff(
+            new_internal_solid,
+            offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5),
+            true
+        ); 
+        if (!too_narrow.empty()) 
+            new_internal_solid = solid = diff(new_internal_solid, too_narrow);
+    }
+
+    // make sure the new internal solid is wide enough, as it might get collapsed
+    // when spacing is added in Slic3r::Fill
+    {
+        // require at least this size
+        const auto margin = 3 * layerm->flow(frSolidInfill).scaled_width();
+
+        // we use a higher miterLimit here to handle areas with acute angles
+        // in those cases, the default miterLimit would cut the corner and we'd
+        // get a triangle in $too_narrow; if we grow it below then the shell
+        // would have a different shape from the external surface and we'd still
+        // have the same angle, so the next shell would be grown even more and so on.
+        const auto too_narrow = diff(
+            new_internal_solid,
+            offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5),
             true
         );
-        if (new_internal_solid.empty()) {
-            // No internal solid needed on this layer. In order to decide whether to continue
-            // searching on the next neighbor (thus enforcing the configured number of solid
-            // layers, use different strategies according to configured infill density:
-            if (region_config.fill_density == 0) {
-                // If user expects the object to be void (for example a hollow sloping vase),
-                // don't continue the search. In this case, we only generate the external solid
-                // shell if the object would otherwise show a hole (gap between perimeters of 
-                // the two layers), and internal solid shells are a subset of the shells found 
-                // on each previous layer.
-                return;
-            } else {
-                // If we have internal infill, we can generate internal solid shells freely.
-                continue;
-            }
-        }
 
-        if (region_config.fill_density == 0) {
-            // if we're printing a hollow object we discard any solid shell thinner
-            // than a perimeter width, since it's probably just crossing a sloping wall
-            // and it's not wanted in a hollow print even if it would make sense when
-            // obeying the solid shell count option strictly (DWIM!)
-            const auto margin = neighbor_layerm->flow(frExternalPerimeter).scaled_width();
-            const auto too_narrow = diff(
-                new_internal_solid,
-                offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5),
-                true
-            ); 
-            if (!too_narrow.empty()) 
-                new_internal_solid = solid = diff(new_internal_solid, too_narrow);
-        }
+        if (!too_narrow.empty()) {
+            // grow the collapsing parts and add the extra area to  the neighbor layer 
+            // as well as to our original surfaces so that we support this 
+            // additional area in the next shell too
 
-        // make sure the new internal solid is wide enough, as it might get collapsed
-        // when spacing is added in Slic3r::Fill
-        {
-            // require at least this size
-            const auto margin = 3 * layerm->flow(frSolidInfill).scaled_width();
-
-            // we use a higher miterLimit here to handle areas with acute angles
-            // in those cases, the default miterLimit would cut the corner and we'd
-            // get a triangle in $too_narrow; if we grow it below then the shell
-            // would have a different shape from the external surface and we'd still
-            // have the same angle, so the next shell would be grown even more and so on.
-            const auto too_narrow = diff(
-                new_internal_solid,
-                offset2(new_internal_solid, -margin, +margin, CLIPPER_OFFSET_SCALE, ClipperLib::jtMiter, 5),
-                true
+            // make sure our grown surfaces don't exceed the fill area
+            Polygons tmp;
+            for (auto& s : neighbor_fill_surfaces)
+                if (s.is_internal() && !s.is_bridge())
+                    append_to(tmp, (Polygons)s);
+            const auto grown = intersection(
+                offset(too_narrow, +margin),
+                // Discard bridges as they are grown for anchoring and we can't
+                // remove such anchors. (This may happen when a bridge is being 
+                // anchored onto a wall where little space remains after the bridge
+                // is grown, and that little space is an internal solid shell so 
+                // it triggers this too_narrow logic.)
+                tmp
             );
-
-            if (!too_narrow.empty()) {
-                // grow the collapsing parts and add the extra area to  the neighbor layer 
-                // as well as to our original surfaces so that we support this 
-                // additional area in the next shell too
-
-                // make sure our grown surfaces don't exceed the fill area
-                Polygons tmp;
-                for (auto& s : neighbor_fill_surfaces)
-                    if (s.is_internal() && !s.is_bridge())
-                        append_to(tmp, (Polygons)s);
-                const auto grown = intersection(
-                    offset(too_narrow, +margin),
-                    // Discard bridges as they are grown for anchoring and we can't
-                    // remove such anchors. (This may happen when a bridge is being 
-                    // anchored onto a wall where little space remains after the bridge
-                    // is grown, and that little space is an internal solid shell so 
-                    // it triggers this too_narrow logic.)
-                    tmp
-                );
-                append_to(new_internal_solid, grown);
-                solid = new_internal_solid;
-            }
+            append_to(new_internal_solid, grown);
+            solid = new_internal_solid;
         }
+    }
+    
+    // internal-solid are the union of the existing internal-solid surfaces
+    // and new ones
+    Polygons tmp { to_polygons(neighbor_fill_surfaces.filter_by_type(stInternal | stSolid)) };
+    polygons_append(tmp, new_internal_solid);
+    const ExPolygons internal_solid = union_ex(tmp);
+
+    // subtract intersections from layer surfaces to get resulting internal surfaces
+    tmp = to_polygons(neighbor_fill_surfaces.filter_by_type(stInternal));
+    const ExPolygons internal = diff_ex(tmp, to_polygons(internal_solid), 1);
+
+    // assign resulting internal surfaces to layer
+    neighbor_layerm->fill_surfaces.clear();
+    neighbor_layerm->fill_surfaces.append(internal, stInternal);
+
+    // assign new internal-solid surfaces to layer
+    neighbor_layerm->fill_surfaces.append(internal_solid, (stInternal | stSolid));
+
+    // assign top and bottom surfaces to layer
+    SurfaceCollection tmp_coll;
+    for (const Surface& s : neighbor_fill_surfaces.surfaces)
+        if (s.is_top() || s.is_bottom())
+            tmp_coll.append(s);
+    
+    for (auto s : tmp_coll.group()) {
+        Polygons tmp;
+        append_to(tmp, to_polygons(internal_solid));
+        append_to(tmp, to_polygons(internal));
         
-        // internal-solid are the union of the existing internal-solid surfaces
-        // and new ones
-        Polygons tmp { to_polygons(neighbor_fill_surfaces.filter_by_type(stInternal | stSolid)) };
-        polygons_append(tmp, new_internal_solid);
-        const ExPolygons internal_solid = union_ex(tmp);
-
-        // subtract intersections from layer surfaces to get resulting internal surfaces
-        tmp = to_polygons(neighbor_fill_surfaces.filter_by_type(stInternal));
-        const ExPolygons internal = diff_ex(tmp, to_polygons(internal_solid), 1);
-
-        // assign resulting internal surfaces to layer
-        neighbor_layerm->fill_surfaces.clear();
-        neighbor_layerm->fill_surfaces.append(internal, stInternal);
-
-        // assign new internal-solid surfaces to layer
-        neighbor_layerm->fill_surfaces.append(internal_solid, (stInternal | stSolid));
-
-        // assign top and bottom surfaces to layer
-        SurfaceCollection tmp_coll;
-        for (const Surface& s : neighbor_fill_surfaces.surfaces)
-            if (s.is_top() || s.is_bottom())
-                tmp_coll.append(s);
-        
-        for (auto s : tmp_coll.group()) {
-            Polygons tmp;
-            append_to(tmp, to_polygons(internal_solid));
-            append_to(tmp, to_polygons(internal));
-            
-            const auto solid_surfaces = diff_ex(to_polygons(s), tmp, true);
-            neighbor_layerm->fill_surfaces.append(solid_surfaces, s.front()->surface_type);
-        }
+        const auto solid_surfaces = diff_ex(to_polygons(s), tmp, true);
+        neighbor_layerm->fill_surfaces.append(solid_surfaces, s.front()->surface_type);
     }
+    return true;
 }
 
 // Idempotence of this method is guaranteed by the fact that we don't remove things from
@@ -22,7 +22,7 @@ void
 SLAPrint::slice()
 {
     TriangleMesh mesh = this->model->mesh();
-    mesh.repair();
+    mesh.repair(this->config.threads.value);
     
     mesh.align_to_bed();
     
@@ -56,11 +56,12 @@ SLAPrint::slice()
         for (size_t i = 0; i < this->layers.size(); ++i)
             slice_z.push_back(this->layers[i].slice_z);
         
-        std::vector<ExPolygons> slices;
-        TriangleMeshSlicer<Z>(&mesh).slice(slice_z, &slices);
-        
-        for (size_t i = 0; i < slices.size(); ++i)
-            this->layers[i].slices.expolygons = slices[i];
+        TriangleMeshSlicer<Z>(&mesh, this->config.threads.value).slice_streaming(
+            slice_z,
+            [this](size_t layer_id, ExPolygons &slices) {
+                this->layers[layer_id].slices.expolygons = std::move(slices);
+            }
+        );
     }
     
     // generate infill
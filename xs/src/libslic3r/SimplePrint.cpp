@@ -10,6 +10,7 @@ SimplePrint::set_model(const Model &model) {
     
     // make method idempotent so that the object is reusable
     this->_print.clear_objects();
+    this->_print.share_identical_objects = this->share_identical_objects;
     
     // align to z = 0
     for (ModelObject* o : this->_model.objects)
@@ -11,6 +11,8 @@ class SimplePrint {
     public:
     bool arrange{true};
     bool center{true};
+    /// Print identical objects as copies of one another, see Print::share_identical_objects.
+    bool share_identical_objects{true};
     std::function<void(int, const std::string&)> status_cb {nullptr};
     
     bool apply_config(DynamicPrintConfig config) { return this->_print.apply_config(config); }
@@ -0,0 +1,156 @@
+#include "SliceKernel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SLIC3R_SLICE_KERNEL_X86
+    #include <immintrin.h>
+#endif
+
+namespace Slic3r {
+
+/*  All kernels evaluate, for each edge (a, b) crossing the plane,
+        b + ((a - b) * (slice_z - b.z)) / (a.z - b.z)
+    in this exact order and in single precision, as slice_facet() does.
+    No fused multiply-add is involved, so every variant rounds the same way. */
+
+static void
+intersect_facet_scalar(const FacetsSoA &soa, int facet_idx, float slice_z, FacetCrossing* out)
+{
+    out->edges    = 0;
+    out->vertices = 0;
+    for (int a = 0; a < 3; ++a) {
+        const int b = (a + 1) % 3;
+        const float za = soa.z[a][facet_idx];
+        const float zb = soa.z[b][facet_idx];
+        if (za == slice_z) out->vertices |= 1 << a;
+        if ((za < slice_z && zb > slice_z) || (zb < slice_z && za > slice_z)) {
+            const float xa = soa.x[a][facet_idx], xb = soa.x[b][facet_idx];
+            const float ya = soa.y[a][facet_idx], yb = soa.y[b][facet_idx];
+            out->edges |= 1 << a;
+            out->x[a] = xb + (xa - xb) * (slice_z - zb) / (za - zb);
+            out->y[a] = yb + (ya - yb) * (slice_z - zb) / (za - zb);
+        }
+    }
+}
+
+static void
+intersect_facets_scalar(const FacetsSoA &soa, const int* facets, size_t count, float slice_z,
+    FacetCrossing* out)
+{
+    for (size_t i = 0; i < count; ++i)
+        intersect_facet_scalar(soa, facets[i], slice_z, &out[i]);
+}
+
+#ifdef SLIC3R_SLICE_KERNEL_X86
+
+__attribute__((target("sse2"))) static void
+intersect_facets_sse2(const FacetsSoA &soa, const int* facets, size_t count, float slice_z,
+    FacetCrossing* out)
+{
+    const __m128 plane = _mm_set1_ps(slice_z);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const int* f = facets + i;
+        __m128 x[3], y[3], z[3];
+        for (int k = 0; k < 3; ++k) {
+            x[k] = _mm_setr_ps(soa.x[k][f[0]], soa.x[k][f[1]], soa.x[k][f[2]], soa.x[k][f[3]]);
+            y[k] = _mm_setr_ps(soa.y[k][f[0]], soa.y[k][f[1]], soa.y[k][f[2]], soa.y[k][f[3]]);
+            z[k] = _mm_setr_ps(soa.z[k][f[0]], soa.z[k][f[1]], soa.z[k][f[2]], soa.z[k][f[3]]);
+        }
+        int on_plane[3], crossing[3];
+        float px[3][4], py[3][4];
+        for (int a = 0; a < 3; ++a) {
+            const int b = (a + 1) % 3;
+            on_plane[a] = _mm_movemask_ps(_mm_cmpeq_ps(z[a], plane));
+            crossing[a] = _mm_movemask_ps(_mm_or_ps(
+                _mm_and_ps(_mm_cmplt_ps(z[a], plane), _mm_cmpgt_ps(z[b], plane)),
+                _mm_and_ps(_mm_cmplt_ps(z[b], plane), _mm_cmpgt_ps(z[a], plane))));
+            const __m128 dz_plane = _mm_sub_ps(plane, z[b]);
+            const __m128 dz_edge  = _mm_sub_ps(z[a], z[b]);
+            _mm_storeu_ps(px[a], _mm_add_ps(x[b], _mm_div_ps(_mm_mul_ps(_mm_sub_ps(x[a], x[b]), dz_plane), dz_edge)));
+            _mm_storeu_ps(py[a], _mm_add_ps(y[b], _mm_div_ps(_mm_mul_ps(_mm_sub_ps(y[a], y[b]), dz_plane), dz_edge)));
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            FacetCrossing &c = out[i + lane];
+            c.edges    = 0;
+            c.vertices = 0;
+            for (int a = 0; a < 3; ++a) {
+                if (on_plane[a] & (1 << lane)) c.vertices |= 1 << a;
+                if (crossing[a] & (1 << lane)) {
+                    c.edges |= 1 << a;
+                    c.x[a] = px[a][lane];
+                    c.y[a] = py[a][lane];
+                }
+            }
+        }
+    }
+    intersect_facets_scalar(soa, facets + i, count - i, slice_z, out + i);
+}
+
+__attribute__((target("avx2"))) static void
+intersect_facets_avx2(const FacetsSoA &soa, const int* facets, size_t count, float slice_z,
+    FacetCrossing* out)
+{
+    const __m256 plane = _mm256_set1_ps(slice_z);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(facets + i));
+        __m256 x[3], y[3], z[3];
+        for (int k = 0; k < 3; ++k) {
+            x[k] = _mm256_i32gather_ps(soa.x[k].data(), idx, 4);
+            y[k] = _mm256_i32gather_ps(soa.y[k].data(), idx, 4);
+            z[k] = _mm256_i32gather_ps(soa.z[k].data(), idx, 4);
+        }
+        int on_plane[3], crossing[3];
+        float px[3][8], py[3][8];
+        for (int a = 0; a < 3; ++a) {
+            const int b = (a + 1) % 3;
+            on_plane[a] = _mm256_movemask_ps(_mm256_cmp_ps(z[a], plane, _CMP_EQ_OQ));
+            crossing[a] = _mm256_movemask_ps(_mm256_or_ps(
+                _mm256_and_ps(_mm256_cmp_ps(z[a], plane, _CMP_LT_OQ), _mm256_cmp_ps(z[b], plane, _CMP_GT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(z[b], plane, _CMP_LT_OQ), _mm256_cmp_ps(z[a], plane, _CMP_GT_OQ))));
+            const __m256 dz_plane = _mm256_sub_ps(plane, z[b]);
+            const __m256 dz_edge  = _mm256_sub_ps(z[a], z[b]);
+            _mm256_storeu_ps(px[a], _mm256_add_ps(x[b], _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(x[a], x[b]), dz_plane), dz_edge)));
+            _mm256_storeu_ps(py[a], _mm256_add_ps(y[b], _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(y[a], y[b]), dz_plane), dz_edge)));
+        }
+        for (int lane = 0; lane < 8; ++lane) {
+            FacetCrossing &c = out[i + lane];
+            c.edges    = 0;
+            c.vertices = 0;
+            for (int a = 0; a < 3; ++a) {
+                if (on_plane[a] & (1 << lane)) c.vertices |= 1 << a;
+                if (crossing[a] & (1 << lane)) {
+                    c.edges |= 1 << a;
+                    c.x[a] = px[a][lane];
+                    c.y[a] = py[a][lane];
+                }
+            }
+        }
+    }
+    intersect_facets_sse2(soa, facets + i, count - i, slice_z, out + i);
+}
+
+#endif
+
+typedef void (*intersect_facets_fn)(const FacetsSoA&, const int*, size_t, float, FacetCrossing*);
+
+static intersect_facets_fn
+select_intersect_facets()
+{
+    #ifdef SLIC3R_SLICE_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &intersect_facets_avx2;
+    if (__builtin_cpu_supports("sse2")) return &intersect_facets_sse2;
+    #endif
+    return &intersect_facets_scalar;
+}
+
+void
+intersect_facets(const FacetsSoA &soa, const int* facets, size_t count, float slice_z,
+    FacetCrossing* out)
+{
+    static const intersect_facets_fn kernel = select_intersect_facets();
+    kernel(soa, facets, count, slice_z, out);
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef slic3r_SliceKernel_hpp_
+#define slic3r_SliceKernel_hpp_
+
+#include <cstddef>
+#include <vector>
+
+namespace Slic3r {
+
+/// Facet vertices in structure-of-arrays layout: x[k][facet_idx] is the X
+/// coordinate of the k-th vertex of a facet. Coordinates are already scaled
+/// and permuted for the slicing axis.
+struct FacetsSoA
+{
+    std::vector<float> x[3];
+    std::vector<float> y[3];
+    std::vector<float> z[3];
+
+    void resize(size_t facets_count) {
+        for (int k = 0; k < 3; ++k) {
+            this->x[k].resize(facets_count);
+            this->y[k].resize(facets_count);
+            this->z[k].resize(facets_count);
+        }
+    }
+    size_t size() const { return this->z[0].size(); }
+};
+
+/// Intersection of a facet with a horizontal plane.
+/// Edge e runs from vertex e to vertex (e+1) % 3.
+struct FacetCrossing
+{
+    /// Intersection point of edge e, only valid if bit e of edges is set.
+    float x[3];
+    float y[3];
+    /// Edges strictly crossing the plane.
+    unsigned char edges;
+    /// Vertices lying exactly on the plane; such facets need the full
+    /// treatment of TriangleMeshSlicer::slice_facet().
+    unsigned char vertices;
+};
+
+/// Intersect the facets listed in facets[0..count) with the plane at the
+/// (scaled) height slice_z, writing one FacetCrossing per facet to out.
+/// The arithmetic matches TriangleMeshSlicer::slice_facet() operation by
+/// operation, so the results are bit-for-bit the same. An AVX2 kernel
+/// handling 8 facets per batch is picked at runtime when the CPU has it,
+/// falling back to SSE2 (4 facets) and then to plain code.
+void intersect_facets(const FacetsSoA &soa, const int* facets, size_t count, float slice_z,
+    FacetCrossing* out);
+
+}
+
+#endif
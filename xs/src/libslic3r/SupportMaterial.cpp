@@ -17,14 +17,11 @@ PolylineCollection _fill_surface(Fill *fill, Surface *surface)
 }
 
 void
-SupportMaterial::generate_toolpaths(PrintObject *object,
-                                    map<coordf_t, Polygons> overhang,
-                                    map<coordf_t, Polygons> contact,
-                                    map<int, Polygons> _interface,
-                                    map<int, Polygons> base)
+SupportMaterial::generate_toolpaths(PrintObject *object, SupportLayersAreas &&layers)
 {
-    // Assign the object to the supports class.
+    // Assign the object and the support areas to the supports class.
     this->object = object;
+    this->layers = std::move(layers);
 
     // Shape of contact area.
     toolpaths_params params;
@@ -61,6 +58,7 @@ SupportMaterial::generate_toolpaths(PrintObject *object,
         boost::bind(&SupportMaterial::process_layer, this, _1, params),
         this->config->threads.value
     );
+    this->layers = SupportLayersAreas();
 }
 
 void
@@ -85,7 +83,7 @@ SupportMaterial::generate(PrintObject *object)
     // Determine the top surfaces of the object. We need these to determine
     // the layer heights of support material and to clip support to the object
     // silhouette.
-    map<coordf_t, Polygons> top = object_top(object, &contact);
+    map<coordf_t, Polygons> top = object_top(object, contact);
     // We now know the upper and lower boundaries for our support material object
     // (@$contact_z and @$top_z), so we can generate intermediate layers.
     vector<coordf_t> support_z = support_layers_z(get_keys_sorted(contact),
@@ -93,25 +91,30 @@ SupportMaterial::generate(PrintObject *object)
                                                   get_max_layer_height(object));
     // If we wanted to apply some special logic to the first support layers lying on
     // object's top surfaces this is the place to detect them.
-    map<int, Polygons> shape;
-    if (object_config->support_material_pattern.value == smpPillars)
-        this->generate_pillars_shape(contact, support_z, shape);
+    SupportLayersAreas layers(support_z.size());
+    for (size_t i = 0; i < support_z.size(); i++)
+        layers[i].print_z = support_z[i];
+    const bool pillars = object_config->support_material_pattern.value == smpPillars;
+    if (pillars)
+        this->generate_pillars_shape(contact, layers);
+
+    // From now on, only the contact areas lying on a support layer matter.
+    for (auto &layer : layers) {
+        auto it = contact.find(layer.print_z);
+        if (it != contact.end()) layer.contact = std::move(it->second);
+        it = overhang.find(layer.print_z);
+        if (it != overhang.end()) layer.overhang = std::move(it->second);
+    }
 
     // Propagate contact layers downwards to generate interface layers.
-    map<int, Polygons> _interface = generate_interface_layers(support_z, contact, top);
-    clip_with_object(_interface, support_z, *object);
-    if (!shape.empty())
-        clip_with_shape(_interface, shape);
+    generate_interface_layers(layers, top);
     // Propagate contact layers and interface layers downwards to generate
     // the main support layers.
-    map<int, Polygons> base = generate_base_layers(support_z, contact, _interface, top);
-    clip_with_object(base, support_z, *object);
-    if (!shape.empty())
-        clip_with_shape(base, shape);
+    generate_base_layers(layers, top);
 
     // Detect what part of base support layers are "reverse interfaces" because they
     // lie above object's top surfaces.
-    generate_bottom_interface_layers(support_z, base, top, _interface);
+    generate_bottom_interface_layers(layers, top);
     // Install support layers into object.
     for (int i = 0; i < int(support_z.size()); i++) {
         object->add_support_layer(
@@ -126,7 +129,7 @@ SupportMaterial::generate(PrintObject *object)
         }
     }
     // Generate the actual toolpaths and save them into each layer.
-    generate_toolpaths(object, overhang, contact, _interface, base);
+    generate_toolpaths(object, SupportLayersAreas(layers.size()));
 }
 
 vector<coordf_t>
@@ -226,20 +229,11 @@ SupportMaterial::contact_area(PrintObject *object)
     bool buildplate_only =
         (conf.support_material || conf.support_material_enforce_layers)
             && conf.support_material_buildplate_only;
-    Polygons buildplate_only_top_surfaces;
+    const int threads = this->config->threads.value;
 
-    // Determine contact areas.
-    map<coordf_t, Polygons> contact; // contact_z => [ polygons ].
-    map<coordf_t, Polygons> overhang; // This stores the actual overhang supported by each contact layer
-    for (int layer_id = 0; layer_id < (int)object->layers.size(); layer_id++) {
-        // Note $layer_id might != $layer->id when raft_layers > 0
-        // so $layer_id == 0 means first object layer
-        // and $layer->id == 0 means first print layer (including raft).
-
-        // If no raft, and we're at layer 0, skip to layer 1
-        if (conf.raft_layers == 0 && layer_id == 0) {
-            continue;
-        }
+    // Find the layers to look at.
+    int layers_count = (int)object->layers.size();
+    for (int layer_id = 0; layer_id < layers_count; layer_id++) {
         // With or without raft, if we're above layer 1, we need to quit
         // support generation if supports are disabled, or if we're at a high
         // enough layer that enforce-supports no longer applies.
@@ -248,34 +242,53 @@ SupportMaterial::contact_area(PrintObject *object)
             && (layer_id >= conf.support_material_enforce_layers))
             // If we are only going to generate raft just check
             // the 'overhangs' of the first object layer.
-            break;
-
-        Layer *layer = object->get_layer(layer_id);
-
-        if (conf.support_material_max_layers
+            layers_count = layer_id;
+        else if (conf.support_material_max_layers
             && layer_id > conf.support_material_max_layers)
-            break;
+            layers_count = layer_id;
+    }
 
-        if (buildplate_only) {
-            // Collect the top surfaces up to this layer and merge them. TODO @Ask about this line.
+    // Note $layer_id might != $layer->id when raft_layers > 0
+    // so $layer_id == 0 means first object layer
+    // and $layer->id == 0 means first print layer (including raft).
+    // If no raft, and we're at layer 0, skip to layer 1
+    const int first_layer_id = conf.raft_layers == 0 ? 1 : 0;
+
+    // Top surfaces of all the layers up to each layer.
+    vector<Polygons> buildplate_only_top_surfaces;
+    if (buildplate_only && first_layer_id < layers_count) {
+        buildplate_only_top_surfaces.assign(layers_count, Polygons());
+        parallelize<int>(first_layer_id, layers_count - 1, [this, object, &buildplate_only_top_surfaces](int layer_id) {
             Polygons projection_new;
-            for (auto const &region : layer->regions) {
+            for (auto const &region : object->get_layer(layer_id)->regions) {
                 SurfacesPtr top_surfaces = region->slices.filter_by_type(stTop);
-                for (const auto &polygon : p(top_surfaces)) {
-                    projection_new.push_back(polygon);
-                }
+                append_to(projection_new, p(top_surfaces));
             }
-            if (!projection_new.empty()) {
-                // Merge the new top surfaces with the preceding top surfaces. TODO @Ask about this line.
-                // Apply the safety offset to the newly added polygons, so they will connect
-                // with the polygons collected before,
-                // but don't apply the safety offset during the union operation as it would
-                // inflate the polygons over and over.
-                append_to(buildplate_only_top_surfaces, offset(projection_new, scale_(0.01)));
-
-                buildplate_only_top_surfaces = union_(buildplate_only_top_surfaces, 0);
+            // Apply the safety offset to the newly added polygons, so they will connect
+            // with the polygons collected before,
+            // but don't apply the safety offset during the union operation as it would
+            // inflate the polygons over and over.
+            if (!projection_new.empty())
+                buildplate_only_top_surfaces[layer_id] = offset(projection_new, scale_(0.01));
+        }, threads);
+
+        // Merge the new top surfaces with the preceding top surfaces.
+        Polygons projection;
+        for (int layer_id = first_layer_id; layer_id < layers_count; layer_id++) {
+            if (!buildplate_only_top_surfaces[layer_id].empty()) {
+                append_to(projection, buildplate_only_top_surfaces[layer_id]);
+                projection = union_(projection, 0);
             }
+            buildplate_only_top_surfaces[layer_id] = projection;
         }
+    }
+
+    // Determine contact areas, one layer per thread.
+    vector<coordf_t> layers_contact_z(layers_count, 0.);
+    vector<Polygons> layers_contact(layers_count);
+    vector<Polygons> layers_overhang(layers_count);
+    parallelize<int>(first_layer_id, layers_count - 1, [&](int layer_id) {
+        Layer *layer = object->get_layer(layer_id);
 
         // Detect overhangs and contact areas needed to support them.
         Polygons tmp_overhang, tmp_contact;
@@ -455,7 +468,7 @@ SupportMaterial::contact_area(PrintObject *object)
                 if (buildplate_only) {
                     // Don't support overhangs above the top surfaces.
                     // This step is done before the contact surface is calcuated by growing the overhang region.
-                    difference = diff(difference, buildplate_only_top_surfaces);
+                    difference = diff(difference, buildplate_only_top_surfaces[layer_id]);
                 }
 
                 if (difference.empty()) continue;
@@ -472,7 +485,7 @@ SupportMaterial::contact_area(PrintObject *object)
 
                     if (buildplate_only) {
                         // Trim the inflated contact surfaces by the top surfaces as well.
-                        append_to(slices_margin, buildplate_only_top_surfaces);
+                        append_to(slices_margin, buildplate_only_top_surfaces[layer_id]);
                         slices_margin = union_(slices_margin);
                     }
 
@@ -490,7 +503,7 @@ SupportMaterial::contact_area(PrintObject *object)
             }
         }
         if (tmp_contact.empty())
-            continue;
+            return;
 
         // Now apply the contact areas to the layer were they need to be made.
         {
@@ -516,18 +529,27 @@ SupportMaterial::contact_area(PrintObject *object)
 
             // Ignore this contact area if it's too low.
             if (contact_z < conf.first_layer_height - EPSILON)
-                continue;
+                return;
 
-            contact[contact_z] = tmp_contact;
-            overhang[contact_z] = tmp_overhang;
+            layers_contact_z[layer_id] = contact_z;
+            layers_contact[layer_id] = std::move(tmp_contact);
+            layers_overhang[layer_id] = std::move(tmp_overhang);
         }
+    }, threads);
+
+    map<coordf_t, Polygons> contact; // contact_z => [ polygons ].
+    map<coordf_t, Polygons> overhang; // This stores the actual overhang supported by each contact layer
+    for (int layer_id = first_layer_id; layer_id < layers_count; layer_id++) {
+        if (layers_contact[layer_id].empty()) continue;
+        contact[layers_contact_z[layer_id]] = std::move(layers_contact[layer_id]);
+        overhang[layers_contact_z[layer_id]] = std::move(layers_overhang[layer_id]);
     }
 
-    return make_pair(contact, overhang);
+    return make_pair(std::move(contact), std::move(overhang));
 }
 
 map<coordf_t, Polygons>
-SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contact)
+SupportMaterial::object_top(PrintObject *object, const map<coordf_t, Polygons> &contact)
 {
     // find object top surfaces
     // we'll use them to clip our support and detect where does it stick.
@@ -535,32 +557,35 @@ SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contac
     if (object_config->support_material_buildplate_only.value)
         return top;
 
+    // Collect the top surfaces of each layer.
+    vector<Polygons> layers_top(object->layers.size());
+    parallelize<size_t>(0, object->layers.size() - 1, [this, object, &layers_top](size_t i) {
+        SurfacesPtr m_top;
+        for (auto r : object->layers[i]->regions)
+            append_to(m_top, r->slices.filter_by_type(stTop));
+        layers_top[i] = p(m_top);
+    }, this->config->threads.value);
+
     Polygons projection;
     for (auto i = static_cast<int>(object->layers.size()) - 1; i >= 0; i--) {
 
         Layer *layer = object->layers[i];
-        SurfacesPtr m_top;
-
-        for (auto r : layer->regions)
-            append_to(m_top, r->slices.filter_by_type(stTop));
-
-        if (m_top.empty()) continue;
+        if (layers_top[i].empty()) continue;
 
         // compute projection of the contact areas above this top layer
         // first add all the 'new' contact areas to the current projection
         // ('new' means all the areas that are lower than the last top layer
         // we considered).
-        double min_top = (!top.empty() ? top.begin()->first : contact->rbegin()->first);
+        double min_top = (!top.empty() ? top.begin()->first : contact.rbegin()->first);
 
         // Use <= instead of just < because otherwise we'd ignore any contact regions
         // having the same Z of top layers.
-        for (auto el : *contact)
-            if (el.first > layer->print_z && el.first <= min_top)
-                for (const auto &p : el.second)
-                    projection.push_back(p);
+        if (min_top > layer->print_z)
+            for (auto el = contact.upper_bound(layer->print_z); el != contact.upper_bound(min_top); ++el)
+                append_to(projection, el->second);
 
         // Now find whether any projection falls onto this top surface.
-        Polygons touching = intersection(projection, p(m_top));
+        Polygons touching = intersection(projection, layers_top[i]);
         if (!touching.empty()) {
             // Grow top surfaces so that interface and support generation are generated
             // with some spacing from object - it looks we don't need the actual
@@ -577,9 +602,7 @@ SupportMaterial::object_top(PrintObject *object, map<coordf_t, Polygons> *contac
 }
 
 void
-SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
-                                        const vector<coordf_t> &support_z,
-                                        map<int, Polygons> &shape)
+SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact, SupportLayersAreas &layers)
 {
     // This prevents supplying an empty point set to BoundingBox constructor.
     if (contact.empty()) return;
@@ -600,7 +623,7 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
         BoundingBox bb;
         {
             Points bb_points;
-            for (auto contact_el : contact) {
+            for (const auto &contact_el : contact) {
                 append_to(bb_points, to_points(contact_el.second));
             }
             bb = BoundingBox(bb_points);
@@ -615,13 +638,13 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
 
         grid = union_(pillars);
     }
-    // Add pillars to every layer.
-    for (size_t i = 0; i < support_z.size(); i++) {
-        shape[i] = grid;
-    }
-    // Build capitals.
-    for (size_t i = 0; i < support_z.size(); i++) {
-        coordf_t z = support_z[i];
+    // Build capitals, one layer per thread.
+    vector<Polygons> contact_not_supported_by_capitals(layers.size());
+    parallelize<size_t>(0, layers.size() - 1, [&](size_t i) {
+        coordf_t z = layers[i].print_z;
+
+        // Add pillars to every layer.
+        layers[i].shape = grid;
 
         auto capitals = intersection(
             grid,
@@ -636,180 +659,220 @@ SupportMaterial::generate_pillars_shape(const map<coordf_t, Polygons> &contact,
             auto capital_polygons = offset(Polygons({capital}), +(pillar_spacing - pillar_size) / 2);
             append_to(contact_supported_by_capitals, capital_polygons);
 
-            for (int j = i - 1; j >= 0; j--) {
-                capital_polygons = offset(Polygons{capital}, -interface_flow.scaled_width() / 2);
-                if (capitals.empty()) break;
-                append_to(shape[i], capital_polygons);
-            }
+            capital_polygons = offset(Polygons{capital}, -interface_flow.scaled_width() / 2);
+            for (size_t j = 0; j < i; j++)
+                append_to(layers[i].shape, capital_polygons);
         }
         // Work on one pillar at time (if any) to prevent the capitals from being merged
         // but store the contact area supported by the capital because we need to make
         // sure nothing is left.
-        auto contact_not_supported_by_capitals = diff(
+        contact_not_supported_by_capitals[i] = diff(
             contact.count(z) > 0 ? contact.at(z) : Polygons(),
             contact_supported_by_capitals
         );
+    }, this->config->threads.value);
 
-        if (!contact_not_supported_by_capitals.empty()) {
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (!contact_not_supported_by_capitals[i].empty()) {
             for (int j = i - 1; j >= 0; j--) {
-                append_to(shape[j], contact_not_supported_by_capitals);
+                append_to(layers[j].shape, contact_not_supported_by_capitals[i]);
             }
         }
     }
 }
 
-map<int, Polygons>
-SupportMaterial::generate_base_layers(vector<coordf_t> support_z,
-                                      map<coordf_t, Polygons> contact,
-                                      map<int, Polygons> _interface,
-                                      map<coordf_t, Polygons> top)
+void
+SupportMaterial::generate_base_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top)
 {
     // Let's now generate support layers under interface layers.
-    map<int, Polygons> base;
-    {
-        for (auto i = static_cast<int>(support_z.size()) - 1; i >= 0; i--) {
-            auto overlapping_layers = this->overlapping_layers(i, support_z);
-            vector<coordf_t> overlapping_z;
-            for (auto el : overlapping_layers)
-                overlapping_z.push_back(support_z[el]);
-
-            // In case we have no interface layers, look at upper contact
-            // (1 interface layer means we only have contact layer, so $interface->{$i+1} is empty).
-            Polygons upper_contact;
-            if (object_config->support_material_interface_layers.value <= 1) {
-                append_to(upper_contact, ((size_t)i + 1 < support_z.size() ? contact[support_z[i + 1]] : contact[-1]));
-            }
-
-            Polygons ps_1;
-            append_to(ps_1, base[i + 1]); // support regions on upper layer.
-            append_to(ps_1, _interface[i + 1]); // _interface regions on upper layer
-            append_to(ps_1, upper_contact); // contact regions on upper layer
-
-            Polygons ps_2;
-            for (auto el : overlapping_z) {
-                if (top.count(el) > 0)
-                    append_to(ps_2, top[el]); // top slices on this layer.
-                if (_interface.count(el) > 0)
-                    append_to(ps_2, _interface[el]); // _interface regions on this layer.
-                if (contact.count(el) > 0)
-                    append_to(ps_2, contact[el]); // contact regions on this layer.
-            }
-
-            base[i] = diff(
-                ps_1,
-                ps_2,
-                1
-            );
+    // Each layer depends on the one above, so only the areas to keep
+    // clear on each layer are computed in parallel.
+    vector<Polygons> overlapping = this->overlapping_areas(layers, top);
+
+    for (auto i = static_cast<int>(layers.size()) - 1; i >= 0; i--) {
+        // In case we have no interface layers, look at upper contact
+        // (1 interface layer means we only have contact layer, so $interface->{$i+1} is empty).
+        Polygons ps_1;
+        if ((size_t)i + 1 < layers.size()) {
+            const SupportLayerAreas &upper = layers[i + 1];
+            append_to(ps_1, upper.base); // support regions on upper layer.
+            append_to(ps_1, upper._interface); // _interface regions on upper layer
+            if (object_config->support_material_interface_layers.value <= 1)
+                append_to(ps_1, upper.contact); // contact regions on upper layer
         }
+
+        layers[i].base = diff(
+            ps_1,
+            overlapping[i],
+            1
+        );
     }
-    return base;
 }
 
-map<int, Polygons>
-SupportMaterial::generate_interface_layers(vector<coordf_t> support_z,
-                                           map<coordf_t, Polygons> contact,
-                                           map<coordf_t, Polygons> top)
+void
+SupportMaterial::generate_interface_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top)
 {
     // let's now generate interface layers below contact areas.
-    map<int, Polygons> _interface;
     auto interface_layers_num = object_config->support_material_interface_layers.value;
 
-    for (int layer_id = 0; layer_id < (int)support_z.size(); layer_id++) {
-        auto z = support_z[layer_id];
-
-        if (contact.count(z) <= 0)
+    vector<coordf_t> support_z;
+    for (const auto &layer : layers)
+        support_z.push_back(layer.print_z);
+    vector<vector<int>> overlapping(layers.size());
+    parallelize<size_t>(0, layers.size() - 1, [this, &overlapping, &support_z](size_t i) {
+        overlapping[i] = this->overlapping_layers(i, support_z);
+    }, this->config->threads.value);
+
+    // Every contact layer propagates downwards: the chains of distant
+    // contact layers run in parallel, while the ones reaching the same
+    // layers apply there in the order of their contact layers.
+    LayerChains chains(layers.size());
+    vector<vector<size_t>> chains_layers;
+    vector<int> chains_contact_layer;
+    vector<int> layers_chain(layers.size(), -1);
+    for (int layer_id = 0; layer_id < (int)layers.size(); layer_id++) {
+        if (layers[layer_id].contact.empty())
             continue;
-        Polygons &_contact = contact[z];
 
         // Count contact layer as interface layer.
-        for (int i = layer_id - 1; i >= 0 && i > layer_id - interface_layers_num; i--) {
-            auto overlapping_layers = this->overlapping_layers(i, support_z);
-            vector<coordf_t> overlapping_z;
-            for (auto z_el : overlapping_layers)
-                overlapping_z.push_back(support_z[z_el]);
-
-            // Compute interface area on this layer as diff of upper contact area
-            // (or upper interface area) and layer slices.
-            // This diff is responsible of the contact between support material and
-            // the top surfaces of the object. We should probably offset the top
-            // surfaces vertically before performing the diff, but this needs
-            // investigation.
-            Polygons ps_1;
-            append_to(ps_1, _contact); // clipped projection of the current contact regions.
-            append_to(ps_1, _interface[i]); // _interface regions already applied to this layer.
-
-            Polygons ps_2;
-            for (auto el : overlapping_z) {
-                if (top.count(el) > 0)
-                    append_to(ps_2, top[el]); // top slices on this layer.
-                if (contact.count(el) > 0)
-                    append_to(ps_2, contact[el]); // contact regions on this layer.
-            }
+        vector<size_t> chain_layers;
+        for (int i = layer_id - 1; i >= 0 && i > layer_id - interface_layers_num; i--)
+            chain_layers.push_back(i);
+        if (chain_layers.empty())
+            continue;
 
-            _contact = _interface[i] = diff(
-                ps_1,
-                ps_2,
-                true
-            );
-        }
+        layers_chain[layer_id] = chains.add_chain(chain_layers);
+        chains_layers.push_back(std::move(chain_layers));
+        chains_contact_layer.push_back(layer_id);
     }
-    return _interface;
+
+    // Each chain replaces the contact area of its layer by the interface it
+    // leaves on its way down, and clips with the contact areas of the layers
+    // overlapping its own ones as the chains before it left them. A chain
+    // reading the contact layer of another one thus has to run in the serial
+    // order, and so do all of them then.
+    bool serial = false;
+    for (size_t c = 0; c < chains_layers.size() && !serial; c++)
+        for (size_t i : chains_layers[c])
+            for (int el : overlapping[i])
+                if (layers_chain[el] >= 0 && layers_chain[el] != (int)c)
+                    serial = true;
+
+    // The contact area of every layer, as the chains left it so far.
+    vector<const Polygons*> contact(layers.size());
+    for (size_t i = 0; i < layers.size(); i++)
+        contact[i] = &layers[i].contact;
+    vector<Polygons> chains_contact(chains.chains_count());
+    chains.run([&](size_t c, size_t v) {
+        const size_t i = chains_layers[c][v];
+        const int contact_layer = chains_contact_layer[c];
+
+        // Compute interface area on this layer as diff of upper contact area
+        // (or upper interface area) and layer slices.
+        // This diff is responsible of the contact between support material and
+        // the top surfaces of the object. We should probably offset the top
+        // surfaces vertically before performing the diff, but this needs
+        // investigation.
+        Polygons ps_1;
+        append_to(ps_1, *contact[contact_layer]); // clipped projection of the current contact regions.
+        append_to(ps_1, layers[i]._interface); // _interface regions already applied to this layer.
+
+        Polygons ps_2;
+        for (int el : overlapping[i]) {
+            auto top_el = top.find(support_z[el]);
+            if (top_el != top.end())
+                append_to(ps_2, top_el->second); // top slices on this layer.
+            append_to(ps_2, *contact[el]); // contact regions on this layer.
+        }
+
+        chains_contact[c] = layers[i]._interface = diff(
+            ps_1,
+            ps_2,
+            true
+        );
+        contact[contact_layer] = &chains_contact[c];
+    }, serial ? 1 : this->config->threads.value);
 }
 
 void
-SupportMaterial::generate_bottom_interface_layers(const vector<coordf_t> &support_z,
-                                                  map<int, Polygons> &base,
-                                                  map<coordf_t, Polygons> &top,
-                                                  map<int, Polygons> &_interface)
+SupportMaterial::generate_bottom_interface_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top)
 {
     // If no interface layers are allowed, don't generate bottom interface layers.
-    if (object_config->support_material_interface_layers.value == 0)
+    const int interface_layers_num = object_config->support_material_interface_layers.value;
+    if (interface_layers_num <= 0)
         return;
 
     auto area_threshold = interface_flow.scaled_spacing() * interface_flow.scaled_spacing();
 
-    // Loop through object's top surfaces. TODO CHeck if the keys are sorted.
-    for (auto &top_el : top) {
-        // Keep a count of the interface layers we generated for this top surface.
-        int interface_layers = 0;
-
-        // Loop through support layers until we find the one(s) right above the top
-        // surface.
-        for (size_t layer_id = 0; layer_id < support_z.size(); layer_id++) {
-            auto z = support_z[layer_id];
-            if (z <= top_el.first) // next unless $z > $top_z;
-                continue;
-
-            if (base.count(layer_id) > 0) {
-                // Get the support material area that should be considered interface.
-                auto interface_area = intersection(
-                    base[layer_id],
-                    top_el.second
-                );
+    // Loop through object's top surfaces: each one turns the base of the
+    // first support layers right above it into interface.
+    LayerChains chains(layers.size());
+    vector<const Polygons*> chains_top;
+    vector<vector<size_t>> chains_layers;
+    for (const auto &top_el : top) {
+        vector<size_t> chain_layers;
+        for (size_t layer_id = 0; layer_id < layers.size() && (int)chain_layers.size() < interface_layers_num; layer_id++)
+            if (layers[layer_id].print_z > top_el.first)
+                chain_layers.push_back(layer_id);
+        if (chain_layers.empty())
+            continue;
 
-                // Discard too small areas.
-                Polygons new_interface_area;
-                for (auto p : interface_area) {
-                    if (abs(p.area()) >= area_threshold)
-                        new_interface_area.push_back(p);
-                }
-                interface_area = new_interface_area;
+        chains.add_chain(chain_layers);
+        chains_top.push_back(&top_el.second);
+        chains_layers.push_back(std::move(chain_layers));
+    }
 
-                // Subtract new interface area from base.
-                base[layer_id] = diff(
-                    base[layer_id],
-                    interface_area
-                );
+    chains.run([&](size_t c, size_t v) {
+        SupportLayerAreas &layer = layers[chains_layers[c][v]];
 
-                // Add the new interface area to interface.
-                append_to(_interface[layer_id], interface_area);
-            }
+        // Get the support material area that should be considered interface.
+        auto interface_area = intersection(
+            layer.base,
+            *chains_top[c]
+        );
 
-            interface_layers++;
-            if (interface_layers == object_config->support_material_interface_layers.value)
-                layer_id = static_cast<int>(support_z.size());
+        // Discard too small areas.
+        Polygons new_interface_area;
+        for (const auto &p : interface_area) {
+            if (abs(p.area()) >= area_threshold)
+                new_interface_area.push_back(p);
         }
-    }
+        interface_area = std::move(new_interface_area);
+
+        // Subtract new interface area from base.
+        layer.base = diff(
+            layer.base,
+            interface_area
+        );
+
+        // Add the new interface area to interface.
+        append_to(layer._interface, interface_area);
+    }, this->config->threads.value);
+}
+
+vector<Polygons>
+SupportMaterial::overlapping_areas(const SupportLayersAreas &layers,
+                                   const map<coordf_t, Polygons> &top)
+{
+    vector<coordf_t> support_z;
+    for (const auto &layer : layers)
+        support_z.push_back(layer.print_z);
+
+    vector<Polygons> areas(layers.size());
+    parallelize<size_t>(0, layers.size() - 1, [&](size_t i) {
+        for (auto el : this->overlapping_layers(i, support_z)) {
+            auto top_el = top.find(support_z[el]);
+            if (top_el != top.end())
+                append_to(areas[i], top_el->second); // top slices on this layer.
+            // _interface regions on this layer, found by the print_z truncated
+            // to an integer as the serial code keyed them by layer index.
+            const size_t interface_el = static_cast<size_t>(static_cast<int>(support_z[el]));
+            if (interface_el < layers.size())
+                append_to(areas[i], layers[interface_el]._interface);
+            append_to(areas[i], layers[el].contact); // contact regions on this layer.
+        }
+    }, this->config->threads.value);
+    return areas;
 }
 
 coordf_t
@@ -846,50 +909,46 @@ SupportMaterial::overlapping_layers(int layer_idx, const vector<coordf_t> &suppo
 }
 
 void
-SupportMaterial::clip_with_shape(map<int, Polygons> &support, map<int, Polygons> &shape)
+SupportMaterial::clip_with_shape(SupportLayersAreas &layers, Polygons SupportLayerAreas::*areas)
 {
-    for (auto layer : support) {
+    parallelize<size_t>(0, layers.size() - 1, [this, &layers, areas](size_t i) {
         // Don't clip bottom layer with shape so that we
         // can generate a continuous base flange
         // also don't clip raft layers
-        if (layer.first == 0) continue;
-        else if (layer.first < object_config->raft_layers) continue;
+        if (i == 0) return;
+        else if ((int)i < object_config->raft_layers) return;
 
-        layer.second = intersection(layer.second, shape[layer.first]);
-    }
+        SupportLayerAreas &layer = layers[i];
+        layer.*areas = intersection(layer.*areas, layer.shape);
+    }, this->config->threads.value);
 }
 
 void
-SupportMaterial::clip_with_object(map<int, Polygons> &support, vector<coordf_t> support_z, PrintObject &object)
+SupportMaterial::clip_with_object(SupportLayersAreas &layers, Polygons SupportLayerAreas::*areas, const PrintObject &object)
 {
-    int i = 0;
-    for (auto support_layer: support) {
-        if (support_layer.second.empty()) {
-            i++;
-            continue;
-        }
-        coordf_t z_max = support_z[i];
-        coordf_t z_min = (i == 0) ? 0 : support_z[i - 1];
+    parallelize<size_t>(0, layers.size() - 1, [this, &layers, areas, &object](size_t i) {
+        Polygons &support = layers[i].*areas;
+        if (support.empty()) return;
 
-        LayerPtrs layers;
-        for (auto layer : object.layers) {
-            if (layer->print_z > z_min && (layer->print_z - layer->height) < z_max) {
-                layers.push_back(layer);
-            }
-        }
+        coordf_t z_max = layers[i].print_z;
+        coordf_t z_min = (i == 0) ? 0 : layers[i - 1].print_z;
+
+        // The object layers are sorted by print_z, so are their bottoms.
+        auto layer = std::upper_bound(object.layers.begin(), object.layers.end(), z_min,
+            [](coordf_t z, const Layer *l) { return z < l->print_z; });
 
         // $layer->slices contains the full shape of layer, thus including
         // perimeter's width. $support contains the full shape of support
         // material, thus including the width of its foremost extrusion.
         // We leave a gap equal to a full extrusion width. TODO ask about this line @samir
         Polygons slices;
-        for (Layer *l : layers) {
-            for (auto s : l->slices.contours()) {
+        for (; layer != object.layers.end() && ((*layer)->print_z - (*layer)->height) < z_max; ++layer) {
+            for (auto s : (*layer)->slices.contours()) {
                 slices.push_back(s);
             }
         }
-        support_layer.second = diff(support_layer.second, offset(slices, flow.scaled_width()));
-    }
+        support = diff(support, offset(slices, flow.scaled_width()));
+    }, this->config->threads.value);
     /*
         $support->{$i} = diff(
             $support->{$i},
@@ -899,10 +958,9 @@ SupportMaterial::clip_with_object(map<int, Polygons> &support, vector<coordf_t>
 }
 
 void
-SupportMaterial::process_layer(int layer_id, toolpaths_params params)
+SupportMaterial::process_layer(int layer_id, const toolpaths_params &params)
 {
     SupportLayer *layer = this->object->support_layers[layer_id];
-    coordf_t z = layer->print_z;
 
     // We redefine flows locally by applyinh this layer's height.
     Flow _flow = flow;
@@ -910,10 +968,12 @@ SupportMaterial::process_layer(int layer_id, toolpaths_params params)
     _flow.height = static_cast<float>(layer->height);
     _interface_flow.height = static_cast<float>(layer->height);
 
-    Polygons overhang = this->overhang.count(z) > 0 ? this->overhang[z] : Polygons();
-    Polygons contact = this->contact.count(z) > 0 ? this->contact[z] : Polygons();
-    Polygons _interface = this->_interface.count(layer_id) > 0 ? this->_interface[layer_id] : Polygons();
-    Polygons base = this->base.count(layer_id) > 0 ? this->base[layer_id] : Polygons();
+    // This layer's areas are consumed here.
+    SupportLayerAreas &areas = this->layers[layer_id];
+    Polygons overhang = std::move(areas.overhang);
+    Polygons contact = std::move(areas.contact);
+    Polygons _interface = std::move(areas._interface);
+    Polygons base = std::move(areas.base);
 
     // Islands.
     {
@@ -1197,10 +1257,10 @@ SupportMaterial::append_polygons(Polygons &dst, Polygons &src)
 }
 
 vector<coordf_t>
-SupportMaterial::get_keys_sorted(map<coordf_t, Polygons> _map)
+SupportMaterial::get_keys_sorted(const map<coordf_t, Polygons> &_map)
 {
     vector<coordf_t> ret;
-    for (auto el : _map)
+    for (const auto &el : _map)
         ret.push_back(el.first);
     sort(ret.begin(), ret.end());
     return ret;
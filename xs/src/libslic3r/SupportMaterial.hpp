@@ -64,6 +64,21 @@ struct toolpaths_params
     {}
 };
 
+/// Support areas of a single support layer. The stages of generate() fill
+/// them in one after the other and hand the whole vector over to
+/// generate_toolpaths(), which consumes it.
+struct SupportLayerAreas
+{
+    coordf_t print_z {0};
+    Polygons overhang; ///< The overhang supported by the contact area.
+    Polygons contact; ///< The contact area, on contact layers only.
+    Polygons _interface;
+    Polygons base;
+    Polygons shape; ///< The pillars shape, with the pillars pattern only.
+};
+
+typedef vector<SupportLayerAreas> SupportLayersAreas;
+
 class SupportMaterial
 {
 public:
@@ -76,11 +91,7 @@ public:
     Flow interface_flow; ///< The interface layers print flow.
 
     /// Generate the extrusions paths for the support matterial generated for the given print object.
-    void generate_toolpaths(PrintObject *object,
-                            map<coordf_t, Polygons> overhang,
-                            map<coordf_t, Polygons> contact,
-                            map<int, Polygons> _interface,
-                            map<int, Polygons> base);
+    void generate_toolpaths(PrintObject *object, SupportLayersAreas &&layers);
 
     /// Generate support material for the given print object.
     void generate(PrintObject *object);
@@ -92,39 +103,30 @@ public:
 
     pair<map<coordf_t, Polygons>, map<coordf_t, Polygons>> contact_area(PrintObject *object);
 
-    map<coordf_t, Polygons> object_top(PrintObject *object, map<coordf_t, Polygons> *contact);
+    map<coordf_t, Polygons> object_top(PrintObject *object, const map<coordf_t, Polygons> &contact);
 
-    void generate_pillars_shape(const map<coordf_t, Polygons> &contact,
-                                const vector<coordf_t> &support_z,
-                                map<int, Polygons> &shape);
+    void generate_pillars_shape(const map<coordf_t, Polygons> &contact, SupportLayersAreas &layers);
 
-    map<int, Polygons> generate_base_layers(vector<coordf_t> support_z,
-                                            map<coordf_t, Polygons> contact,
-                                            map<int, Polygons> _interface,
-                                            map<coordf_t, Polygons> top);
+    void generate_base_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top);
 
-    map<int, Polygons> generate_interface_layers(vector<coordf_t> support_z,
-                                                 map<coordf_t, Polygons> contact,
-                                                 map<coordf_t, Polygons> top);
+    void generate_interface_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top);
 
-    void generate_bottom_interface_layers(const vector<coordf_t> &support_z,
-                                          map<int, Polygons> &base,
-                                          map<coordf_t, Polygons> &top,
-                                          map<int, Polygons> &_interface);
+    void generate_bottom_interface_layers(SupportLayersAreas &layers, const map<coordf_t, Polygons> &top);
 
     coordf_t contact_distance(coordf_t layer_height, coordf_t nozzle_diameter);
 
     /// This method returns the indices of the layers overlapping with the given one.
     vector<int> overlapping_layers(int layer_idx, const vector<coordf_t> &support_z);
 
-    void clip_with_shape(map<int, Polygons> &support, map<int, Polygons> &shape);
+    /// Clip the given areas of the support layers with their pillars shape.
+    void clip_with_shape(SupportLayersAreas &layers, Polygons SupportLayerAreas::*areas);
 
     // This method removes object silhouette from support material
     // (it's used with interface and base only). It removes a bit more,
     // leaving a thin gap between object and support in the XY plane.
-    void clip_with_object(map<int, Polygons> &support, vector<coordf_t> support_z, PrintObject &object);
+    void clip_with_object(SupportLayersAreas &layers, Polygons SupportLayerAreas::*areas, const PrintObject &object);
 
-    void process_layer(int layer_id, toolpaths_params params);
+    void process_layer(int layer_id, const toolpaths_params &params);
 
 private:
     /// SupportMaterial is generated by PrintObject.
@@ -150,16 +152,20 @@ private:
     // Return polygon vector given a vector of surfaces.
     Polygons p(SurfacesPtr &surfaces);
 
-    vector<coordf_t> get_keys_sorted(map<coordf_t, Polygons> _map);
+    vector<coordf_t> get_keys_sorted(const map<coordf_t, Polygons> &_map);
+
+    /// Areas of the layers overlapping each support layer which the base
+    /// support must not cover: object top surfaces, interface and contact
+    /// areas. The interface areas are looked up as the serial code did, by
+    /// print_z truncated to a layer index.
+    vector<Polygons> overlapping_areas(const SupportLayersAreas &layers,
+                                       const map<coordf_t, Polygons> &top);
 
     Polygon create_circle(coordf_t radius);
 
     // Used during generate_toolpaths function.
     PrintObject *object;
-    map<coordf_t, Polygons> overhang;
-    map<coordf_t, Polygons> contact;
-    map<int, Polygons> _interface;
-    map<int, Polygons> base;
+    SupportLayersAreas layers;
 
 };
 
@@ -0,0 +1,198 @@
+#include "ThreadPool.hpp"
+#include "CancellationToken.hpp"
+#include <algorithm>
+
+namespace Slic3r {
+
+/// Shared state of a single parallel_for() call. It lives on the stack of
+/// the calling thread, which does not return before every range is retired.
+struct ThreadPool::Job {
+    const boost::function<void(size_t)>* func;
+    /// Token of the calling thread, made current while running the ranges.
+    const CancellationToken* cancel;
+    /// Only workers having an index lower than this may run the job.
+    size_t max_workers;
+    /// Number of ranges not retired yet, guarded by mutex.
+    size_t remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    boost::mutex mutex;
+    boost::condition_variable done;
+};
+
+const size_t ThreadPool::max_workers;
+
+ThreadPool&
+ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool()
+    : n_workers(0), epoch(0), stopping(false)
+{
+    this->workers.reserve(max_workers);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        this->stopping = true;
+        this->work_available.notify_all();
+    }
+    for (auto &worker : this->workers)
+        worker->thread.join();
+}
+
+void
+ThreadPool::reserve_workers(size_t count)
+{
+    if (this->n_workers.load() >= count) return;
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    while (this->workers.size() < count) {
+        const size_t idx = this->workers.size();
+        this->workers.emplace_back(new Worker());
+        this->workers.back()->thread = boost::thread(&ThreadPool::worker_loop, this, idx);
+    }
+    this->n_workers = this->workers.size();
+}
+
+void
+ThreadPool::parallel_for(size_t begin, size_t end, const boost::function<void(size_t)> &func,
+    int threads_count, size_t chunk_size)
+{
+    if (end <= begin) return;
+    const size_t count = end - begin;
+
+    size_t helpers = std::min<size_t>(std::max(threads_count, 1) - 1, max_workers);
+    if (chunk_size == 0)
+        chunk_size = std::max<size_t>(1, count / ((helpers + 1) * 4));
+    const size_t n_chunks = (count + chunk_size - 1) / chunk_size;
+    helpers = std::min(helpers, n_chunks - 1);
+
+    // nothing to share, so don't pay for the hand-off
+    if (helpers == 0) {
+        const CancellationToken* cancel = CancellationToken::current();
+        for (size_t i = begin; i < end; ++i) {
+            if (cancel != NULL) cancel->check();
+            func(i);
+        }
+        return;
+    }
+    this->reserve_workers(helpers);
+
+    Job job;
+    job.func        = &func;
+    job.cancel      = CancellationToken::current();
+    job.max_workers = helpers;
+    job.remaining   = n_chunks;
+    job.failed      = false;
+
+    // deal the chunks round-robin to the deques of the allowed workers
+    for (size_t w = 0; w < helpers; ++w) {
+        Worker &worker = *this->workers[w];
+        boost::lock_guard<boost::mutex> lock(worker.mutex);
+        for (size_t chunk = w; chunk < n_chunks; chunk += helpers) {
+            Range range;
+            range.job   = &job;
+            range.begin = begin + chunk * chunk_size;
+            range.end   = std::min(end, range.begin + chunk_size);
+            worker.ranges.push_back(range);
+        }
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        ++this->epoch;
+        this->work_available.notify_all();
+    }
+
+    // help with our own job until every chunk has been picked up, then wait
+    // for the workers still busy with the last ones
+    Range range;
+    while (this->steal_range(max_workers, &job, &range))
+        this->run_range(range);
+    {
+        boost::unique_lock<boost::mutex> lock(job.mutex);
+        while (job.remaining > 0) job.done.wait(lock);
+    }
+
+    if (job.error) std::rethrow_exception(job.error);
+}
+
+void
+ThreadPool::worker_loop(size_t idx)
+{
+    Range range;
+    while (true) {
+        const size_t seen = this->epoch.load();
+        if (this->stopping) return;
+
+        if (this->pop_range(idx, &range) || this->steal_range(idx, NULL, &range)) {
+            this->run_range(range);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(this->mutex);
+        while (!this->stopping && this->epoch.load() == seen)
+            this->work_available.wait(lock);
+    }
+}
+
+bool
+ThreadPool::pop_range(size_t idx, Range* range)
+{
+    Worker &worker = *this->workers[idx];
+    boost::lock_guard<boost::mutex> lock(worker.mutex);
+    if (worker.ranges.empty()) return false;
+    *range = worker.ranges.back();
+    worker.ranges.pop_back();
+    return true;
+}
+
+bool
+ThreadPool::steal_range(size_t thief_idx, const Job* only_job, Range* range)
+{
+    const size_t n = this->n_workers.load();
+    for (size_t k = 1; k <= n; ++k) {
+        Worker &victim = *this->workers[(thief_idx + k) % n];
+        boost::lock_guard<boost::mutex> lock(victim.mutex);
+        for (auto it = victim.ranges.begin(); it != victim.ranges.end(); ++it) {
+            const bool eligible = only_job != NULL
+                ? it->job == only_job
+                : it->job->max_workers > thief_idx;
+            if (!eligible) continue;
+            *range = *it;
+            victim.ranges.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ThreadPool::run_range(const Range &range)
+{
+    Job* job = range.job;
+    if (!job->failed) {
+        try {
+            CancellationScope scope(job->cancel);
+            for (size_t i = range.begin; i < range.end; ++i) {
+                if (job->cancel != NULL) job->cancel->check();
+                (*job->func)(i);
+            }
+        } catch (...) {
+            boost::lock_guard<boost::mutex> lock(job->mutex);
+            if (!job->failed.exchange(true))
+                job->error = std::current_exception();
+        }
+    }
+
+    // the caller only returns after taking this lock, so the job stays
+    // alive until we release it
+    boost::lock_guard<boost::mutex> lock(job->mutex);
+    if (--job->remaining == 0) job->done.notify_all();
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef slic3r_ThreadPool_hpp_
+#define slic3r_ThreadPool_hpp_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+/// Process-wide pool of worker threads backing parallelize().
+/// Threads are started on first use and kept alive until the process exits.
+/// Each worker owns a deque of index ranges: it pops from the back of its own
+/// deque and steals from the front of the other workers' deques when idle.
+/// The calling thread participates in its own job, so nested calls made from
+/// inside a worker cannot deadlock.
+class ThreadPool
+{
+    public:
+    /// Return the shared instance, creating it on first use.
+    static ThreadPool& instance();
+
+    ~ThreadPool();
+
+    /// Call func(i) for every i in [begin, end), using at most threads_count
+    /// threads (the calling one included). The range is cut into chunks of
+    /// chunk_size items; 0 picks a chunk size giving a few chunks per thread.
+    /// The first exception thrown by func is rethrown here once all chunks
+    /// have been retired. The current CancellationToken of the caller, if
+    /// any, is checked before each item and is current while func runs.
+    void parallel_for(size_t begin, size_t end, const boost::function<void(size_t)> &func,
+        int threads_count, size_t chunk_size = 0);
+
+    /// Number of worker threads started so far.
+    size_t workers_count() const { return this->n_workers.load(); }
+
+    private:
+    struct Job;
+
+    /// A chunk of a job: the half-open index range [begin, end).
+    struct Range {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Worker {
+        boost::mutex mutex;
+        std::deque<Range> ranges;
+        boost::thread thread;
+    };
+
+    /// Hard cap on the number of worker threads; the vector holding them is
+    /// reserved to this size so that it never reallocates while being read.
+    static const size_t max_workers = 256;
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void reserve_workers(size_t count);
+    void worker_loop(size_t idx);
+    bool pop_range(size_t idx, Range* range);
+    bool steal_range(size_t thief_idx, const Job* only_job, Range* range);
+    void run_range(const Range &range);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> n_workers;
+
+    /// Guards growth of the pool and the sleeping of idle workers.
+    boost::mutex mutex;
+    boost::condition_variable work_available;
+    /// Bumped every time ranges are queued, so that idle workers can tell
+    /// whether they missed a wake-up while scanning the deques.
+    std::atomic<size_t> epoch;
+    std::atomic<bool> stopping;
+};
+
+}
+
+#endif
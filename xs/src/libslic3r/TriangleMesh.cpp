@@ -2,12 +2,17 @@
 #include "ClipperUtils.hpp"
 #include "Log.hpp"
 #include "Geometry.hpp"
+#include "IO/STL.hpp"
+#include "MeshRepair.hpp"
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <deque>
 #include <queue>
 #include <set>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <utility>
 #include <algorithm>
 #include <math.h>
@@ -80,7 +85,9 @@ TriangleMesh::TriangleMesh(const Pointf3* points, const Point3* facets, size_t n
 }
 
 TriangleMesh::TriangleMesh(const TriangleMesh &other)
-    : stl(other.stl), repaired(other.repaired)
+    : stl(other.stl), its(other.its), repaired(other.repaired), repair_timings(other.repair_timings),
+      tree(std::atomic_load(&other.tree)), projection(std::atomic_load(&other.projection)),
+      hull(std::atomic_load(&other.hull))
 {
     this->clone(other);
 }
@@ -88,7 +95,12 @@ TriangleMesh::TriangleMesh(const TriangleMesh &other)
 TriangleMesh& TriangleMesh::operator= (const TriangleMesh& other)
 {
     this->stl = other.stl;
+    this->its = other.its;
     this->repaired = other.repaired;
+    this->repair_timings = other.repair_timings;
+    this->tree = std::atomic_load(&other.tree);
+    this->projection = std::atomic_load(&other.projection);
+    this->hull = std::atomic_load(&other.hull);
     this->clone(other);
 
     return *this;
@@ -120,14 +132,26 @@ void TriangleMesh::clone(const TriangleMesh& other) {
 TriangleMesh::TriangleMesh(TriangleMesh&& other) {
     this->repaired = std::move(other.repaired);
     this->stl = std::move(other.stl);
+    this->its = std::move(other.its);
+    this->repair_timings = other.repair_timings;
+    this->tree = std::move(other.tree);
+    this->projection = std::move(other.projection);
+    this->hull = std::move(other.hull);
     stl_initialize(&other.stl);
+    other.its.clear();
 }
 
 TriangleMesh& TriangleMesh::operator= (TriangleMesh&& other)
 {
     this->repaired = std::move(other.repaired);
     this->stl = std::move(other.stl);
+    this->its = std::move(other.its);
+    this->repair_timings = other.repair_timings;
+    this->tree = std::move(other.tree);
+    this->projection = std::move(other.projection);
+    this->hull = std::move(other.hull);
     stl_initialize(&other.stl);
+    other.its.clear();
 
     return *this;
 }
@@ -136,7 +160,12 @@ void
 TriangleMesh::swap(TriangleMesh &other)
 {
     std::swap(this->stl,      other.stl);
+    std::swap(this->its,      other.its);
     std::swap(this->repaired, other.repaired);
+    std::swap(this->repair_timings, other.repair_timings);
+    std::swap(this->tree, other.tree);
+    std::swap(this->projection, other.projection);
+    std::swap(this->hull, other.hull);
 }
 
 TriangleMesh::~TriangleMesh() {
@@ -144,12 +173,20 @@ TriangleMesh::~TriangleMesh() {
 }
 
 void
-TriangleMesh::ReadSTLFile(const std::string &input_file) {
-    #ifdef BOOST_WINDOWS
-    stl_open(&stl, boost::nowide::widen(input_file).c_str());
-    #else
-    stl_open(&stl, input_file.c_str());
-    #endif
+TriangleMesh::ReadSTLFile(const std::string &input_file, int threads) {
+    this->its.clear();
+    this->tree.reset();
+    this->projection.reset();
+    this->hull.reset();
+    
+    // files are mapped and decoded in parallel, admesh only handles the odd ones
+    if (!IO::read_stl(input_file, &this->stl, threads)) {
+        #ifdef BOOST_WINDOWS
+        stl_open(&stl, boost::nowide::widen(input_file).c_str());
+        #else
+        stl_open(&stl, input_file.c_str());
+        #endif
+    }
     if (this->stl.error != 0) throw std::runtime_error("Failed to read STL file");
 }
 
@@ -173,39 +210,63 @@ TriangleMesh::write_binary(const std::string &output_file) const
     #endif
 }
 
+namespace {
+
+/// Seconds elapsed since start.
+double
+seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
 void
-TriangleMesh::repair() {
+TriangleMesh::repair(int threads) {
     if (this->repaired) return;
     
     // admesh fails when repairing empty meshes
     if (this->stl.stats.number_of_facets == 0) return;
     
-    this->check_topology();
-
-    /// Call the stl_repair from admesh rather than reimplementing it ourselves.
-    stl_repair(&(this->stl),  // operate on this STL
-               true,  // flag: try to fix everything
-               true,  // flag: check for perfectly aligned edges
-               false, // flag: don't use tolerance
-               0.0,    // null tolerance value
-               false, // flag: don't increment tolerance
-               0.0,   // amount to increment tolerance on each iteration
-               true,  // find and try to connect nearby bad facets
-               10,    // Perform 10 iterations
-               true,  // remove unconnected
-               true,  // fill holes
-               true,  // fix normal directions
-               true,  // fix normal values
-               false, // reverse direction of all facets and normals
-               0);  // Verbosity
-    
+    this->repair_timings = mesh_repair_timings();
+    this->check_topology(threads);
+
+    // The passes stl_repair() runs when asked to fix everything, the exact
+    // check and the normal fixes running on the thread pool.
+    this->check_facets_exact(threads);
+    this->check_facets_nearby(10);
+
+    auto start = std::chrono::steady_clock::now();
+    if (this->stl.stats.connected_facets_3_edge < this->stl.stats.number_of_facets)
+        stl_remove_unconnected_facets(&this->stl);
+    this->repair_timings.remove_unconnected += seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    if (this->stl.stats.connected_facets_3_edge < this->stl.stats.number_of_facets)
+        stl_fill_holes(&this->stl);
+    this->repair_timings.fill_holes += seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    MeshRepair::fix_normal_directions(&this->stl, threads);
+    this->repair_timings.normal_directions += seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    MeshRepair::fix_normal_values(&this->stl, threads);
+    this->repair_timings.normal_values += seconds_since(start);
+
     // always calculate the volume and reverse all normals if volume is negative
-    (void)this->volume();
+    start = std::chrono::steady_clock::now();
+    stl_calculate_volume(&this->stl);
+    this->repair_timings.volume += seconds_since(start);
     
     // neighbors
     stl_verify_neighbors(&stl);
     
     this->repaired = true;
+    
+    // index the vertices once, now that the facets are final
+    this->invalidate_shared_vertices();
+    this->require_shared_vertices();
 }
 
 float
@@ -216,32 +277,35 @@ TriangleMesh::volume()
 }
 
 void
-TriangleMesh::check_topology()
+TriangleMesh::check_topology(int threads)
 {
-    // checking exact
-    stl_check_facets_exact(&stl);
+    this->check_facets_exact(threads);
+    this->check_facets_nearby(2);
+}
+
+void
+TriangleMesh::check_facets_exact(int threads)
+{
+    const auto start = std::chrono::steady_clock::now();
+    MeshRepair::check_facets_exact(&stl, threads);
     stl.stats.facets_w_1_bad_edge = (stl.stats.connected_facets_2_edge - stl.stats.connected_facets_3_edge);
     stl.stats.facets_w_2_bad_edge = (stl.stats.connected_facets_1_edge - stl.stats.connected_facets_2_edge);
     stl.stats.facets_w_3_bad_edge = (stl.stats.number_of_facets - stl.stats.connected_facets_1_edge);
-    
-    // checking nearby
-    //int last_edges_fixed = 0;
+    this->repair_timings.check_exact += seconds_since(start);
+}
+
+void
+TriangleMesh::check_facets_nearby(int iterations)
+{
+    const auto start = std::chrono::steady_clock::now();
     float tolerance = stl.stats.shortest_edge;
     float increment = stl.stats.bounding_diameter / 10000.0;
-    int iterations = 2;
-    if (stl.stats.connected_facets_3_edge < stl.stats.number_of_facets) {
-        for (int i = 0; i < iterations; i++) {
-            if (stl.stats.connected_facets_3_edge < stl.stats.number_of_facets) {
-                //printf("Checking nearby. Tolerance= %f Iteration=%d of %d...", tolerance, i + 1, iterations);
-                stl_check_facets_nearby(&stl, tolerance);
-                //printf("  Fixed %d edges.\n", stl.stats.edges_fixed - last_edges_fixed);
-                //last_edges_fixed = stl.stats.edges_fixed;
-                tolerance += increment;
-            } else {
-                break;
-            }
-        }
+    for (int i = 0; i < iterations; i++) {
+        if (stl.stats.connected_facets_3_edge >= stl.stats.number_of_facets) break;
+        stl_check_facets_nearby(&stl, tolerance);
+        tolerance += increment;
     }
+    this->repair_timings.check_nearby += seconds_since(start);
 }
 
 bool
@@ -280,19 +344,23 @@ TriangleMesh::facets_count() const
 
 void
 TriangleMesh::WriteOBJFile(const std::string &output_file) const {
-    stl_generate_shared_vertices(const_cast<stl_file*>(&this->stl));
+    stl_file* stl = const_cast<stl_file*>(&this->stl);
+    stl_generate_shared_vertices(stl);
     
     #ifdef BOOST_WINDOWS
-    stl_write_obj(const_cast<stl_file*>(&this->stl), boost::nowide::widen(output_file).c_str());
+    stl_write_obj(stl, boost::nowide::widen(output_file).c_str());
     #else
-    stl_write_obj(const_cast<stl_file*>(&this->stl), output_file.c_str());
+    stl_write_obj(stl, output_file.c_str());
     #endif
+    
+    // the indexed triangle set holds the shared vertices from now on
+    stl_invalidate_shared_vertices(stl);
 }
 
 void TriangleMesh::scale(float factor)
 {
     stl_scale(&(this->stl), factor);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 void TriangleMesh::scale(const Pointf3 &versor)
@@ -302,13 +370,13 @@ void TriangleMesh::scale(const Pointf3 &versor)
     fversor[1] = versor.y;
     fversor[2] = versor.z;
     stl_scale_versor(&this->stl, fversor);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 void TriangleMesh::translate(float x, float y, float z)
 {
     stl_translate_relative(&(this->stl), x, y, z);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 void TriangleMesh::translate(Pointf3 vec) {
@@ -331,7 +399,7 @@ void TriangleMesh::rotate(float angle, const Axis &axis)
     } else if (axis == Z) {
         stl_rotate_z(&(this->stl), angle);
     }
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 void TriangleMesh::rotate_x(float angle)
@@ -358,7 +426,7 @@ void TriangleMesh::mirror(const Axis &axis)
     } else if (axis == Z) {
         stl_mirror_xy(&this->stl);
     }
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 void TriangleMesh::mirror_x()
@@ -403,13 +471,14 @@ void TriangleMesh::rotate(double angle, const Point& center)
 {
     this->translate(-center.x, -center.y, 0);
     stl_rotate_z(&(this->stl), (float)angle);
+    this->invalidate_shared_vertices();
     this->translate(+center.x, +center.y, 0);
 }
 
 void TriangleMesh::align_to_bed()
 {
     stl_translate_relative(&(this->stl), 0.0f, 0.0f, -this->stl.stats.min.z);
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
 }
 
 TriangleMesh TriangleMesh::get_transformed_mesh(TransformationMatrix const & trafo) const
@@ -425,19 +494,17 @@ void TriangleMesh::transform(TransformationMatrix const & trafo)
 {
     std::vector<double> trafo_arr = trafo.matrix3x4f();
     stl_transform(&(this->stl), trafo_arr.data());
-    stl_invalidate_shared_vertices(&(this->stl));
+    this->invalidate_shared_vertices();
 }
 
 Pointf3s TriangleMesh::vertices()
 {
     Pointf3s tmp {};
     if (this->repaired) {
-        if (this->stl.v_shared == nullptr) 
-            stl_generate_shared_vertices(&stl); // build the list of vertices
-        for (auto i = 0; i < this->stl.stats.shared_vertices; i++) {
-            const auto& v = this->stl.v_shared[i];
+        this->require_shared_vertices(); // build the list of vertices
+        tmp.reserve(this->its.vertices.size());
+        for (const auto& v : this->its.vertices)
             tmp.emplace_back(Pointf3(v.x, v.y, v.z));
-        }
     } else {
         Slic3r::Log::warn("TriangleMesh", "vertices() requires repair()");
     }
@@ -448,12 +515,10 @@ Point3s TriangleMesh::facets()
 {
     Point3s tmp {};
     if (this->repaired) {
-        if (this->stl.v_shared == nullptr) 
-            stl_generate_shared_vertices(&stl); // build the list of vertices
-        for (auto i = 0; i < stl.stats.number_of_facets; i++) {
-            const auto& v = stl.v_indices[i];
+        this->require_shared_vertices(); // build the list of vertices
+        tmp.reserve(this->its.indices.size());
+        for (const auto& v : this->its.indices)
             tmp.emplace_back(Point3(v.vertex[0], v.vertex[1], v.vertex[2]));
-        }
     } else {
         Slic3r::Log::warn("TriangleMesh", "facets() requires repair()");
     }
@@ -488,11 +553,11 @@ TriangleMesh::center() const {
 }
 
 std::vector<ExPolygons> 
-TriangleMesh::slice(const std::vector<double>& z)
+TriangleMesh::slice(const std::vector<double>& z, int threads)
 {
     // convert doubles to floats
     std::vector<float> z_f(z.begin(), z.end());
-    TriangleMeshSlicer<Z> mslicer(this);
+    TriangleMeshSlicer<Z> mslicer(this, threads);
     std::vector<ExPolygons> layers;
 
     mslicer.slice(z_f, &layers);
@@ -513,6 +578,7 @@ TriangleMesh::stats() const {
     tmp_stats.facets_reversed = this->stl.stats.facets_reversed;
     tmp_stats.backwards_edges = this->stl.stats.backwards_edges;
     tmp_stats.normals_fixed = this->stl.stats.normals_fixed;
+    tmp_stats.repair_timings = this->repair_timings;
     return tmp_stats;
 }
 
@@ -527,13 +593,13 @@ void TriangleMesh::cut(Axis axis, double z, TriangleMesh* upper, TriangleMesh* l
 {
     switch(axis) {
         case X:
-            TriangleMeshSlicer<X>(this).cut(z, upper, lower);
+            TriangleMeshSlicer<X>(this, 1).cut(z, upper, lower);
             break;
         case Y:
-            TriangleMeshSlicer<Y>(this).cut(z, upper, lower);
+            TriangleMeshSlicer<Y>(this, 1).cut(z, upper, lower);
             break;
         case Z:
-            TriangleMeshSlicer<Z>(this).cut(z, upper, lower);
+            TriangleMeshSlicer<Z>(this, 1).cut(z, upper, lower);
             break;
         default: 
             Slic3r::Log::error("TriangleMesh", "Invalid Axis supplied to cut()");
@@ -541,55 +607,124 @@ void TriangleMesh::cut(Axis axis, double z, TriangleMesh* upper, TriangleMesh* l
 }
 
 TriangleMeshPtrs
-TriangleMesh::split() const
+TriangleMesh::split(int threads) const
 {
     TriangleMeshPtrs meshes;
-    std::set<int> seen_facets;
     
-    // we need neighbors
+    // facets are connected through the vertices they share
     if (!this->repaired) CONFESS("split() requires repair()");
+    const IndexedTriangleSet &its = this->shared_vertices();
+    const int facets_count = its.indices.size();
     
-    // loop while we have remaining facets
-    while (1) {
-        // get the first facet
-        std::queue<int> facet_queue;
-        std::deque<int> facets;
-        for (int facet_idx = 0; facet_idx < this->stl.stats.number_of_facets; facet_idx++) {
-            if (seen_facets.find(facet_idx) == seen_facets.end()) {
-                // if facet was not seen put it into queue and start searching
-                facet_queue.push(facet_idx);
-                break;
-            }
+    const int vertices_count = its.vertices.size();
+    if (facets_count == 0) return meshes;
+    
+    const size_t facets_per_chunk = 16384;
+    const size_t chunks_count = (facets_count + facets_per_chunk - 1) / facets_per_chunk;
+    
+    /*  Union-find over the vertices: every facet unites its three vertices.
+        Roots are only ever linked to a lower root, with a compare-and-swap,
+        so the facets can be walked concurrently and every part ends up
+        rooted at its lowest vertex whatever the order of the unions. */
+    std::unique_ptr<std::atomic<int>[]> parent(new std::atomic<int>[vertices_count]);
+    for (int v = 0; v < vertices_count; v++) parent[v].store(v, std::memory_order_relaxed);
+    auto find = [&parent](int v) {
+        int p = parent[v].load(std::memory_order_relaxed);
+        while (p != v) {
+            // path halving: point v to its grandparent, which is still one of its ancestors
+            const int gp = parent[p].load(std::memory_order_relaxed);
+            parent[v].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+            v = p;
+            p = parent[v].load(std::memory_order_relaxed);
         }
-        if (facet_queue.empty()) break;
-        
-        while (!facet_queue.empty()) {
-            int facet_idx = facet_queue.front();
-            facet_queue.pop();
-            if (seen_facets.find(facet_idx) != seen_facets.end()) continue;
-            facets.push_back(facet_idx);
-            for (int j = 0; j <= 2; j++) {
-                facet_queue.push(this->stl.neighbors_start[facet_idx].neighbor[j]);
-            }
-            seen_facets.insert(facet_idx);
+        return v;
+    };
+    auto unite = [&parent, &find](int a, int b) {
+        for (;;) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a < b) std::swap(a, b);
+            int expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
         }
-        
-        TriangleMesh* mesh = new TriangleMesh;
-        meshes.push_back(mesh);
-        mesh->stl.stats.type = inmemory;
-        mesh->stl.stats.number_of_facets = facets.size();
-        mesh->stl.stats.original_num_facets = mesh->stl.stats.number_of_facets;
-        stl_clear_error(&mesh->stl);
-        stl_allocate(&mesh->stl);
-        
-        int first = 1;
-        for (std::deque<int>::const_iterator facet = facets.begin(); facet != facets.end(); ++facet) {
-            mesh->stl.facet_start[facet - facets.begin()] = this->stl.facet_start[*facet];
-            stl_facet_stats(&mesh->stl, this->stl.facet_start[*facet], first);
-            first = 0;
+    };
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const int first = chunk_idx * facets_per_chunk;
+            const int last  = std::min<int>(facets_count, first + facets_per_chunk);
+            for (int facet_idx = first; facet_idx < last; facet_idx++) {
+                const v_indices_struct &facet = its.indices[facet_idx];
+                unite(facet.vertex[0], facet.vertex[1]);
+                unite(facet.vertex[0], facet.vertex[2]);
+            }
+        },
+        threads
+    );
+    
+    // the unions are over, so the roots are final
+    std::vector<int> facet_roots(facets_count);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const int first = chunk_idx * facets_per_chunk;
+            const int last  = std::min<int>(facets_count, first + facets_per_chunk);
+            for (int facet_idx = first; facet_idx < last; facet_idx++)
+                facet_roots[facet_idx] = find(its.indices[facet_idx].vertex[0]);
+        },
+        threads
+    );
+    
+    // number the parts in the order of their first facet and bucket the facets
+    std::vector<int> root_parts(vertices_count, -1);
+    std::vector<int> part_facets_start(1, 0);
+    for (int facet_idx = 0; facet_idx < facets_count; facet_idx++) {
+        int &part = root_parts[facet_roots[facet_idx]];
+        if (part == -1) {
+            part = part_facets_start.size() - 1;
+            part_facets_start.push_back(0);
         }
+        facet_roots[facet_idx] = part;
+        ++part_facets_start[part + 1];
+    }
+    const size_t parts_count = part_facets_start.size() - 1;
+    for (size_t i = 1; i <= parts_count; i++)
+        part_facets_start[i] += part_facets_start[i-1];
+    std::vector<int> part_facets(facets_count);
+    {
+        std::vector<int> next(part_facets_start.begin(), part_facets_start.end() - 1);
+        for (int facet_idx = 0; facet_idx < facets_count; facet_idx++)
+            part_facets[ next[facet_roots[facet_idx]]++ ] = facet_idx;
     }
     
+    // the parts are known with their sizes, so they are filled concurrently
+    meshes.reserve(parts_count);
+    for (size_t i = 0; i < parts_count; i++) meshes.push_back(new TriangleMesh);
+    parallelize<size_t>(
+        0,
+        parts_count - 1,
+        [&](size_t part) {
+            TriangleMesh* mesh = meshes[part];
+            mesh->stl.stats.type = inmemory;
+            mesh->stl.stats.number_of_facets = part_facets_start[part+1] - part_facets_start[part];
+            mesh->stl.stats.original_num_facets = mesh->stl.stats.number_of_facets;
+            stl_clear_error(&mesh->stl);
+            stl_allocate(&mesh->stl);
+            
+            int first = 1;
+            for (int i = part_facets_start[part]; i < part_facets_start[part+1]; i++) {
+                const stl_facet &facet = this->stl.facet_start[part_facets[i]];
+                mesh->stl.facet_start[i - part_facets_start[part]] = facet;
+                stl_facet_stats(&mesh->stl, facet, first);
+                first = 0;
+            }
+        },
+        threads
+    );
+    
     return meshes;
 }
 
@@ -609,7 +744,7 @@ TriangleMesh::cut_by_grid(const Pointf &grid) const
             curr = mesh;
         } else {
             TriangleMesh next;
-            TriangleMeshSlicer<X>(&mesh).cut(bb.min.x + (grid.x * i), &next, &curr);
+            TriangleMeshSlicer<X>(&mesh, 1).cut(bb.min.x + (grid.x * i), &next, &curr);
             curr.repair();
             next.repair();
             mesh = next;
@@ -622,7 +757,7 @@ TriangleMesh::cut_by_grid(const Pointf &grid) const
             } else {
                 TriangleMesh next;
                 tile = new TriangleMesh;
-                TriangleMeshSlicer<Y>(&curr).cut(bb.min.y + (grid.y * j), &next, tile);
+                TriangleMeshSlicer<Y>(&curr, 1).cut(bb.min.y + (grid.y * j), &next, tile);
                 tile->repair();
                 next.repair();
                 curr = next;
@@ -639,7 +774,7 @@ TriangleMesh::merge(const TriangleMesh &mesh)
 {
     // reset stats and metadata
     int number_of_facets = this->stl.stats.number_of_facets;
-    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_shared_vertices();
     this->repaired = false;
     
     // update facet count and allocate more memory
@@ -657,7 +792,21 @@ TriangleMesh::merge(const TriangleMesh &mesh)
 
 /* this will return scaled ExPolygons */
 ExPolygons
-TriangleMesh::horizontal_projection() const
+TriangleMesh::horizontal_projection(int threads) const
+{
+    std::shared_ptr<const ExPolygons> projection = std::atomic_load(&this->projection);
+    if (!projection) {
+        // the silhouette needs the indexed facets, which only exist once repaired
+        if (this->repaired) this->shared_vertices();
+        projection = std::make_shared<const ExPolygons>(
+            this->its.empty() ? this->facets_projection() : this->silhouette_projection(threads));
+        std::atomic_store(&this->projection, projection);
+    }
+    return *projection;
+}
+
+ExPolygons
+TriangleMesh::facets_projection() const
 {
     Polygons pp;
     pp.reserve(this->stl.stats.number_of_facets);
@@ -676,17 +825,177 @@ TriangleMesh::horizontal_projection() const
     return union_ex(offset(pp, 0.01 / SCALING_FACTOR), true);
 }
 
+ExPolygons
+TriangleMesh::silhouette_projection(int threads) const
+{
+    /*  Over every point of the footprint the topmost facet faces up, so the
+        footprint is the union of the projections of the upward facets. These
+        all project counter-clockwise, so the winding number of the boundary
+        of the upward region is the number of upward facets above a point:
+        projecting that boundary and filling it with the nonzero rule gives
+        the footprint without ever handing the facets to Clipper. */
+    const IndexedTriangleSet &its = this->its;
+    const int facets_count = its.indices.size();
+    const int vertices_count = its.vertices.size();
+    const size_t items_per_chunk = 16384;
+    
+    Points points(vertices_count);
+    parallelize<size_t>(
+        0,
+        (vertices_count - 1) / items_per_chunk,
+        [&](size_t chunk_idx) {
+            const int last = std::min<int>(vertices_count, (chunk_idx + 1) * items_per_chunk);
+            for (int v = chunk_idx * items_per_chunk; v < last; v++)
+                points[v] = Point(its.vertices[v].x / SCALING_FACTOR, its.vertices[v].y / SCALING_FACTOR);
+        },
+        threads
+    );
+    
+    // the orientation is taken after scaling, so that the loops agree with it
+    std::vector<char> upward(facets_count);
+    parallelize<size_t>(
+        0,
+        (facets_count - 1) / items_per_chunk,
+        [&](size_t chunk_idx) {
+            const int last = std::min<int>(facets_count, (chunk_idx + 1) * items_per_chunk);
+            for (int i = chunk_idx * items_per_chunk; i < last; i++) {
+                const Point &a = points[its.indices[i].vertex[0]];
+                const Point &b = points[its.indices[i].vertex[1]];
+                const Point &c = points[its.indices[i].vertex[2]];
+                upward[i] = (double(b.x - a.x) * double(c.y - a.y) - double(b.y - a.y) * double(c.x - a.x)) > 0;
+            }
+        },
+        threads
+    );
+    
+    /*  An edge of an upward facet is on the boundary unless the neighbor
+        across it is upward too and runs along it backwards. The test is
+        symmetric, so edges only ever drop out in opposite pairs and every
+        vertex keeps as many boundary edges leaving as entering it. */
+    const size_t chunks_count = (facets_count + items_per_chunk - 1) / items_per_chunk;
+    std::vector< std::vector<std::pair<int,int> > > chunk_edges(chunks_count);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            const int last = std::min<int>(facets_count, (chunk_idx + 1) * items_per_chunk);
+            for (int i = chunk_idx * items_per_chunk; i < last; i++) {
+                if (!upward[i]) continue;
+                for (int j = 0; j <= 2; j++) {
+                    const int a = its.indices[i].vertex[j];
+                    const int b = its.indices[i].vertex[(j + 1) % 3];
+                    const int neighbor = this->stl.neighbors_start[i].neighbor[j];
+                    bool inner = false;
+                    if (neighbor != -1 && upward[neighbor]) {
+                        for (int k = 0; k <= 2 && !inner; k++)
+                            inner = its.indices[neighbor].vertex[k] == b
+                                && its.indices[neighbor].vertex[(k + 1) % 3] == a
+                                && this->stl.neighbors_start[neighbor].neighbor[k] == i;
+                    }
+                    if (!inner) chunk_edges[chunk_idx].push_back(std::make_pair(a, b));
+                }
+            }
+        },
+        threads
+    );
+    
+    // list the boundary edges leaving each vertex
+    std::vector<int> vertex_edges_start(vertices_count + 1, 0);
+    for (const std::vector<std::pair<int,int> > &edges : chunk_edges)
+        for (const std::pair<int,int> &edge : edges) ++vertex_edges_start[edge.first + 1];
+    for (int v = 1; v <= vertices_count; v++)
+        vertex_edges_start[v] += vertex_edges_start[v-1];
+    std::vector<int> vertex_edges(vertex_edges_start.back());
+    {
+        std::vector<int> next(vertex_edges_start.begin(), vertex_edges_start.end() - 1);
+        for (const std::vector<std::pair<int,int> > &edges : chunk_edges)
+            for (const std::pair<int,int> &edge : edges) vertex_edges[ next[edge.first]++ ] = edge.second;
+    }
+    
+    // walk the edges into loops, leaving each vertex through any unused edge
+    Polygons loops;
+    std::vector<int> next_edge(vertex_edges_start.begin(), vertex_edges_start.end() - 1);
+    for (int start = 0; start < vertices_count; start++) {
+        while (next_edge[start] < vertex_edges_start[start+1]) {
+            Polygon loop;
+            int v = start;
+            do {
+                loop.points.push_back(points[v]);
+                v = vertex_edges[ next_edge[v]++ ];
+            } while (v != start);
+            loops.push_back(loop);
+        }
+    }
+    
+    // the offset closes the slivers lost to the scaling, as in facets_projection()
+    return offset_ex(union_(loops), 0.01 / SCALING_FACTOR);
+}
+
 Polygon
-TriangleMesh::convex_hull()
+TriangleMesh::convex_hull(int threads)
 {
+    std::shared_ptr<const Polygon> hull = std::atomic_load(&this->hull);
+    if (hull) return *hull;
+    
     this->require_shared_vertices();
+    const std::vector<stl_vertex> &vertices = this->its.vertices;
+    if (vertices.empty()) return Polygon();
+    
+    // the hull of the hulls of every chunk of the vertices is the hull of them all
+    const size_t vertices_per_chunk = 65536;
+    const size_t chunks_count = (vertices.size() + vertices_per_chunk - 1) / vertices_per_chunk;
+    std::vector<Points> chunk_points(chunks_count);
+    parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            Points &pp = chunk_points[chunk_idx];
+            const size_t last = std::min(vertices.size(), (chunk_idx + 1) * vertices_per_chunk);
+            for (size_t i = chunk_idx * vertices_per_chunk; i < last; i++)
+                pp.push_back(Point(vertices[i].x / SCALING_FACTOR, vertices[i].y / SCALING_FACTOR));
+            if (pp.size() >= 3) pp = Slic3r::Geometry::convex_hull(pp).points;
+        },
+        threads
+    );
     Points pp;
-    pp.reserve(this->stl.stats.shared_vertices);
-    for (int i = 0; i < this->stl.stats.shared_vertices; i++) {
-        stl_vertex* v = &this->stl.v_shared[i];
-        pp.push_back(Point(v->x / SCALING_FACTOR, v->y / SCALING_FACTOR));
-    }
-    return Slic3r::Geometry::convex_hull(pp);
+    for (const Points &points : chunk_points)
+        pp.insert(pp.end(), points.begin(), points.end());
+    
+    hull = std::make_shared<const Polygon>(Slic3r::Geometry::convex_hull(pp));
+    std::atomic_store(&this->hull, hull);
+    return *hull;
+}
+
+uint64_t
+TriangleMesh::content_hash(const Pointf3 &origin, int threads) const
+{
+    // the chunks are fixed, so the hash doesn't depend on the number of threads
+    const size_t facets_count = this->stl.stats.number_of_facets;
+    const size_t facets_per_chunk = 16384;
+    const size_t chunks_count = (facets_count + facets_per_chunk - 1) / facets_per_chunk;
+    std::vector<uint64_t> chunk_hashes(chunks_count);
+    if (chunks_count > 0) parallelize<size_t>(
+        0,
+        chunks_count - 1,
+        [&](size_t chunk_idx) {
+            uint64_t hash = hash_value(chunk_idx);
+            const size_t last = std::min(facets_count, (chunk_idx + 1) * facets_per_chunk);
+            for (size_t i = chunk_idx * facets_per_chunk; i < last; i++) {
+                for (const stl_vertex &v : this->stl.facet_start[i].vertex) {
+                    const float coords[3] = {
+                        float(v.x - origin.x), float(v.y - origin.y), float(v.z - origin.z)
+                    };
+                    hash = hash_bytes(coords, sizeof(coords), hash);
+                }
+            }
+            chunk_hashes[chunk_idx] = hash;
+        },
+        threads
+    );
+    
+    uint64_t hash = hash_value(facets_count);
+    for (uint64_t chunk_hash : chunk_hashes) hash = hash_value(chunk_hash, hash);
+    return hash;
 }
 
 BoundingBoxf3
@@ -726,13 +1035,83 @@ void
 TriangleMesh::require_shared_vertices()
 {
     if (!this->repaired) this->repair();
-    if (this->stl.v_shared == NULL) stl_generate_shared_vertices(&(this->stl));
+    this->shared_vertices();
+}
+
+const IndexedTriangleSet&
+TriangleMesh::shared_vertices() const
+{
+    boost::lock_guard<boost::mutex> lock(this->its_mutex);
+    if (this->its.empty() && this->stl.stats.number_of_facets > 0) {
+        // admesh's tables are only a step towards its, so building it leaves the mesh as it was
+        TriangleMesh* mesh = const_cast<TriangleMesh*>(this);
+        stl_generate_shared_vertices(&mesh->stl);
+        mesh->its.vertices.assign(mesh->stl.v_shared, mesh->stl.v_shared + mesh->stl.stats.shared_vertices);
+        mesh->its.indices.assign(mesh->stl.v_indices, mesh->stl.v_indices + mesh->stl.stats.number_of_facets);
+        stl_invalidate_shared_vertices(&mesh->stl);
+    }
+    return this->its;
+}
+
+void
+TriangleMesh::invalidate_shared_vertices()
+{
+    stl_invalidate_shared_vertices(&this->stl);
+    this->its.clear();
+    std::atomic_store(&this->tree, std::shared_ptr<const AABBTree>());
+    std::atomic_store(&this->projection, std::shared_ptr<const ExPolygons>());
+    std::atomic_store(&this->hull, std::shared_ptr<const Polygon>());
+}
+
+const AABBTree&
+TriangleMesh::aabb_tree() const
+{
+    std::shared_ptr<const AABBTree> tree = std::atomic_load(&this->tree);
+    if (!tree) {
+        std::shared_ptr<const AABBTree> built = std::make_shared<const AABBTree>(this->stl);
+        // keep the tree of whoever got there first, so that no caller's reference dangles
+        if (std::atomic_compare_exchange_strong(&this->tree, &tree, built))
+            tree = built;
+    }
+    return *tree;
+}
+
+std::vector<int>
+TriangleMesh::facets_in_range(Axis axis, float min, float max) const
+{
+    return this->aabb_tree().facets_in_range(axis, min, max);
+}
+
+bool
+TriangleMesh::intersect_ray(const Linef3 &ray, Pointf3* hit, int* facet_idx) const
+{
+    double t;
+    const int facet = this->aabb_tree().intersect_ray(this->stl, ray, &t);
+    if (facet == -1) return false;
+    
+    *hit = Pointf3(
+        ray.a.x + (ray.b.x - ray.a.x) * t,
+        ray.a.y + (ray.b.y - ray.a.y) * t,
+        ray.a.z + (ray.b.z - ray.a.z) * t);
+    if (facet_idx != NULL) *facet_idx = facet;
+    return true;
+}
+
+Pointf3
+TriangleMesh::closest_point(const Pointf3 &point, int* facet_idx) const
+{
+    Pointf3 closest;
+    const int facet = this->aabb_tree().closest_point(this->stl, point, &closest);
+    if (facet == -1) CONFESS("closest_point() requires a non-empty mesh");
+    if (facet_idx != NULL) *facet_idx = facet;
+    return closest;
 }
 
 void
 TriangleMesh::reverse_normals()
 {
     stl_reverse_all_facets(&this->stl);
+    this->invalidate_shared_vertices();
     if (this->stl.stats.volume != -1) this->stl.stats.volume *= -1.0;
 }
 
@@ -781,6 +1160,7 @@ TriangleMesh::extrude_tin(float offset)
         }
     }
     stl_get_size(&this->stl);
+    this->invalidate_shared_vertices();
     
     this->repair();
 }
@@ -967,43 +1347,65 @@ TriangleMeshSlicer<A>::slice(const std::vector<float> &z, std::vector<Polygons>*
         type is float.
     */
     
-    std::vector<IntersectionLines> lines(z.size());
-    {
-        boost::mutex lines_mutex;
-        parallelize<int>(
-            0,
-            this->mesh->stl.stats.number_of_facets-1,
-            boost::bind(&TriangleMeshSlicer<A>::_slice_do, this, _1, &lines, &lines_mutex, z)
-        );
-    }
+    /*  Facets are sliced in contiguous chunks, each one collecting its lines
+        in its own per-layer buckets so that no locking is needed. The buckets
+        are then concatenated in chunk order, which yields the same line order
+        as a serial pass over the facets and hence the same loops. */
+    const size_t facets_count = this->its->indices.size();
+    const size_t chunks_count = std::min<size_t>(facets_count, std::max(this->threads, 1) * 4);
+    const size_t chunk_size   = chunks_count == 0 ? 0 : (facets_count + chunks_count - 1) / chunks_count;
+    std::vector< std::vector<IntersectionLines> > chunk_lines(chunks_count);
+    parallelize<size_t>(
+        0,
+        chunks_count-1,
+        boost::bind(&TriangleMeshSlicer<A>::_slice_chunk_do, this, _1, chunk_size, &chunk_lines, boost::cref(z)),
+        this->threads
+    );
     
     // v_scaled_shared could be freed here
     
-    // build loops
+    // merge the buckets of each layer and build loops
     layers->resize(z.size());
     parallelize<size_t>(
         0,
-        lines.size()-1,
-        boost::bind(&TriangleMeshSlicer<A>::_make_loops_do, this, _1, &lines, layers)
+        z.size()-1,
+        boost::bind(&TriangleMeshSlicer<A>::_make_loops_do, this, _1, &chunk_lines, layers),
+        this->threads
     );
 }
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, 
+TriangleMeshSlicer<A>::_slice_chunk_do(size_t chunk_idx, size_t chunk_size,
+    std::vector< std::vector<IntersectionLines> >* chunk_lines, const std::vector<float> &z) const
+{
+    std::vector<IntersectionLines> &lines = (*chunk_lines)[chunk_idx];
+    lines.resize(z.size());
+    
+    const size_t facets_count = this->its->indices.size();
+    const size_t last = std::min(facets_count, (chunk_idx + 1) * chunk_size);
+    for (size_t facet_idx = chunk_idx * chunk_size; facet_idx < last; ++facet_idx)
+        this->_slice_do(facet_idx, &lines, z);
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines,
     const std::vector<float> &z) const
 {
-    const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
+    const stl_vertex &v0 = this->facet_vertex(facet_idx, 0);
+    const stl_vertex &v1 = this->facet_vertex(facet_idx, 1);
+    const stl_vertex &v2 = this->facet_vertex(facet_idx, 2);
     
     // find facet extents
-    const float min_z = fminf(_z(facet.vertex[0]), fminf(_z(facet.vertex[1]), _z(facet.vertex[2])));
-    const float max_z = fmaxf(_z(facet.vertex[0]), fmaxf(_z(facet.vertex[1]), _z(facet.vertex[2])));
+    const float min_z = fminf(_z(v0), fminf(_z(v1), _z(v2)));
+    const float max_z = fmaxf(_z(v0), fmaxf(_z(v1), _z(v2)));
     
     #ifdef SLIC3R_DEBUG
     printf("\n==> FACET %zu (%f,%f,%f - %f,%f,%f - %f,%f,%f):\n", facet_idx,
-        _x(facet.vertex[0]), _y(facet.vertex[0]), _z(facet.vertex[0]),
-        _x(facet.vertex[1]), _y(facet.vertex[1]), _z(facet.vertex[1]),
-        _x(facet.vertex[2]), _y(facet.vertex[2]), _z(facet.vertex[2]));
+        _x(v0), _y(v0), _z(v0),
+        _x(v1), _y(v1), _z(v1),
+        _x(v2), _y(v2), _z(v2));
     printf("z: min = %.2f, max = %.2f\n", min_z, max_z);
     #endif
     
@@ -1017,7 +1419,7 @@ TriangleMeshSlicer<A>::_slice_do(size_t facet_idx, std::vector<IntersectionLines
     
     for (std::vector<float>::const_iterator it = min_layer; it != max_layer + 1; ++it) {
         std::vector<float>::size_type layer_idx = it - z.begin();
-        this->slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &(*lines)[layer_idx], lines_mutex);
+        this->slice_facet(*it / SCALING_FACTOR, facet_idx, min_z, max_z, &(*lines)[layer_idx]);
     }
 }
 
@@ -1025,20 +1427,140 @@ template <Axis A>
 void
 TriangleMeshSlicer<A>::slice(const std::vector<float> &z, std::vector<ExPolygons>* layers) const
 {
-    std::vector<Polygons> layers_p;
-    this->slice(z, &layers_p);
-    
     layers->resize(z.size());
-    for (std::vector<Polygons>::const_iterator loops = layers_p.begin(); loops != layers_p.end(); ++loops) {
+    this->slice_streaming(z, [layers](size_t layer_id, ExPolygons &slices) {
         #ifdef SLIC3R_DEBUG
-        size_t layer_id = loops - layers_p.begin();
-        printf("Layer %zu (slice_z = %.2f):\n", layer_id, z[layer_id]);
+        printf("Layer %zu: %zu slices\n", layer_id, slices.size());
         #endif
+        (*layers)[layer_id] = std::move(slices);
+    });
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::slice_streaming(const std::vector<float> &z, const SliceCallback &callback) const
+{
+    const size_t facets_count = this->its->indices.size();
+    
+    // facet extents along the slicing axis, and facets ordered by their lowest point
+    std::vector<float> min_z(facets_count), max_z(facets_count);
+    std::vector<int> by_min_z(facets_count);
+    for (size_t facet_idx = 0; facet_idx < facets_count; ++facet_idx) {
+        const stl_vertex &v0 = this->facet_vertex(facet_idx, 0);
+        const stl_vertex &v1 = this->facet_vertex(facet_idx, 1);
+        const stl_vertex &v2 = this->facet_vertex(facet_idx, 2);
+        min_z[facet_idx] = fminf(_z(v0), fminf(_z(v1), _z(v2)));
+        max_z[facet_idx] = fmaxf(_z(v0), fmaxf(_z(v1), _z(v2)));
+        by_min_z[facet_idx] = facet_idx;
+    }
+    std::sort(by_min_z.begin(), by_min_z.end(),
+        [&min_z](int a, int b) { return min_z[a] < min_z[b]; });
+    
+    // sweep the planes bottom-up even if z isn't sorted
+    std::vector<size_t> order(z.size());
+    for (size_t i = 0; i < z.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [&z](size_t a, size_t b) { return z[a] < z[b]; });
+    
+    // process a few layers per thread at a time
+    const size_t window = std::max(this->threads, 1) * 2;
+    std::vector<int> active;
+    size_t next_facet = 0;
+    std::vector<ExPolygons> slices;
+    for (size_t first = 0; first < order.size(); first += window) {
+        const size_t last = std::min(order.size(), first + window);
+        const float window_min_z = z[order[first]];
+        const float window_max_z = z[order[last-1]];
         
-        this->make_expolygons(*loops, &(*layers)[ loops - layers_p.begin() ]);
+        // retire the facets lying entirely below this window...
+        active.erase(
+            std::remove_if(active.begin(), active.end(), [&](int f) { return max_z[f] < window_min_z; }),
+            active.end()
+        );
+        // ...and activate the ones starting below its top plane
+        const size_t active_before = active.size();
+        while (next_facet < facets_count && min_z[by_min_z[next_facet]] <= window_max_z)
+            active.push_back(by_min_z[next_facet++]);
+        // visiting facets in index order yields the lines in the order slice() sees them
+        if (active.size() != active_before)
+            std::sort(active.begin(), active.end());
+        
+        slices.assign(last - first, ExPolygons());
+        parallelize<size_t>(
+            first,
+            last-1,
+            [&](size_t i) {
+                this->_slice_layer_do(z[order[i]], active, min_z, max_z, &slices[i - first]);
+            },
+            this->threads
+        );
+        for (size_t i = first; i < last; ++i)
+            callback(order[i], slices[i - first]);
     }
 }
 
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_slice_layer_do(float slice_z, const std::vector<int> &facets,
+    const std::vector<float> &min_z, const std::vector<float> &max_z, ExPolygons* slices) const
+{
+    std::vector<int> crossing;
+    crossing.reserve(facets.size());
+    for (int facet_idx : facets)
+        if (min_z[facet_idx] <= slice_z && max_z[facet_idx] >= slice_z)
+            crossing.push_back(facet_idx);
+    
+    // intersect the edges of all the candidate facets in batches
+    const float scaled_z = slice_z / SCALING_FACTOR;
+    std::vector<FacetCrossing> crossings(crossing.size());
+    intersect_facets(this->facets_soa, crossing.data(), crossing.size(), scaled_z, crossings.data());
+    
+    IntersectionLines lines;
+    for (size_t k = 0; k < crossing.size(); ++k) {
+        const int facet_idx = crossing[k];
+        const FacetCrossing &c = crossings[k];
+        if (c.vertices != 0) {
+            // vertices or edges lying on the plane need the full treatment
+            this->slice_facet(scaled_z, facet_idx, min_z[facet_idx], max_z[facet_idx], &lines);
+            continue;
+        }
+        if (c.edges == 0) continue;
+        
+        // same edge order as slice_facet(), starting from the lowest vertex
+        int i = 0;
+        if (_z(this->facet_vertex(facet_idx, 1)) == min_z[facet_idx]) {
+            i = 1;
+        } else if (_z(this->facet_vertex(facet_idx, 2)) == min_z[facet_idx]) {
+            i = 2;
+        }
+        IntersectionPoint points[2];
+        size_t n_points = 0;
+        for (int j = i; (j-i) < 3; j++) {
+            const int e = j % 3;
+            if (!(c.edges & (1 << e))) continue;
+            assert(n_points < 2);
+            IntersectionPoint &point = points[n_points++];
+            point.x         = c.x[e];
+            point.y         = c.y[e];
+            point.edge_id   = this->facets_edges[facet_idx][e];
+        }
+        assert(n_points == 2); // facets must intersect each plane 0 or 2 times
+        IntersectionLine line;
+        line.a          = (Point)points[1];
+        line.b          = (Point)points[0];
+        line.a_id       = points[1].point_id;
+        line.b_id       = points[0].point_id;
+        line.edge_a_id  = points[1].edge_id;
+        line.edge_b_id  = points[0].edge_id;
+        lines.push_back(line);
+    }
+    
+    Polygons loops;
+    this->make_loops(lines, &loops);
+    IntersectionLines().swap(lines);
+    this->make_expolygons(loops, slices);
+}
+
 template <Axis A>
 void
 TriangleMeshSlicer<A>::slice(float z, ExPolygons* slices) const
@@ -1052,9 +1574,8 @@ TriangleMeshSlicer<A>::slice(float z, ExPolygons* slices) const
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const int &facet_idx,
-    const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines,
-    boost::mutex* lines_mutex) const
+TriangleMeshSlicer<A>::slice_facet(float slice_z, const int &facet_idx,
+    const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines) const
 {
     std::vector<IntersectionPoint> points;
     std::vector< std::vector<IntersectionPoint>::size_type > points_on_layer;
@@ -1064,30 +1585,30 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
        this is needed to get all intersection lines in a consistent order
        (external on the right of the line) */
     int i = 0;
-    if (_z(facet.vertex[1]) == min_z) {
+    if (_z(this->facet_vertex(facet_idx, 1)) == min_z) {
         // vertex 1 has lowest Z
         i = 1;
-    } else if (_z(facet.vertex[2]) == min_z) {
+    } else if (_z(this->facet_vertex(facet_idx, 2)) == min_z) {
         // vertex 2 has lowest Z
         i = 2;
     }
     for (int j = i; (j-i) < 3; j++) {  // loop through facet edges
         int edge_id = this->facets_edges[facet_idx][j % 3];
-        int a_id = this->mesh->stl.v_indices[facet_idx].vertex[j % 3];
-        int b_id = this->mesh->stl.v_indices[facet_idx].vertex[(j+1) % 3];
+        int a_id = this->its->indices[facet_idx].vertex[j % 3];
+        int b_id = this->its->indices[facet_idx].vertex[(j+1) % 3];
         stl_vertex* a = &this->v_scaled_shared[a_id];
         stl_vertex* b = &this->v_scaled_shared[b_id];
         
         if (_z(*a) == _z(*b) && _z(*a) == slice_z) {
             // edge is horizontal and belongs to the current layer
             
-            stl_vertex &v0 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[0] ];
-            stl_vertex &v1 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[1] ];
-            stl_vertex &v2 = this->v_scaled_shared[ this->mesh->stl.v_indices[facet_idx].vertex[2] ];
+            stl_vertex &v0 = this->v_scaled_shared[ this->its->indices[facet_idx].vertex[0] ];
+            stl_vertex &v1 = this->v_scaled_shared[ this->its->indices[facet_idx].vertex[1] ];
+            stl_vertex &v2 = this->v_scaled_shared[ this->its->indices[facet_idx].vertex[2] ];
             IntersectionLine line;
             if (min_z == max_z) {
                 line.edge_type = feHorizontal;
-                if (_z(this->mesh->stl.facet_start[facet_idx].normal) < 0) {
+                if (this->normals_z[facet_idx] < 0) {
                     /*  if normal points downwards this is a bottom horizontal facet so we reverse
                         its point order */
                     std::swap(a, b);
@@ -1106,12 +1627,7 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
             line.b.y    = _y(*b);
             line.a_id   = a_id;
             line.b_id   = b_id;
-            if (lines_mutex != NULL) {
-                boost::lock_guard<boost::mutex> l(*lines_mutex);
-                lines->push_back(line);
-            } else {
-                lines->push_back(line);
-            }
+            lines->push_back(line);
             
             found_horizontal_edge = true;
             
@@ -1164,21 +1680,26 @@ TriangleMeshSlicer<A>::slice_facet(float slice_z, const stl_facet &facet, const
         line.b_id       = points[0].point_id;
         line.edge_a_id  = points[1].edge_id;
         line.edge_b_id  = points[0].edge_id;
-        if (lines_mutex != NULL) {
-            boost::lock_guard<boost::mutex> l(*lines_mutex);
-            lines->push_back(line);
-        } else {
-            lines->push_back(line);
-        }
+        lines->push_back(line);
         return;
     }
 }
 
 template <Axis A>
 void
-TriangleMeshSlicer<A>::_make_loops_do(size_t i, std::vector<IntersectionLines>* lines, std::vector<Polygons>* layers) const
+TriangleMeshSlicer<A>::_make_loops_do(size_t i, std::vector< std::vector<IntersectionLines> >* chunk_lines,
+    std::vector<Polygons>* layers) const
 {
-    this->make_loops((*lines)[i], &(*layers)[i]);
+    IntersectionLines lines;
+    size_t lines_count = 0;
+    for (const std::vector<IntersectionLines> &chunk : *chunk_lines)
+        lines_count += chunk[i].size();
+    lines.reserve(lines_count);
+    for (std::vector<IntersectionLines> &chunk : *chunk_lines) {
+        append_to(lines, chunk[i]);
+        IntersectionLines().swap(chunk[i]);
+    }
+    this->make_loops(lines, &(*layers)[i]);
 }
 
 template <Axis A>
@@ -1192,55 +1713,97 @@ TriangleMeshSlicer<A>::make_loops(std::vector<IntersectionLine> &lines, Polygons
     */
     
     // remove tangent edges
-    for (IntersectionLines::iterator line = lines.begin(); line != lines.end(); ++line) {
-        if (line->skip || line->edge_type == feNone) continue;
+    {
+        /*  Only facet edges lying on the plane can cancel each other, and only
+            when they join the same two vertices. Group them by their undirected
+            edge so that each line is only compared with the few lines sharing
+            its edge, instead of with every following line of the layer. */
+        std::unordered_map<uint64_t, size_t> group_by_edge;
+        group_by_edge.reserve(lines.size());
+        std::vector<size_t> group_of(lines.size(), size_t(-1));
+        std::vector<size_t> group_start(1, 0);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            const IntersectionLine &line = lines[i];
+            if (line.edge_type == feNone) continue;
+            const uint64_t key = (uint64_t(uint32_t(std::min(line.a_id, line.b_id))) << 32)
+                | uint32_t(std::max(line.a_id, line.b_id));
+            auto group = group_by_edge.emplace(key, group_start.size() - 1);
+            if (group.second) group_start.push_back(0);
+            group_of[i] = group.first->second;
+            ++group_start[group_of[i] + 1];
+        }
+        for (size_t g = 1; g < group_start.size(); ++g)
+            group_start[g] += group_start[g-1];
         
-        /* if the line is a facet edge, find another facet edge
-           having the same endpoints but in reverse order */
-        for (IntersectionLines::iterator line2 = line + 1; line2 != lines.end(); ++line2) {
-            if (line2->skip || line2->edge_type == feNone) continue;
-            
-            // are these facets adjacent? (sharing a common edge on this layer)
-            if (line->a_id == line2->a_id && line->b_id == line2->b_id) {
-                line2->skip = true;
+        // members of each group, in the order they appear in the layer
+        std::vector<IntersectionLine*> members(group_start.back());
+        {
+            std::vector<size_t> cursor(group_start.begin(), group_start.end() - 1);
+            for (size_t i = 0; i < lines.size(); ++i)
+                if (group_of[i] != size_t(-1))
+                    members[cursor[group_of[i]]++] = &lines[i];
+        }
+        
+        for (size_t g = 0; g + 1 < group_start.size(); ++g) {
+            IntersectionLine** group_begin = members.data() + group_start[g];
+            IntersectionLine** group_end   = members.data() + group_start[g+1];
+            for (IntersectionLine** it = group_begin; it != group_end; ++it) {
+                IntersectionLine* line = *it;
+                if (line->skip) continue;
                 
-                /* if they are both oriented upwards or downwards (like a 'V')
-                   then we can remove both edges from this layer since it won't 
-                   affect the sliced shape */
-                /* if one of them is oriented upwards and the other is oriented
-                   downwards, let's only keep one of them (it doesn't matter which
-                   one since all 'top' lines were reversed at slicing) */
-                if (line->edge_type == line2->edge_type) {
-                    line->skip = true;
-                    break;
-                }
-            } else if (line->a_id == line2->b_id && line->b_id == line2->a_id) {
-                /* if this edge joins two horizontal facets, remove both of them */
-                if (line->edge_type == feHorizontal && line2->edge_type == feHorizontal) {
-                    line->skip = true;
-                    line2->skip = true;
-                    break;
+                /* if the line is a facet edge, find another facet edge
+                   having the same endpoints but in reverse order */
+                for (IntersectionLine** it2 = it + 1; it2 != group_end; ++it2) {
+                    IntersectionLine* line2 = *it2;
+                    if (line2->skip) continue;
+                    
+                    // are these facets adjacent? (sharing a common edge on this layer)
+                    if (line->a_id == line2->a_id && line->b_id == line2->b_id) {
+                        line2->skip = true;
+                        
+                        /* if they are both oriented upwards or downwards (like a 'V')
+                           then we can remove both edges from this layer since it won't 
+                           affect the sliced shape */
+                        /* if one of them is oriented upwards and the other is oriented
+                           downwards, let's only keep one of them (it doesn't matter which
+                           one since all 'top' lines were reversed at slicing) */
+                        if (line->edge_type == line2->edge_type) {
+                            line->skip = true;
+                            break;
+                        }
+                    } else if (line->a_id == line2->b_id && line->b_id == line2->a_id) {
+                        /* if this edge joins two horizontal facets, remove both of them */
+                        if (line->edge_type == feHorizontal && line2->edge_type == feHorizontal) {
+                            line->skip = true;
+                            line2->skip = true;
+                            break;
+                        }
+                    }
                 }
             }
         }
     }
     
-    // build a map of lines by edge_a_id and a_id
-    std::vector<IntersectionLinePtrs> by_edge_a_id, by_a_id;
-    by_edge_a_id.resize(this->mesh->stl.stats.number_of_facets * 3);
-    by_a_id.resize(this->mesh->stl.stats.shared_vertices);
+    /*  build a map of lines by edge_a_id and a_id; the tables are keyed by the
+        ids actually found on this layer, so their size doesn't depend on the
+        size of the mesh */
+    std::unordered_map<int, IntersectionLinePtrs> by_edge_a_id, by_a_id;
+    by_edge_a_id.reserve(lines.size());
+    by_a_id.reserve(lines.size());
     for (IntersectionLines::iterator line = lines.begin(); line != lines.end(); ++line) {
         if (line->skip) continue;
         if (line->edge_a_id != -1) by_edge_a_id[line->edge_a_id].push_back(&(*line));
         if (line->a_id != -1) by_a_id[line->a_id].push_back(&(*line));
     }
     
+    // lines before this one are all used already, no need to scan them again
+    IntersectionLines::iterator first_spare = lines.begin();
     CYCLE: while (1) {
         // take first spare line and start a new loop
         IntersectionLine* first_line = NULL;
-        for (IntersectionLines::iterator line = lines.begin(); line != lines.end(); ++line) {
-            if (line->skip) continue;
-            first_line = &(*line);
+        for (; first_spare != lines.end(); ++first_spare) {
+            if (first_spare->skip) continue;
+            first_line = &(*first_spare);
             break;
         }
         if (first_line == NULL) break;
@@ -1258,19 +1821,23 @@ TriangleMeshSlicer<A>::make_loops(std::vector<IntersectionLine> &lines, Polygons
             // find a line starting where last one finishes
             IntersectionLine* next_line = NULL;
             if (loop.back()->edge_b_id != -1) {
-                IntersectionLinePtrs &candidates = by_edge_a_id[loop.back()->edge_b_id];
-                for (IntersectionLinePtrs::iterator lineptr = candidates.begin(); lineptr != candidates.end(); ++lineptr) {
-                    if ((*lineptr)->skip) continue;
-                    next_line = *lineptr;
-                    break;
+                auto candidates = by_edge_a_id.find(loop.back()->edge_b_id);
+                if (candidates != by_edge_a_id.end()) {
+                    for (IntersectionLine* lineptr : candidates->second) {
+                        if (lineptr->skip) continue;
+                        next_line = lineptr;
+                        break;
+                    }
                 }
             }
             if (next_line == NULL && loop.back()->b_id != -1) {
-                IntersectionLinePtrs &candidates = by_a_id[loop.back()->b_id];
-                for (IntersectionLinePtrs::iterator lineptr = candidates.begin(); lineptr != candidates.end(); ++lineptr) {
-                    if ((*lineptr)->skip) continue;
-                    next_line = *lineptr;
-                    break;
+                auto candidates = by_a_id.find(loop.back()->b_id);
+                if (candidates != by_a_id.end()) {
+                    for (IntersectionLine* lineptr : candidates->second) {
+                        if (lineptr->skip) continue;
+                        next_line = lineptr;
+                        break;
+                    }
                 }
             }
             
@@ -1443,9 +2010,19 @@ template <Axis A>
 void
 TriangleMeshSlicer<A>::cut(float z, TriangleMesh* upper, TriangleMesh* lower) const
 {
+    if (this->mesh == NULL) CONFESS("cut() requires a slicer built on a single mesh");
     IntersectionLines upper_lines, lower_lines;
     
     const float scaled_z = scale_(z);
+    
+    // Only the facets touching the plane can be intersected with it, so ask
+    // the AABB tree for them. The range is widened a little since the facets
+    // are intersected with scaled coordinates, whose rounding may bring a
+    // vertex onto the plane.
+    const float margin = EPSILON * (1 + fabsf(z));
+    const std::vector<int> touching = this->mesh->facets_in_range(A, z - margin, z + margin);
+    std::vector<int>::const_iterator next_touching = touching.begin();
+    
     for (int facet_idx = 0; facet_idx < this->mesh->stl.stats.number_of_facets; facet_idx++) {
         stl_facet* facet = &this->mesh->stl.facet_start[facet_idx];
         
@@ -1455,7 +2032,10 @@ TriangleMeshSlicer<A>::cut(float z, TriangleMesh* upper, TriangleMesh* lower) co
         
         // intersect facet with cutting plane
         IntersectionLines lines;
-        this->slice_facet(scaled_z, *facet, facet_idx, min_z, max_z, &lines);
+        if (next_touching != touching.end() && *next_touching == facet_idx) {
+            ++next_touching;
+            this->slice_facet(scaled_z, facet_idx, min_z, max_z, &lines);
+        }
         
         // save intersection lines for generating correct triangulations
         for (IntersectionLines::const_iterator it = lines.begin(); it != lines.end(); ++it) {
@@ -1597,26 +2177,91 @@ TriangleMeshSlicer<A>::cut(float z, TriangleMesh* upper, TriangleMesh* lower) co
 
 
 template <Axis A>
-TriangleMeshSlicer<A>::TriangleMeshSlicer(TriangleMesh* _mesh) : mesh(_mesh), v_scaled_shared(NULL)
+TriangleMeshSlicer<A>::TriangleMeshSlicer(TriangleMesh* _mesh, int _threads)
+    : mesh(_mesh), threads(_threads), its(NULL), v_scaled_shared(NULL)
 {
-    // build a table to map a facet_idx to its three edge indices
     this->mesh->require_shared_vertices();
+    const stl_file &stl = this->mesh->stl;
+    this->its = &this->mesh->its;
+    this->normals_z.reserve(stl.stats.number_of_facets);
+    for (int facet_idx = 0; facet_idx < stl.stats.number_of_facets; facet_idx++)
+        this->normals_z.push_back(_z(stl.facet_start[facet_idx].normal));
+    this->_build_tables();
+}
+
+template <Axis A>
+TriangleMeshSlicer<A>::TriangleMeshSlicer(const TransformedMeshes &meshes, int _threads)
+    : mesh(NULL), threads(_threads), its(&transformed), v_scaled_shared(NULL)
+{
+    size_t vertices_count = 0, facets_count = 0;
+    for (const TransformedMesh &m : meshes) {
+        if (!m.first->repaired)
+            throw std::runtime_error("TriangleMeshSlicer: the meshes must be repaired before slicing");
+        vertices_count += m.first->shared_vertices().vertices.size();
+        facets_count   += m.first->stl.stats.number_of_facets;
+    }
+    this->transformed.vertices.reserve(vertices_count);
+    this->transformed.indices.reserve(facets_count);
+    this->normals_z.reserve(facets_count);
+    
+    for (const TransformedMesh &m : meshes) {
+        const IndexedTriangleSet &its = m.first->shared_vertices();
+        const int offset = this->transformed.vertices.size();
+        
+        // same arithmetic as stl_get_transform(), so that the slices match the
+        // ones of a transformed copy of the mesh
+        const std::vector<double> t = m.second.matrix3x4f();
+        for (const stl_vertex &vertex : its.vertices) {
+            const double x = vertex.x, y = vertex.y, z = vertex.z;
+            stl_vertex v;
+            v.x = (float)(t[0] * x + t[1] * y + t[2]  * z + t[3]);
+            v.y = (float)(t[4] * x + t[5] * y + t[6]  * z + t[7]);
+            v.z = (float)(t[8] * x + t[9] * y + t[10] * z + t[11]);
+            this->transformed.vertices.push_back(v);
+        }
+        
+        // mirroring transformations flip the facets, as stl_get_transform() does
+        const bool reverse = m.second.determinante() < 0;
+        for (v_indices_struct facet : its.indices) {
+            for (int k = 0; k <= 2; k++) facet.vertex[k] += offset;
+            if (reverse) std::swap(facet.vertex[0], facet.vertex[1]);
+            this->transformed.indices.push_back(facet);
+            
+            stl_facet f;
+            for (int k = 0; k <= 2; k++) f.vertex[k] = this->transformed.vertices[facet.vertex[k]];
+            float normal[3];
+            stl_calculate_normal(normal, &f);
+            f.normal.x = normal[0];
+            f.normal.y = normal[1];
+            f.normal.z = normal[2];
+            this->normals_z.push_back(_z(f.normal));
+        }
+    }
+    this->_build_tables();
+}
+
+template <Axis A>
+void
+TriangleMeshSlicer<A>::_build_tables()
+{
+    // build a table to map a facet_idx to its three edge indices
     typedef std::pair<int,int>              t_edge;
     typedef std::vector<t_edge>             t_edges;  // edge_idx => a_id,b_id
     typedef std::map<t_edge,int>            t_edges_map;  // a_id,b_id => edge_idx
     
-    this->facets_edges.resize(this->mesh->stl.stats.number_of_facets);
+    const int facets_count = this->its->indices.size();
+    this->facets_edges.resize(facets_count);
     
     {
         t_edges edges;
         // reserve() instead of resize() because otherwise we couldn't read .size() below to assign edge_idx
-        edges.reserve(this->mesh->stl.stats.number_of_facets * 3);  // number of edges = number of facets * 3
+        edges.reserve(facets_count * 3);  // number of edges = number of facets * 3
         t_edges_map edges_map;
-        for (int facet_idx = 0; facet_idx < this->mesh->stl.stats.number_of_facets; facet_idx++) {
+        for (int facet_idx = 0; facet_idx < facets_count; facet_idx++) {
             this->facets_edges[facet_idx].resize(3);
             for (int i = 0; i <= 2; i++) {
-                int a_id = this->mesh->stl.v_indices[facet_idx].vertex[i];
-                int b_id = this->mesh->stl.v_indices[facet_idx].vertex[(i+1) % 3];
+                int a_id = this->its->indices[facet_idx].vertex[i];
+                int b_id = this->its->indices[facet_idx].vertex[(i+1) % 3];
                 
                 int edge_idx;
                 t_edges_map::const_iterator my_edge = edges_map.find(std::make_pair(b_id,a_id));
@@ -1647,13 +2292,24 @@ TriangleMeshSlicer<A>::TriangleMeshSlicer(TriangleMesh* _mesh) : mesh(_mesh), v_
     }
     
     // clone shared vertices coordinates and scale them
-    this->v_scaled_shared = (stl_vertex*)calloc(this->mesh->stl.stats.shared_vertices, sizeof(stl_vertex));
-    std::copy(this->mesh->stl.v_shared, this->mesh->stl.v_shared + this->mesh->stl.stats.shared_vertices, this->v_scaled_shared);
-    for (int i = 0; i < this->mesh->stl.stats.shared_vertices; i++) {
+    const std::vector<stl_vertex> &vertices = this->its->vertices;
+    this->v_scaled_shared = (stl_vertex*)calloc(vertices.size(), sizeof(stl_vertex));
+    std::copy(vertices.begin(), vertices.end(), this->v_scaled_shared);
+    for (size_t i = 0; i < vertices.size(); i++) {
         this->v_scaled_shared[i].x /= SCALING_FACTOR;
         this->v_scaled_shared[i].y /= SCALING_FACTOR;
         this->v_scaled_shared[i].z /= SCALING_FACTOR;
     }
+    
+    this->facets_soa.resize(facets_count);
+    for (int facet_idx = 0; facet_idx < facets_count; facet_idx++) {
+        for (int k = 0; k <= 2; k++) {
+            const stl_vertex &v = this->v_scaled_shared[ this->its->indices[facet_idx].vertex[k] ];
+            this->facets_soa.x[k][facet_idx] = _x(v);
+            this->facets_soa.y[k][facet_idx] = _y(v);
+            this->facets_soa.z[k][facet_idx] = _z(v);
+        }
+    }
 }
 
 template <Axis A>
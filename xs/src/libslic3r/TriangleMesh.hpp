@@ -3,14 +3,18 @@
 
 #include "libslic3r.h"
 #include <admesh/stl.h>
+#include <memory>
 #include <vector>
+#include <utility>
 #include <boost/thread.hpp>
+#include "AABBTree.hpp"
 #include "BoundingBox.hpp"
 #include "Line.hpp"
 #include "Point.hpp"
 #include "Polygon.hpp"
 #include "ExPolygon.hpp"
 #include "TransformationMatrix.hpp"
+#include "SliceKernel.hpp"
 
 namespace Slic3r {
 
@@ -19,6 +23,18 @@ template <Axis A> class TriangleMeshSlicer;
 typedef std::vector<TriangleMesh*> TriangleMeshPtrs;
 
 
+/// Wall-clock seconds spent in the passes of TriangleMesh::repair().
+/// Both runs of the exact and nearby checks add up.
+struct mesh_repair_timings {
+    double check_exact {0};
+    double check_nearby {0};
+    double remove_unconnected {0};
+    double fill_holes {0};
+    double normal_directions {0};
+    double normal_values {0};
+    double volume {0};
+};
+
 /// Interface to available statistics from the underlying mesh. 
 struct mesh_stats {
     size_t number_of_facets {0};
@@ -31,6 +47,22 @@ struct mesh_stats {
     size_t facets_reversed {0};
     size_t backwards_edges {0};
     size_t normals_fixed {0};
+    /// Seconds spent in each pass of the last repair().
+    mesh_repair_timings repair_timings;
+};
+
+/// Triangles as an array of vertices and int32 index triples into it, so that
+/// vertices shared by several facets are stored once.
+struct IndexedTriangleSet
+{
+    std::vector<stl_vertex> vertices;
+    std::vector<v_indices_struct> indices;
+
+    void clear() {
+        std::vector<stl_vertex>().swap(this->vertices);
+        std::vector<v_indices_struct>().swap(this->indices);
+    }
+    bool empty() const { return this->indices.empty(); }
 };
 
 class TriangleMesh
@@ -54,11 +86,11 @@ class TriangleMesh
 
     void swap(TriangleMesh &other);
     ~TriangleMesh();
-    void ReadSTLFile(const std::string &input_file);
+    void ReadSTLFile(const std::string &input_file, int threads = boost::thread::hardware_concurrency());
     void write_ascii(const std::string &output_file) const;
     void write_binary(const std::string &output_file) const;
-    void repair();
-    void check_topology();
+    void repair(int threads = boost::thread::hardware_concurrency());
+    void check_topology(int threads = boost::thread::hardware_concurrency());
     float volume();
     bool is_manifold() const;
     void WriteOBJFile(const std::string &output_file) const;
@@ -99,17 +131,26 @@ class TriangleMesh
     void transform(TransformationMatrix const & trafo);
 
 
-    TriangleMeshPtrs split() const;
+    /// Split the mesh into its connected parts, ordered by their first facet.
+    /// Requires repair().
+    TriangleMeshPtrs split(int threads = boost::thread::hardware_concurrency()) const;
     TriangleMeshPtrs cut_by_grid(const Pointf &grid) const;
     void merge(const TriangleMesh &mesh);
-    ExPolygons horizontal_projection() const;
-    Polygon convex_hull();
+    /// Footprint of the mesh on the XY plane, cached until the geometry changes.
+    ExPolygons horizontal_projection(int threads = boost::thread::hardware_concurrency()) const;
+    /// Convex hull of the footprint, cached until the geometry changes.
+    Polygon convex_hull(int threads = boost::thread::hardware_concurrency());
+
+    /// Stable hash of the facet vertices taken relative to origin, so that
+    /// meshes only differing by that translation hash the same.
+    uint64_t content_hash(const Pointf3 &origin = Pointf3(), int threads = boost::thread::hardware_concurrency()) const;
     BoundingBoxf3 bounding_box() const;
     BoundingBoxf3 get_transformed_bounding_box(TransformationMatrix const & trafo) const;
     void reset_repair_stats();
     bool needed_repair() const;
     size_t facets_count() const;
     void extrude_tin(float offset);
+    /// Build the indexed triangle set if it is not available, repairing the mesh first if needed.
     void require_shared_vertices();
     void reverse_normals();
     
@@ -129,7 +170,7 @@ class TriangleMesh
     Pointf3 center() const;
 
     /// Slice this mesh at the provided Z levels and return the vector
-    std::vector<ExPolygons> slice(const std::vector<double>& z);
+    std::vector<ExPolygons> slice(const std::vector<double>& z, int threads = boost::thread::hardware_concurrency());
 
     /// Contains general statistics from underlying mesh structure.
     mesh_stats stats() const;
@@ -138,6 +179,25 @@ class TriangleMesh
 
     /// Perform a cut of the mesh and put the output in upper and lower
     void cut(Axis axis, double z, TriangleMesh* upper, TriangleMesh* lower);
+
+    /// Bounding volume hierarchy over the facets, built on first use and kept
+    /// until the geometry changes. Concurrent callers may build it twice, but
+    /// all of them get the one that is kept.
+    const AABBTree& aabb_tree() const;
+
+    /// Indices of the facets whose extent along axis overlaps [min, max], in
+    /// increasing order, e.g. the facets crossing a range of layers along Z.
+    std::vector<int> facets_in_range(Axis axis, float min, float max) const;
+
+    /// First point of the mesh hit by the ray starting at ray.a and going through ray.b.
+    /// \param hit receives the point hit
+    /// \param facet_idx if not NULL, receives the index of the facet hit
+    /// \return false if the ray misses the mesh
+    bool intersect_ray(const Linef3 &ray, Pointf3* hit, int* facet_idx = NULL) const;
+
+    /// Point of the mesh closest to point. The mesh must not be empty.
+    /// \param facet_idx if not NULL, receives the index of the facet holding it
+    Pointf3 closest_point(const Pointf3 &point, int* facet_idx = NULL) const;
 	
 	/// Generate a mesh representing a cube with dimensions (x, y, z), with one corner at (0,0,0).
     static TriangleMesh make_cube(double x, double y, double z);
@@ -155,10 +215,50 @@ class TriangleMesh
 
     
     stl_file stl;
+    /// Indexed view of the facets of stl, built by repair() and dropped by
+    /// any change to the geometry. admesh's own shared vertex tables are
+    /// released once copied here.
+    IndexedTriangleSet its;
 	/// Whether or not this mesh has been repaired.
     bool repaired;
     
     private:
+    /// Drop the indexed triangle set, the AABB tree and the footprints after
+    /// the facets have changed.
+    void invalidate_shared_vertices();
+
+    /// The indexed triangle set of a repaired mesh, built on first use under
+    /// its_mutex so that the const callers may run concurrently.
+    const IndexedTriangleSet& shared_vertices() const;
+
+    /// Footprint as the union of the projections of all the facets.
+    ExPolygons facets_projection() const;
+
+    /// Footprint from the projected boundary of the upward facets, which
+    /// needs the indexed triangle set.
+    ExPolygons silhouette_projection(int threads) const;
+
+    /// Connect the facets sharing exact edges and derive the bad edge
+    /// statistics, as stl_repair() does.
+    void check_facets_exact(int threads);
+
+    /// Connect the facets having nearby edges, growing the tolerance for up
+    /// to the given number of iterations, as stl_repair() does.
+    void check_facets_nearby(int iterations);
+
+    /// Time spent in the passes of repair().
+    mesh_repair_timings repair_timings;
+
+    /// Serializes the building of its by shared_vertices().
+    mutable boost::mutex its_mutex;
+
+    /// Cache behind aabb_tree(), shared by the copies of the mesh.
+    mutable std::shared_ptr<const AABBTree> tree;
+
+    /// Caches behind horizontal_projection() and convex_hull(), shared by the
+    /// copies of the mesh.
+    mutable std::shared_ptr<const ExPolygons> projection;
+    mutable std::shared_ptr<const Polygon> hull;
 
     /// Private constructor that is called from the public sphere. 
     /// It doesn't do any bounds checking on points and operates on raw pointers, so we hide it. 
@@ -197,34 +297,77 @@ class IntersectionLine : public Line
 typedef std::vector<IntersectionLine> IntersectionLines;
 typedef std::vector<IntersectionLine*> IntersectionLinePtrs;
 
+/// Receives the slices of a single layer from TriangleMeshSlicer::slice_streaming().
+/// The callee may move the slices away.
+typedef boost::function<void(size_t layer_id, ExPolygons &slices)> SliceCallback;
+
+
+/// A mesh to be sliced, along with the transformation to apply to its vertices.
+/// The mesh must be repaired already: the slicer only reads it.
+typedef std::pair<const TriangleMesh*, TransformationMatrix> TransformedMesh;
+typedef std::vector<TransformedMesh> TransformedMeshes;
 
 /// \brief Class for processing TriangleMesh objects. 
 template <Axis A>
 class TriangleMeshSlicer
 {
     public:
+    /// Mesh being sliced, NULL when slicing a list of transformed meshes.
     TriangleMesh* mesh;
-    TriangleMeshSlicer(TriangleMesh* _mesh);
+    /// Number of threads used by slice(), usually PrintConfig::threads.
+    int threads;
+    TriangleMeshSlicer(TriangleMesh* _mesh, int _threads);
+    
+    /// \brief Slices several meshes as a whole, without merging them into a new mesh.
+    /// The transformations are applied to the shared vertices of each mesh
+    /// while the slicer builds its own vertex and facet tables, instead of
+    /// a merged transformed copy of the meshes. The meshes are left as they
+    /// are, so several slicers may read them at once.
+    /// cut() is not available on such a slicer.
+    TriangleMeshSlicer(const TransformedMeshes &meshes, int _threads);
     ~TriangleMeshSlicer();
     void slice(const std::vector<float> &z, std::vector<Polygons>* layers) const;
     void slice(const std::vector<float> &z, std::vector<ExPolygons>* layers) const;
     void slice(float z, ExPolygons* slices) const;
-    void slice_facet(float slice_z, const stl_facet &facet, const int &facet_idx,
-        const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines,
-        boost::mutex* lines_mutex = NULL) const;
+
+    /// \brief Sweep-plane slicing with bounded memory.
+    /// Facets are sorted by their lowest point and an active set is advanced
+    /// bottom-up a few planes at a time, so only the lines of the layers being
+    /// processed are held in memory. Each layer is handed to callback in
+    /// ascending z order, with the same slices slice() would produce.
+    void slice_streaming(const std::vector<float> &z, const SliceCallback &callback) const;
+    void slice_facet(float slice_z, const int &facet_idx,
+        const float &min_z, const float &max_z, std::vector<IntersectionLine>* lines) const;
     
 	/// \brief Splits the current mesh into two parts.
 	/// \param[in] z Coordinate plane to cut along.
 	/// \param[out] upper TriangleMesh object to add the mesh > z. NULL suppresses saving this.
 	/// \param[out] lower TriangleMesh object to save the mesh < z. NULL suppresses saving this.
+	/// Runs on the calling thread whatever the number of threads of the slicer.
     void cut(float z, TriangleMesh* upper, TriangleMesh* lower) const;
     
     private:
     typedef std::vector< std::vector<int> > t_facets_edges;
     t_facets_edges facets_edges;
+    /// Facets being sliced, either the ones of mesh or transformed.
+    /// Its vertices are indexed the same way as v_scaled_shared.
+    const IndexedTriangleSet* its;
+    /// Transformed vertices of the meshes, when not slicing a single mesh.
+    IndexedTriangleSet transformed;
+    /// Component of each facet normal along the slicing axis.
+    std::vector<float> normals_z;
     stl_vertex* v_scaled_shared;
-    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, const std::vector<float> &z) const;
-    void _make_loops_do(size_t i, std::vector<IntersectionLines>* lines, std::vector<Polygons>* layers) const;
+    /// Scaled facet vertices laid out for intersect_facets().
+    FacetsSoA facets_soa;
+    void _slice_chunk_do(size_t chunk_idx, size_t chunk_size, std::vector< std::vector<IntersectionLines> >* chunk_lines, const std::vector<float> &z) const;
+    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, const std::vector<float> &z) const;
+    void _slice_layer_do(float slice_z, const std::vector<int> &facets, const std::vector<float> &min_z,
+        const std::vector<float> &max_z, ExPolygons* slices) const;
+    void _make_loops_do(size_t i, std::vector< std::vector<IntersectionLines> >* chunk_lines, std::vector<Polygons>* layers) const;
+    void _build_tables();
+    const stl_vertex& facet_vertex(size_t facet_idx, int k) const {
+        return this->its->vertices[this->its->indices[facet_idx].vertex[k]];
+    }
     void make_loops(std::vector<IntersectionLine> &lines, Polygons* loops) const;
     void make_expolygons(const Polygons &loops, ExPolygons* slices) const;
     void make_expolygons_simple(std::vector<IntersectionLine> &lines, ExPolygons* slices) const;
@@ -16,6 +16,7 @@
 #include <vector>
 #include <boost/thread.hpp>
 #include <cstdint>
+#include "ThreadPool.hpp"
 
 #ifdef _MSC_VER
 #include <limits>
@@ -97,49 +98,71 @@ constexpr float CLIPPER_OFFSET_SCALE = 100000.0;
 
 enum Axis { X=0, Y, Z };
 
+/// 64-bit FNV-1a hash of size bytes, continuing from hash. The result does
+/// not depend on the run, so it identifies content within one build; the
+/// hashed representations are not portable across platforms.
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// hash_bytes() over the representation of a trivially copyable value.
+template <class T>
+inline uint64_t hash_value(const T &value, uint64_t hash = 14695981039346656037ULL)
+{
+    return hash_bytes(&value, sizeof(T), hash);
+}
+
 template <class T>
 inline void append_to(std::vector<T> &dst, const std::vector<T> &src)
 {
     dst.insert(dst.end(), src.begin(), src.end());
 }
 
+/// Run func on every item, sharing the work among up to threads_count threads
+/// of the process-wide ThreadPool (the calling thread included).
 template <class T> void
-_parallelize_do(std::queue<T>* queue, boost::mutex* queue_mutex, boost::function<void(T)> func)
+parallelize(const std::vector<T> &items, boost::function<void(T)> func,
+    int threads_count = boost::thread::hardware_concurrency())
 {
-    //std::cout << "THREAD STARTED: " << boost::this_thread::get_id() << std::endl;
-    while (true) {
-        T i;
-        {
-            boost::lock_guard<boost::mutex> l(*queue_mutex);
-            if (queue->empty()) return;
-            i = queue->front();
-            queue->pop();
-        }
-        //std::cout << "  Thread " << boost::this_thread::get_id() << " processing item " << i << std::endl;
-        func(i);
-        boost::this_thread::interruption_point();
-    }
+    if (threads_count == 0) threads_count = 2;
+    ThreadPool::instance().parallel_for(
+        0, items.size(),
+        [&items, &func](size_t i) { func(items[i]); },
+        threads_count
+    );
+    boost::this_thread::interruption_point();
 }
 
 template <class T> void
 parallelize(std::queue<T> queue, boost::function<void(T)> func,
     int threads_count = boost::thread::hardware_concurrency())
 {
-    if (threads_count == 0) threads_count = 2;
-    boost::mutex queue_mutex;
-    boost::thread_group workers;
-    for (int i = 0; i < std::min(threads_count, (int)queue.size()); i++)
-        workers.add_thread(new boost::thread(&_parallelize_do<T>, &queue, &queue_mutex, func));
-    workers.join_all();
+    std::vector<T> items;
+    items.reserve(queue.size());
+    for (; !queue.empty(); queue.pop()) items.push_back(queue.front());
+    parallelize(items, func, threads_count);
 }
 
+/// Run func on every value between start and end (both included).
 template <class T> void
 parallelize(T start, T end, boost::function<void(T)> func,
     int threads_count = boost::thread::hardware_concurrency())
 {
-    std::queue<T> queue;
-    for (T i = start; i <= end; ++i) queue.push(i);
-    parallelize(queue, func, threads_count);
+    if (end < start) return;
+    if (threads_count == 0) threads_count = 2;
+    // an empty unsigned range (start = 0, end = size()-1) wraps to a count of 0
+    ThreadPool::instance().parallel_for(
+        0, size_t(end - start) + 1,
+        [start, &func](size_t i) { func(start + T(i)); },
+        threads_count
+    );
+    boost::this_thread::interruption_point();
 }
 
 } // namespace Slic3r
@@ -234,11 +234,16 @@ GLVertexArray::load_mesh(const TriangleMesh &mesh)
 {
     this->reserve_more(3 * 3 * mesh.facets_count());
     
+    // read the vertices through the indexed triangle set when it is available
+    const bool indexed = !mesh.its.empty();
     for (int i = 0; i < mesh.stl.stats.number_of_facets; ++i) {
-        stl_facet &facet = mesh.stl.facet_start[i];
+        const stl_facet &facet = mesh.stl.facet_start[i];
         for (int j = 0; j <= 2; ++j) {
+            const stl_vertex &v = indexed
+                ? mesh.its.vertices[mesh.its.indices[i].vertex[j]]
+                : facet.vertex[j];
             this->push_norm(facet.normal.x, facet.normal.y, facet.normal.z);
-            this->push_vert(facet.vertex[j].x, facet.vertex[j].y, facet.vertex[j].z);
+            this->push_vert(v.x, v.y, v.z);
         }
     }
 }